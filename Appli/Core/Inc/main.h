@@ -61,6 +61,11 @@ void Error_Handler(void);
 #define activar_VBUS_GPIO_Port GPIOM
 
 /* USER CODE BEGIN Private defines */
+/* ADC inputs of the Type-C CC lines, read by the TCPP application
+   (usbpd_ADCnoPD.h). CC1 must be a channel of ADC1, CC2 one of ADC2; check
+   them against the board schematic when the CC dividers are reworked. */
+#define ADC_CC1_CHANNEL ADC_CHANNEL_3
+#define ADC_CC2_CHANNEL ADC_CHANNEL_5
 
 /* USER CODE END Private defines */
 
@@ -113,6 +113,16 @@ int main(void)
 
   MX_TCPP_Process();
     /* USER CODE BEGIN 3 */
+    MX_USB_HOST_ProcessEvents();
+
+    /* Sleep until the next interrupt when the USB host has nothing queued;
+       WFI still wakes on an interrupt pended while PRIMASK is set */
+    __disable_irq();
+    if (MX_USB_HOST_EventPending() == 0U)
+    {
+      __WFI();
+    }
+    __enable_irq();
   }
   /* USER CODE END 3 */
 }
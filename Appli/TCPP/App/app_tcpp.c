@@ -22,26 +22,82 @@
 #include "app_tcpp.h"
 #include "custom_board_usbpd_pwr.h"
 #include "USBnoPD_Tim.h"
+#include "usbpd_ADCconv.h"
+#include "usbpd_ADCfilter.h"
+
+/* Private types -------------------------------------------------------------*/
+
+/* Completed halves of the DMA buffer, copied by the ADC DMA interrupt and
+   filtered by the state machine. Block n goes to Frames[n % USBNOPD_ADC_QUEUE_BLOCKS],
+   then Sequence becomes n + 1. A reader keeps its copy of block n only if
+   Sequence is still below n + USBNOPD_ADC_QUEUE_BLOCKS afterwards, i.e. the
+   interrupt did not start to reuse the slot meanwhile. */
+typedef struct
+{
+  volatile uint32_t Sequence;
+  volatile uint16_t Frames[USBNOPD_ADC_QUEUE_BLOCKS][USBNOPD_ADC_HALF_SIZE];
+} USBnoPD_ADCQueueTypeDef;
 
 /* Private variables ---------------------------------------------------------*/
 
 USBnoPD_StatesTypeDef USBnoPD_State =                                  USBnoPD_State_DETACHED;
-uint16_t USBnoPD_adc_buffer[USBNOPD_ADC_USED_CHANNELS] =               {0};
+uint16_t USBnoPD_adc_buffer[USBNOPD_ADC_BUFFER_SIZE] __ALIGNED(32) =   {0}; /* Circular DMA buffer, two halves of frames */
 uint16_t USBnoPD_adc_buffer_filtered[USBNOPD_ADC_USED_CHANNELS];
 uint16_t USBnoPD_adc_converted_buffer[USBNOPD_ADC_USED_CHANNELS] =     {0};
 uint16_t USBnoPD_debounce_counter =                                    0;
 uint8_t USBnoPD_activeCC =                                             USBnoPD_CC1; /* Default */
-
-/* Maximum digital value of the ADC output (12 Bits resolution)
-   To convert ADC measurement to an absolute voltage value:
-   VCHANNELx = ADCx_DATA x (VDD/ADC_FULL_SCALE)
-  */
-#define ADC_FULL_SCALE       (0x0FFFU)
+static USBnoPD_ADCQueueTypeDef USBnoPD_adc_queue =                     {0};
+static uint32_t USBnoPD_adc_sequence =                                 0u;  /* Next block to filter */
+static uint32_t USBnoPD_adc_lost_blocks =                              0u;  /* Blocks reused before being filtered */
+static uint16_t USBnoPD_adc_block[USBNOPD_ADC_HALF_SIZE];                        /* Copy of the block being filtered */
+static USBPD_ADC_FilterTypeDef USBnoPD_adc_filter;                               /* Runs in thread context */
+static uint8_t USBnoPD_adc_extra_bits[USBNOPD_ADC_USED_CHANNELS] =     {0};  /* Oversampled bits above 12 */
+
+/* Filter of each frame index, one output per DMA half (USBNOPD_ADC_FRAMES_PER_HALF
+   frames). Average and IIR lengths count ADC conversions: the filters get
+   them divided by the oversampling ratio, the oversampler averaging the rest.
+   CC lines and VBUS react within a block, ISENSE trades latency for noise.
+   Can be changed at run time with USBnoPD_SetADCFilter() */
+static USBPD_ADC_FilterConfTypeDef USBnoPD_adc_filter_conf[USBNOPD_ADC_USED_CHANNELS] =
+{
+  [USBnoPD_ADC_Index_CC1]    = {USBPD_ADC_FILTER_AVERAGE, 3u},   /* 8 conversions       */
+  [USBnoPD_ADC_Index_CC2]    = {USBPD_ADC_FILTER_AVERAGE, 3u},   /* 8 conversions       */
+  [USBnoPD_ADC_Index_ISENSE] = {USBPD_ADC_FILTER_IIR,     6u},   /* tau = 64 conversions */
+  [USBnoPD_ADC_Index_VBUSC]  = {USBPD_ADC_FILTER_AVERAGE, 4u},   /* 16 conversions      */
+  [USBnoPD_ADC_Index_VPROV]  = {USBPD_ADC_FILTER_CIC,     2u},   /* 2nd order, 2 blocks */
+};
+
+/* Conversion of each frame index to mV (mA for ISENSE), see usbpd_ADCconv.h */
+static const uint32_t USBnoPD_adc_scale[USBNOPD_ADC_USED_CHANNELS] =
+{
+  [USBnoPD_ADC_Index_CC1]    = USBPD_ADC_DIVIDER_SCALE(USBNOPD_SRC1M1_NORA, USBNOPD_SRC1M1_NORB),
+  [USBnoPD_ADC_Index_CC2]    = USBPD_ADC_DIVIDER_SCALE(USBNOPD_SRC1M1_NORA, USBNOPD_SRC1M1_NORB),
+  [USBnoPD_ADC_Index_ISENSE] = USBPD_ADC_CURRENT_SCALE(USBPD_PWR_ISENSE_GA, USBPD_PWR_ISENSE_RS),
+  [USBnoPD_ADC_Index_VBUSC]  = USBPD_ADC_DIVIDER_SCALE(USBPD_PWR_VSENSE_RA, USBPD_PWR_VSENSE_RB),
+  [USBnoPD_ADC_Index_VPROV]  = USBPD_ADC_DIVIDER_SCALE(USBPD_PWR_VSENSE_RA, USBPD_PWR_VSENSE_RB),
+};
+
+#if (USBPD_ADC_DIVIDER_SCALE(USBPD_PWR_VSENSE_RA, USBPD_PWR_VSENSE_RB) >= 4294967296ULL) || \
+    (USBPD_ADC_CURRENT_SCALE(USBPD_PWR_ISENSE_GA, USBPD_PWR_ISENSE_RS) >= 4294967296ULL)
+#error "VBUS divider or ISENSE gain out of the Q4.28 range"
+#endif
+
+#if (USBNOPD_ADC_QUEUE_BLOCKS < 2u) || ((USBNOPD_ADC_QUEUE_BLOCKS & (USBNOPD_ADC_QUEUE_BLOCKS - 1u)) != 0u)
+#error "USBNOPD_ADC_QUEUE_BLOCKS must be a power of two, at least 2"
+#endif
+
+#if ((USBNOPD_ADC_FRAMES_PER_HALF & (USBNOPD_ADC_FRAMES_PER_HALF - 1u)) != 0u) || \
+    (USBNOPD_ADC_FRAMES_PER_HALF > (1u << USBPD_ADC_FILTER_MAX_LOG2_FRAMES))
+#error "USBNOPD_ADC_FRAMES_PER_HALF must be a power of two up to the filter block size"
+#endif
 
 /* Private function prototypes -----------------------------------------------*/
-static uint32_t USBnoPD_TCPP0203_ConvertADCDataToVoltage(uint32_t ADCData, uint32_t Ra, uint32_t Rb);
-static int32_t USBnoPD_TCPP0203_ConvertADCDataToCurrent(uint32_t ADCData, uint32_t Ga, uint32_t Rs);
+static void USBnoPD_PublishADC(const uint16_t *pFrames);
+static uint32_t USBnoPD_ReadADC(uint32_t Block, uint16_t *pFrames);
 static void USBnoPD_ProcessADC(void);
+static void USBnoPD_ConfigureADC(void);
+static USBPD_ADC_FilterStatusTypeDef USBnoPD_ApplyADCFilter(uint32_t Index, uint32_t Log2Ratio);
+static uint32_t USBnoPD_IsVPROVValid(void);
 static void USBnoPD_IncrementDebounceCount(void);
 static void USBnoPD_StateMachineRun(void);
 
@@ -56,6 +112,7 @@ void MX_TCPP_Init(void)
   BSP_USBPD_PWR_Init(USBPD_PWR_TYPE_C_PORT_1);
   BSP_USBPD_PWR_SetPowerMode(USBPD_PWR_TYPE_C_PORT_1, USBPD_PWR_MODE_NORMAL);
 
+  USBnoPD_ConfigureADC();
   ADC_Start();
   USBnoPD_State = USBnoPD_State_DETACHED;
 }
@@ -72,11 +129,14 @@ void MX_TCPP_Process(void)
   */
 static void USBnoPD_StateMachineRun(void)
 {
+  /* Work on a converted copy of the latest frame, stable for the whole run */
+  USBnoPD_ProcessADC();
+
   switch(USBnoPD_State)
   {
     case USBnoPD_State_DETACHED:      /* IDLE, nothing connected         */
       /* Transition to next state */
-      if (USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_VPROV] > USBNOPD_VPROV_VOLTAGE_MIN)
+      if (USBnoPD_IsVPROVValid() != 0u)
       {
         /* Connection detected on CC1 */
         if ((USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_CC1] > USBNOPD_CC_VOLTAGE_MINRD) &&
@@ -157,7 +217,7 @@ static void USBnoPD_StateMachineRun(void)
       /* If we detect a fault on Vbus or Vprov and
          CC voltage still correspond to an attached state */
       if (((USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_VBUSC]  > USBNOPD_VBUS_VOLTAGE_MAX) ||
-           (USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_VPROV] < USBNOPD_VPROV_VOLTAGE_MIN))&&
+           (USBnoPD_IsVPROVValid() == 0u))&&
           (((USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_CC1] > USBNOPD_CC_VOLTAGE_MINRD) &&
             (USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_CC1] < USBNOPD_CC_VOLTAGE_MAXRD))||
            ((USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_CC2] > USBNOPD_CC_VOLTAGE_MINRD) &&
@@ -269,99 +329,166 @@ static void USBnoPD_StateMachineRun(void)
 }
 
 /**
-  * @brief  Calculate the VBUS voltage level corresponding to ADC raw converted data.
-  * @note   Voltage level is measured though a voltage divider
-  *  Example :
-  *  Voltage -- Ra ----.-   ^
-  *                    |    |
-  *                    Rb   | vadc = VBUS * Rb /(Ra + Rb)
-  *                    |    |
-  *                   GND   |
-  * vadc = raw_data * (ADC_FULL_SCALE / VDD)
-  * @param  ADCData  ADC raw converted data (resolution 12 bits)
-  * @param  Ra       value of Ra resistance
-  * @param  Rb       value of Rb resistance
-  * @retval analog voltage (unit: mV)
+  * @brief  Check the provider supply is above USBNOPD_VPROV_VOLTAGE_MIN.
+  * @note   Always valid when the board does not route VPROV to the ADC
+  *         (USBNOPD_ADC_VPROV_ROUTED): its rank then holds ISENSE.
+  * @param  none
+  * @retval 1 if valid, 0 otherwise
+  */
+static uint32_t USBnoPD_IsVPROVValid(void)
+{
+#if (USBNOPD_ADC_VPROV_ROUTED != 0u)
+  return (USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_VPROV] > USBNOPD_VPROV_VOLTAGE_MIN) ? 1u : 0u;
+#else
+  return 1u;
+#endif /* USBNOPD_ADC_VPROV_ROUTED */
+}
+
+/**
+  * @brief  Queue a completed half of the DMA buffer, used in ADC DMA IRQHandler.
+  * @param  pFrames  USBNOPD_ADC_FRAMES_PER_HALF frames
+  * @retval none
+  */
+static void USBnoPD_PublishADC(const uint16_t *pFrames)
+{
+  uint32_t sequence = USBnoPD_adc_queue.Sequence;
+  volatile uint16_t *pSlot = USBnoPD_adc_queue.Frames[sequence % USBNOPD_ADC_QUEUE_BLOCKS];
+
+  for (uint32_t i = 0u; i < USBNOPD_ADC_HALF_SIZE; i++)
+  {
+    pSlot[i] = pFrames[i];
+  }
+  __DMB();
+  USBnoPD_adc_queue.Sequence = sequence + 1u;
+}
+
+/**
+  * @brief  Copy a queued block of frames.
+  * @param  Block    sequence number of the block, already published
+  * @param  pFrames  USBNOPD_ADC_HALF_SIZE samples
+  * @retval 1 if the copy is consistent, 0 if the interrupt reused the slot meanwhile
+  */
+static uint32_t USBnoPD_ReadADC(uint32_t Block, uint16_t *pFrames)
+{
+  const volatile uint16_t *pSlot = USBnoPD_adc_queue.Frames[Block % USBNOPD_ADC_QUEUE_BLOCKS];
+
+  for (uint32_t i = 0u; i < USBNOPD_ADC_HALF_SIZE; i++)
+  {
+    pFrames[i] = pSlot[i];
+  }
+  __DMB();
+
+  return ((USBnoPD_adc_queue.Sequence - Block) < USBNOPD_ADC_QUEUE_BLOCKS) ? 1u : 0u;
+}
+
+/**
+  * @brief  Filter the blocks of ADC frames queued since the previous run and
+  *         update USBnoPD_adc_converted_buffer.
+  * @note   Runs in thread context. Blocks the interrupt reused before they
+  *         were filtered are counted in USBnoPD_adc_lost_blocks.
+  * @param  none
+  * @retval none
   */
-static uint32_t USBnoPD_TCPP0203_ConvertADCDataToVoltage(uint32_t ADCData, uint32_t Ra, uint32_t Rb)
+static void USBnoPD_ProcessADC(void)
 {
-  uint32_t voltage;
-  uint32_t vadc;
+  uint32_t sequence = USBnoPD_adc_queue.Sequence;
+  uint32_t filtered = 0u;
 
-  /* Convert ADC RAW data to voltage */
-  vadc = (ADCData * VDD_VALUE) / ADC_FULL_SCALE;
+  __DMB();
 
-  /* If no Ra or Rb are defined, return vadc directly */
-  if ((Ra == 0u) && (Rb == 0u))
+  /* The oldest slots were already reused */
+  if ((sequence - USBnoPD_adc_sequence) > USBNOPD_ADC_QUEUE_BLOCKS)
   {
-    voltage = vadc;
+    USBnoPD_adc_lost_blocks += sequence - USBnoPD_adc_sequence - USBNOPD_ADC_QUEUE_BLOCKS;
+    USBnoPD_adc_sequence = sequence - USBNOPD_ADC_QUEUE_BLOCKS;
   }
-  else
+
+  /* Every frame of every block goes through the filters, in order */
+  while (USBnoPD_adc_sequence != sequence)
   {
-    /* Avoid dividing by zero */
-    if (Rb == 0u)
+    if (USBnoPD_ReadADC(USBnoPD_adc_sequence, USBnoPD_adc_block) != 0u)
     {
-      voltage = 0u;
+      USBPD_ADC_FilterBlock(&USBnoPD_adc_filter, USBnoPD_adc_block, USBnoPD_adc_buffer_filtered);
+      filtered = 1u;
     }
     else
     {
-      /* Apply voltage divider */
-      voltage = vadc * (Ra + Rb) / Rb;
+      USBnoPD_adc_lost_blocks++;
     }
+    USBnoPD_adc_sequence++;
   }
-  return voltage;
+
+  /* Nothing new since the previous run */
+  if (filtered == 0u)
+  {
+    return;
+  }
+
+  /* Update the voltage buffer by converting the filtered values */
+  USBPD_ADC_ConvertEx(USBnoPD_adc_buffer_filtered, USBnoPD_adc_scale, USBnoPD_adc_extra_bits,
+                      USBnoPD_adc_converted_buffer, USBNOPD_ADC_USED_CHANNELS);
 }
 
 /**
-  * @brief  Calculate the VBUS current level corresponding to ADC raw converted data.
-  * @note   ADC measurement provides measurement on IANA pin.
-  * @param  ADCData  ADC raw converted data (resolution 12 bits)
-  * @param  Ga       value of TCPP0X Iana gain in V/V
-  * @param  Rs       value of shunt resistor in milliohm
-  * @retval VBUS analog current (unit: mA)
+  * @brief  Follow the oversampler: width of the samples of each frame index,
+  *         filters restarted for the new frame rate.
+  * @note   Called from thread context, with the ADC DMA interrupt masked or the ADCs stopped.
+  * @param  none
+  * @retval none
   */
-static int32_t USBnoPD_TCPP0203_ConvertADCDataToCurrent(uint32_t ADCData, uint32_t Ga, uint32_t Rs)
+static void USBnoPD_ConfigureADC(void)
 {
-  int32_t current;
-  uint32_t vadc;
+  ADC_OversamplingConfTypeDef ovs;
+  uint8_t bits[USBNOPD_ADC_USED_CHANNELS];
+
+  ADC_GetOversampling(&ovs);
+  for (uint8_t i = 0u; i < USBNOPD_ADC_USED_CHANNELS; i++)
+  {
+    USBnoPD_adc_extra_bits[i] = (uint8_t)(ovs.Log2Ratio - ovs.Shift[USBNOPD_ADC_SLOT_INSTANCE(i)]);
+    bits[i] = (uint8_t)(USBNOPD_ADC_RESOLUTION_BITS + USBnoPD_adc_extra_bits[i]);
+  }
 
-  /* Avoid dividing by zero */
-  if ((Ga == 0u) || (Rs == 0u))
+  if (USBPD_ADC_FilterInit(&USBnoPD_adc_filter, USBNOPD_ADC_FRAME_SIZE, USBNOPD_ADC_USED_CHANNELS,
+                           USBNOPD_ADC_FRAMES_PER_HALF, bits, NULL) != USBPD_ADC_FILTER_OK)
   {
-    current = 0u;
+    Error_Handler();
   }
-  else
+  for (uint8_t i = 0u; i < USBNOPD_ADC_USED_CHANNELS; i++)
   {
-    vadc = (ADCData * VDD_VALUE) / ADC_FULL_SCALE;
-    current = (int32_t)((vadc * 1000u) / (Ga * Rs));
+    if (USBnoPD_ApplyADCFilter(i, ovs.Log2Ratio) != USBPD_ADC_FILTER_OK)
+    {
+      Error_Handler();
+    }
   }
 
-  return current;
+  /* The queued blocks have the previous width: drop them */
+  USBnoPD_adc_sequence = USBnoPD_adc_queue.Sequence;
 }
 
 /**
-  * @brief  Process the ADC values and update USBnoPD_adc_converted_buffer with measured values.
-  * @param  none
-  * @retval none
+  * @brief  Program the filter of one frame index from USBnoPD_adc_filter_conf.
+  * @note   Average and IIR lengths are divided by the oversampling ratio, and
+  *         clamped to the longest the filter supports.
+  * @param  Index      frame index
+  * @param  Log2Ratio  oversampling ratio of the frames
+  * @retval USBPD_ADC_FILTER_OK, USBPD_ADC_FILTER_ERROR on an invalid mode or CIC order
   */
-void USBnoPD_ProcessADC(void)
+static USBPD_ADC_FilterStatusTypeDef USBnoPD_ApplyADCFilter(uint32_t Index, uint32_t Log2Ratio)
 {
-  /* Perform ADC Filtering */
-  for (uint8_t i = 0u; i < USBNOPD_ADC_USED_CHANNELS; i++)
+  USBPD_ADC_FilterConfTypeDef conf = USBnoPD_adc_filter_conf[Index];
+  uint32_t max = (conf.Mode == USBPD_ADC_FILTER_AVERAGE) ?
+                 (USBnoPD_adc_filter.Log2Frames + USBPD_ADC_FILTER_LOG2_HISTORY) : USBPD_ADC_FILTER_IIR_MAX_SHIFT;
+
+  if ((conf.Mode == USBPD_ADC_FILTER_AVERAGE) || (conf.Mode == USBPD_ADC_FILTER_IIR))
   {
-    USBnoPD_adc_buffer_filtered[i] = (USBnoPD_adc_buffer_filtered[i] + USBnoPD_adc_buffer[i]) >> 1u;
+    conf.Param = (uint8_t)((conf.Param > Log2Ratio) ? (conf.Param - Log2Ratio) : 0u);
+    if (conf.Param > max)
+    {
+      conf.Param = (uint8_t)max;
+    }
   }
-  /* Update the voltage buffer by converting the filtered values */
-  USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_CC1] =
-    USBnoPD_TCPP0203_ConvertADCDataToVoltage(USBnoPD_adc_buffer_filtered[USBnoPD_ADC_Index_CC1],USBNOPD_SRC1M1_NORA,USBNOPD_SRC1M1_NORB);
-  USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_CC2] =
-    USBnoPD_TCPP0203_ConvertADCDataToVoltage(USBnoPD_adc_buffer_filtered[USBnoPD_ADC_Index_CC2],USBNOPD_SRC1M1_NORA,USBNOPD_SRC1M1_NORB);
-  USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_VBUSC] =
-    USBnoPD_TCPP0203_ConvertADCDataToVoltage(USBnoPD_adc_buffer_filtered[USBnoPD_ADC_Index_VBUSC],USBPD_PWR_VSENSE_RA,USBPD_PWR_VSENSE_RB);
-  USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_ISENSE] =
-    USBnoPD_TCPP0203_ConvertADCDataToCurrent(USBnoPD_adc_buffer_filtered[USBnoPD_ADC_Index_ISENSE],USBPD_PWR_ISENSE_GA,USBPD_PWR_ISENSE_RS);
-  USBnoPD_adc_converted_buffer[USBnoPD_ADC_Index_VPROV] =
-    USBnoPD_TCPP0203_ConvertADCDataToVoltage(USBnoPD_adc_buffer_filtered[USBnoPD_ADC_Index_VPROV],USBPD_PWR_VSENSE_RA,USBPD_PWR_VSENSE_RB);
+
+  return USBPD_ADC_FilterConfig(&USBnoPD_adc_filter, Index, &conf);
 }
 
 /**
@@ -405,10 +532,77 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 }
 
 /**
-  * @brief This function handles DMA2 stream0 global interrupt.
+  * @brief  Half of the ADC DMA buffer completed, called from the GPDMA1 interrupt.
+  * @param  pFrames   NbFrames frames of USBNOPD_ADC_FRAME_SIZE samples
+  * @param  NbFrames  number of frames
+  * @retval none
   */
-void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc)
+void ADC_FramesCallback(const uint16_t *pFrames, uint32_t NbFrames)
 {
-  USBnoPD_ProcessADC();
+  /* Filtered by the state machine, out of the interrupt */
+  UNUSED(NbFrames);
+  USBnoPD_PublishADC(pFrames);
+}
+
+/**
+  * @brief  Change the filter of one ADC channel, from thread context.
+  * @param  Index  frame index of the channel
+  * @param  Mode   filter, see USBPD_ADC_FilterModeTypeDef
+  * @param  Param  log2 of the average length or IIR time constant in ADC
+  *                conversions (see USBnoPD_ApplyADCFilter()), CIC order
+  * @retval USBPD_ADC_FILTER_OK, USBPD_ADC_FILTER_ERROR if Param does not fit the mode
+  */
+USBPD_ADC_FilterStatusTypeDef USBnoPD_SetADCFilter(USBnoPD_ADCBufIDTypeDef Index,
+                                                   USBPD_ADC_FilterModeTypeDef Mode, uint8_t Param)
+{
+  USBPD_ADC_FilterConfTypeDef previous;
+  ADC_OversamplingConfTypeDef ovs;
+  USBPD_ADC_FilterStatusTypeDef status;
+
+  if ((uint32_t)Index >= USBNOPD_ADC_USED_CHANNELS)
+  {
+    return USBPD_ADC_FILTER_ERROR;
+  }
+  ADC_GetOversampling(&ovs);
+
+  /* The filters run in thread context, between two state machine passes */
+  previous = USBnoPD_adc_filter_conf[Index];
+  USBnoPD_adc_filter_conf[Index].Mode = Mode;
+  USBnoPD_adc_filter_conf[Index].Param = Param;
+  status = USBnoPD_ApplyADCFilter((uint32_t)Index, ovs.Log2Ratio);
+  if (status != USBPD_ADC_FILTER_OK)
+  {
+    USBnoPD_adc_filter_conf[Index] = previous;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Trade ADC frame rate for resolution, from thread context.
+  * @note   Each sample becomes the sum of 2^Log2Ratio conversions shifted
+  *         right: 12 + Log2Ratio - Shift bits, 12 to 16. The frame rate and
+  *         the ADC DMA interrupt rate are divided by 2^Log2Ratio, the filters
+  *         and the conversion to mV / mA follow. The ADCs restart.
+  * @param  Log2Ratio    0 (oversampler off) to 8
+  * @param  ShiftMaster  right shift of ADC1 (CC1, ISENSE, VPROV)
+  * @param  ShiftSlave   right shift of ADC2 (CC2, VBUS)
+  * @retval HAL_OK, HAL_ERROR if a sample would not be 12 to 16 bits
+  */
+HAL_StatusTypeDef USBnoPD_SetADCOversampling(uint32_t Log2Ratio, uint32_t ShiftMaster, uint32_t ShiftSlave)
+{
+  ADC_OversamplingConfTypeDef ovs = {Log2Ratio, {ShiftMaster, ShiftSlave}};
+  HAL_StatusTypeDef status;
+
+  /* No block of the previous width may reach the filters */
+  HAL_NVIC_DisableIRQ(GPDMA1_Channel0_IRQn);
+  status = ADC_SetOversampling(&ovs);
+  if (status == HAL_OK)
+  {
+    USBnoPD_ConfigureADC();
+  }
+  HAL_NVIC_EnableIRQ(GPDMA1_Channel0_IRQn);
+
+  return status;
 }
 
@@ -31,12 +31,9 @@ extern "C" {
 #include "stm32h7rsxx_hal.h"
 #include "usbpd_ADCnoPD.h"
 #include "usbpd_GPIO.h"
+#include "usbpd_ADCfilter.h"
 #include "STMicroelectronics.X-CUBE-TCPP_conf.h"
 
-/* Exported functions --------------------------------------------------------*/
-void MX_TCPP_Init(void);
-void MX_TCPP_Process(void);
-
 /* Exported types ------------------------------------------------------------*/
 typedef enum
 {
@@ -54,17 +51,28 @@ typedef enum
   USBnoPD_State_FAULT          /* Hardware fault                  */
 } USBnoPD_StatesTypeDef;
 
+/* Position in a frame, following the dual mode sequencer (usbpd_ADCnoPD.h) */
 typedef enum
 {
   USBnoPD_ADC_Index_CC1 = 0u,  /* CC1 index in adc buffer    */
   USBnoPD_ADC_Index_CC2,       /* CC2 index in adc buffer    */
-  USBnoPD_ADC_Index_VBUSC,     /* VBus index in adc buffer   */
   USBnoPD_ADC_Index_ISENSE,    /* Isense index in adc buffer */
+  USBnoPD_ADC_Index_VBUSC,     /* VBus index in adc buffer   */
   USBnoPD_ADC_Index_VPROV      /* Vprov index in adc buffer  */
 } USBnoPD_ADCBufIDTypeDef;
 
+/* Exported functions --------------------------------------------------------*/
+void MX_TCPP_Init(void);
+void MX_TCPP_Process(void);
+USBPD_ADC_FilterStatusTypeDef USBnoPD_SetADCFilter(USBnoPD_ADCBufIDTypeDef Index,
+                                                   USBPD_ADC_FilterModeTypeDef Mode, uint8_t Param);
+HAL_StatusTypeDef USBnoPD_SetADCOversampling(uint32_t Log2Ratio, uint32_t ShiftMaster, uint32_t ShiftSlave);
+
 /* Exported constants --------------------------------------------------------*/
 #define USBNOPD_ADC_USED_CHANNELS     5u      /* Number of used ADC channels                                   */
+#ifndef USBNOPD_ADC_QUEUE_BLOCKS
+#define USBNOPD_ADC_QUEUE_BLOCKS      4u      /* DMA halves queued for the state machine, a power of two       */
+#endif /* USBNOPD_ADC_QUEUE_BLOCKS */
 
 #define USBNOPD_CC_VOLTAGE_MAXRA      800u    /* CC line Max voltage when Ra is connected (in mV)              */
 #define USBNOPD_CC_VOLTAGE_MINRD      850u    /* CC line Min voltage when connected to Rd (in mV)              */
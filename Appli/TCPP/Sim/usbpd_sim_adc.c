@@ -0,0 +1,426 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbpd_sim_adc.c
+  * @brief          : ADC conversion check: USBPD_ADC_Convert() against the
+  *                   division formulas it replaces, over all 4096 codes, for
+  *                   the board scales then for a sweep of dividers and shunt
+  *                   gains. Both are then timed. USBPD_ADC_ConvertEx() is
+  *                   checked on oversampled codes against the exact values.
+  *                   One JSON object per line.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include "usbpd_ADCconv.h"
+#include "STMicroelectronics.X-CUBE-TCPP_conf.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLE_UNIT          "tsc"
+#else
+#include <time.h>
+#define BENCH_CYCLE_UNIT          "ns"
+#endif
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_CODES               (USBPD_ADC_FULL_SCALE + 1u)
+#define BENCH_CHANNELS            5u
+#define BENCH_FRAMES              4096u
+#define BENCH_REPEAT              16u
+#define BENCH_SEED                0x2545F491u
+
+/* Sweep bounds: every divider up to this Rb, every Ga * Rs product above
+   the smallest one keeping the result in 16 bits */
+#define SWEEP_RB_MAX              1000u
+#define SWEEP_RA_STEP             7u
+#define SWEEP_GARS_MIN            63u
+#define SWEEP_GARS_MAX            20000u
+
+/* Private typedef -----------------------------------------------------------*/
+typedef void (*Bench_KernelTypeDef)(void);
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Frame layout and scales of app_tcpp.c: CC1, CC2, ISENSE, VBUSC, VPROV */
+static const uint32_t BenchScale[BENCH_CHANNELS] =
+{
+  USBPD_ADC_DIVIDER_SCALE(0u, 0u),
+  USBPD_ADC_DIVIDER_SCALE(0u, 0u),
+  USBPD_ADC_CURRENT_SCALE(USBPD_PWR_ISENSE_GA, USBPD_PWR_ISENSE_RS),
+  USBPD_ADC_DIVIDER_SCALE(USBPD_PWR_VSENSE_RA, USBPD_PWR_VSENSE_RB),
+  USBPD_ADC_DIVIDER_SCALE(USBPD_PWR_VSENSE_RA, USBPD_PWR_VSENSE_RB),
+};
+
+static uint16_t BenchCodes[BENCH_FRAMES][BENCH_CHANNELS];
+static uint16_t BenchOut[BENCH_FRAMES][BENCH_CHANNELS];
+static uint32_t BenchSeed = BENCH_SEED;
+
+/* Read at run time, as the firmware functions took them as arguments: the
+   compiler may not turn the formula divisions into multiplications */
+static volatile uint32_t BenchRa = USBPD_PWR_VSENSE_RA;
+static volatile uint32_t BenchRb = USBPD_PWR_VSENSE_RB;
+static volatile uint32_t BenchGa = USBPD_PWR_ISENSE_GA;
+static volatile uint32_t BenchRs = USBPD_PWR_ISENSE_RS;
+static volatile uint32_t BenchNo = 0u;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t Bench_GetCycles(void);
+static uint32_t Bench_Random(void);
+static __attribute__((noinline)) uint32_t Ref_Voltage(uint32_t ADCData, uint32_t Ra, uint32_t Rb);
+static __attribute__((noinline)) int32_t Ref_Current(uint32_t ADCData, uint32_t Ga, uint32_t Rs);
+static uint32_t Check_Scale(uint32_t scale, uint32_t Ra, uint32_t Rb, uint32_t Ga, uint32_t Rs);
+static uint32_t Check_Oversampled(uint32_t scale, uint32_t Num, uint32_t Den, uint8_t ExtraBits,
+                                  uint32_t *pLevels);
+static void Naive_Frames(void);
+static void Fast_Frames(void);
+static double Bench_Time(Bench_KernelTypeDef kernel);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Cycle counter, nanoseconds where there is no TSC.
+  * @retval Counter
+  */
+static uint64_t Bench_GetCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+  * @brief  xorshift32, the same sequence on every run.
+  * @retval Random word
+  */
+static uint32_t Bench_Random(void)
+{
+  BenchSeed ^= BenchSeed << 13;
+  BenchSeed ^= BenchSeed >> 17;
+  BenchSeed ^= BenchSeed << 5;
+
+  return BenchSeed;
+}
+
+/**
+  * @brief  USBnoPD_TCPP0203_ConvertADCDataToVoltage() as it was in app_tcpp.c.
+  */
+static uint32_t Ref_Voltage(uint32_t ADCData, uint32_t Ra, uint32_t Rb)
+{
+  uint32_t voltage;
+  uint32_t vadc;
+
+  vadc = (ADCData * VDD_VALUE) / USBPD_ADC_FULL_SCALE;
+
+  if ((Ra == 0u) && (Rb == 0u))
+  {
+    voltage = vadc;
+  }
+  else if (Rb == 0u)
+  {
+    voltage = 0u;
+  }
+  else
+  {
+    voltage = vadc * (Ra + Rb) / Rb;
+  }
+
+  return voltage;
+}
+
+/**
+  * @brief  USBnoPD_TCPP0203_ConvertADCDataToCurrent() as it was in app_tcpp.c.
+  */
+static int32_t Ref_Current(uint32_t ADCData, uint32_t Ga, uint32_t Rs)
+{
+  int32_t current;
+  uint32_t vadc;
+
+  if ((Ga == 0u) || (Rs == 0u))
+  {
+    current = 0;
+  }
+  else
+  {
+    vadc = (ADCData * VDD_VALUE) / USBPD_ADC_FULL_SCALE;
+    current = (int32_t)((vadc * 1000u) / (Ga * Rs));
+  }
+
+  return current;
+}
+
+/**
+  * @brief  Count the codes a scale converts differently from the formula.
+  * @param  scale  scale under test
+  * @param  Ra, Rb divider of the formula, used if Ga is 0
+  * @param  Ga, Rs current sense of the formula
+  * @retval Mismatches over the 4096 codes
+  */
+static uint32_t Check_Scale(uint32_t scale, uint32_t Ra, uint32_t Rb, uint32_t Ga, uint32_t Rs)
+{
+  uint32_t mismatches = 0u;
+  uint16_t code;
+  uint16_t value;
+  uint32_t ref;
+
+  for (uint32_t c = 0u; c < BENCH_CODES; c++)
+  {
+    code = (uint16_t)c;
+    USBPD_ADC_Convert(&code, &scale, &value, 1u);
+
+    ref = (Ga == 0u) ? Ref_Voltage(c, Ra, Rb) : (uint32_t)Ref_Current(c, Ga, Rs);
+    mismatches += (value != ref) ? 1u : 0u;
+  }
+
+  return mismatches;
+}
+
+/**
+  * @brief  Count the oversampled codes USBPD_ADC_ConvertEx() converts above the
+  *         exact value, or below it by more than the mV lost at the pin
+  *         (2^-ExtraBits) times the scale, plus one.
+  * @param  scale      scale under test
+  * @param  Num, Den   exact ratio of the scale
+  * @param  ExtraBits  bits above 12 of the codes
+  * @param  pLevels    distinct results over the codes
+  * @retval Mismatches over the 2^(12 + ExtraBits) codes
+  */
+static uint32_t Check_Oversampled(uint32_t scale, uint32_t Num, uint32_t Den, uint8_t ExtraBits,
+                                  uint32_t *pLevels)
+{
+  uint32_t mismatches = 0u;
+  uint32_t levels = 0u;
+  uint32_t tolerance = ((Num + (Den << ExtraBits) - 1u) / (Den << ExtraBits)) + 1u;
+  uint16_t code;
+  uint16_t value;
+  uint32_t previous = UINT32_MAX;
+  uint64_t exact;
+
+  for (uint32_t c = 0u; c < ((BENCH_CODES - 1u) << ExtraBits) + 1u; c++)
+  {
+    code = (uint16_t)c;
+    USBPD_ADC_ConvertEx(&code, &scale, &ExtraBits, &value, 1u);
+
+    exact = ((uint64_t)c * VDD_VALUE * Num) / ((uint64_t)USBPD_ADC_FULL_SCALE * Den << ExtraBits);
+    mismatches += ((value > exact) || ((exact - value) > tolerance)) ? 1u : 0u;
+    levels += (value != previous) ? 1u : 0u;
+    previous = value;
+  }
+  *pLevels = levels;
+
+  return mismatches;
+}
+
+/**
+  * @brief  Convert BenchCodes with the division formulas, channel by channel.
+  */
+static void Naive_Frames(void)
+{
+  uint32_t ra = BenchRa;
+  uint32_t rb = BenchRb;
+  uint32_t ga = BenchGa;
+  uint32_t rs = BenchRs;
+  uint32_t no = BenchNo;
+
+  for (uint32_t f = 0u; f < BENCH_FRAMES; f++)
+  {
+    BenchOut[f][0] = (uint16_t)Ref_Voltage(BenchCodes[f][0], no, no);
+    BenchOut[f][1] = (uint16_t)Ref_Voltage(BenchCodes[f][1], no, no);
+    BenchOut[f][2] = (uint16_t)Ref_Current(BenchCodes[f][2], ga, rs);
+    BenchOut[f][3] = (uint16_t)Ref_Voltage(BenchCodes[f][3], ra, rb);
+    BenchOut[f][4] = (uint16_t)Ref_Voltage(BenchCodes[f][4], ra, rb);
+  }
+}
+
+/**
+  * @brief  Convert BenchCodes with USBPD_ADC_Convert(), one frame per call.
+  */
+static void Fast_Frames(void)
+{
+  for (uint32_t f = 0u; f < BENCH_FRAMES; f++)
+  {
+    USBPD_ADC_Convert(BenchCodes[f], BenchScale, BenchOut[f], BENCH_CHANNELS);
+  }
+}
+
+/**
+  * @brief  Best of BENCH_REPEAT runs of a kernel.
+  * @param  kernel: Kernel
+  * @retval Cycles
+  */
+static double Bench_Time(Bench_KernelTypeDef kernel)
+{
+  uint64_t best = UINT64_MAX;
+  uint64_t start;
+  uint64_t cycles;
+
+  for (uint32_t rep = 0u; rep < BENCH_REPEAT; rep++)
+  {
+    start = Bench_GetCycles();
+    kernel();
+    cycles = Bench_GetCycles() - start;
+
+    if (cycles < best)
+    {
+      best = cycles;
+    }
+  }
+
+  return (double)best;
+}
+
+/**
+  * @brief  Check entry point.
+  * @retval 0 when every code converts like the formulas
+  */
+int main(void)
+{
+  uint32_t failures = 0u;
+  uint32_t mismatches;
+  uint32_t scales;
+  double naive_cycles;
+  double fast_cycles;
+  uint16_t ref[BENCH_CHANNELS];
+
+  printf("{\"bench\":\"usbpd_adc_conv\",\"vdd_mv\":%u,\"cycle_unit\":\"%s\"}\n",
+         (unsigned int)VDD_VALUE, BENCH_CYCLE_UNIT);
+
+  /* Board scales, as used by app_tcpp.c and custom_board_usbpd_pwr.c */
+  mismatches = 0u;
+  for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+  {
+    mismatches += (ch == 2u) ? Check_Scale(BenchScale[ch], 0u, 0u, USBPD_PWR_ISENSE_GA, USBPD_PWR_ISENSE_RS)
+                             : Check_Scale(BenchScale[ch], (ch < 2u) ? 0u : USBPD_PWR_VSENSE_RA,
+                                           (ch < 2u) ? 0u : USBPD_PWR_VSENSE_RB, 0u, 0u);
+  }
+  failures += mismatches;
+  printf("{\"check\":\"board\",\"scales\":%u,\"codes\":%u,\"mismatches\":%u}\n",
+         (unsigned int)BENCH_CHANNELS, (unsigned int)BENCH_CODES, (unsigned int)mismatches);
+
+  /* Dividers: ratio (Ra + Rb) / Rb below 16, Rb == 0 included */
+  mismatches = 0u;
+  scales = 0u;
+  for (uint32_t rb = 0u; rb <= SWEEP_RB_MAX; rb++)
+  {
+    for (uint32_t ra = 0u; (ra + rb) < (16u * rb) || ((rb == 0u) && (ra == 0u)); ra += SWEEP_RA_STEP)
+    {
+      mismatches += Check_Scale((uint32_t)USBPD_ADC_DIVIDER_SCALE(ra, rb), ra, rb, 0u, 0u);
+      scales++;
+    }
+  }
+  mismatches += Check_Scale((uint32_t)USBPD_ADC_DIVIDER_SCALE(SWEEP_RA_STEP, 0u), SWEEP_RA_STEP, 0u, 0u, 0u);
+  scales++;
+  failures += mismatches;
+  printf("{\"check\":\"divider\",\"scales\":%u,\"codes\":%u,\"mismatches\":%u}\n",
+         (unsigned int)scales, (unsigned int)BENCH_CODES, (unsigned int)mismatches);
+
+  /* Current sense: Ga * Rs products, 0 included */
+  mismatches = Check_Scale((uint32_t)USBPD_ADC_CURRENT_SCALE(0u, 7u), 0u, 0u, 1u, 0u);
+  scales = 1u;
+  for (uint32_t gars = SWEEP_GARS_MIN; gars <= SWEEP_GARS_MAX; gars++)
+  {
+    mismatches += Check_Scale((uint32_t)USBPD_ADC_CURRENT_SCALE(gars, 1u), 0u, 0u, gars, 1u);
+    scales++;
+  }
+  failures += mismatches;
+  printf("{\"check\":\"current\",\"scales\":%u,\"codes\":%u,\"mismatches\":%u}\n",
+         (unsigned int)scales, (unsigned int)BENCH_CODES, (unsigned int)mismatches);
+
+  /* Oversampled codes: ExtraBits 0 as USBPD_ADC_Convert(), then against the exact values */
+  mismatches = 0u;
+  for (uint32_t c = 0u; c < BENCH_CODES; c++)
+  {
+    uint8_t extra[BENCH_CHANNELS] = {0u};
+
+    for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+    {
+      BenchCodes[0][ch] = (uint16_t)c;
+    }
+    USBPD_ADC_Convert(BenchCodes[0], BenchScale, ref, BENCH_CHANNELS);
+    USBPD_ADC_ConvertEx(BenchCodes[0], BenchScale, extra, BenchOut[0], BENCH_CHANNELS);
+    for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+    {
+      mismatches += (BenchOut[0][ch] != ref[ch]) ? 1u : 0u;
+    }
+  }
+  failures += mismatches;
+  printf("{\"check\":\"oversampled\",\"extra_bits\":0,\"codes\":%u,\"mismatches\":%u}\n",
+         (unsigned int)BENCH_CODES, (unsigned int)mismatches);
+
+  for (uint8_t e = 1u; e <= USBPD_ADC_MAX_EXTRA_BITS; e++)
+  {
+    uint32_t levels[BENCH_CHANNELS];
+
+    mismatches = 0u;
+    for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+    {
+      mismatches += (ch == 2u) ? Check_Oversampled(BenchScale[ch], 1000u, USBPD_PWR_ISENSE_GA * USBPD_PWR_ISENSE_RS,
+                                                   e, &levels[ch])
+                  : (ch < 2u)  ? Check_Oversampled(BenchScale[ch], 1u, 1u, e, &levels[ch])
+                               : Check_Oversampled(BenchScale[ch], USBPD_PWR_VSENSE_RA + USBPD_PWR_VSENSE_RB,
+                                                   USBPD_PWR_VSENSE_RB, e, &levels[ch]);
+    }
+    failures += mismatches;
+    printf("{\"check\":\"oversampled\",\"extra_bits\":%u,\"codes\":%u,\"mismatches\":%u,"
+           "\"vbus_levels\":%u,\"isense_levels\":%u}\n",
+           (unsigned int)e, (unsigned int)(((BENCH_CODES - 1u) << e) + 1u), (unsigned int)mismatches,
+           (unsigned int)levels[3], (unsigned int)levels[2]);
+  }
+
+  /* Whole frames of random codes, then timing */
+  for (uint32_t f = 0u; f < BENCH_FRAMES; f++)
+  {
+    for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+    {
+      BenchCodes[f][ch] = (uint16_t)(Bench_Random() & USBPD_ADC_FULL_SCALE);
+    }
+  }
+
+  mismatches = 0u;
+  Naive_Frames();
+  for (uint32_t f = 0u; f < BENCH_FRAMES; f++)
+  {
+    for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+    {
+      ref[ch] = BenchOut[f][ch];
+    }
+    USBPD_ADC_Convert(BenchCodes[f], BenchScale, BenchOut[f], BENCH_CHANNELS);
+    for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+    {
+      mismatches += (BenchOut[f][ch] != ref[ch]) ? 1u : 0u;
+    }
+  }
+  failures += mismatches;
+
+  naive_cycles = Bench_Time(Naive_Frames);
+  fast_cycles = Bench_Time(Fast_Frames);
+  printf("{\"kernel\":\"convert_frame\",\"channels\":%u,\"frames\":%u,\"mismatches\":%u,"
+         "\"naive_cycles_per_sample\":%.3f,\"cycles_per_sample\":%.3f,\"speedup\":%.2f}\n",
+         (unsigned int)BENCH_CHANNELS, (unsigned int)BENCH_FRAMES, (unsigned int)mismatches,
+         naive_cycles / (BENCH_FRAMES * BENCH_CHANNELS), fast_cycles / (BENCH_FRAMES * BENCH_CHANNELS),
+         naive_cycles / fast_cycles);
+
+  if (failures != 0u)
+  {
+    fprintf(stderr, "adc conversion check: %u mismatches\n", (unsigned int)failures);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,737 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbpd_sim_filter.c
+  * @brief          : ADC filter check: USBPD_ADC_FilterBlock() against per
+  *                   sample reference filters on random frames of 12-bit
+  *                   samples and of the default 14/12-bit widths, step
+  *                   responses on the channel traces, then the cost of a
+  *                   block in cycles per sample. Built once with the scalar
+  *                   path and once with the packed path emulated
+  *                   (ADC_FILTER_SIMD_EMULATION). One JSON object per line.
+  *
+  *                   The traces are generated from the board levels (VBUS
+  *                   attach through the divider, ISENSE load step through
+  *                   the shunt, CC line going from open to Rd) plus noise.
+  *                   Recorded traces are used instead when given as
+  *                   arguments: text files of ADC codes, one frame per
+  *                   line, one code per channel (CC1 CC2 ISENSE VBUS VPROV)
+  *                   or a single code for all of them.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "usbpd_ADCfilter.h"
+#include "STMicroelectronics.X-CUBE-TCPP_conf.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLE_UNIT          "tsc"
+#else
+#include <time.h>
+#define BENCH_CYCLE_UNIT          "ns"
+#endif
+
+#if defined(ADC_FILTER_SIMD_EMULATION)
+#define BENCH_PATH                "simd-emulated"
+#else
+#define BENCH_PATH                "scalar"
+#endif
+
+/* Private define ------------------------------------------------------------*/
+
+/* Frame layout of usbpd_ADCnoPD.h: 3 ranks on 2 ADCs, 5 used slots */
+#define BENCH_FRAME_SIZE          6u
+#define BENCH_CHANNELS            5u
+#define BENCH_LOG2_FRAMES         4u
+#define BENCH_FRAMES_PER_BLOCK    (1u << BENCH_LOG2_FRAMES)
+#define BENCH_SAMPLE_BITS         12u
+#define BENCH_FULL_SCALE          ((1u << BENCH_SAMPLE_BITS) - 1u)
+#define BENCH_BLOCKS              1024u
+#define BENCH_REPEAT              16u
+#define BENCH_SEED                0x2545F491u
+
+#define TRACE_FRAMES              4096u
+#define TRACE_BLOCKS              (TRACE_FRAMES / BENCH_FRAMES_PER_BLOCK)
+#define TRACE_STEP_FRAME          2056u   /* Mid block */
+#define TRACE_MAX_FILES           8u
+
+/* Slots of a frame, as USBnoPD_ADCBufIDTypeDef */
+#define SLOT_CC1                  0u
+#define SLOT_CC2                  1u
+#define SLOT_ISENSE               2u
+#define SLOT_VBUS                 3u
+#define SLOT_VPROV                4u
+
+/* Board levels in ADC codes */
+#define CODE_MV(__MV__)           (((__MV__) * BENCH_FULL_SCALE) / VDD_VALUE)
+#define CODE_VBUS(__MV__)         CODE_MV(((__MV__) * USBPD_PWR_VSENSE_RB) / (USBPD_PWR_VSENSE_RA + USBPD_PWR_VSENSE_RB))
+#define CODE_MA(__MA__)           CODE_MV(((__MA__) * USBPD_PWR_ISENSE_GA * USBPD_PWR_ISENSE_RS) / 1000u)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  const char *Name;
+  uint32_t    Slot;
+  uint32_t    From;
+  uint32_t    To;
+  uint32_t    Noise;                  /* Peak of each of the 3 uniform terms */
+} Trace_StepTypeDef;
+
+typedef struct
+{
+  const char                 *Name;
+  USBPD_ADC_FilterConfTypeDef Conf[BENCH_CHANNELS];
+} Bench_SetupTypeDef;
+
+typedef struct
+{
+  const char *Name;
+  uint8_t     Bits[BENCH_CHANNELS];
+} Bench_WidthTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Every mode and parameter the checks go through */
+static const USBPD_ADC_FilterConfTypeDef CheckConf[] =
+{
+  {USBPD_ADC_FILTER_NONE, 0u},
+  {USBPD_ADC_FILTER_AVERAGE, 0u}, {USBPD_ADC_FILTER_AVERAGE, 1u}, {USBPD_ADC_FILTER_AVERAGE, 2u},
+  {USBPD_ADC_FILTER_AVERAGE, 3u}, {USBPD_ADC_FILTER_AVERAGE, 4u}, {USBPD_ADC_FILTER_AVERAGE, 5u},
+  {USBPD_ADC_FILTER_AVERAGE, 6u}, {USBPD_ADC_FILTER_AVERAGE, 7u}, {USBPD_ADC_FILTER_AVERAGE, 8u},
+  {USBPD_ADC_FILTER_CIC, 1u}, {USBPD_ADC_FILTER_CIC, 2u}, {USBPD_ADC_FILTER_CIC, 3u},
+  {USBPD_ADC_FILTER_IIR, 0u}, {USBPD_ADC_FILTER_IIR, 2u}, {USBPD_ADC_FILTER_IIR, 4u},
+  {USBPD_ADC_FILTER_IIR, 6u}, {USBPD_ADC_FILTER_IIR, 8u}, {USBPD_ADC_FILTER_IIR, 10u},
+  {USBPD_ADC_FILTER_IIR, 12u},
+};
+
+static const Trace_StepTypeDef TraceStep[] =
+{
+  {"vbus_attach", SLOT_VBUS,   CODE_VBUS(0u),    CODE_VBUS(5000u), 4u},
+  {"isense_load", SLOT_ISENSE, CODE_MA(300u),    CODE_MA(2000u),   12u},
+  {"cc1_rd",      SLOT_CC1,    CODE_MV(3240u),   CODE_MV(1680u),   3u},
+};
+
+/* Filters of app_tcpp.c, then one mode on every channel */
+static const Bench_SetupTypeDef BenchSetup[] =
+{
+  {"app_tcpp", {{USBPD_ADC_FILTER_AVERAGE, 3u}, {USBPD_ADC_FILTER_AVERAGE, 3u}, {USBPD_ADC_FILTER_IIR, 6u},
+                {USBPD_ADC_FILTER_AVERAGE, 4u}, {USBPD_ADC_FILTER_CIC, 2u}}},
+  {"none",     {{USBPD_ADC_FILTER_NONE, 0u}, {USBPD_ADC_FILTER_NONE, 0u}, {USBPD_ADC_FILTER_NONE, 0u},
+                {USBPD_ADC_FILTER_NONE, 0u}, {USBPD_ADC_FILTER_NONE, 0u}}},
+  {"average4", {{USBPD_ADC_FILTER_AVERAGE, 4u}, {USBPD_ADC_FILTER_AVERAGE, 4u}, {USBPD_ADC_FILTER_AVERAGE, 4u},
+                {USBPD_ADC_FILTER_AVERAGE, 4u}, {USBPD_ADC_FILTER_AVERAGE, 4u}}},
+  {"average8", {{USBPD_ADC_FILTER_AVERAGE, 8u}, {USBPD_ADC_FILTER_AVERAGE, 8u}, {USBPD_ADC_FILTER_AVERAGE, 8u},
+                {USBPD_ADC_FILTER_AVERAGE, 8u}, {USBPD_ADC_FILTER_AVERAGE, 8u}}},
+  {"cic1",     {{USBPD_ADC_FILTER_CIC, 1u}, {USBPD_ADC_FILTER_CIC, 1u}, {USBPD_ADC_FILTER_CIC, 1u},
+                {USBPD_ADC_FILTER_CIC, 1u}, {USBPD_ADC_FILTER_CIC, 1u}}},
+  {"cic3",     {{USBPD_ADC_FILTER_CIC, 3u}, {USBPD_ADC_FILTER_CIC, 3u}, {USBPD_ADC_FILTER_CIC, 3u},
+                {USBPD_ADC_FILTER_CIC, 3u}, {USBPD_ADC_FILTER_CIC, 3u}}},
+  {"iir6",     {{USBPD_ADC_FILTER_IIR, 6u}, {USBPD_ADC_FILTER_IIR, 6u}, {USBPD_ADC_FILTER_IIR, 6u},
+                {USBPD_ADC_FILTER_IIR, 6u}, {USBPD_ADC_FILTER_IIR, 6u}}},
+};
+
+/* Sample widths: 12 bits on both ADCs, then the default oversampling of
+   usbpd_ADCnoPD.h, ADC1 slots at 14 bits */
+static const Bench_WidthTypeDef BenchWidth[] =
+{
+  {"12",    {12u, 12u, 12u, 12u, 12u}},
+  {"14/12", {14u, 12u, 14u, 12u, 14u}},
+};
+
+static uint16_t TraceFrames[TRACE_FRAMES][BENCH_FRAME_SIZE];
+static uint16_t TraceOut[TRACE_BLOCKS][BENCH_CHANNELS];
+static uint16_t BenchFrames[BENCH_BLOCKS][BENCH_FRAMES_PER_BLOCK][BENCH_FRAME_SIZE];
+static uint16_t BenchOut[BENCH_CHANNELS];
+static USBPD_ADC_FilterTypeDef BenchFilter;
+static const Bench_WidthTypeDef *BenchBits = &BenchWidth[0];
+static uint32_t BenchSeed = BENCH_SEED;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t Bench_GetCycles(void);
+static uint32_t Bench_Random(void);
+static uint16_t Bench_RandomCode(uint32_t slot);
+static uint16_t Trace_Noisy(uint32_t level, uint32_t noise);
+static void Trace_Filter(const USBPD_ADC_FilterConfTypeDef *pConf, uint32_t frames);
+static int32_t Ref_Sample(int32_t frame, uint32_t slot);
+static uint32_t Check_Reference(const USBPD_ADC_FilterConfTypeDef *pConf);
+static uint32_t Check_Step(const Trace_StepTypeDef *pStep, const USBPD_ADC_FilterConfTypeDef *pConf);
+static void Report_Trace(const char *name, uint32_t slot, uint32_t frames, uint32_t step);
+static uint32_t Trace_Load(const char *path);
+static double Bench_Time(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Cycle counter, nanoseconds where there is no TSC.
+  * @retval Counter
+  */
+static uint64_t Bench_GetCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+  * @brief  xorshift32, the same sequence on every run.
+  * @retval Random word
+  */
+static uint32_t Bench_Random(void)
+{
+  BenchSeed ^= BenchSeed << 13;
+  BenchSeed ^= BenchSeed >> 17;
+  BenchSeed ^= BenchSeed << 5;
+
+  return BenchSeed;
+}
+
+/**
+  * @brief  Full scale random code of a slot, at the width of BenchBits.
+  * @param  slot  frame slot, the spare one takes 12 bits
+  * @retval ADC code
+  */
+static uint16_t Bench_RandomCode(uint32_t slot)
+{
+  uint32_t bits = (slot < BENCH_CHANNELS) ? BenchBits->Bits[slot] : BENCH_SAMPLE_BITS;
+
+  return (uint16_t)(Bench_Random() & ((1u << bits) - 1u));
+}
+
+/**
+  * @brief  A level plus roughly gaussian noise (sum of 3 uniform terms), clipped to the ADC range.
+  * @param  level  ADC code
+  * @param  noise  peak of each uniform term, in codes
+  * @retval ADC code
+  */
+static uint16_t Trace_Noisy(uint32_t level, uint32_t noise)
+{
+  int32_t code = (int32_t)level;
+
+  for (uint32_t n = 0u; n < 3u; n++)
+  {
+    code += (int32_t)(Bench_Random() % ((2u * noise) + 1u)) - (int32_t)noise;
+  }
+
+  return (uint16_t)((code < 0) ? 0 : ((code > (int32_t)BENCH_FULL_SCALE) ? (int32_t)BENCH_FULL_SCALE : code));
+}
+
+/**
+  * @brief  Filter TraceFrames block by block into TraceOut, every channel with pConf.
+  * @param  pConf   filter of all channels
+  * @param  frames  frames in TraceFrames, multiple of a block
+  */
+static void Trace_Filter(const USBPD_ADC_FilterConfTypeDef *pConf, uint32_t frames)
+{
+  USBPD_ADC_FilterConfTypeDef conf[BENCH_CHANNELS];
+
+  for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+  {
+    conf[ch] = *pConf;
+  }
+  (void)USBPD_ADC_FilterInit(&BenchFilter, BENCH_FRAME_SIZE, BENCH_CHANNELS, BENCH_FRAMES_PER_BLOCK,
+                             BenchBits->Bits, conf);
+
+  for (uint32_t b = 0u; b < (frames / BENCH_FRAMES_PER_BLOCK); b++)
+  {
+    USBPD_ADC_FilterBlock(&BenchFilter, TraceFrames[b * BENCH_FRAMES_PER_BLOCK], TraceOut[b]);
+  }
+}
+
+/**
+  * @brief  Sample of the trace, the first block repeated before the start:
+  *         the history the moving averages are primed with.
+  */
+static int32_t Ref_Sample(int32_t frame, uint32_t slot)
+{
+  if (frame < 0)
+  {
+    frame = (int32_t)BENCH_FRAMES_PER_BLOCK - 1 - ((-frame - 1) % (int32_t)BENCH_FRAMES_PER_BLOCK);
+  }
+
+  return (int32_t)TraceFrames[frame][slot];
+}
+
+/**
+  * @brief  Count the outputs that differ from per sample reference filters:
+  *         window sums for the averages, cascaded moving sums for the CIC
+  *         (same transfer function), a double precision low-pass for the
+  *         IIR (within one code).
+  * @param  pConf  filter under test, on every channel
+  * @retval Mismatches
+  */
+static uint32_t Check_Reference(const USBPD_ADC_FilterConfTypeDef *pConf)
+{
+  static int64_t stage[USBPD_ADC_FILTER_CIC_MAX_ORDER + 1u][TRACE_FRAMES];
+  uint32_t mismatches = 0u;
+  uint32_t param = pConf->Param;
+  int64_t tolerance = (pConf->Mode == USBPD_ADC_FILTER_IIR) ? 1 : 0;
+  int64_t ref;
+  int64_t sum;
+  double y;
+
+  for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+  {
+    if (pConf->Mode == USBPD_ADC_FILTER_CIC)
+    {
+      for (uint32_t i = 0u; i < TRACE_FRAMES; i++)
+      {
+        stage[0][i] = Ref_Sample((int32_t)i, ch);
+      }
+      for (uint32_t k = 1u; k <= param; k++)
+      {
+        for (uint32_t i = 0u; i < TRACE_FRAMES; i++)
+        {
+          stage[k][i] = 0;
+          for (uint32_t j = 0u; (j < BENCH_FRAMES_PER_BLOCK) && (j <= i); j++)
+          {
+            stage[k][i] += stage[k - 1u][i - j];
+          }
+        }
+      }
+    }
+
+    y = 0.0;
+    for (uint32_t b = 0u; b < TRACE_BLOCKS; b++)
+    {
+      uint32_t end = (b + 1u) * BENCH_FRAMES_PER_BLOCK;
+
+      sum = 0;
+      for (uint32_t f = end - BENCH_FRAMES_PER_BLOCK; f < end; f++)
+      {
+        sum += Ref_Sample((int32_t)f, ch);
+      }
+
+      switch (pConf->Mode)
+      {
+        case USBPD_ADC_FILTER_AVERAGE:
+          sum = 0;
+          for (int32_t f = (int32_t)end - (int32_t)(1u << param); f < (int32_t)end; f++)
+          {
+            sum += Ref_Sample(f, ch);
+          }
+          ref = (sum + ((1LL << param) >> 1)) >> param;
+          break;
+
+        case USBPD_ADC_FILTER_CIC:
+          if ((param == 1u) || (b < (param - 1u)))
+          {
+            ref = (sum + (BENCH_FRAMES_PER_BLOCK / 2u)) >> BENCH_LOG2_FRAMES;
+          }
+          else
+          {
+            ref = (stage[param][end - 1u] + ((1LL << (param * BENCH_LOG2_FRAMES)) >> 1)) >>
+                  (param * BENCH_LOG2_FRAMES);
+          }
+          break;
+
+        case USBPD_ADC_FILTER_IIR:
+          if (b == 0u)
+          {
+            y = (double)((sum + (BENCH_FRAMES_PER_BLOCK / 2u)) >> BENCH_LOG2_FRAMES);
+          }
+          else
+          {
+            for (uint32_t f = end - BENCH_FRAMES_PER_BLOCK; f < end; f++)
+            {
+              y += ((double)Ref_Sample((int32_t)f, ch) - y) / (double)(1u << param);
+            }
+          }
+          ref = (int64_t)floor(y + 0.5);
+          break;
+
+        case USBPD_ADC_FILTER_NONE:
+        default:
+          ref = Ref_Sample((int32_t)end - 1, ch);
+          break;
+      }
+
+      mismatches += (llabs(ref - (int64_t)TraceOut[b][ch]) > tolerance) ? 1u : 0u;
+    }
+  }
+
+  return mismatches;
+}
+
+/**
+  * @brief  Noise free step through a filter: the output must move
+  *         monotonically, never overshoot and settle on the exact level.
+  * @param  pStep  step, its noise is ignored
+  * @param  pConf  filter
+  * @retval Failures
+  */
+static uint32_t Check_Step(const Trace_StepTypeDef *pStep, const USBPD_ADC_FilterConfTypeDef *pConf)
+{
+  uint32_t failures = 0u;
+  uint32_t bound;
+  uint32_t settled = TRACE_BLOCKS;
+  uint32_t lo = (pStep->From < pStep->To) ? pStep->From : pStep->To;
+  uint32_t hi = (pStep->From < pStep->To) ? pStep->To : pStep->From;
+  uint32_t out;
+
+  for (uint32_t f = 0u; f < TRACE_FRAMES; f++)
+  {
+    for (uint32_t ch = 0u; ch < BENCH_FRAME_SIZE; ch++)
+    {
+      TraceFrames[f][ch] = (uint16_t)((f < TRACE_STEP_FRAME) ? pStep->From : pStep->To);
+    }
+  }
+  Trace_Filter(pConf, TRACE_FRAMES);
+
+  /* Frames after the step by which the output must be exact */
+  switch (pConf->Mode)
+  {
+    case USBPD_ADC_FILTER_AVERAGE:
+      bound = (1u << pConf->Param) + BENCH_FRAMES_PER_BLOCK;
+      break;
+    case USBPD_ADC_FILTER_CIC:
+      bound = (pConf->Param + 1u) * BENCH_FRAMES_PER_BLOCK;
+      break;
+    case USBPD_ADC_FILTER_IIR:
+      /* (1 - 2^-k)^n below half a code of a full scale step */
+      bound = (uint32_t)ceil(log(2.0 * BENCH_FULL_SCALE) / -log1p(-1.0 / (double)(1u << pConf->Param)))
+              + BENCH_FRAMES_PER_BLOCK;
+      if (pConf->Param == 0u)
+      {
+        bound = BENCH_FRAMES_PER_BLOCK;
+      }
+      break;
+    default:
+      bound = BENCH_FRAMES_PER_BLOCK;
+      break;
+  }
+
+  for (uint32_t b = 0u; b < TRACE_BLOCKS; b++)
+  {
+    out = TraceOut[b][pStep->Slot];
+    failures += ((out < lo) || (out > hi)) ? 1u : 0u;
+    if (b > 0u)
+    {
+      failures += (((pStep->To > pStep->From) && (out < TraceOut[b - 1u][pStep->Slot])) ||
+                   ((pStep->To < pStep->From) && (out > TraceOut[b - 1u][pStep->Slot]))) ? 1u : 0u;
+    }
+    if (((b + 1u) * BENCH_FRAMES_PER_BLOCK) <= TRACE_STEP_FRAME)
+    {
+      failures += (out != pStep->From) ? 1u : 0u;
+    }
+    else if ((out == pStep->To) && (settled == TRACE_BLOCKS))
+    {
+      settled = b;
+    }
+    else if ((out != pStep->To) && (settled != TRACE_BLOCKS))
+    {
+      failures++;
+    }
+  }
+  failures += (((settled + 1u) * BENCH_FRAMES_PER_BLOCK) > (TRACE_STEP_FRAME + bound)) ? 1u : 0u;
+
+  return failures;
+}
+
+/**
+  * @brief  Step response of a trace through every filter of CheckConf:
+  *         frames from the step to 10 %, 50 % and 90 % of the output swing
+  *         (-1 if not reached in the trace, the output changes once a block),
+  *         output noise before the step against the input noise.
+  * @param  name    trace
+  * @param  slot    channel looked at
+  * @param  frames  frames in TraceFrames
+  * @param  step    step frame, 0 to locate it on the input
+  */
+static void Report_Trace(const char *name, uint32_t slot, uint32_t frames, uint32_t step)
+{
+  const uint32_t edge = 64u;
+  uint32_t blocks = frames / BENCH_FRAMES_PER_BLOCK;
+  double from = 0.0;
+  double to = 0.0;
+  double in_mean = 0.0;
+  double in_var = 0.0;
+  double level[3];
+  int32_t cross[3];
+  uint32_t quiet;
+  double out_mean;
+  double out_var;
+  double out;
+
+  /* Levels from both ends, step where a moving mean of a block crosses half way */
+  for (uint32_t f = 0u; f < edge; f++)
+  {
+    from += TraceFrames[f][slot];
+    to += TraceFrames[frames - 1u - f][slot];
+  }
+  from /= edge;
+  to /= edge;
+  if (step == 0u)
+  {
+    double mean = 0.0;
+
+    for (uint32_t f = 0u; f < frames; f++)
+    {
+      mean += (TraceFrames[f][slot] - ((f >= BENCH_FRAMES_PER_BLOCK) ?
+                                       TraceFrames[f - BENCH_FRAMES_PER_BLOCK][slot] : TraceFrames[0][slot])) /
+              (double)BENCH_FRAMES_PER_BLOCK;
+      if ((step == 0u) && (f >= BENCH_FRAMES_PER_BLOCK) &&
+          (fabs((TraceFrames[0][slot] + mean) - from) > (fabs(to - from) / 2.0)))
+      {
+        step = f - (BENCH_FRAMES_PER_BLOCK / 2u);
+      }
+    }
+  }
+
+  /* Input noise over the blocks before the step, the first ones left out */
+  quiet = step / BENCH_FRAMES_PER_BLOCK;
+  for (uint32_t f = 4u * BENCH_FRAMES_PER_BLOCK; f < (quiet * BENCH_FRAMES_PER_BLOCK); f++)
+  {
+    in_mean += TraceFrames[f][slot];
+    in_var += (double)TraceFrames[f][slot] * TraceFrames[f][slot];
+  }
+  in_mean /= (double)((quiet * BENCH_FRAMES_PER_BLOCK) - (4u * BENCH_FRAMES_PER_BLOCK));
+  in_var = (in_var / (double)((quiet * BENCH_FRAMES_PER_BLOCK) - (4u * BENCH_FRAMES_PER_BLOCK))) -
+           (in_mean * in_mean);
+
+  for (uint32_t c = 0u; c < (sizeof(CheckConf) / sizeof(CheckConf[0])); c++)
+  {
+    Trace_Filter(&CheckConf[c], frames);
+
+    /* Output noise after the longest filter settled, before the step */
+    out_mean = 0.0;
+    out_var = 0.0;
+    for (uint32_t b = quiet / 2u; b < quiet; b++)
+    {
+      out_mean += TraceOut[b][slot];
+      out_var += (double)TraceOut[b][slot] * TraceOut[b][slot];
+    }
+    out_mean /= (double)(quiet - (quiet / 2u));
+    out_var = (out_var / (double)(quiet - (quiet / 2u))) - (out_mean * out_mean);
+
+    for (uint32_t l = 0u; l < 3u; l++)
+    {
+      level[l] = from + ((to - from) * ((l == 0u) ? 0.1 : ((l == 1u) ? 0.5 : 0.9)));
+      cross[l] = -1;
+      for (uint32_t b = quiet; b < blocks; b++)
+      {
+        out = TraceOut[b][slot];
+        if (((to > from) && (out >= level[l])) || ((to < from) && (out <= level[l])))
+        {
+          cross[l] = (int32_t)(((b + 1u) * BENCH_FRAMES_PER_BLOCK) - step);
+          break;
+        }
+      }
+    }
+
+    printf("{\"trace\":\"%s\",\"mode\":%u,\"param\":%u,\"from\":%.1f,\"to\":%.1f,"
+           "\"t10_frames\":%d,\"t50_frames\":%d,\"t90_frames\":%d,"
+           "\"noise_in\":%.2f,\"noise_out\":%.2f}\n",
+           name, (unsigned int)CheckConf[c].Mode, (unsigned int)CheckConf[c].Param, from, to,
+           (int)cross[0], (int)cross[1], (int)cross[2],
+           sqrt((in_var > 0.0) ? in_var : 0.0), sqrt((out_var > 0.0) ? out_var : 0.0));
+  }
+}
+
+/**
+  * @brief  Read a recorded trace into TraceFrames.
+  * @param  path  text file, one frame per line: BENCH_CHANNELS codes or one for all
+  * @retval Frames read, rounded down to a block, 0 on error
+  */
+static uint32_t Trace_Load(const char *path)
+{
+  FILE *file = fopen(path, "r");
+  char line[256];
+  uint32_t frames = 0u;
+  unsigned int code[BENCH_CHANNELS];
+  int count;
+
+  if (file == NULL)
+  {
+    return 0u;
+  }
+
+  while ((frames < TRACE_FRAMES) && (fgets(line, sizeof(line), file) != NULL))
+  {
+    count = sscanf(line, "%u %u %u %u %u", &code[0], &code[1], &code[2], &code[3], &code[4]);
+    if (count <= 0)
+    {
+      continue;
+    }
+    for (uint32_t ch = 0u; ch < BENCH_FRAME_SIZE; ch++)
+    {
+      TraceFrames[frames][ch] = (uint16_t)(code[(count == (int)BENCH_CHANNELS) && (ch < BENCH_CHANNELS) ? ch : 0u] &
+                                           BENCH_FULL_SCALE);
+    }
+    frames++;
+  }
+  (void)fclose(file);
+
+  return frames & ~(BENCH_FRAMES_PER_BLOCK - 1u);
+}
+
+/**
+  * @brief  Best of BENCH_REPEAT runs over BenchFrames.
+  * @retval Cycles
+  */
+static double Bench_Time(void)
+{
+  uint64_t best = UINT64_MAX;
+  uint64_t start;
+  uint64_t cycles;
+
+  for (uint32_t rep = 0u; rep < BENCH_REPEAT; rep++)
+  {
+    start = Bench_GetCycles();
+    for (uint32_t b = 0u; b < BENCH_BLOCKS; b++)
+    {
+      USBPD_ADC_FilterBlock(&BenchFilter, BenchFrames[b][0], BenchOut);
+    }
+    cycles = Bench_GetCycles() - start;
+
+    if (cycles < best)
+    {
+      best = cycles;
+    }
+  }
+
+  return (double)best;
+}
+
+/**
+  * @brief  Check entry point.
+  * @param  argc, argv  recorded traces, none for the generated ones
+  * @retval 0 when every filter matches its reference and every step settles
+  */
+int main(int argc, char **argv)
+{
+  uint32_t failures = 0u;
+  uint32_t mismatches;
+  uint32_t frames;
+  double cycles;
+
+  printf("{\"bench\":\"usbpd_adc_filter\",\"path\":\"%s\",\"frames_per_block\":%u,\"cycle_unit\":\"%s\"}\n",
+         BENCH_PATH, (unsigned int)BENCH_FRAMES_PER_BLOCK, BENCH_CYCLE_UNIT);
+
+  /* Every filter against its reference, on full scale random codes of each width */
+  for (uint32_t w = 0u; w < (sizeof(BenchWidth) / sizeof(BenchWidth[0])); w++)
+  {
+    BenchBits = &BenchWidth[w];
+    for (uint32_t c = 0u; c < (sizeof(CheckConf) / sizeof(CheckConf[0])); c++)
+    {
+      for (uint32_t f = 0u; f < TRACE_FRAMES; f++)
+      {
+        for (uint32_t ch = 0u; ch < BENCH_FRAME_SIZE; ch++)
+        {
+          TraceFrames[f][ch] = Bench_RandomCode(ch);
+        }
+      }
+      Trace_Filter(&CheckConf[c], TRACE_FRAMES);
+      mismatches = Check_Reference(&CheckConf[c]);
+      failures += mismatches;
+      printf("{\"check\":\"reference\",\"bits\":\"%s\",\"mode\":%u,\"param\":%u,\"blocks\":%u,"
+             "\"mismatches\":%u}\n", BenchBits->Name, (unsigned int)CheckConf[c].Mode,
+             (unsigned int)CheckConf[c].Param, (unsigned int)TRACE_BLOCKS, (unsigned int)mismatches);
+    }
+  }
+  BenchBits = &BenchWidth[0];
+
+  /* Noise free steps */
+  for (uint32_t t = 0u; t < (sizeof(TraceStep) / sizeof(TraceStep[0])); t++)
+  {
+    mismatches = 0u;
+    for (uint32_t c = 0u; c < (sizeof(CheckConf) / sizeof(CheckConf[0])); c++)
+    {
+      mismatches += Check_Step(&TraceStep[t], &CheckConf[c]);
+    }
+    failures += mismatches;
+    printf("{\"check\":\"step\",\"trace\":\"%s\",\"from\":%u,\"to\":%u,\"filters\":%u,\"failures\":%u}\n",
+           TraceStep[t].Name, (unsigned int)TraceStep[t].From, (unsigned int)TraceStep[t].To,
+           (unsigned int)(sizeof(CheckConf) / sizeof(CheckConf[0])), (unsigned int)mismatches);
+  }
+
+  /* Step responses on noisy traces */
+  if (argc > 1)
+  {
+    for (int a = 1; (a < argc) && (a <= (int)TRACE_MAX_FILES); a++)
+    {
+      frames = Trace_Load(argv[a]);
+      if (frames < (8u * BENCH_FRAMES_PER_BLOCK))
+      {
+        fprintf(stderr, "%s: no trace\n", argv[a]);
+        failures++;
+        continue;
+      }
+      for (uint32_t ch = 0u; ch < BENCH_CHANNELS; ch++)
+      {
+        char name[300];
+
+        (void)snprintf(name, sizeof(name), "%s:%u", argv[a], (unsigned int)ch);
+        Report_Trace(name, ch, frames, 0u);
+      }
+    }
+  }
+  else
+  {
+    for (uint32_t t = 0u; t < (sizeof(TraceStep) / sizeof(TraceStep[0])); t++)
+    {
+      for (uint32_t f = 0u; f < TRACE_FRAMES; f++)
+      {
+        for (uint32_t ch = 0u; ch < BENCH_FRAME_SIZE; ch++)
+        {
+          TraceFrames[f][ch] = Trace_Noisy((f < TRACE_STEP_FRAME) ? TraceStep[t].From : TraceStep[t].To,
+                                           TraceStep[t].Noise);
+        }
+      }
+      Report_Trace(TraceStep[t].Name, TraceStep[t].Slot, TRACE_FRAMES, TRACE_STEP_FRAME);
+    }
+  }
+
+  /* Cost of a block, at each width */
+  for (uint32_t w = 0u; w < (sizeof(BenchWidth) / sizeof(BenchWidth[0])); w++)
+  {
+    BenchBits = &BenchWidth[w];
+    for (uint32_t b = 0u; b < BENCH_BLOCKS; b++)
+    {
+      for (uint32_t f = 0u; f < BENCH_FRAMES_PER_BLOCK; f++)
+      {
+        for (uint32_t ch = 0u; ch < BENCH_FRAME_SIZE; ch++)
+        {
+          BenchFrames[b][f][ch] = Bench_RandomCode(ch);
+        }
+      }
+    }
+    for (uint32_t s = 0u; s < (sizeof(BenchSetup) / sizeof(BenchSetup[0])); s++)
+    {
+      (void)USBPD_ADC_FilterInit(&BenchFilter, BENCH_FRAME_SIZE, BENCH_CHANNELS, BENCH_FRAMES_PER_BLOCK,
+                                 BenchBits->Bits, BenchSetup[s].Conf);
+      cycles = Bench_Time();
+      printf("{\"kernel\":\"filter_block\",\"setup\":\"%s\",\"bits\":\"%s\",\"channels\":%u,\"blocks\":%u,"
+             "\"cycles_per_block\":%.1f,\"cycles_per_sample\":%.3f}\n",
+             BenchSetup[s].Name, BenchBits->Name, (unsigned int)BENCH_CHANNELS, (unsigned int)BENCH_BLOCKS,
+             cycles / BENCH_BLOCKS, cycles / (BENCH_BLOCKS * BENCH_FRAMES_PER_BLOCK * BENCH_CHANNELS));
+    }
+  }
+
+  if (failures != 0u)
+  {
+    fprintf(stderr, "adc filter check: %u failures\n", (unsigned int)failures);
+    return 1;
+  }
+
+  return 0;
+}
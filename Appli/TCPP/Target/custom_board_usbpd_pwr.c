@@ -24,6 +24,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "custom_board_usbpd_pwr.h"
 #include "app_tcpp.h"
+#include "usbpd_ADCconv.h"
 
 #if  defined(_TRACE)
 #include "usbpd_core.h"
@@ -86,12 +87,6 @@ typedef struct
   * @{
   */
 
-/* Maximum digital value of the ADC output (12 Bits resolution)
-   To convert ADC measurement to an absolute voltage value:
-   VCHANNELx = ADCx_DATA x (VDD/ADC_FULL_SCALE)
-  */
-#define ADC_FULL_SCALE       (0x0FFFU)
-
 #define ABS(__VAL__) (((int32_t)(__VAL__)) < 0 ? - ((int32_t)(__VAL__)) : ((int32_t)(__VAL__)))
 
 /* Minimum time between 2 detected faults allowing to consider that
@@ -124,11 +119,6 @@ static int32_t  PWR_TCPP0203_BUSConfigInit(uint32_t PortNum, uint16_t Address);
 static int32_t  PWR_TCPP0203_ConfigDeInit(uint32_t PortNum);
 static void     PWR_TCPP0203_EventCallback(uint32_t PortNum);
 
-static uint32_t PWR_TCPP0203_ConvertADCDataToVoltage(uint32_t ADCData, uint32_t Ra, uint32_t Rb);
-#if !defined(ADC_VBUS_ONLY)
-static int32_t  PWR_TCPP0203_ConvertADCDataToCurrent(uint32_t ADCData, uint32_t Ga, uint32_t Rs);
-#endif
-
 /**
   * @}
   */
@@ -138,6 +128,15 @@ static int32_t  PWR_TCPP0203_ConvertADCDataToCurrent(uint32_t ADCData, uint32_t
   */
 uint16_t usbpd_pwr_adcx_buff[VISENSE_ADC_BUFFER_SIZE]; /* Global ADC buffer to be filled by DMA */
 
+/* ADC code to VBUS mV through the Ra / Rb divider (0 if Rb is 0), see usbpd_ADCconv.h */
+static const uint32_t PWR_TCPP0203_VSenseScale =
+  USBPD_ADC_SCALE(USBPD_PWR_VSENSE_RA + USBPD_PWR_VSENSE_RB, USBPD_PWR_VSENSE_RB);
+#if !defined(ADC_VBUS_ONLY)
+/* ADC code to VBUS mA through the IANA gain and the shunt */
+static const uint32_t PWR_TCPP0203_ISenseScale =
+  USBPD_ADC_CURRENT_SCALE(USBPD_PWR_ISENSE_GA, USBPD_PWR_ISENSE_RS);
+#endif
+
 static USBPD_PWR_PortConfig_t USBPD_PWR_Port_Configs[USBPD_PWR_INSTANCES_NBR] =
 {
   {
@@ -953,14 +952,16 @@ int32_t BSP_USBPD_PWR_VBUSGetVoltage(uint32_t PortNum, uint32_t *pVoltage)
   }
   else
   {
-    uint32_t voltage;
+    uint16_t voltage;
+    uint16_t code;
     static __IO uint16_t adc_value;
 #if defined (ADC_VBUS_ONLY)
 	adc_value = LL_ADC_REG_ReadConversionData12(VISENSE_ADC_INSTANCE);
 #else
     adc_value = (uint16_t) usbpd_pwr_adcx_buff[ADCBUF_VSENSE];
 #endif
-    voltage = PWR_TCPP0203_ConvertADCDataToVoltage(adc_value, USBPD_PWR_VSENSE_RA, USBPD_PWR_VSENSE_RB);
+    code = adc_value;
+    USBPD_ADC_Convert(&code, &PWR_TCPP0203_VSenseScale, &voltage, 1u);
 
     *pVoltage = voltage;
   }
@@ -991,8 +992,10 @@ int32_t BSP_USBPD_PWR_VBUSGetCurrent(uint32_t PortNum, int32_t *pCurrent)
 	current=0;
 #else
     uint16_t adc_value;
+    uint16_t value;
     adc_value = (uint16_t) usbpd_pwr_adcx_buff[ADCBUF_ISENSE];
-    current = PWR_TCPP0203_ConvertADCDataToCurrent(adc_value, USBPD_PWR_ISENSE_GA, USBPD_PWR_ISENSE_RS);
+    USBPD_ADC_Convert(&adc_value, &PWR_TCPP0203_ISenseScale, &value, 1u);
+    current = (int32_t)value;
 #endif
 
     *pCurrent = current;
@@ -1686,68 +1689,6 @@ static void PWR_TCPP0203_EventCallback(uint32_t PortNum)
   }
 }
 
-/**
-  * @brief  Calculate the VBUS voltage level corresponding to ADC raw converted data.
-  * @note   Voltage level is measured though a voltage divider
-  *  Example :
-  *  Voltage -- Ra ----.-   ^
-  *                    |    |
-  *                    Rb   | vadc = VBUS * Rb /(Ra + Rb)
-  *                    |    |
-  *                   GND   |
-  * vadc = raw_data * (ADC_FULL_SCALE / VDD)
-  * @param  ADCData  ADC raw converted data (resolution 12 bits)
-  * @param  Ra       value of Ra resistance
-  * @param  Rb       value of Rb resistance
-  * @retval analog voltage (unit: mV)
-  */
-static uint32_t PWR_TCPP0203_ConvertADCDataToVoltage(uint32_t ADCData, uint32_t Ra, uint32_t Rb)
-{
-  uint32_t voltage;
-  uint32_t vadc;
-
-  /* Avoid dividing by zero */
-  if (Rb == 0u)
-  {
-    voltage = 0u;
-  }
-  else
-  {
-    vadc = (ADCData * VDD_VALUE) / ADC_FULL_SCALE;
-    voltage = vadc * (Ra + Rb) / Rb;
-  }
-
-  return voltage;
-}
-
-#if !defined(ADC_VBUS_ONLY)
-/**
-  * @brief  Calculate the VBUS current level corresponding to ADC raw converted data.
-  * @note   ADC measurement provides measurement on IANA pin.
-  * @param  ADCData  ADC raw converted data (resolution 12 bits)
-  * @param  Ga       value of TCPP0X Iana gain in V/V
-  * @param  Rs       value of shunt resistor in milliohm
-  * @retval VBUS analog current (unit: mA)
-  */
-static int32_t PWR_TCPP0203_ConvertADCDataToCurrent(uint32_t ADCData, uint32_t Ga, uint32_t Rs)
-{
-  int32_t current;
-  uint32_t vadc;
-
-  /* Avoid dividing by zero */
-  if ((Ga == 0u) || (Rs == 0u))
-  {
-    current = 0u;
-  }
-  else
-  {
-    vadc = (ADCData * VDD_VALUE) / ADC_FULL_SCALE;
-    current = (int32_t)((vadc * 1000u) / (Ga * Rs));
-  }
-
-  return current;
-}
-#endif
 
 /**
   * @}
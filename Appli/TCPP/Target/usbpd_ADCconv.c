@@ -0,0 +1,74 @@
+/**
+  ******************************************************************************
+  * File Name          : usbpd_ADCconv.c
+  * Description        : Fixed-point ADC to mV / mA conversion C file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include "usbpd_ADCconv.h"
+
+/**
+  * @brief  Convert a frame of ADC codes to mV or mA, one scale per channel.
+  * @note   Same results as vadc = (code * VDD_VALUE) / ADC_FULL_SCALE followed by
+  *         vadc * Num / Den, bit for bit: each division is a 32x32->64 multiply
+  *         (UMULL on Cortex-M7) by a USBPD_ADC_SCALE() constant.
+  * @param  pData       NbChannels ADC codes (12 bits)
+  * @param  pScale      NbChannels USBPD_ADC_DIVIDER_SCALE() / USBPD_ADC_CURRENT_SCALE()
+  * @param  pValue      NbChannels results (unit: mV or mA)
+  * @param  NbChannels  number of channels
+  * @retval none
+  */
+void USBPD_ADC_Convert(const uint16_t *pData, const uint32_t *pScale, uint16_t *pValue,
+                       uint32_t NbChannels)
+{
+  for (uint32_t i = 0u; i < NbChannels; i++)
+  {
+    uint32_t vadc = (uint32_t)(((uint64_t)pData[i] * (uint32_t)USBPD_ADC_VDD_SCALE) >> USBPD_ADC_SCALE_SHIFT);
+
+    pValue[i] = (uint16_t)(((uint64_t)vadc * pScale[i]) >> USBPD_ADC_SCALE_SHIFT);
+  }
+}
+
+/**
+  * @brief  Convert a frame of oversampled ADC codes to mV or mA, one scale per channel.
+  * @note   A code with E extra bits is 2^E times the 12-bit code: the first
+  *         product keeps the mV at the pin with E fractional bits and the
+  *         second one drops them, so that the divider or shunt scale applies
+  *         to the full resolution. With E = 0 same results as USBPD_ADC_Convert().
+  * @param  pData       NbChannels ADC codes (12 + pExtraBits[i] bits)
+  * @param  pScale      NbChannels USBPD_ADC_DIVIDER_SCALE() / USBPD_ADC_CURRENT_SCALE()
+  * @param  pExtraBits  NbChannels bits above 12 of each code, up to USBPD_ADC_MAX_EXTRA_BITS
+  * @param  pValue      NbChannels results (unit: mV or mA)
+  * @param  NbChannels  number of channels
+  * @retval none
+  */
+void USBPD_ADC_ConvertEx(const uint16_t *pData, const uint32_t *pScale, const uint8_t *pExtraBits,
+                         uint16_t *pValue, uint32_t NbChannels)
+{
+  for (uint32_t i = 0u; i < NbChannels; i++)
+  {
+    uint32_t vadc = (uint32_t)(((uint64_t)pData[i] * (uint32_t)USBPD_ADC_VDD_SCALE) >> USBPD_ADC_SCALE_SHIFT);
+
+    pValue[i] = (uint16_t)(((uint64_t)vadc * pScale[i]) >> (USBPD_ADC_SCALE_SHIFT + pExtraBits[i]));
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
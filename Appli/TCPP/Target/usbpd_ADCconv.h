@@ -0,0 +1,86 @@
+/**
+  ******************************************************************************
+  * File Name          : usbpd_ADCconv.h
+  * Description        : Fixed-point ADC to mV / mA conversion H file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef ADCCONV_H
+#define ADCCONV_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#if !defined(VDD_VALUE)
+#include "stm32h7rsxx_hal.h"
+#endif /* VDD_VALUE */
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Maximum digital value of the ADC output (12 Bits resolution) */
+#define USBPD_ADC_FULL_SCALE                        0x0FFFu
+
+/* Oversampled codes: up to 4 bits above the 12-bit resolution */
+#define USBPD_ADC_MAX_EXTRA_BITS                    4u
+
+/* Scales are unsigned Q4.28: ratios up to 16 */
+#define USBPD_ADC_SCALE_SHIFT                       28u
+
+/* Exported macros -----------------------------------------------------------*/
+
+/* Q4.28 multiplier for floor(x * Num / Den), rounded up so that the product,
+   shifted down, floors exactly like the division as long as x < 4096 and
+   Den < 65536. Den == 0 gives 0. Usable in #if. */
+#define USBPD_ADC_SCALE(__NUM__, __DEN__)                                              \
+  ((((((__NUM__) * 268435456ULL) + (__DEN__) - 1ULL) / ((__DEN__) + ((__DEN__) == 0))) \
+    * ((__DEN__) != 0)))
+
+/* ADC code to mV at the pin */
+#define USBPD_ADC_VDD_SCALE                         USBPD_ADC_SCALE(VDD_VALUE, USBPD_ADC_FULL_SCALE)
+
+/* mV at the pin to mV before a Ra / Rb divider, no divider if both are 0 */
+#define USBPD_ADC_DIVIDER_SCALE(__RA__, __RB__)                                        \
+  ((((__RA__) == 0) && ((__RB__) == 0)) ? USBPD_ADC_SCALE(1u, 1u)                      \
+                                        : USBPD_ADC_SCALE((__RA__) + (__RB__), (__RB__)))
+
+/* mV on IANA to mA through the shunt, Ga in V/V, Rs in milliohm */
+#define USBPD_ADC_CURRENT_SCALE(__GA__, __RS__)     USBPD_ADC_SCALE(1000u, (__GA__) * (__RS__))
+
+#if (USBPD_ADC_VDD_SCALE >= 4294967296ULL)
+#error "VDD_VALUE is out of the Q4.28 range"
+#endif
+
+/* Exported functions --------------------------------------------------------*/
+void USBPD_ADC_Convert(const uint16_t *pData, const uint32_t *pScale, uint16_t *pValue,
+                       uint32_t NbChannels);
+void USBPD_ADC_ConvertEx(const uint16_t *pData, const uint32_t *pScale, const uint8_t *pExtraBits,
+                         uint16_t *pValue, uint32_t NbChannels);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADCCONV_H */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
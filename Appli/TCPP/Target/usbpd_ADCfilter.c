@@ -0,0 +1,472 @@
+/**
+  ******************************************************************************
+  * File Name          : usbpd_ADCfilter.c
+  * Description        : Block based filtering of ADC frames C file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "usbpd_ADCfilter.h"
+
+/* Packed 16-bit adds on cores with the DSP extension (Cortex-M7), a C model of
+   the intrinsic when ADC_FILTER_SIMD_EMULATION is defined on a host build */
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include "cmsis_compiler.h"
+#define ADC_FILTER_SIMD                             1u
+#elif defined(ADC_FILTER_SIMD_EMULATION)
+#define ADC_FILTER_SIMD                             1u
+#else
+#define ADC_FILTER_SIMD                             0u
+#endif /* __ARM_FEATURE_DSP */
+
+/* Private define ------------------------------------------------------------*/
+#define ADC_FILTER_MAX_SAMPLE_BITS                  16u
+
+/* Private macro -------------------------------------------------------------*/
+
+/* x / 2^shift, rounded to nearest */
+#define ADC_FILTER_ROUND(__X__, __SHIFT__)          (((__X__) + ((1u << (__SHIFT__)) >> 1)) >> (__SHIFT__))
+
+/* Private function prototypes -----------------------------------------------*/
+#if defined(ADC_FILTER_SIMD_EMULATION) && !defined(__ARM_FEATURE_DSP)
+static inline uint32_t __UADD16(uint32_t op1, uint32_t op2);
+#endif /* ADC_FILTER_SIMD_EMULATION */
+static void ADC_FilterTailSums(const USBPD_ADC_FilterTypeDef *pFilter, const uint16_t *pFrames,
+                               uint32_t pTail[][USBPD_ADC_FILTER_MAX_CHANNELS]);
+static uint32_t ADC_FilterAverage(USBPD_ADC_FilterTypeDef *pFilter, uint32_t Channel,
+                                  uint32_t pTail[][USBPD_ADC_FILTER_MAX_CHANNELS], uint32_t Slot);
+static uint32_t ADC_FilterCIC(USBPD_ADC_FilterTypeDef *pFilter, uint32_t Channel, const uint16_t *pFrames,
+                              uint32_t Sum);
+static uint32_t ADC_FilterIIR(USBPD_ADC_FilterTypeDef *pFilter, uint32_t Channel, const uint16_t *pFrames,
+                              uint32_t Sum);
+
+/* Private functions ---------------------------------------------------------*/
+#if defined(ADC_FILTER_SIMD_EMULATION) && !defined(__ARM_FEATURE_DSP)
+/**
+  * @brief  UADD16 model: two unsigned 16-bit adds, carries dropped.
+  */
+static inline uint32_t __UADD16(uint32_t op1, uint32_t op2)
+{
+  return ((op1 + op2) & 0x0000FFFFu) | (((op1 & 0xFFFF0000u) + (op2 & 0xFFFF0000u)) & 0xFFFF0000u);
+}
+#endif /* ADC_FILTER_SIMD_EMULATION */
+
+/**
+  * @brief  Sums of the last 1, 2, 4 ... 2^Log2Frames frames of a block, per slot.
+  * @note   One backward pass over the block. With the DSP extension a word
+  *         holds two slots (ADC1 | ADC2 of a rank) summed by a single UADD16,
+  *         over 2^Log2Lane[w] frames at most before the lanes are widened to
+  *         32 bits; a word with a 16-bit slot is summed slot by slot.
+  * @param  pFilter  filter
+  * @param  pFrames  2^Log2Frames frames
+  * @param  pTail    pTail[n][slot]: sum of the last 2^n frames
+  * @retval none
+  */
+static void ADC_FilterTailSums(const USBPD_ADC_FilterTypeDef *pFilter, const uint16_t *pFrames,
+                               uint32_t pTail[][USBPD_ADC_FILTER_MAX_CHANNELS])
+{
+  uint32_t frames = 1u << pFilter->Log2Frames;
+  uint32_t level = 0u;
+  uint32_t next = 1u;
+  uint32_t acc[USBPD_ADC_FILTER_MAX_CHANNELS] = {0};
+  const uint16_t *pFrame;
+
+#if (ADC_FILTER_SIMD == 1u)
+  uint32_t words = (pFilter->NbChannels + 1u) / 2u;
+  uint32_t lanes[USBPD_ADC_FILTER_MAX_CHANNELS / 2u] = {0};
+  uint32_t pair;
+  uint32_t mask;
+
+  for (uint32_t n = 1u; n <= frames; n++)
+  {
+    pFrame = &pFrames[(frames - n) * pFilter->FrameSize];
+    for (uint32_t w = 0u; w < words; w++)
+    {
+      if (pFilter->Log2Lane[w] == 0u)
+      {
+        acc[2u * w]        += pFrame[2u * w];
+        acc[(2u * w) + 1u] += pFrame[(2u * w) + 1u];
+      }
+      else
+      {
+        (void)memcpy(&pair, &pFrame[2u * w], sizeof(pair));
+        lanes[w] = __UADD16(lanes[w], pair);
+
+        /* Widen before a lane can carry */
+        mask = (1u << pFilter->Log2Lane[w]) - 1u;
+        if ((n & mask) == 0u)
+        {
+          acc[2u * w]        += lanes[w] & 0xFFFFu;
+          acc[(2u * w) + 1u] += lanes[w] >> 16;
+          lanes[w] = 0u;
+        }
+      }
+    }
+
+    if (n == next)
+    {
+      for (uint32_t w = 0u; w < words; w++)
+      {
+        pTail[level][2u * w]        = acc[2u * w] + (lanes[w] & 0xFFFFu);
+        pTail[level][(2u * w) + 1u] = acc[(2u * w) + 1u] + (lanes[w] >> 16);
+      }
+      level++;
+      next <<= 1;
+    }
+  }
+#else
+  for (uint32_t n = 1u; n <= frames; n++)
+  {
+    pFrame = &pFrames[(frames - n) * pFilter->FrameSize];
+    for (uint32_t ch = 0u; ch < pFilter->NbChannels; ch++)
+    {
+      acc[ch] += pFrame[ch];
+    }
+
+    if (n == next)
+    {
+      for (uint32_t ch = 0u; ch < pFilter->NbChannels; ch++)
+      {
+        pTail[level][ch] = acc[ch];
+      }
+      level++;
+      next <<= 1;
+    }
+  }
+#endif /* ADC_FILTER_SIMD */
+}
+
+/**
+  * @brief  Moving average of 2^Param frames, from the tail sums of the block
+  *         and, past a block, from the block sums of the history.
+  * @param  pFilter  filter
+  * @param  Channel  slot
+  * @param  pTail    tail sums of the block
+  * @param  Slot     history entry of the block
+  * @retval Average
+  */
+static uint32_t ADC_FilterAverage(USBPD_ADC_FilterTypeDef *pFilter, uint32_t Channel,
+                                  uint32_t pTail[][USBPD_ADC_FILTER_MAX_CHANNELS], uint32_t Slot)
+{
+  uint32_t length = pFilter->Conf[Channel].Param;
+  uint32_t sum = 0u;
+
+  if (pFilter->Warmup[Channel] != 0u)
+  {
+    /* Start from a steady input rather than from 0 */
+    for (uint32_t h = 0u; h < USBPD_ADC_FILTER_HISTORY; h++)
+    {
+      pFilter->History[h][Channel] = pTail[pFilter->Log2Frames][Channel];
+    }
+    pFilter->Warmup[Channel] = 0u;
+  }
+
+  if (length <= pFilter->Log2Frames)
+  {
+    return ADC_FILTER_ROUND(pTail[length][Channel], length);
+  }
+
+  for (uint32_t b = 0u; b < (1u << (length - pFilter->Log2Frames)); b++)
+  {
+    sum += pFilter->History[(Slot - b) & (USBPD_ADC_FILTER_HISTORY - 1u)][Channel];
+  }
+
+  return ADC_FILTER_ROUND(sum, length);
+}
+
+/**
+  * @brief  CIC decimator: Param integrators at the frame rate, Param combs
+  *         at the block rate, differential delay 1, gain 2^(Param * Log2Frames).
+  * @note   At order 1 the integrator and comb pair is the block sum.
+  * @param  pFilter  filter
+  * @param  Channel  slot
+  * @param  pFrames  block
+  * @param  Sum      block sum of the slot
+  * @retval Filtered sample
+  */
+static uint32_t ADC_FilterCIC(USBPD_ADC_FilterTypeDef *pFilter, uint32_t Channel, const uint16_t *pFrames,
+                              uint32_t Sum)
+{
+  uint32_t order = pFilter->Conf[Channel].Param;
+  uint32_t frames = 1u << pFilter->Log2Frames;
+  uint32_t *pInt = pFilter->State[Channel];
+  uint32_t *pComb = pFilter->Comb[Channel];
+  uint32_t out;
+  uint32_t prev;
+
+  if (order == 1u)
+  {
+    return ADC_FILTER_ROUND(Sum, pFilter->Log2Frames);
+  }
+
+  /* Integrators wrap modulo 2^32, the comb differences are exact */
+  for (uint32_t f = 0u; f < frames; f++)
+  {
+    pInt[0] += pFrames[(f * pFilter->FrameSize) + Channel];
+    pInt[1] += pInt[0];
+    if (order == 3u)
+    {
+      pInt[2] += pInt[1];
+    }
+  }
+
+  out = pInt[order - 1u];
+  for (uint32_t c = 0u; c < order; c++)
+  {
+    prev = pComb[c];
+    pComb[c] = out;
+    out -= prev;
+  }
+
+  /* The first outputs still see the zero state: use the block average */
+  if (pFilter->Warmup[Channel] != 0u)
+  {
+    pFilter->Warmup[Channel]--;
+    return ADC_FILTER_ROUND(Sum, pFilter->Log2Frames);
+  }
+
+  return ADC_FILTER_ROUND(out, order * pFilter->Log2Frames);
+}
+
+/**
+  * @brief  First order IIR low-pass run on every frame of the block.
+  * @note   The output is kept with 31 - SampleBits[Channel] fractional bits, so that
+  *         x - y never overflows and a step settles on the exact input.
+  * @param  pFilter  filter
+  * @param  Channel  slot
+  * @param  pFrames  block
+  * @param  Sum      block sum of the slot
+  * @retval Filtered sample
+  */
+static uint32_t ADC_FilterIIR(USBPD_ADC_FilterTypeDef *pFilter, uint32_t Channel, const uint16_t *pFrames,
+                              uint32_t Sum)
+{
+  uint32_t shift = pFilter->Conf[Channel].Param;
+  uint32_t frac = 31u - pFilter->SampleBits[Channel];
+  uint32_t frames = 1u << pFilter->Log2Frames;
+  int32_t y = (int32_t)pFilter->State[Channel][0];
+  int32_t x;
+
+  if (pFilter->Warmup[Channel] != 0u)
+  {
+    /* Start from the block average rather than from 0 */
+    y = (int32_t)(ADC_FILTER_ROUND(Sum, pFilter->Log2Frames) << frac);
+    pFilter->Warmup[Channel] = 0u;
+  }
+  else
+  {
+    for (uint32_t f = 0u; f < frames; f++)
+    {
+      x = (int32_t)((uint32_t)pFrames[(f * pFilter->FrameSize) + Channel] << frac);
+      y += (x - y) >> shift;
+    }
+  }
+  pFilter->State[Channel][0] = (uint32_t)y;
+
+  return ADC_FILTER_ROUND((uint32_t)y, frac);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Set up a filter for blocks of frames and configure every channel.
+  * @param  pFilter     filter
+  * @param  FrameSize   samples per frame, even, up to USBPD_ADC_FILTER_MAX_CHANNELS
+  * @param  NbChannels  slots filtered, the first ones of each frame
+  * @param  NbFrames    frames per block, a power of two up to 2^USBPD_ADC_FILTER_MAX_LOG2_FRAMES
+  * @param  pSampleBits NbChannels sample widths, 1 to 16 bits
+  * @param  pConf       NbChannels configurations, NULL for USBPD_ADC_FILTER_NONE
+  * @retval USBPD_ADC_FILTER_OK, USBPD_ADC_FILTER_ERROR on an invalid layout or configuration
+  */
+USBPD_ADC_FilterStatusTypeDef USBPD_ADC_FilterInit(USBPD_ADC_FilterTypeDef *pFilter, uint32_t FrameSize,
+                                                   uint32_t NbChannels, uint32_t NbFrames, const uint8_t *pSampleBits,
+                                                   const USBPD_ADC_FilterConfTypeDef *pConf)
+{
+  static const USBPD_ADC_FilterConfTypeDef none = {USBPD_ADC_FILTER_NONE, 0u};
+  uint32_t log2frames = 0u;
+  uint32_t bits;
+
+  if ((FrameSize == 0u) || ((FrameSize % 2u) != 0u) || (FrameSize > USBPD_ADC_FILTER_MAX_CHANNELS) ||
+      (NbChannels > FrameSize) || (NbFrames == 0u) || ((NbFrames & (NbFrames - 1u)) != 0u))
+  {
+    return USBPD_ADC_FILTER_ERROR;
+  }
+  for (uint32_t ch = 0u; ch < NbChannels; ch++)
+  {
+    if ((pSampleBits[ch] == 0u) || (pSampleBits[ch] > ADC_FILTER_MAX_SAMPLE_BITS))
+    {
+      return USBPD_ADC_FILTER_ERROR;
+    }
+  }
+
+  while ((1u << log2frames) < NbFrames)
+  {
+    log2frames++;
+  }
+  if (log2frames > USBPD_ADC_FILTER_MAX_LOG2_FRAMES)
+  {
+    return USBPD_ADC_FILTER_ERROR;
+  }
+
+  (void)memset(pFilter, 0, sizeof(*pFilter));
+  pFilter->FrameSize  = FrameSize;
+  pFilter->NbChannels = NbChannels;
+  pFilter->Log2Frames = log2frames;
+
+  /* A lane sums 2^(16 - SampleBits) frames of its slot without a carry: the
+     wider slot of a word sets how often the word is widened */
+  for (uint32_t ch = 0u; ch < NbChannels; ch++)
+  {
+    pFilter->SampleBits[ch] = pSampleBits[ch];
+  }
+  for (uint32_t w = 0u; w < (FrameSize / 2u); w++)
+  {
+    bits = (pFilter->SampleBits[2u * w] > pFilter->SampleBits[(2u * w) + 1u]) ?
+           pFilter->SampleBits[2u * w] : pFilter->SampleBits[(2u * w) + 1u];
+    pFilter->Log2Lane[w] = (uint8_t)(((bits + log2frames) <= 16u) ? log2frames : (16u - bits));
+  }
+
+  for (uint32_t ch = 0u; ch < NbChannels; ch++)
+  {
+    if (USBPD_ADC_FilterConfig(pFilter, ch, (pConf != NULL) ? &pConf[ch] : &none) != USBPD_ADC_FILTER_OK)
+    {
+      return USBPD_ADC_FILTER_ERROR;
+    }
+  }
+
+  return USBPD_ADC_FILTER_OK;
+}
+
+/**
+  * @brief  Change the filter of one channel, its state restarts from the next block.
+  * @note   Not reentrant with USBPD_ADC_FilterBlock(): call it from the
+  *         context that filters the blocks, or with that context masked.
+  * @param  pFilter  filter
+  * @param  Channel  slot
+  * @param  pConf    configuration
+  * @retval USBPD_ADC_FILTER_OK, USBPD_ADC_FILTER_ERROR if Param is out of range for the mode
+  */
+USBPD_ADC_FilterStatusTypeDef USBPD_ADC_FilterConfig(USBPD_ADC_FilterTypeDef *pFilter, uint32_t Channel,
+                                                     const USBPD_ADC_FilterConfTypeDef *pConf)
+{
+  uint32_t param = pConf->Param;
+  uint8_t warmup;
+
+  if (Channel >= pFilter->NbChannels)
+  {
+    return USBPD_ADC_FILTER_ERROR;
+  }
+
+  switch (pConf->Mode)
+  {
+    case USBPD_ADC_FILTER_NONE:
+      warmup = 0u;
+      break;
+
+    case USBPD_ADC_FILTER_AVERAGE:
+      if (param > (pFilter->Log2Frames + USBPD_ADC_FILTER_LOG2_HISTORY))
+      {
+        return USBPD_ADC_FILTER_ERROR;
+      }
+      warmup = 1u;
+      break;
+
+    case USBPD_ADC_FILTER_CIC:
+      /* The comb output, SampleBits + order * Log2Frames bits, must fit the integrators */
+      if ((param == 0u) || (param > USBPD_ADC_FILTER_CIC_MAX_ORDER) ||
+          ((pFilter->SampleBits[Channel] + (param * pFilter->Log2Frames)) > 31u))
+      {
+        return USBPD_ADC_FILTER_ERROR;
+      }
+      warmup = (uint8_t)(param - 1u);
+      break;
+
+    case USBPD_ADC_FILTER_IIR:
+      if (param > USBPD_ADC_FILTER_IIR_MAX_SHIFT)
+      {
+        return USBPD_ADC_FILTER_ERROR;
+      }
+      warmup = 1u;
+      break;
+
+    default:
+      return USBPD_ADC_FILTER_ERROR;
+  }
+
+  pFilter->Conf[Channel] = *pConf;
+  pFilter->Warmup[Channel] = warmup;
+  for (uint32_t s = 0u; s < USBPD_ADC_FILTER_CIC_MAX_ORDER; s++)
+  {
+    pFilter->State[Channel][s] = 0u;
+    pFilter->Comb[Channel][s] = 0u;
+  }
+
+  return USBPD_ADC_FILTER_OK;
+}
+
+/**
+  * @brief  Filter a block of frames, one output sample per channel.
+  * @param  pFilter  filter
+  * @param  pFrames  2^Log2Frames frames of FrameSize samples
+  * @param  pOut     NbChannels filtered samples, same scale as the input
+  * @retval none
+  */
+void USBPD_ADC_FilterBlock(USBPD_ADC_FilterTypeDef *pFilter, const uint16_t *pFrames, uint16_t *pOut)
+{
+  uint32_t tail[USBPD_ADC_FILTER_MAX_LOG2_FRAMES + 1u][USBPD_ADC_FILTER_MAX_CHANNELS];
+  uint32_t slot = pFilter->Blocks & (USBPD_ADC_FILTER_HISTORY - 1u);
+  uint32_t sum;
+  uint32_t out;
+
+  ADC_FilterTailSums(pFilter, pFrames, tail);
+
+  for (uint32_t ch = 0u; ch < pFilter->NbChannels; ch++)
+  {
+    sum = tail[pFilter->Log2Frames][ch];
+    pFilter->History[slot][ch] = sum;
+
+    switch (pFilter->Conf[ch].Mode)
+    {
+      case USBPD_ADC_FILTER_AVERAGE:
+        out = ADC_FilterAverage(pFilter, ch, tail, slot);
+        break;
+
+      case USBPD_ADC_FILTER_CIC:
+        out = ADC_FilterCIC(pFilter, ch, pFrames, sum);
+        break;
+
+      case USBPD_ADC_FILTER_IIR:
+        out = ADC_FilterIIR(pFilter, ch, pFrames, sum);
+        break;
+
+      case USBPD_ADC_FILTER_NONE:
+      default:
+        out = tail[0][ch];
+        break;
+    }
+    pOut[ch] = (uint16_t)out;
+  }
+
+  pFilter->Blocks++;
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
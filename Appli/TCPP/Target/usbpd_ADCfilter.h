@@ -0,0 +1,105 @@
+/**
+  ******************************************************************************
+  * File Name          : usbpd_ADCfilter.h
+  * Description        : Block based filtering of ADC frames H file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef ADCFILTER_H
+#define ADCFILTER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Samples of a frame, one filter per slot. Frames are an even number of
+   samples, the SIMD path adds them two by two */
+#define USBPD_ADC_FILTER_MAX_CHANNELS               6u
+
+/* Frames per block: a power of two up to 16. A 16-bit lane holds the block
+   sum of 12-bit samples; wider samples are summed 2^(16 - bits) frames at a
+   time in the lanes, then widened to 32 bits */
+#define USBPD_ADC_FILTER_MAX_LOG2_FRAMES            4u
+
+/* Block sums kept for the moving averages longer than a block: up to
+   2^(Log2Frames + USBPD_ADC_FILTER_LOG2_HISTORY) frames */
+#define USBPD_ADC_FILTER_LOG2_HISTORY               4u
+#define USBPD_ADC_FILTER_HISTORY                    (1u << USBPD_ADC_FILTER_LOG2_HISTORY)
+
+#define USBPD_ADC_FILTER_CIC_MAX_ORDER              3u
+#define USBPD_ADC_FILTER_IIR_MAX_SHIFT              12u
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  USBPD_ADC_FILTER_NONE = 0u,  /* Last sample of the block                               */
+  USBPD_ADC_FILTER_AVERAGE,    /* Moving average of the last 2^Param frames              */
+  USBPD_ADC_FILTER_CIC,        /* CIC of order Param (1 to 3), decimated by the block    */
+  USBPD_ADC_FILTER_IIR         /* y += (x - y) / 2^Param, time constant ~2^Param frames  */
+} USBPD_ADC_FilterModeTypeDef;
+
+typedef enum
+{
+  USBPD_ADC_FILTER_OK = 0u,
+  USBPD_ADC_FILTER_ERROR
+} USBPD_ADC_FilterStatusTypeDef;
+
+typedef struct
+{
+  USBPD_ADC_FilterModeTypeDef Mode;
+  uint8_t                     Param;
+} USBPD_ADC_FilterConfTypeDef;
+
+typedef struct
+{
+  uint32_t FrameSize;                                        /* Samples per frame, even             */
+  uint32_t NbChannels;                                       /* Filtered slots, first of each frame */
+  uint32_t Log2Frames;                                       /* Frames per block = 2^Log2Frames     */
+  uint32_t Blocks;                                           /* Blocks filtered, History position   */
+  uint8_t  SampleBits[USBPD_ADC_FILTER_MAX_CHANNELS];        /* Significant bits of a sample        */
+  uint8_t  Log2Lane[USBPD_ADC_FILTER_MAX_CHANNELS / 2u];     /* Lane sums of 2^n frames, 0: scalar */
+  USBPD_ADC_FilterConfTypeDef Conf[USBPD_ADC_FILTER_MAX_CHANNELS];
+  uint8_t  Warmup[USBPD_ADC_FILTER_MAX_CHANNELS];            /* Blocks before the state is usable   */
+  uint32_t State[USBPD_ADC_FILTER_MAX_CHANNELS][USBPD_ADC_FILTER_CIC_MAX_ORDER]; /* CIC integrators, IIR output */
+  uint32_t Comb[USBPD_ADC_FILTER_MAX_CHANNELS][USBPD_ADC_FILTER_CIC_MAX_ORDER];  /* CIC comb delays   */
+  uint32_t History[USBPD_ADC_FILTER_HISTORY][USBPD_ADC_FILTER_MAX_CHANNELS];     /* Block sums        */
+} USBPD_ADC_FilterTypeDef;
+
+/* Exported functions --------------------------------------------------------*/
+USBPD_ADC_FilterStatusTypeDef USBPD_ADC_FilterInit(USBPD_ADC_FilterTypeDef *pFilter, uint32_t FrameSize,
+                                                   uint32_t NbChannels, uint32_t NbFrames, const uint8_t *pSampleBits,
+                                                   const USBPD_ADC_FilterConfTypeDef *pConf);
+USBPD_ADC_FilterStatusTypeDef USBPD_ADC_FilterConfig(USBPD_ADC_FilterTypeDef *pFilter, uint32_t Channel,
+                                                     const USBPD_ADC_FilterConfTypeDef *pConf);
+void USBPD_ADC_FilterBlock(USBPD_ADC_FilterTypeDef *pFilter, const uint16_t *pFrames, uint16_t *pOut);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADCFILTER_H */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -15,74 +15,230 @@
   ******************************************************************************
   */
 
+#include "main.h"
 #include "usbpd_ADCnoPD.h"
 
-/* Check DMA Usage */
-
-/* Check same ADC for all */
+extern ADC_HandleTypeDef            hadc1;
+extern ADC_HandleTypeDef            hadc2;
 
-/* Common ADC for All 3(SRC) or 4(DRP) Channels :  */
-#define	ADC_INSTANCE
+static ADC_OversamplingConfTypeDef  ADC_Oversampling =
+{
+  USBNOPD_ADC_OVS_LOG2_RATIO, {USBNOPD_ADC_OVS_SHIFT_MASTER, USBNOPD_ADC_OVS_SHIFT_SLAVE}
+};
 
-#define ADC_CC1_CHANNEL	            ADC_CHANNEL_
-#define ADC_CC2_CHANNEL	            ADC_CHANNEL_
-#define ADC_VBUS_NOPD_CHANNEL       ADC_CHANNEL_2
-#define ADC_VPROV_NOPD_CHANNEL      ADC_CHANNEL_
-#define ADC_ISENSE_NOPD_CHANNEL     ADC_CHANNEL_6
+static void ADC_Oversampling_Init(ADC_HandleTypeDef *hadc, uint32_t Log2Ratio, uint32_t Shift);
 
-#define ADC_DMA
-#define ADC_DMA_CHANNEL
+/**
+  * @brief  Program the regular sequencer of both ADCs, ranks as listed in usbpd_ADCnoPD.h.
+  * @note   Dual simultaneous mode requires the same sampling time on both ADCs at each rank.
+  * @param  none
+  * @retval none
+  */
+void ADC_Channels_Init(void)
+{
+  static const uint32_t master_channels[USBNOPD_ADC_RANKS] =
+  {
+    ADC_CC1_CHANNEL, ADC_ISENSE_NOPD_CHANNEL, USBNOPD_ADC_RANK3_MASTER_CHANNEL
+  };
+  static const uint32_t slave_channels[USBNOPD_ADC_RANKS] =
+  {
+    ADC_CC2_CHANNEL, ADC_VBUS_NOPD_CHANNEL, ADC_VBUS_NOPD_CHANNEL
+  };
+  static const uint32_t ranks[USBNOPD_ADC_RANKS] =
+  {
+    ADC_REGULAR_RANK_1, ADC_REGULAR_RANK_2, ADC_REGULAR_RANK_3
+  };
+  ADC_ChannelConfTypeDef sConfig = {0};
+
+  sConfig.SamplingTime = USBNOPD_ADC_SAMPLETIME;
+  sConfig.SingleDiff = ADC_SINGLE_ENDED;
+  sConfig.OffsetNumber = ADC_OFFSET_NONE;
+  sConfig.Offset = 0;
+  sConfig.OffsetSign = ADC_OFFSET_SIGN_NEGATIVE;
+
+  for (uint32_t i = 0u; i < USBNOPD_ADC_RANKS; i++)
+  {
+    sConfig.Rank = ranks[i];
+
+    sConfig.Channel = master_channels[i];
+    if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    sConfig.Channel = slave_channels[i];
+    if (HAL_ADC_ConfigChannel(&hadc2, &sConfig) != HAL_OK)
+    {
+      Error_Handler();
+    }
+  }
+}
 
-extern ADC_HandleTypeDef            hadc1;
-extern ADC_HandleTypeDef            hadc2;
-extern DMA_HandleTypeDef            handle_GPDMA1_Channel0;
-extern DMA_HandleTypeDef            handle_GPDMA1_Channel1;
+/**
+  * @brief  Program the regular oversampler of one ADC, ADC disabled.
+  * @param  hadc       ADC handle
+  * @param  Log2Ratio  log2 of the conversions per sample, 0 to disable
+  * @param  Shift      right shift of the sum
+  * @retval none
+  */
+static void ADC_Oversampling_Init(ADC_HandleTypeDef *hadc, uint32_t Log2Ratio, uint32_t Shift)
+{
+  static const uint32_t ratios[USBNOPD_ADC_OVS_MAX_LOG2_RATIO + 1u] =
+  {
+    0u, ADC_OVERSAMPLING_RATIO_2, ADC_OVERSAMPLING_RATIO_4, ADC_OVERSAMPLING_RATIO_8, ADC_OVERSAMPLING_RATIO_16,
+    ADC_OVERSAMPLING_RATIO_32, ADC_OVERSAMPLING_RATIO_64, ADC_OVERSAMPLING_RATIO_128, ADC_OVERSAMPLING_RATIO_256
+  };
+  static const uint32_t shifts[USBNOPD_ADC_OVS_MAX_LOG2_RATIO + 1u] =
+  {
+    ADC_RIGHTBITSHIFT_NONE, ADC_RIGHTBITSHIFT_1, ADC_RIGHTBITSHIFT_2, ADC_RIGHTBITSHIFT_3, ADC_RIGHTBITSHIFT_4,
+    ADC_RIGHTBITSHIFT_5, ADC_RIGHTBITSHIFT_6, ADC_RIGHTBITSHIFT_7, ADC_RIGHTBITSHIFT_8
+  };
+
+  hadc->Init.OversamplingMode = (Log2Ratio != 0u) ? ENABLE : DISABLE;
+  hadc->Init.Oversampling.Ratio = ratios[Log2Ratio];
+  hadc->Init.Oversampling.RightBitShift = shifts[Shift];
+  hadc->Init.Oversampling.TriggeredMode = ADC_TRIGGEREDMODE_SINGLE_TRIGGER;
+  hadc->Init.Oversampling.OversamplingStopReset = ADC_REGOVERSAMPLING_CONTINUED_MODE;
+  if (HAL_ADC_Init(hadc) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
 
+/**
+  * @brief  Calibrate both ADCs and start the dual mode sequencer on the circular DMA buffer.
+  * @note   Only the master DMA channel is used: each transfer moves one rank of both
+  *         ADCs from the common data register. Does nothing if already running.
+  *         The oversampler is programmed here, see ADC_SetOversampling().
+  * @param  none
+  * @retval none
+  */
+void ADC_Start(void)
+{
+  if ((HAL_ADC_GetState(&hadc1) & HAL_ADC_STATE_REG_BUSY) != 0u)
+  {
+    return;
+  }
+
+  ADC_Oversampling_Init(&hadc1, ADC_Oversampling.Log2Ratio, ADC_Oversampling.Shift[0]);
+  ADC_Oversampling_Init(&hadc2, ADC_Oversampling.Log2Ratio, ADC_Oversampling.Shift[1]);
+  ADC_Channels_Init();
+
+  (void)HAL_ADCEx_Calibration_Start(&hadc1, ADC_SINGLE_ENDED);
+  (void)HAL_ADCEx_Calibration_Start(&hadc2, ADC_SINGLE_ENDED);
+
+  /* Length in words, one per rank */
+  if (HAL_ADCEx_MultiModeStart_DMA(&hadc1, (uint32_t *)USBnoPD_adc_buffer,
+                                   USBNOPD_ADC_BUFFER_SIZE / 2u) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
 
 /**
-  *
+  * @brief  Change the oversampling ratio and shifts, restarting the ADCs if they run.
+  * @note   A higher ratio trades frame rate (and DMA interrupts) for bits,
+  *         see usbpd_ADCnoPD.h for the valid range. The DMA restarts at the
+  *         beginning of the buffer: the caller keeps the DMA interrupt masked
+  *         until it is ready for frames of the new width.
+  * @param  pConf  ratio and per instance shifts
+  * @retval HAL_OK, HAL_ERROR if the samples would not be 12 to 16 bits or the ADCs do not stop
   */
+HAL_StatusTypeDef ADC_SetOversampling(const ADC_OversamplingConfTypeDef *pConf)
+{
+  uint32_t running = ((HAL_ADC_GetState(&hadc1) & HAL_ADC_STATE_REG_BUSY) != 0u) ? 1u : 0u;
+
+  if (pConf->Log2Ratio > USBNOPD_ADC_OVS_MAX_LOG2_RATIO)
+  {
+    return HAL_ERROR;
+  }
+  for (uint32_t i = 0u; i < USBNOPD_ADC_INSTANCES; i++)
+  {
+    if ((pConf->Shift[i] > pConf->Log2Ratio) ||
+        (pConf->Log2Ratio > (pConf->Shift[i] + USBNOPD_ADC_OVS_MAX_EXTRA_BITS)))
+    {
+      return HAL_ERROR;
+    }
+  }
+
+  if ((running == 1u) && (HAL_ADCEx_MultiModeStop_DMA(&hadc1) != HAL_OK))
+  {
+    return HAL_ERROR;
+  }
+
+  ADC_Oversampling = *pConf;
+
+  if (running == 1u)
+  {
+    ADC_Start();
+  }
+
+  return HAL_OK;
+}
 
-void ADC_Channels_Init(void)
+/**
+  * @brief  Current oversampling ratio and shifts.
+  * @param  pConf  filled with the configuration
+  * @retval none
+  */
+void ADC_GetOversampling(ADC_OversamplingConfTypeDef *pConf)
 {
-  ADC_ChannelConfTypeDef sConfig;
-   /** Configure for the selected ADC regular channel its corresponding rank in the sequencer and its sample time.
+  *pConf = ADC_Oversampling;
+}
+
+/**
+  * @brief  Hand a completed half of the DMA buffer to the application.
+  * @param  pFrames  first sample of the half, in DMA order
+  * @retval none
   */
-  /*
-  sConfig.Channel = ADC_CC1_CHANNEL;
-  sConfig.Rank = 1;
-  sConfig.SamplingTime = LL_ADC_GetChannelSamplingTime(,1);
-  HAL_ADC_ConfigChannel(&h, &sConfig);
-
-  sConfig.Channel = ADC_CC2_CHANNEL;
-  sConfig.Rank = 2;
-  HAL_ADC_ConfigChannel(&h, &sConfig);
-
-  sConfig.Channel = ADC_VPROV_NOPD_CHANNEL;
-    sConfig.Rank = 5;
-    HAL_ADC_ConfigChannel(&h, &sConfig);
-*/
-  sConfig.Channel = ADC_VBUS_NOPD_CHANNEL;
-  sConfig.SamplingTime = LL_ADC_SAMPLINGTIME_24CYCLES_5;
-  sConfig.Rank = 1;
-  HAL_ADC_ConfigChannel(&hadc1, &sConfig);
-  //HAL_ADCEx_MultiModeConfigChannel(hadc, pMultimode)
-
-  sConfig.Channel = ADC_ISENSE_NOPD_CHANNEL;
-  sConfig.SamplingTime = LL_ADC_SAMPLINGTIME_24CYCLES_5;
-  sConfig.Rank = 1;
-  HAL_ADC_ConfigChannel(&hadc2, &sConfig);
+static void ADC_DeliverHalf(uint16_t *pFrames)
+{
+  /* The DMA writes behind the D-cache: drop stale lines before reading.
+     Halves are aligned on and sized in whole cache lines */
+  SCB_InvalidateDCache_by_Addr((uint32_t *)pFrames, (int32_t)(USBNOPD_ADC_HALF_SIZE * sizeof(uint16_t)));
 
+  ADC_FramesCallback(pFrames, USBNOPD_ADC_FRAMES_PER_HALF);
+}
 
+/**
+  * @brief  First half of the buffer filled, the DMA moves on to the second one.
+  * @param  hadc ADC handle
+  * @retval none
+  */
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc)
+{
+  if (hadc->Instance == ADC1)
+  {
+    ADC_DeliverHalf(&USBnoPD_adc_buffer[0]);
+  }
 }
 
-void ADC_Start(void)
+/**
+  * @brief  Second half of the buffer filled, the DMA wraps to the first one.
+  * @param  hadc ADC handle
+  * @retval none
+  */
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+  if (hadc->Instance == ADC1)
+  {
+    ADC_DeliverHalf(&USBnoPD_adc_buffer[USBNOPD_ADC_HALF_SIZE]);
+  }
+}
+
+/**
+  * @brief  Whole frames converted, called from the DMA interrupt.
+  * @note   The frames stay valid until the DMA comes back to them, i.e. for
+  *         USBNOPD_ADC_FRAMES_PER_HALF frame periods.
+  * @param  pFrames   NbFrames frames of USBNOPD_ADC_FRAME_SIZE samples
+  * @param  NbFrames  number of frames
+  * @retval none
+  */
+__weak void ADC_FramesCallback(const uint16_t *pFrames, uint32_t NbFrames)
 {
-  //HAL_ADC_Start_DMA(&h,(uint32_t *)&USBnoPD_adc_buffer, USBNOPD_ADC_USED_CHANNELS);
-	HAL_ADCEx_Calibration_Start(&hadc1, ADC_SINGLE_ENDED);
-	HAL_ADCEx_Calibration_Start(&hadc2, ADC_SINGLE_ENDED);
-	HAL_ADC_Start(&hadc2);
-	HAL_ADCEx_MultiModeStart_DMA(&hadc1, (uint32_t *)&USBnoPD_adc_buffer, USBNOPD_ADC_USED_CHANNELS);
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pFrames);
+  UNUSED(NbFrames);
 }
 
 /**
@@ -25,6 +25,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32h7rsxx.h"
 #include "stm32h7rsxx_hal.h"
+#include "main.h"                                   /* Board ADC channels */
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,10 +33,115 @@ extern "C" {
 
 #define USBNOPD_ADC_USED_CHANNELS                   5u                      /* Number of ADC channels used (USBnoPD Mode*/
 #define VISENSE_ADC_BUFFER_SIZE	                    1u
-/* ADC_Buffer values */
+
+/* Regular sequencer, run by ADC1 (master) and ADC2 (slave) in dual regular
+   simultaneous mode. Each rank converts one channel on both ADCs at once and
+   the common data register packs them in one word, master in the low half:
+     rank 1 : ADC1 CC1    | ADC2 CC2
+     rank 2 : ADC1 ISENSE | ADC2 VBUS
+     rank 3 : ADC1 VPROV  | ADC2 VBUS (spare, same pin as rank 2)
+   CubeMX only routes VBUS (PF13) and ISENSE (PF12): the CC lines have no
+   default here and come with the board, in main.h (this board: channel 3 of
+   ADC1, channel 5 of ADC2) or on the compiler command line. A board without
+   them stops here, as the port cannot tell a sink from an open plug. VPROV
+   may stay undefined: rank 3 of ADC1 then converts ISENSE again and the
+   state machine ignores it. */
+#if !defined(ADC_CC1_CHANNEL) || !defined(ADC_CC2_CHANNEL)
+#error "Define ADC_CC1_CHANNEL (ADC1) and ADC_CC2_CHANNEL (ADC2) for the board"
+#endif /* ADC_CC1_CHANNEL || ADC_CC2_CHANNEL */
+#ifndef ADC_VBUS_NOPD_CHANNEL
+#define ADC_VBUS_NOPD_CHANNEL                       ADC_CHANNEL_2           /* ADC2, PF13 */
+#endif /* ADC_VBUS_NOPD_CHANNEL */
+#ifndef ADC_ISENSE_NOPD_CHANNEL
+#define ADC_ISENSE_NOPD_CHANNEL                     ADC_CHANNEL_6           /* ADC1, PF12 */
+#endif /* ADC_ISENSE_NOPD_CHANNEL */
+#ifdef ADC_VPROV_NOPD_CHANNEL
+#define USBNOPD_ADC_VPROV_ROUTED                    1u
+#define USBNOPD_ADC_RANK3_MASTER_CHANNEL            ADC_VPROV_NOPD_CHANNEL
+#else
+#define USBNOPD_ADC_VPROV_ROUTED                    0u                      /* VPROV not monitored */
+#define USBNOPD_ADC_RANK3_MASTER_CHANNEL            ADC_ISENSE_NOPD_CHANNEL /* Spare, same pin as rank 2 */
+#endif /* ADC_VPROV_NOPD_CHANNEL */
+
+#define USBNOPD_ADC_RANKS                           3u                      /* Sequencer length of each ADC */
+#define USBNOPD_ADC_FRAME_SIZE                      (2u * USBNOPD_ADC_RANKS) /* Samples in a frame, one per rank and ADC */
+
+/* Frames in each half of the circular DMA buffer, i.e. per callback. Keep
+   a half a multiple of the 32-byte D-cache line (8 frames) */
+#ifndef USBNOPD_ADC_FRAMES_PER_HALF
+#define USBNOPD_ADC_FRAMES_PER_HALF                 16u
+#endif /* USBNOPD_ADC_FRAMES_PER_HALF */
+
+#define USBNOPD_ADC_HALF_SIZE                       (USBNOPD_ADC_FRAMES_PER_HALF * USBNOPD_ADC_FRAME_SIZE)
+#define USBNOPD_ADC_BUFFER_SIZE                     (2u * USBNOPD_ADC_HALF_SIZE)
+
+#if ((USBNOPD_ADC_FRAMES_PER_HALF == 0u) || ((USBNOPD_ADC_FRAMES_PER_HALF % 8u) != 0u))
+#error "USBNOPD_ADC_FRAMES_PER_HALF must be a non-zero multiple of 8"
+#endif
+
+/* Resolution of a conversion */
+#define USBNOPD_ADC_RESOLUTION_BITS                 12u
+
+/* Hardware oversampler: each rank accumulates 2^Log2Ratio conversions and
+   shifts the sum right, so a sample carries 12 + Log2Ratio - Shift bits.
+   Both ADCs take the same ratio to keep the ranks simultaneous, the shift is
+   per instance. Samples are kept between 12 and 16 bits, a half-word of the
+   common data register: Shift <= Log2Ratio <= Shift + 4.
+   The frame rate is divided by the ratio. By default ADC1 keeps the 2 extra
+   bits of the ratio for ISENSE, ADC2 stays at 12 bits. The filters sum 14-bit
+   samples in packed 16-bit lanes 4 frames at a time, then widen the sums
+   (usbpd_ADCfilter.h); a rank with a 16-bit sample is summed slot by slot. */
+#define USBNOPD_ADC_INSTANCES                       2u                      /* ADC1 (master), ADC2 (slave) */
+#define USBNOPD_ADC_OVS_MAX_LOG2_RATIO              8u                      /* 256 */
+#define USBNOPD_ADC_OVS_MAX_EXTRA_BITS              4u
+#ifndef USBNOPD_ADC_OVS_LOG2_RATIO
+#define USBNOPD_ADC_OVS_LOG2_RATIO                  2u                      /* 4 conversions per sample */
+#endif /* USBNOPD_ADC_OVS_LOG2_RATIO */
+#ifndef USBNOPD_ADC_OVS_SHIFT_MASTER
+#define USBNOPD_ADC_OVS_SHIFT_MASTER                0u                      /* ADC1 (CC1, ISENSE, VPROV): 14 bits */
+#endif /* USBNOPD_ADC_OVS_SHIFT_MASTER */
+#ifndef USBNOPD_ADC_OVS_SHIFT_SLAVE
+#define USBNOPD_ADC_OVS_SHIFT_SLAVE                 2u                      /* ADC2 (CC2, VBUS): 12 bits */
+#endif /* USBNOPD_ADC_OVS_SHIFT_SLAVE */
+
+/* ADC instance of a frame slot: the master fills the low half-words */
+#define USBNOPD_ADC_SLOT_INSTANCE(__SLOT__)         ((__SLOT__) & 1u)
+
+#if (USBNOPD_ADC_OVS_SHIFT_MASTER > USBNOPD_ADC_OVS_LOG2_RATIO) || \
+    (USBNOPD_ADC_OVS_SHIFT_SLAVE > USBNOPD_ADC_OVS_LOG2_RATIO) || \
+    (USBNOPD_ADC_OVS_LOG2_RATIO > (USBNOPD_ADC_OVS_SHIFT_MASTER + USBNOPD_ADC_OVS_MAX_EXTRA_BITS)) || \
+    (USBNOPD_ADC_OVS_LOG2_RATIO > (USBNOPD_ADC_OVS_SHIFT_SLAVE + USBNOPD_ADC_OVS_MAX_EXTRA_BITS)) || \
+    (USBNOPD_ADC_OVS_LOG2_RATIO > USBNOPD_ADC_OVS_MAX_LOG2_RATIO)
+#error "ADC oversampling must give samples of 12 to 16 bits"
+#endif
+
+typedef struct
+{
+  uint32_t Log2Ratio;                               /* 0 (oversampler off) to 8 */
+  uint32_t Shift[USBNOPD_ADC_INSTANCES];            /* Right shift of ADC1 and ADC2 */
+} ADC_OversamplingConfTypeDef;
+
+/* Sample rate: the sequencer free runs (continuous mode), a rank takes the
+   sampling time plus 12.5 cycles of successive approximation at 12 bits,
+   times the oversampling ratio */
+#define USBNOPD_ADC_SAMPLETIME                      ADC_SAMPLETIME_640CYCLES_5
+#define USBNOPD_ADC_RANK_CYCLES                     653u                    /* 640.5 + 12.5 */
+#ifndef USBNOPD_ADC_KERNEL_CLOCK_HZ
+#define USBNOPD_ADC_KERNEL_CLOCK_HZ                 204000000u              /* PLL3R */
+#endif /* USBNOPD_ADC_KERNEL_CLOCK_HZ */
+#define USBNOPD_ADC_PRESCALER                       6u                      /* ADC_CLOCK_ASYNC_DIV6 */
+#define USBNOPD_ADC_FRAME_RATE_HZ(__LOG2RATIO__)    (USBNOPD_ADC_KERNEL_CLOCK_HZ / \
+                                                     ((USBNOPD_ADC_PRESCALER * USBNOPD_ADC_RANKS * \
+                                                       USBNOPD_ADC_RANK_CYCLES) << (__LOG2RATIO__)))
+
+/* ADC_Buffer values: USBNOPD_ADC_BUFFER_SIZE samples, two halves of frames */
 extern uint16_t USBnoPD_adc_buffer[];
 
+void ADC_Channels_Init(void);
 void ADC_Start(void);
+HAL_StatusTypeDef ADC_SetOversampling(const ADC_OversamplingConfTypeDef *pConf);
+void ADC_GetOversampling(ADC_OversamplingConfTypeDef *pConf);
+void ADC_FramesCallback(const uint16_t *pFrames, uint32_t NbFrames);
 
 /**
   * @}
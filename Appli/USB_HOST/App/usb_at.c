@@ -0,0 +1,609 @@
+/**
+  ******************************************************************************
+  * @file           : usb_at.c
+  * @brief          : AT command engine on the CDC reception stream of a
+  *                   modem, or on one CMUX channel of it.
+  *
+  *                   Lines are cut in the receive buffers themselves: a line
+  *                   held by one buffer is handed over in place, only a line
+  *                   split across two buffers is assembled in Line. Each line
+  *                   is classified with one probe of a perfect hash over the
+  *                   final result codes and the 27.007/27.005 URCs, keyed on
+  *                   the text before the colon.
+  *
+  *                   Commands are queued, up to AT_MAX_PENDING, each with its
+  *                   own timeout and tag. The modem runs them one at a time:
+  *                   the next one is sent from the reception of the final
+  *                   result of the previous one, without waiting for the
+  *                   application. Results, information lines, prompts and
+  *                   URCs are reported through the weak callbacks.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_at.h"
+#include "usbh_cdc.h"
+
+/* Private define ------------------------------------------------------------*/
+
+/* Keyword hash: h = h * 259 + c over the key, slot = top 6 bits of
+   h * 0x9E3779B1. The multiplier was searched for so that the keywords of
+   AtKeywords land in distinct slots; search again when adding one. */
+#define AT_HASH_MULT                       259U
+#define AT_HASH_SHIFT                      26U
+#define AT_HASH_SLOTS                      64U
+
+/* Longest keyword, longer keys are not looked up */
+#define AT_KEY_MAX                         12U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  const char                        *pKey;
+  uint8_t                           Length;
+  uint8_t                           Result;           /* AT_RESULT_NONE if not final */
+  uint8_t                           Urc;              /* AT_URC_OTHER if not a URC */
+}
+AT_KeywordTypeDef;
+
+/* Private macro -------------------------------------------------------------*/
+#define AT_KEYWORD(key, result, urc)       { (key), (uint8_t)(sizeof(key) - 1U), (uint8_t)(result), (uint8_t)(urc) }
+
+/* Private variables ---------------------------------------------------------*/
+static const AT_KeywordTypeDef AtKeywords[AT_HASH_SLOTS] =
+{
+  [4]  = AT_KEYWORD("+CMS ERROR",  AT_RESULT_CMS_ERROR,   AT_URC_OTHER),
+  [5]  = AT_KEYWORD("BUSY",        AT_RESULT_BUSY,        AT_URC_OTHER),
+  [8]  = AT_KEYWORD("+CUSD",       AT_RESULT_NONE,        AT_URC_CUSD),
+  [11] = AT_KEYWORD("NO CARRIER",  AT_RESULT_NO_CARRIER,  AT_URC_NO_CARRIER),
+  [13] = AT_KEYWORD("+CIEV",       AT_RESULT_NONE,        AT_URC_CIEV),
+  [17] = AT_KEYWORD("+CME ERROR",  AT_RESULT_CME_ERROR,   AT_URC_OTHER),
+  [19] = AT_KEYWORD("ERROR",       AT_RESULT_ERROR,       AT_URC_OTHER),
+  [26] = AT_KEYWORD("+CTZV",       AT_RESULT_NONE,        AT_URC_CTZV),
+  [28] = AT_KEYWORD("NO DIALTONE", AT_RESULT_NO_DIALTONE, AT_URC_OTHER),
+  [30] = AT_KEYWORD("+CCWA",       AT_RESULT_NONE,        AT_URC_CCWA),
+  [34] = AT_KEYWORD("+CGEV",       AT_RESULT_NONE,        AT_URC_CGEV),
+  [35] = AT_KEYWORD("+CSSI",       AT_RESULT_NONE,        AT_URC_CSSI),
+  [36] = AT_KEYWORD("+CDS",        AT_RESULT_NONE,        AT_URC_CDS),
+  [38] = AT_KEYWORD("+CMTI",       AT_RESULT_NONE,        AT_URC_CMTI),
+  [41] = AT_KEYWORD("+CEREG",      AT_RESULT_NONE,        AT_URC_CEREG),
+  [42] = AT_KEYWORD("+CGREG",      AT_RESULT_NONE,        AT_URC_CGREG),
+  [43] = AT_KEYWORD("RING",        AT_RESULT_NONE,        AT_URC_RING),
+  [46] = AT_KEYWORD("+CBM",        AT_RESULT_NONE,        AT_URC_CBM),
+  [51] = AT_KEYWORD("+CLIP",       AT_RESULT_NONE,        AT_URC_CLIP),
+  [52] = AT_KEYWORD("+CMT",        AT_RESULT_NONE,        AT_URC_CMT),
+  [53] = AT_KEYWORD("+CRING",      AT_RESULT_NONE,        AT_URC_CRING),
+  [57] = AT_KEYWORD("CONNECT",     AT_RESULT_CONNECT,     AT_URC_OTHER),
+  [58] = AT_KEYWORD("+CTZE",       AT_RESULT_NONE,        AT_URC_CTZE),
+  [59] = AT_KEYWORD("NO ANSWER",   AT_RESULT_NO_ANSWER,   AT_URC_OTHER),
+  [60] = AT_KEYWORD("OK",          AT_RESULT_OK,          AT_URC_OTHER),
+  [61] = AT_KEYWORD("+CSSU",       AT_RESULT_NONE,        AT_URC_CSSU),
+  [63] = AT_KEYWORD("+CREG",       AT_RESULT_NONE,        AT_URC_CREG),
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static inline uint32_t AT_Now(AT_HandleTypeDef *pat);
+static const AT_KeywordTypeDef *AT_Lookup(const uint8_t *pkey, uint32_t length);
+static int32_t AT_ParseCode(const uint8_t *pline, uint32_t length, uint32_t offset);
+static uint32_t AT_Write(AT_HandleTypeDef *pat, const uint8_t *pbuff, uint32_t length);
+static void AT_Kick(AT_HandleTypeDef *pat);
+static void AT_Complete(AT_HandleTypeDef *pat, AT_ResultTypeDef result, int32_t code);
+static void AT_Dispatch(AT_HandleTypeDef *pat, const uint8_t *pline, uint32_t length);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Host timer of the root port, in SOF ticks.
+  */
+static inline uint32_t AT_Now(AT_HandleTypeDef *pat)
+{
+  return pat->phost->pRoot->Timer;
+}
+
+/**
+  * @brief  Look a key up in the keyword table.
+  * @param  pkey: Key, not terminated
+  * @param  length: Key length
+  * @retval Keyword, NULL when the key is not one
+  */
+static const AT_KeywordTypeDef *AT_Lookup(const uint8_t *pkey, uint32_t length)
+{
+  const AT_KeywordTypeDef *pkw;
+  uint32_t hash = 0U;
+  uint32_t idx;
+
+  if ((length < 2U) || (length > AT_KEY_MAX))
+  {
+    return NULL;
+  }
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    hash = (hash * AT_HASH_MULT) + pkey[idx];
+  }
+
+  pkw = &AtKeywords[(hash * 0x9E3779B1U) >> AT_HASH_SHIFT];
+
+  if ((pkw->Length != length) || (USBH_memcmp(pkw->pKey, pkey, length) != 0))
+  {
+    return NULL;
+  }
+
+  return pkw;
+}
+
+/**
+  * @brief  Numeric value of a +CME ERROR or +CMS ERROR line.
+  * @param  pline: Line
+  * @param  length: Line length
+  * @param  offset: Offset of the colon
+  * @retval Value, -1 when verbose
+  */
+static int32_t AT_ParseCode(const uint8_t *pline, uint32_t length, uint32_t offset)
+{
+  int32_t code = 0;
+  uint32_t idx = offset + 1U;
+
+  while ((idx < length) && (pline[idx] == (uint8_t)' '))
+  {
+    idx++;
+  }
+
+  if ((idx == length) || (pline[idx] < (uint8_t)'0') || (pline[idx] > (uint8_t)'9'))
+  {
+    return -1;
+  }
+
+  while ((idx < length) && (pline[idx] >= (uint8_t)'0') && (pline[idx] <= (uint8_t)'9') && (code < 100000))
+  {
+    code = (code * 10) + (int32_t)(pline[idx] - (uint8_t)'0');
+    idx++;
+  }
+
+  return code;
+}
+
+/**
+  * @brief  Queue bytes to the modem, on the CDC ring or the CMUX channel.
+  * @param  pat: AT engine
+  * @param  pbuff: Data
+  * @param  length: Data length
+  * @retval Bytes queued, the rest to be sent later
+  */
+static uint32_t AT_Write(AT_HandleTypeDef *pat, const uint8_t *pbuff, uint32_t length)
+{
+  if (pat->pmux != NULL)
+  {
+    return CMUX_Write(pat->pmux, pat->Dlci, pbuff, length);
+  }
+
+  return USBH_CDC_Write(pat->phost, pbuff, MIN(length, USBH_CDC_GetTxFree(pat->phost)));
+}
+
+/**
+  * @brief  Send what is left of the command at the head of the queue, and
+  *         start its timer once all of it is queued.
+  * @param  pat: AT engine
+  * @retval None
+  */
+static void AT_Kick(AT_HandleTypeDef *pat)
+{
+  AT_CommandTypeDef *pcmd;
+
+  if (pat->Head == pat->Tail)
+  {
+    return;
+  }
+
+  pcmd = &pat->Queue[pat->Tail & (AT_MAX_PENDING - 1U)];
+
+  if (pcmd->Sent < pcmd->Length)
+  {
+    pcmd->Sent += (uint16_t)AT_Write(pat, &pcmd->Cmd[pcmd->Sent], (uint32_t)pcmd->Length - pcmd->Sent);
+
+    if (pcmd->Sent == pcmd->Length)
+    {
+      pcmd->Timer = AT_Now(pat);
+    }
+  }
+}
+
+/**
+  * @brief  The command at the head of the queue ended: report it, then send
+  *         the next one at once. The slot is freed first so that the
+  *         callback may queue another command.
+  * @param  pat: AT engine
+  * @param  result: Final result
+  * @param  code: Error value of +CME ERROR and +CMS ERROR
+  * @retval None
+  */
+static void AT_Complete(AT_HandleTypeDef *pat, AT_ResultTypeDef result, int32_t code)
+{
+  uint32_t tag = pat->Queue[pat->Tail & (AT_MAX_PENDING - 1U)].Tag;
+
+  pat->Tail++;
+  AT_ResultCallback(pat, tag, result, code);
+  AT_Kick(pat);
+}
+
+/**
+  * @brief  Act on one line, CR and LF removed.
+  * @param  pat: AT engine
+  * @param  pline: Line, in the receive buffer or in Line
+  * @param  length: Line length, not 0
+  * @retval None
+  */
+static void AT_Dispatch(AT_HandleTypeDef *pat, const uint8_t *pline, uint32_t length)
+{
+  const AT_KeywordTypeDef *pkw;
+  const uint8_t *pcolon;
+  AT_CommandTypeDef *pcmd = NULL;
+  uint32_t key;
+
+  pat->Lines++;
+
+  /* The key is the text before the colon, or the whole line, or the first
+     word of it: "CONNECT 115200" */
+  pcolon = (const uint8_t *)memchr(pline, ':', MIN(length, AT_KEY_MAX + 1U));
+  key = (pcolon != NULL) ? (uint32_t)(pcolon - pline) : length;
+  pkw = AT_Lookup(pline, key);
+
+  if ((pkw == NULL) && (pcolon == NULL))
+  {
+    pcolon = (const uint8_t *)memchr(pline, ' ', MIN(length, AT_KEY_MAX + 1U));
+    pkw = (pcolon != NULL) ? AT_Lookup(pline, (uint32_t)(pcolon - pline)) : NULL;
+    pcolon = NULL;
+  }
+
+  if (pat->Head != pat->Tail)
+  {
+    pcmd = &pat->Queue[pat->Tail & (AT_MAX_PENDING - 1U)];
+
+    /* Nothing answers a command before it is sent in full */
+    pcmd = (pcmd->Sent == pcmd->Length) ? pcmd : NULL;
+  }
+
+  if (pcmd != NULL)
+  {
+    if ((pkw != NULL) && (pkw->Result != (uint8_t)AT_RESULT_NONE))
+    {
+      AT_Complete(pat, (AT_ResultTypeDef)pkw->Result,
+                  (pcolon != NULL) ? AT_ParseCode(pline, length, key) : 0);
+      return;
+    }
+
+    /* Echo of the command, with ATE1 */
+    if ((length >= 2U) && ((pline[0] | 0x20U) == (uint8_t)'a') && ((pline[1] | 0x20U) == (uint8_t)'t'))
+    {
+      return;
+    }
+
+    /* With a prefix, only the lines starting with it belong to the
+       command; without, every line but the known URCs */
+    if (pcmd->PrefixLength != 0U)
+    {
+      if ((length >= pcmd->PrefixLength) && (USBH_memcmp(pline, pcmd->pPrefix, pcmd->PrefixLength) == 0))
+      {
+        AT_InfoCallback(pat, pcmd->Tag, pline, length);
+        return;
+      }
+    }
+    else if ((pkw == NULL) || (pkw->Urc == (uint8_t)AT_URC_OTHER))
+    {
+      AT_InfoCallback(pat, pcmd->Tag, pline, length);
+      return;
+    }
+    else
+    {
+      /* .. */
+    }
+  }
+
+  AT_UrcCallback(pat, (pkw != NULL) ? (AT_UrcTypeDef)pkw->Urc : AT_URC_OTHER, pline, length);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start an AT engine. The reception stream data, or the data of
+  *         the CMUX channel, must be passed to AT_Input.
+  * @param  pat: AT engine
+  * @param  phost: CDC device
+  * @param  pmux: Multiplexer on the device, NULL for the plain CDC stream
+  * @param  dlci: CMUX channel, ignored without a multiplexer
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef AT_Init(AT_HandleTypeDef *pat, USBH_HandleTypeDef *phost,
+                           CMUX_HandleTypeDef *pmux, uint8_t dlci)
+{
+  if ((phost == NULL) || ((pmux != NULL) && ((dlci == 0U) || (dlci >= CMUX_NUM_CHANNELS))))
+  {
+    return USBH_FAIL;
+  }
+
+  (void)USBH_memset(pat, 0, sizeof(AT_HandleTypeDef));
+
+  pat->phost = phost;
+  pat->pmux = pmux;
+  pat->Dlci = dlci;
+
+  /* The SOF counter of a high-speed root port runs at 8 kHz */
+  pat->TicksPerMs = (phost->pRoot->device.speed == (uint8_t)USBH_SPEED_HIGH) ? 8U : 1U;
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Queue a command. It is sent at once when the modem is idle,
+  *         otherwise on the final result of the command before it.
+  * @param  pat: AT engine
+  * @param  pcmd: Command, "AT" included, without CR; copied
+  * @param  pprefix: Start of its information lines, as "+CSQ:", or NULL to
+  *         take every line that is not a known URC; kept by reference
+  * @param  timeout_ms: Time allowed for the final result, once sent
+  * @param  tag: Passed back to the callbacks of the command
+  * @retval USBH_OK, USBH_BUSY when the queue is full, USBH_FAIL when the
+  *         command is too long
+  */
+USBH_StatusTypeDef AT_Send(AT_HandleTypeDef *pat, const char *pcmd, const char *pprefix,
+                           uint32_t timeout_ms, uint32_t tag)
+{
+  AT_CommandTypeDef *pslot;
+  uint32_t length = (uint32_t)strlen(pcmd);
+
+  if (length > AT_MAX_CMD_SIZE)
+  {
+    return USBH_FAIL;
+  }
+
+  if ((pat->Head - pat->Tail) >= AT_MAX_PENDING)
+  {
+    return USBH_BUSY;
+  }
+
+  pslot = &pat->Queue[pat->Head & (AT_MAX_PENDING - 1U)];
+
+  (void)USBH_memcpy(pslot->Cmd, pcmd, length);
+  pslot->Cmd[length] = (uint8_t)'\r';
+  pslot->Length = (uint16_t)(length + 1U);
+  pslot->Sent = 0U;
+  pslot->pPrefix = pprefix;
+  pslot->PrefixLength = (pprefix != NULL) ? (uint32_t)strlen(pprefix) : 0U;
+  pslot->Timeout = timeout_ms * pat->TicksPerMs;
+  pslot->Tag = tag;
+
+  pat->Head++;
+  AT_Kick(pat);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Send raw data after a prompt, as the PDU of AT+CMGS followed by
+  *         Ctrl-Z. The command keeps waiting for its final result.
+  * @param  pat: AT engine
+  * @param  pbuff: Data
+  * @param  length: Data length
+  * @retval Bytes queued
+  */
+uint32_t AT_SendData(AT_HandleTypeDef *pat, const uint8_t *pbuff, uint32_t length)
+{
+  return AT_Write(pat, pbuff, length);
+}
+
+/**
+  * @brief  Commands queued, the one waiting for its final result included.
+  * @param  pat: AT engine
+  * @retval Count
+  */
+uint32_t AT_GetPending(AT_HandleTypeDef *pat)
+{
+  return pat->Head - pat->Tail;
+}
+
+/**
+  * @brief  Cut received data into lines, to be called from
+  *         USBH_CDC_ReceiveStreamCallback before the buffer is released, or
+  *         from CMUX_DataCallback. Lines are handled as they complete.
+  * @param  pat: AT engine
+  * @param  pbuff: Received data
+  * @param  length: Received length
+  * @retval None
+  */
+void AT_Input(AT_HandleTypeDef *pat, const uint8_t *pbuff, uint32_t length)
+{
+  const uint8_t *pend = &pbuff[length];
+  const uint8_t *pline = pbuff;
+  const uint8_t *plf;
+  uint32_t count;
+
+  while (pline < pend)
+  {
+    /* "> " of AT+CMGS and the like has no line end; the space may come in
+       the next buffer */
+    if (pat->Prompt != 0U)
+    {
+      pat->Prompt = 0U;
+      pline += (pline[0] == (uint8_t)' ') ? 1U : 0U;
+      continue;
+    }
+
+    if ((pat->LineLength == 0U) && (pat->Overflow == 0U) && (pline[0] == (uint8_t)'>') &&
+        (pat->Head != pat->Tail))
+    {
+      AT_PromptCallback(pat, pat->Queue[pat->Tail & (AT_MAX_PENDING - 1U)].Tag);
+      pat->Prompt = 1U;
+      pline++;
+      continue;
+    }
+
+    plf = (const uint8_t *)memchr(pline, '\n', (size_t)(pend - pline));
+    count = (uint32_t)(((plf != NULL) ? plf : pend) - pline);
+
+    if ((pat->LineLength != 0U) || (pat->Overflow != 0U) || (plf == NULL))
+    {
+      /* Line split across buffers: assembled in Line */
+      if ((pat->Overflow == 0U) && (((uint32_t)pat->LineLength + count) <= AT_MAX_LINE_SIZE))
+      {
+        pat->Copies += (pat->LineLength == 0U) ? 1U : 0U;
+        (void)USBH_memcpy(&pat->Line[pat->LineLength], pline, count);
+        pat->LineLength += (uint16_t)count;
+      }
+      else if (pat->Overflow == 0U)
+      {
+        pat->Overflow = 1U;
+        pat->Overflows++;
+      }
+      else
+      {
+        /* .. */
+      }
+
+      if (plf == NULL)
+      {
+        return;
+      }
+
+      pline = (pat->Overflow == 0U) ? pat->Line : NULL;
+      count = pat->LineLength;
+      pat->LineLength = 0U;
+      pat->Overflow = 0U;
+    }
+
+    /* CR of the line end, and of the echo */
+    if (pline != NULL)
+    {
+      while ((count != 0U) && (pline[0] == (uint8_t)'\r'))
+      {
+        pline++;
+        count--;
+      }
+
+      while ((count != 0U) && (pline[count - 1U] == (uint8_t)'\r'))
+      {
+        count--;
+      }
+
+      if (count != 0U)
+      {
+        AT_Dispatch(pat, pline, count);
+      }
+    }
+
+    pline = plf + 1;
+  }
+}
+
+/**
+  * @brief  Command timeouts, and the rest of a command the transmit path
+  *         could not take at once. To be called from the thread running
+  *         USBH_Process.
+  * @param  pat: AT engine
+  * @retval None
+  */
+void AT_Process(AT_HandleTypeDef *pat)
+{
+  AT_CommandTypeDef *pcmd;
+
+  if ((pat->phost == NULL) || (pat->Head == pat->Tail))
+  {
+    return;
+  }
+
+  pcmd = &pat->Queue[pat->Tail & (AT_MAX_PENDING - 1U)];
+
+  if (pcmd->Sent < pcmd->Length)
+  {
+    AT_Kick(pat);
+  }
+  else if ((AT_Now(pat) - pcmd->Timer) >= pcmd->Timeout)
+  {
+    USBH_ErrLog("AT: command %lu timed out", (unsigned long)pcmd->Tag);
+    pat->Timeouts++;
+    AT_Complete(pat, AT_RESULT_TIMEOUT, 0);
+  }
+  else
+  {
+    /* .. */
+  }
+}
+
+/**
+  * @brief  Information line of a command. pline is valid during the call
+  *         only and is not terminated.
+  * @param  pat: AT engine
+  * @param  tag: Tag of the command
+  * @param  pline: Line, CR and LF removed
+  * @param  length: Line length
+  * @retval None
+  */
+__weak void AT_InfoCallback(AT_HandleTypeDef *pat, uint32_t tag,
+                            const uint8_t *pline, uint32_t length)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pat);
+  UNUSED(tag);
+  UNUSED(pline);
+  UNUSED(length);
+}
+
+/**
+  * @brief  Final result of a command. AT_Send may be called from here.
+  * @param  pat: AT engine
+  * @param  tag: Tag of the command
+  * @param  result: Final result, AT_RESULT_TIMEOUT without one
+  * @param  code: Error value of +CME ERROR and +CMS ERROR, -1 if verbose
+  * @retval None
+  */
+__weak void AT_ResultCallback(AT_HandleTypeDef *pat, uint32_t tag,
+                              AT_ResultTypeDef result, int32_t code)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pat);
+  UNUSED(tag);
+  UNUSED(result);
+  UNUSED(code);
+}
+
+/**
+  * @brief  The modem waits for the data of a command: AT_SendData.
+  * @param  pat: AT engine
+  * @param  tag: Tag of the command
+  * @retval None
+  */
+__weak void AT_PromptCallback(AT_HandleTypeDef *pat, uint32_t tag)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pat);
+  UNUSED(tag);
+}
+
+/**
+  * @brief  Unsolicited result code, or any line that belongs to no
+  *         command. pline is valid during the call only and is not
+  *         terminated.
+  * @param  pat: AT engine
+  * @param  urc: Known URC, AT_URC_OTHER for any other line
+  * @param  pline: Line, CR and LF removed
+  * @param  length: Line length
+  * @retval None
+  */
+__weak void AT_UrcCallback(AT_HandleTypeDef *pat, AT_UrcTypeDef urc,
+                           const uint8_t *pline, uint32_t length)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pat);
+  UNUSED(urc);
+  UNUSED(pline);
+  UNUSED(length);
+}
@@ -0,0 +1,154 @@
+/**
+  ******************************************************************************
+  * @file           : usb_at.h
+  * @brief          : Header for usb_at.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_AT_H__
+#define __USB_AT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+#include "usb_cmux.h"
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Commands queued, the one waiting for its final result included */
+#ifndef AT_MAX_PENDING
+#define AT_MAX_PENDING                     4U
+#endif /* AT_MAX_PENDING */
+
+/* Longest command, "AT" included, the terminating CR excluded */
+#ifndef AT_MAX_CMD_SIZE
+#define AT_MAX_CMD_SIZE                    128U
+#endif /* AT_MAX_CMD_SIZE */
+
+/* Longest line held across two receive buffers; longer ones are dropped */
+#ifndef AT_MAX_LINE_SIZE
+#define AT_MAX_LINE_SIZE                   256U
+#endif /* AT_MAX_LINE_SIZE */
+
+#if (AT_MAX_PENDING == 0U) || ((AT_MAX_PENDING & (AT_MAX_PENDING - 1U)) != 0U)
+#error "AT_MAX_PENDING must be a power of two"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Final result of a command */
+typedef enum
+{
+  AT_RESULT_OK = 0U,
+  AT_RESULT_CONNECT,
+  AT_RESULT_ERROR,
+  AT_RESULT_CME_ERROR,                     /* Code: the +CME ERROR value, -1 if verbose */
+  AT_RESULT_CMS_ERROR,                     /* Code: the +CMS ERROR value, -1 if verbose */
+  AT_RESULT_NO_CARRIER,
+  AT_RESULT_BUSY,
+  AT_RESULT_NO_ANSWER,
+  AT_RESULT_NO_DIALTONE,
+  AT_RESULT_TIMEOUT,                       /* No final result within the command timeout */
+  AT_RESULT_NONE,
+}
+AT_ResultTypeDef;
+
+/* Unsolicited result codes told apart by the engine */
+typedef enum
+{
+  AT_URC_OTHER = 0U,                       /* Any other line outside a command */
+  AT_URC_RING,
+  AT_URC_CRING,
+  AT_URC_CLIP,
+  AT_URC_CCWA,
+  AT_URC_NO_CARRIER,
+  AT_URC_CREG,
+  AT_URC_CGREG,
+  AT_URC_CEREG,
+  AT_URC_CMTI,
+  AT_URC_CMT,
+  AT_URC_CDS,
+  AT_URC_CBM,
+  AT_URC_CUSD,
+  AT_URC_CIEV,
+  AT_URC_CGEV,
+  AT_URC_CTZV,
+  AT_URC_CTZE,
+  AT_URC_CSSI,
+  AT_URC_CSSU,
+}
+AT_UrcTypeDef;
+
+typedef struct
+{
+  uint8_t                           Cmd[AT_MAX_CMD_SIZE + 1U];  /* CR terminated */
+  uint16_t                          Length;
+  uint16_t                          Sent;             /* Bytes queued for transmission */
+  const char                        *pPrefix;         /* Information lines of the command */
+  uint32_t                          PrefixLength;
+  uint32_t                          Timeout;          /* In host timer ticks */
+  uint32_t                          Timer;            /* Host timer once fully queued */
+  uint32_t                          Tag;
+}
+AT_CommandTypeDef;
+
+/* AT engine on a CDC modem, or on a CMUX channel of it. All the functions
+   run in the thread calling USBH_Process, the reception callbacks included. */
+typedef struct
+{
+  USBH_HandleTypeDef                *phost;
+  CMUX_HandleTypeDef                *pmux;            /* NULL on the plain CDC stream */
+  uint8_t                           Dlci;
+  uint8_t                           Overflow;         /* Line being dropped */
+  uint8_t                           Prompt;           /* "> " seen, its space to skip */
+  uint16_t                          LineLength;       /* Bytes held in Line */
+  uint32_t                          TicksPerMs;
+  uint32_t                          Head;             /* Free running queue indexes */
+  uint32_t                          Tail;
+  uint32_t                          Lines;
+  uint32_t                          Copies;           /* Lines assembled across buffers */
+  uint32_t                          Overflows;
+  uint32_t                          Timeouts;
+  AT_CommandTypeDef                 Queue[AT_MAX_PENDING];
+  uint8_t                           Line[AT_MAX_LINE_SIZE];
+}
+AT_HandleTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+
+USBH_StatusTypeDef AT_Init(AT_HandleTypeDef *pat, USBH_HandleTypeDef *phost,
+                           CMUX_HandleTypeDef *pmux, uint8_t dlci);
+USBH_StatusTypeDef AT_Send(AT_HandleTypeDef *pat, const char *pcmd, const char *pprefix,
+                           uint32_t timeout_ms, uint32_t tag);
+uint32_t           AT_SendData(AT_HandleTypeDef *pat, const uint8_t *pbuff, uint32_t length);
+uint32_t           AT_GetPending(AT_HandleTypeDef *pat);
+void               AT_Input(AT_HandleTypeDef *pat, const uint8_t *pbuff, uint32_t length);
+void               AT_Process(AT_HandleTypeDef *pat);
+
+void               AT_InfoCallback(AT_HandleTypeDef *pat, uint32_t tag,
+                                   const uint8_t *pline, uint32_t length);
+void               AT_ResultCallback(AT_HandleTypeDef *pat, uint32_t tag,
+                                     AT_ResultTypeDef result, int32_t code);
+void               AT_PromptCallback(AT_HandleTypeDef *pat, uint32_t tag);
+void               AT_UrcCallback(AT_HandleTypeDef *pat, AT_UrcTypeDef urc,
+                                  const uint8_t *pline, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_AT_H__ */
@@ -0,0 +1,1185 @@
+/**
+  ******************************************************************************
+  * @file           : usb_cmux.c
+  * @brief          : 3GPP TS 27.010 multiplexer over the CDC ACM data pipe of
+  *                   a modem: basic (0xF9, length field) and advanced (0x7E,
+  *                   octet transparency) framing, DLCI 0 control channel with
+  *                   MSC, FCon/FCoff, Test, PSC and CLD, and virtual channels
+  *                   (AT control, data, status) with per channel flow control.
+  *
+  *                   Frames are parsed in the CDC reception stream buffers:
+  *                   a frame held by one buffer is delivered in place, only a
+  *                   frame split across two buffers is assembled in RxFrame.
+  *                   Advanced mode removes the escapes in place. Frames go out
+  *                   through USBH_CDC_Write, the payload straight from the
+  *                   caller buffer, once the ring has room for all of it.
+  *
+  *                   The host is the initiator: it sends SABM on DLCI 0, then
+  *                   on each channel. AT+CMUX is sent beforehand on the plain
+  *                   CDC stream.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_cmux.h"
+#include "usbh_cdc.h"
+
+/* Private define ------------------------------------------------------------*/
+#define CMUX_FCS_INIT                      0xFFU
+#define CMUX_FCS_GOOD                      0xCFU
+
+#define CMUX_XON                           0x11U
+#define CMUX_XOFF                          0x13U
+
+/* Private macro -------------------------------------------------------------*/
+#define CMUX_ADDRESS(dlci, cr)             ((uint8_t)(((dlci) << 2) | ((cr) != 0U ? CMUX_ADDR_CR : 0U) | CMUX_ADDR_EA))
+
+/* Private variables ---------------------------------------------------------*/
+
+/* CRC-8 of TS 27.010 annex B: x^8 + x^2 + x + 1, reflected */
+static const uint8_t CmuxFcsTable[256] =
+{
+  0x00U, 0x91U, 0xE3U, 0x72U, 0x07U, 0x96U, 0xE4U, 0x75U,
+  0x0EU, 0x9FU, 0xEDU, 0x7CU, 0x09U, 0x98U, 0xEAU, 0x7BU,
+  0x1CU, 0x8DU, 0xFFU, 0x6EU, 0x1BU, 0x8AU, 0xF8U, 0x69U,
+  0x12U, 0x83U, 0xF1U, 0x60U, 0x15U, 0x84U, 0xF6U, 0x67U,
+  0x38U, 0xA9U, 0xDBU, 0x4AU, 0x3FU, 0xAEU, 0xDCU, 0x4DU,
+  0x36U, 0xA7U, 0xD5U, 0x44U, 0x31U, 0xA0U, 0xD2U, 0x43U,
+  0x24U, 0xB5U, 0xC7U, 0x56U, 0x23U, 0xB2U, 0xC0U, 0x51U,
+  0x2AU, 0xBBU, 0xC9U, 0x58U, 0x2DU, 0xBCU, 0xCEU, 0x5FU,
+  0x70U, 0xE1U, 0x93U, 0x02U, 0x77U, 0xE6U, 0x94U, 0x05U,
+  0x7EU, 0xEFU, 0x9DU, 0x0CU, 0x79U, 0xE8U, 0x9AU, 0x0BU,
+  0x6CU, 0xFDU, 0x8FU, 0x1EU, 0x6BU, 0xFAU, 0x88U, 0x19U,
+  0x62U, 0xF3U, 0x81U, 0x10U, 0x65U, 0xF4U, 0x86U, 0x17U,
+  0x48U, 0xD9U, 0xABU, 0x3AU, 0x4FU, 0xDEU, 0xACU, 0x3DU,
+  0x46U, 0xD7U, 0xA5U, 0x34U, 0x41U, 0xD0U, 0xA2U, 0x33U,
+  0x54U, 0xC5U, 0xB7U, 0x26U, 0x53U, 0xC2U, 0xB0U, 0x21U,
+  0x5AU, 0xCBU, 0xB9U, 0x28U, 0x5DU, 0xCCU, 0xBEU, 0x2FU,
+  0xE0U, 0x71U, 0x03U, 0x92U, 0xE7U, 0x76U, 0x04U, 0x95U,
+  0xEEU, 0x7FU, 0x0DU, 0x9CU, 0xE9U, 0x78U, 0x0AU, 0x9BU,
+  0xFCU, 0x6DU, 0x1FU, 0x8EU, 0xFBU, 0x6AU, 0x18U, 0x89U,
+  0xF2U, 0x63U, 0x11U, 0x80U, 0xF5U, 0x64U, 0x16U, 0x87U,
+  0xD8U, 0x49U, 0x3BU, 0xAAU, 0xDFU, 0x4EU, 0x3CU, 0xADU,
+  0xD6U, 0x47U, 0x35U, 0xA4U, 0xD1U, 0x40U, 0x32U, 0xA3U,
+  0xC4U, 0x55U, 0x27U, 0xB6U, 0xC3U, 0x52U, 0x20U, 0xB1U,
+  0xCAU, 0x5BU, 0x29U, 0xB8U, 0xCDU, 0x5CU, 0x2EU, 0xBFU,
+  0x90U, 0x01U, 0x73U, 0xE2U, 0x97U, 0x06U, 0x74U, 0xE5U,
+  0x9EU, 0x0FU, 0x7DU, 0xECU, 0x99U, 0x08U, 0x7AU, 0xEBU,
+  0x8CU, 0x1DU, 0x6FU, 0xFEU, 0x8BU, 0x1AU, 0x68U, 0xF9U,
+  0x82U, 0x13U, 0x61U, 0xF0U, 0x85U, 0x14U, 0x66U, 0xF7U,
+  0xA8U, 0x39U, 0x4BU, 0xDAU, 0xAFU, 0x3EU, 0x4CU, 0xDDU,
+  0xA6U, 0x37U, 0x45U, 0xD4U, 0xA1U, 0x30U, 0x42U, 0xD3U,
+  0xB4U, 0x25U, 0x57U, 0xC6U, 0xB3U, 0x22U, 0x50U, 0xC1U,
+  0xBAU, 0x2BU, 0x59U, 0xC8U, 0xBDU, 0x2CU, 0x5EU, 0xCFU
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static inline uint8_t CMUX_Fcs(uint8_t crc, const uint8_t *pbuff, uint32_t length);
+static inline uint32_t CMUX_Now(CMUX_HandleTypeDef *pmux);
+static inline uint8_t CMUX_NeedsEscape(uint8_t data);
+static uint32_t CMUX_EscapedSize(const uint8_t *pbuff, uint32_t length);
+static void CMUX_WriteEscaped(CMUX_HandleTypeDef *pmux, const uint8_t *pbuff, uint32_t length);
+static USBH_StatusTypeDef CMUX_SendFrame(CMUX_HandleTypeDef *pmux, uint8_t dlci, uint8_t cr,
+                                         uint8_t control, const uint8_t *pinfo, uint32_t length);
+static void CMUX_SendCommand(CMUX_HandleTypeDef *pmux, uint8_t dlci);
+static USBH_StatusTypeDef CMUX_SendMsc(CMUX_HandleTypeDef *pmux, uint8_t dlci);
+static void CMUX_SetState(CMUX_HandleTypeDef *pmux, uint8_t dlci, CMUX_ChannelStateTypeDef state);
+static void CMUX_CloseAll(CMUX_HandleTypeDef *pmux);
+static void CMUX_Kick(CMUX_HandleTypeDef *pmux);
+static void CMUX_HandleControl(CMUX_HandleTypeDef *pmux, uint8_t *pinfo, uint32_t length);
+static void CMUX_HandleFrame(CMUX_HandleTypeDef *pmux, uint8_t address, uint8_t control,
+                             uint8_t *pinfo, uint32_t length);
+static void CMUX_InputBasic(CMUX_HandleTypeDef *pmux, uint8_t *pbuff, uint32_t length);
+static void CMUX_InputAdvanced(CMUX_HandleTypeDef *pmux, uint8_t *pbuff, uint32_t length);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Run the FCS over a buffer.
+  * @param  crc: Running CRC
+  * @param  pbuff: Data
+  * @param  length: Data length
+  * @retval Running CRC
+  */
+static inline uint8_t CMUX_Fcs(uint8_t crc, const uint8_t *pbuff, uint32_t length)
+{
+  uint32_t idx;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    crc = CmuxFcsTable[crc ^ pbuff[idx]];
+  }
+
+  return crc;
+}
+
+/**
+  * @brief  Host timer of the root port, in SOF ticks.
+  */
+static inline uint32_t CMUX_Now(CMUX_HandleTypeDef *pmux)
+{
+  return pmux->phost->pRoot->Timer;
+}
+
+/**
+  * @brief  Octets sent as an escape pair in advanced mode.
+  */
+static inline uint8_t CMUX_NeedsEscape(uint8_t data)
+{
+  return ((data == CMUX_ADVANCED_FLAG) || (data == CMUX_ADVANCED_ESCAPE) ||
+          (data == CMUX_XON) || (data == CMUX_XOFF)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Size of a buffer once escaped.
+  */
+static uint32_t CMUX_EscapedSize(const uint8_t *pbuff, uint32_t length)
+{
+  uint32_t size = length;
+  uint32_t idx;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    size += CMUX_NeedsEscape(pbuff[idx]);
+  }
+
+  return size;
+}
+
+/**
+  * @brief  Queue a buffer with advanced mode transparency: runs of plain
+  *         octets go to the ring straight from the buffer.
+  * @param  pmux: Multiplexer
+  * @param  pbuff: Data
+  * @param  length: Data length
+  * @retval None
+  */
+static void CMUX_WriteEscaped(CMUX_HandleTypeDef *pmux, const uint8_t *pbuff, uint32_t length)
+{
+  uint8_t pair[2];
+  uint32_t start = 0U;
+  uint32_t idx;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    if (CMUX_NeedsEscape(pbuff[idx]) != 0U)
+    {
+      (void)USBH_CDC_Write(pmux->phost, &pbuff[start], idx - start);
+      pair[0] = CMUX_ADVANCED_ESCAPE;
+      pair[1] = pbuff[idx] ^ CMUX_ADVANCED_XOR;
+      (void)USBH_CDC_Write(pmux->phost, pair, 2U);
+      start = idx + 1U;
+    }
+  }
+
+  (void)USBH_CDC_Write(pmux->phost, &pbuff[start], length - start);
+}
+
+/**
+  * @brief  Queue one frame, whole or not at all.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @param  cr: C/R bit of the address field
+  * @param  control: Control field, P/F included
+  * @param  pinfo: Information field, sent from this buffer
+  * @param  length: Information length, up to CMUX_MAX_INFO_SIZE
+  * @retval USBH_OK, USBH_BUSY when the transmit ring lacks room
+  */
+static USBH_StatusTypeDef CMUX_SendFrame(CMUX_HandleTypeDef *pmux, uint8_t dlci, uint8_t cr,
+                                         uint8_t control, const uint8_t *pinfo, uint32_t length)
+{
+  uint8_t header[5];
+  uint8_t trailer[2];
+  uint32_t hlen;
+  uint32_t need;
+  uint8_t crc;
+
+  header[0] = (pmux->Mode == CMUX_MODE_BASIC) ? CMUX_BASIC_FLAG : CMUX_ADVANCED_FLAG;
+  header[1] = CMUX_ADDRESS(dlci, cr);
+  header[2] = control;
+  hlen = 3U;
+
+  if (pmux->Mode == CMUX_MODE_BASIC)
+  {
+    if (length < 128U)
+    {
+      header[3] = (uint8_t)((length << 1) | 0x01U);
+      hlen = 4U;
+    }
+    else
+    {
+      header[3] = (uint8_t)(length << 1);
+      header[4] = (uint8_t)(length >> 7);
+      hlen = 5U;
+    }
+  }
+
+  /* UIH frames check the header only, the other frames the information too */
+  crc = CMUX_Fcs(CMUX_FCS_INIT, &header[1], hlen - 1U);
+  if ((control & (uint8_t)~CMUX_CTRL_PF) != CMUX_CTRL_UIH)
+  {
+    crc = CMUX_Fcs(crc, pinfo, length);
+  }
+
+  trailer[0] = (uint8_t)(0xFFU - crc);
+  trailer[1] = header[0];
+
+  if (pmux->Mode == CMUX_MODE_BASIC)
+  {
+    need = hlen + length + 2U;
+  }
+  else
+  {
+    need = 2U + CMUX_EscapedSize(&header[1], 2U) + CMUX_EscapedSize(pinfo, length) +
+           CMUX_EscapedSize(trailer, 1U);
+  }
+
+  if (USBH_CDC_GetTxFree(pmux->phost) < need)
+  {
+    return USBH_BUSY;
+  }
+
+  if (pmux->Mode == CMUX_MODE_BASIC)
+  {
+    (void)USBH_CDC_Write(pmux->phost, header, hlen);
+    (void)USBH_CDC_Write(pmux->phost, pinfo, length);
+    (void)USBH_CDC_Write(pmux->phost, trailer, 2U);
+  }
+  else
+  {
+    (void)USBH_CDC_Write(pmux->phost, header, 1U);
+    CMUX_WriteEscaped(pmux, &header[1], 2U);
+    CMUX_WriteEscaped(pmux, pinfo, length);
+    CMUX_WriteEscaped(pmux, trailer, 1U);
+    (void)USBH_CDC_Write(pmux->phost, &trailer[1], 1U);
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Send the SABM or DISC command of a channel in transition and arm
+  *         the T1 timer.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @retval None
+  */
+static void CMUX_SendCommand(CMUX_HandleTypeDef *pmux, uint8_t dlci)
+{
+  CMUX_ChannelTypeDef *pch = &pmux->Channel[dlci];
+  uint8_t control;
+
+  control = (pch->state == CMUX_CHANNEL_OPENING) ? CMUX_CTRL_SABM : CMUX_CTRL_DISC;
+
+  if (CMUX_SendFrame(pmux, dlci, 1U, control | CMUX_CTRL_PF, NULL, 0U) == USBH_OK)
+  {
+    pch->Retries++;
+    pch->Timer = CMUX_Now(pmux);
+  }
+}
+
+/**
+  * @brief  Send our V.24 signals of a channel, FC set while it is stopped.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @retval USBH_OK, USBH_BUSY when the transmit ring lacks room
+  */
+static USBH_StatusTypeDef CMUX_SendMsc(CMUX_HandleTypeDef *pmux, uint8_t dlci)
+{
+  CMUX_ChannelTypeDef *pch = &pmux->Channel[dlci];
+
+  pmux->CtrlBuff[0] = CMUX_MSG_MSC | CMUX_MSG_CR | CMUX_MSG_EA;
+  pmux->CtrlBuff[1] = (uint8_t)((2U << 1) | CMUX_MSG_EA);
+  pmux->CtrlBuff[2] = CMUX_ADDRESS(dlci, 1U);
+  pmux->CtrlBuff[3] = (uint8_t)(CMUX_MSG_EA | CMUX_V24_RTC | CMUX_V24_RTR | CMUX_V24_DV |
+                                ((pch->LocalFc != 0U) ? CMUX_V24_FC : 0U));
+
+  if (CMUX_SendFrame(pmux, 0U, 1U, CMUX_CTRL_UIH, pmux->CtrlBuff, 4U) != USBH_OK)
+  {
+    return USBH_BUSY;
+  }
+
+  pch->MscPending = 1U;
+  pch->Timer = CMUX_Now(pmux);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Change the state of a channel and report it.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @param  state: New state
+  * @retval None
+  */
+static void CMUX_SetState(CMUX_HandleTypeDef *pmux, uint8_t dlci, CMUX_ChannelStateTypeDef state)
+{
+  CMUX_ChannelTypeDef *pch = &pmux->Channel[dlci];
+
+  if (pch->state == state)
+  {
+    return;
+  }
+
+  pch->state = state;
+  pch->Retries = 0U;
+  pch->MscPending = 0U;
+
+  if (state == CMUX_CHANNEL_CLOSED)
+  {
+    pch->RemoteFc = 0U;
+    pch->LocalFc = 0U;
+  }
+
+  USBH_DbgLog("CMUX: DLCI %d state %d", (int)dlci, (int)state);
+  CMUX_ChannelStateCallback(pmux, dlci, state);
+}
+
+/**
+  * @brief  The multiplexer closed down: every channel is closed.
+  * @param  pmux: Multiplexer
+  * @retval None
+  */
+static void CMUX_CloseAll(CMUX_HandleTypeDef *pmux)
+{
+  uint8_t dlci;
+
+  pmux->Closing = 0U;
+  pmux->FcOff = 0U;
+
+  for (dlci = CMUX_NUM_CHANNELS; dlci > 0U; dlci--)
+  {
+    CMUX_SetState(pmux, dlci - 1U, CMUX_CHANNEL_CLOSED);
+  }
+}
+
+/**
+  * @brief  Send the SABM and DISC commands not sent yet. The channels wait
+  *         for DLCI 0 to be open.
+  * @param  pmux: Multiplexer
+  * @retval None
+  */
+static void CMUX_Kick(CMUX_HandleTypeDef *pmux)
+{
+  CMUX_ChannelTypeDef *pch;
+  uint8_t dlci;
+
+  for (dlci = 0U; dlci < CMUX_NUM_CHANNELS; dlci++)
+  {
+    pch = &pmux->Channel[dlci];
+
+    if (((pch->state == CMUX_CHANNEL_OPENING) || (pch->state == CMUX_CHANNEL_CLOSING)) &&
+        (pch->Retries == 0U) &&
+        ((dlci == 0U) || (pmux->Channel[0].state == CMUX_CHANNEL_OPEN)))
+    {
+      CMUX_SendCommand(pmux, dlci);
+    }
+  }
+}
+
+/**
+  * @brief  Control channel messages of one UIH frame. Responses to the
+  *         peer commands echo the values: the C/R bit of the message is
+  *         cleared in place and the message sent back from there.
+  * @param  pmux: Multiplexer
+  * @param  pinfo: Information field
+  * @param  length: Information length
+  * @retval None
+  */
+static void CMUX_HandleControl(CMUX_HandleTypeDef *pmux, uint8_t *pinfo, uint32_t length)
+{
+  CMUX_ChannelTypeDef *pch;
+  uint32_t offset = 0U;
+  uint32_t hlen;
+  uint32_t vlen;
+  uint8_t *pmsg;
+  uint8_t type;
+  uint8_t dlci;
+  uint8_t fc;
+
+  while ((offset + 2U) <= length)
+  {
+    pmsg = &pinfo[offset];
+    type = pmsg[0] & (uint8_t)~(CMUX_MSG_CR | CMUX_MSG_EA);
+
+    if ((pmsg[1] & CMUX_MSG_EA) != 0U)
+    {
+      hlen = 2U;
+      vlen = (uint32_t)pmsg[1] >> 1;
+    }
+    else
+    {
+      if ((offset + 3U) > length)
+      {
+        return;
+      }
+
+      hlen = 3U;
+      vlen = ((uint32_t)pmsg[1] >> 1) | ((uint32_t)pmsg[2] << 7);
+    }
+
+    if ((offset + hlen + vlen) > length)
+    {
+      return;
+    }
+
+    offset += hlen + vlen;
+
+    if ((pmsg[0] & CMUX_MSG_CR) == 0U)
+    {
+      /* Response to one of our commands */
+      if ((type == CMUX_MSG_MSC) && (vlen >= 1U) && ((pmsg[hlen] >> 2) < CMUX_NUM_CHANNELS))
+      {
+        pmux->Channel[pmsg[hlen] >> 2].MscPending = 0U;
+      }
+      else if ((type == CMUX_MSG_CLD) && (pmux->Closing != 0U))
+      {
+        CMUX_CloseAll(pmux);
+        return;
+      }
+      else
+      {
+        /* .. */
+      }
+
+      continue;
+    }
+
+    switch (type)
+    {
+      case CMUX_MSG_MSC:
+        if ((vlen >= 2U) && ((pmsg[hlen] >> 2) < CMUX_NUM_CHANNELS))
+        {
+          dlci = pmsg[hlen] >> 2;
+          pch = &pmux->Channel[dlci];
+          fc = ((pmsg[hlen + 1U] & CMUX_V24_FC) != 0U) ? 1U : 0U;
+          pch->Signals = pmsg[hlen + 1U];
+
+          if ((pch->RemoteFc != 0U) && (fc == 0U))
+          {
+            pch->RemoteFc = 0U;
+            CMUX_TxReadyCallback(pmux, dlci);
+          }
+
+          pch->RemoteFc = fc;
+        }
+        break;
+
+      case CMUX_MSG_FCON:
+        pmux->FcOff = 0U;
+        break;
+
+      case CMUX_MSG_FCOFF:
+        pmux->FcOff = 1U;
+        break;
+
+      case CMUX_MSG_TEST:
+      case CMUX_MSG_PSC:
+      case CMUX_MSG_CLD:
+        break;
+
+      default:
+        /* Not supported: answered with NSC */
+        pmux->CtrlBuff[0] = CMUX_MSG_NSC | CMUX_MSG_EA;
+        pmux->CtrlBuff[1] = (uint8_t)((1U << 1) | CMUX_MSG_EA);
+        pmux->CtrlBuff[2] = pmsg[0];
+        (void)CMUX_SendFrame(pmux, 0U, 1U, CMUX_CTRL_UIH, pmux->CtrlBuff, 3U);
+        continue;
+    }
+
+    pmsg[0] &= (uint8_t)~CMUX_MSG_CR;
+    (void)CMUX_SendFrame(pmux, 0U, 1U, CMUX_CTRL_UIH, pmsg, hlen + vlen);
+
+    if (type == CMUX_MSG_CLD)
+    {
+      CMUX_CloseAll(pmux);
+      return;
+    }
+
+    if (type == CMUX_MSG_FCON)
+    {
+      for (dlci = 1U; dlci < CMUX_NUM_CHANNELS; dlci++)
+      {
+        if ((pmux->Channel[dlci].state == CMUX_CHANNEL_OPEN) && (pmux->Channel[dlci].RemoteFc == 0U))
+        {
+          CMUX_TxReadyCallback(pmux, dlci);
+        }
+      }
+    }
+  }
+}
+
+/**
+  * @brief  Act on a frame with a good FCS.
+  * @param  pmux: Multiplexer
+  * @param  address: Address field
+  * @param  control: Control field
+  * @param  pinfo: Information field, in the receive buffer or in RxFrame
+  * @param  length: Information length
+  * @retval None
+  */
+static void CMUX_HandleFrame(CMUX_HandleTypeDef *pmux, uint8_t address, uint8_t control,
+                             uint8_t *pinfo, uint32_t length)
+{
+  CMUX_ChannelTypeDef *pch;
+  uint8_t dlci = address >> 2;
+
+  control &= (uint8_t)~CMUX_CTRL_PF;
+
+  if (dlci >= CMUX_NUM_CHANNELS)
+  {
+    if (control == CMUX_CTRL_SABM)
+    {
+      (void)CMUX_SendFrame(pmux, dlci, 0U, CMUX_CTRL_DM | CMUX_CTRL_PF, NULL, 0U);
+    }
+
+    return;
+  }
+
+  pch = &pmux->Channel[dlci];
+
+  switch (control)
+  {
+    case CMUX_CTRL_UIH:
+    case CMUX_CTRL_UI:
+      if (pch->state != CMUX_CHANNEL_OPEN)
+      {
+        break;
+      }
+
+      pch->RxFrames++;
+      pch->RxBytes += length;
+
+      if (dlci == 0U)
+      {
+        CMUX_HandleControl(pmux, pinfo, length);
+      }
+      else
+      {
+        CMUX_DataCallback(pmux, dlci, pinfo, length);
+      }
+      break;
+
+    case CMUX_CTRL_UA:
+      if (pch->state == CMUX_CHANNEL_OPENING)
+      {
+        CMUX_SetState(pmux, dlci, CMUX_CHANNEL_OPEN);
+
+        if (dlci == 0U)
+        {
+          CMUX_Kick(pmux);
+        }
+      }
+      else if (pch->state == CMUX_CHANNEL_CLOSING)
+      {
+        if (dlci == 0U)
+        {
+          CMUX_CloseAll(pmux);
+        }
+        else
+        {
+          CMUX_SetState(pmux, dlci, CMUX_CHANNEL_CLOSED);
+        }
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case CMUX_CTRL_DM:
+      CMUX_SetState(pmux, dlci, CMUX_CHANNEL_CLOSED);
+      break;
+
+    case CMUX_CTRL_SABM:
+      (void)CMUX_SendFrame(pmux, dlci, 0U, CMUX_CTRL_UA | CMUX_CTRL_PF, NULL, 0U);
+      CMUX_SetState(pmux, dlci, CMUX_CHANNEL_OPEN);
+      break;
+
+    case CMUX_CTRL_DISC:
+      (void)CMUX_SendFrame(pmux, dlci, 0U, CMUX_CTRL_UA | CMUX_CTRL_PF, NULL, 0U);
+
+      if (dlci == 0U)
+      {
+        CMUX_CloseAll(pmux);
+      }
+      else
+      {
+        CMUX_SetState(pmux, dlci, CMUX_CHANNEL_CLOSED);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Basic mode receiver: flag, address, control, one or two length
+  *         octets, information, FCS. The information field is taken in bulk.
+  * @param  pmux: Multiplexer
+  * @param  pbuff: Received data
+  * @param  length: Received length
+  * @retval None
+  */
+static void CMUX_InputBasic(CMUX_HandleTypeDef *pmux, uint8_t *pbuff, uint32_t length)
+{
+  uint32_t idx = 0U;
+  uint32_t count;
+  uint8_t data;
+
+  while (idx < length)
+  {
+    data = pbuff[idx];
+
+    switch (pmux->RxState)
+    {
+      case CMUX_RX_ADDRESS:
+        idx++;
+
+        /* Repeated flags between frames */
+        if (data == CMUX_BASIC_FLAG)
+        {
+          break;
+        }
+
+        if ((data & CMUX_ADDR_EA) == 0U)
+        {
+          pmux->RxState = CMUX_RX_HUNT;
+          break;
+        }
+
+        pmux->RxAddress = data;
+        pmux->RxFcs = CmuxFcsTable[CMUX_FCS_INIT ^ data];
+        pmux->RxState = CMUX_RX_CONTROL;
+        break;
+
+      case CMUX_RX_CONTROL:
+        idx++;
+        pmux->RxControl = data;
+        pmux->RxFcs = CmuxFcsTable[pmux->RxFcs ^ data];
+        pmux->RxState = CMUX_RX_LENGTH;
+        break;
+
+      case CMUX_RX_LENGTH:
+      case CMUX_RX_LENGTH2:
+        idx++;
+        pmux->RxFcs = CmuxFcsTable[pmux->RxFcs ^ data];
+
+        if (pmux->RxState == CMUX_RX_LENGTH)
+        {
+          pmux->RxLength = (uint16_t)(data >> 1);
+
+          if ((data & CMUX_ADDR_EA) == 0U)
+          {
+            pmux->RxState = CMUX_RX_LENGTH2;
+            break;
+          }
+        }
+        else
+        {
+          pmux->RxLength |= (uint16_t)((uint16_t)data << 7);
+        }
+
+        if (pmux->RxLength > CMUX_MAX_INFO_SIZE)
+        {
+          pmux->Oversize++;
+          pmux->RxState = CMUX_RX_HUNT;
+          break;
+        }
+
+        pmux->RxCount = 0U;
+        pmux->pRxInfo = pmux->RxFrame;
+        pmux->RxState = (pmux->RxLength != 0U) ? CMUX_RX_INFO : CMUX_RX_FCS;
+        break;
+
+      case CMUX_RX_INFO:
+        count = MIN((uint32_t)pmux->RxLength - pmux->RxCount, length - idx);
+
+        if ((pmux->RxCount == 0U) && (count == pmux->RxLength))
+        {
+          /* Whole field in this buffer: delivered from there */
+          pmux->pRxInfo = &pbuff[idx];
+        }
+        else
+        {
+          /* Field split across buffers: assembled in RxFrame */
+          pmux->Copies += (pmux->RxCount == 0U) ? 1U : 0U;
+          (void)USBH_memcpy(&pmux->RxFrame[pmux->RxCount], &pbuff[idx], count);
+        }
+
+        if ((pmux->RxControl & (uint8_t)~CMUX_CTRL_PF) != CMUX_CTRL_UIH)
+        {
+          pmux->RxFcs = CMUX_Fcs(pmux->RxFcs, &pbuff[idx], count);
+        }
+
+        pmux->RxCount += (uint16_t)count;
+        idx += count;
+
+        if (pmux->RxCount == pmux->RxLength)
+        {
+          pmux->RxState = CMUX_RX_FCS;
+        }
+        break;
+
+      case CMUX_RX_FCS:
+        idx++;
+
+        if (CmuxFcsTable[pmux->RxFcs ^ data] == CMUX_FCS_GOOD)
+        {
+          CMUX_HandleFrame(pmux, pmux->RxAddress, pmux->RxControl, pmux->pRxInfo, pmux->RxLength);
+        }
+        else
+        {
+          pmux->FcsErrors++;
+        }
+
+        /* The closing flag may open the next frame */
+        pmux->RxState = CMUX_RX_HUNT;
+        break;
+
+      default:
+        idx++;
+
+        if (data == CMUX_BASIC_FLAG)
+        {
+          pmux->RxState = CMUX_RX_ADDRESS;
+        }
+        break;
+    }
+  }
+
+  /* The FCS is still to come and this buffer is about to be released */
+  if ((pmux->RxState == CMUX_RX_FCS) && (pmux->pRxInfo != pmux->RxFrame))
+  {
+    (void)USBH_memcpy(pmux->RxFrame, pmux->pRxInfo, pmux->RxLength);
+    pmux->pRxInfo = pmux->RxFrame;
+    pmux->Copies++;
+  }
+}
+
+/**
+  * @brief  Advanced mode receiver: octets between two flags, escapes removed
+  *         in place. A frame not closed by the end of the buffer moves to
+  *         RxFrame and is completed there.
+  * @param  pmux: Multiplexer
+  * @param  pbuff: Received data, modified
+  * @param  length: Received length
+  * @retval None
+  */
+static void CMUX_InputAdvanced(CMUX_HandleTypeDef *pmux, uint8_t *pbuff, uint32_t length)
+{
+  uint8_t *pframe = pmux->RxFrame;
+  uint32_t start = 0U;
+  uint32_t idx;
+  uint32_t size;
+  uint8_t data;
+  uint8_t crc;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    data = pbuff[idx];
+
+    if (data == CMUX_ADVANCED_FLAG)
+    {
+      size = pmux->RxCount;
+
+      if ((pmux->RxState == CMUX_RX_FRAME) && (size >= 3U) && (pmux->RxEscape == 0U))
+      {
+        crc = CMUX_Fcs(CMUX_FCS_INIT, pframe, 2U);
+        if ((pframe[1] & (uint8_t)~CMUX_CTRL_PF) != CMUX_CTRL_UIH)
+        {
+          crc = CMUX_Fcs(crc, &pframe[2], size - 3U);
+        }
+
+        if ((CmuxFcsTable[crc ^ pframe[size - 1U]] == CMUX_FCS_GOOD) && ((pframe[0] & CMUX_ADDR_EA) != 0U))
+        {
+          CMUX_HandleFrame(pmux, pframe[0], pframe[1], &pframe[2], size - 3U);
+        }
+        else
+        {
+          pmux->FcsErrors++;
+        }
+      }
+
+      /* Next frame assembled in place, from the octet after the flag */
+      pmux->RxState = CMUX_RX_FRAME;
+      pmux->RxCount = 0U;
+      pmux->RxEscape = 0U;
+      start = idx + 1U;
+      pframe = &pbuff[start];
+      continue;
+    }
+
+    if ((pmux->RxState != CMUX_RX_FRAME) || (data == CMUX_XON) || (data == CMUX_XOFF))
+    {
+      continue;
+    }
+
+    if (data == CMUX_ADVANCED_ESCAPE)
+    {
+      pmux->RxEscape = 1U;
+      continue;
+    }
+
+    if (pmux->RxEscape != 0U)
+    {
+      data ^= CMUX_ADVANCED_XOR;
+      pmux->RxEscape = 0U;
+    }
+
+    if (pmux->RxCount >= (CMUX_MAX_INFO_SIZE + 3U))
+    {
+      pmux->Oversize++;
+      pmux->RxState = CMUX_RX_HUNT;
+      continue;
+    }
+
+    /* Never ahead of idx: the unescaped frame only shrinks */
+    pframe[pmux->RxCount] = data;
+    pmux->RxCount++;
+  }
+
+  if ((pmux->RxState == CMUX_RX_FRAME) && (pframe != pmux->RxFrame))
+  {
+    if (pmux->RxCount != 0U)
+    {
+      (void)USBH_memcpy(pmux->RxFrame, pframe, pmux->RxCount);
+      pmux->Copies++;
+    }
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start the multiplexer on a CDC device whose modem was switched to
+  *         CMUX (AT+CMUX): opens DLCI 0, then every channel. Each opening is
+  *         reported through CMUX_ChannelStateCallback. The CDC reception
+  *         stream must be running, its data passed to CMUX_Input.
+  * @param  pmux: Multiplexer
+  * @param  phost: CDC device
+  * @param  mode: Basic or advanced framing, as in AT+CMUX
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef CMUX_Start(CMUX_HandleTypeDef *pmux, USBH_HandleTypeDef *phost,
+                              CMUX_ModeTypeDef mode)
+{
+  uint8_t dlci;
+
+  (void)USBH_memset(pmux, 0, sizeof(CMUX_HandleTypeDef));
+
+  pmux->phost = phost;
+  pmux->Mode = mode;
+  pmux->RxState = CMUX_RX_HUNT;
+
+  /* The SOF counter of a high-speed root port runs at 8 kHz */
+  pmux->TicksPerMs = (phost->pRoot->device.speed == (uint8_t)USBH_SPEED_HIGH) ? 8U : 1U;
+
+  for (dlci = 0U; dlci < CMUX_NUM_CHANNELS; dlci++)
+  {
+    pmux->Channel[dlci].state = CMUX_CHANNEL_OPENING;
+  }
+
+  CMUX_Kick(pmux);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Close the multiplexer down with CLD. The channels are reported
+  *         closed on the response, or after T2 without one.
+  * @param  pmux: Multiplexer
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef CMUX_Stop(CMUX_HandleTypeDef *pmux)
+{
+  if (pmux->Channel[0].state != CMUX_CHANNEL_OPEN)
+  {
+    CMUX_CloseAll(pmux);
+    return USBH_OK;
+  }
+
+  pmux->CtrlBuff[0] = CMUX_MSG_CLD | CMUX_MSG_CR | CMUX_MSG_EA;
+  pmux->CtrlBuff[1] = CMUX_MSG_EA;
+
+  if (CMUX_SendFrame(pmux, 0U, 1U, CMUX_CTRL_UIH, pmux->CtrlBuff, 2U) != USBH_OK)
+  {
+    return USBH_BUSY;
+  }
+
+  pmux->Closing = 1U;
+  pmux->Channel[0].Timer = CMUX_Now(pmux);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Open a channel closed before, or refused by the peer.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel, 1 to CMUX_NUM_CHANNELS - 1
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef CMUX_OpenChannel(CMUX_HandleTypeDef *pmux, uint8_t dlci)
+{
+  if ((dlci == 0U) || (dlci >= CMUX_NUM_CHANNELS) ||
+      (pmux->Channel[dlci].state != CMUX_CHANNEL_CLOSED))
+  {
+    return USBH_FAIL;
+  }
+
+  CMUX_SetState(pmux, dlci, CMUX_CHANNEL_OPENING);
+  CMUX_Kick(pmux);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Close a channel with DISC.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel, 1 to CMUX_NUM_CHANNELS - 1
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef CMUX_CloseChannel(CMUX_HandleTypeDef *pmux, uint8_t dlci)
+{
+  if ((dlci == 0U) || (dlci >= CMUX_NUM_CHANNELS) ||
+      (pmux->Channel[dlci].state != CMUX_CHANNEL_OPEN))
+  {
+    return USBH_FAIL;
+  }
+
+  CMUX_SetState(pmux, dlci, CMUX_CHANNEL_CLOSING);
+  CMUX_Kick(pmux);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Stop or resume the peer transmission on one channel (MSC FC),
+  *         the other channels keep flowing.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel, 1 to CMUX_NUM_CHANNELS - 1
+  * @param  enable: 0 to stop the peer, 1 to let it send again
+  * @retval USBH_OK, USBH_BUSY to be retried when the MSC could not be queued
+  */
+USBH_StatusTypeDef CMUX_SetFlow(CMUX_HandleTypeDef *pmux, uint8_t dlci, uint8_t enable)
+{
+  if ((dlci == 0U) || (dlci >= CMUX_NUM_CHANNELS) ||
+      (pmux->Channel[dlci].state != CMUX_CHANNEL_OPEN))
+  {
+    return USBH_FAIL;
+  }
+
+  pmux->Channel[dlci].LocalFc = (enable == 0U) ? 1U : 0U;
+  pmux->Channel[dlci].Retries = 0U;
+
+  return CMUX_SendMsc(pmux, dlci);
+}
+
+/**
+  * @brief  Send data on a channel in UIH frames of up to CMUX_MAX_INFO_SIZE
+  *         octets, straight from pbuff.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel, 1 to CMUX_NUM_CHANNELS - 1
+  * @param  pbuff: Data
+  * @param  length: Data length
+  * @retval Bytes sent, less than length when the channel is stopped by the
+  *         peer or the CDC transmit ring is full: CMUX_TxReadyCallback or
+  *         a later call takes the rest
+  */
+uint32_t CMUX_Write(CMUX_HandleTypeDef *pmux, uint8_t dlci, const uint8_t *pbuff, uint32_t length)
+{
+  CMUX_ChannelTypeDef *pch;
+  uint32_t done = 0U;
+  uint32_t count;
+
+  if ((dlci == 0U) || (dlci >= CMUX_NUM_CHANNELS))
+  {
+    return 0U;
+  }
+
+  pch = &pmux->Channel[dlci];
+
+  if ((pch->state != CMUX_CHANNEL_OPEN) || (pch->RemoteFc != 0U) || (pmux->FcOff != 0U))
+  {
+    return 0U;
+  }
+
+  while (done < length)
+  {
+    count = MIN(length - done, CMUX_MAX_INFO_SIZE);
+
+    if (CMUX_SendFrame(pmux, dlci, 1U, CMUX_CTRL_UIH, &pbuff[done], count) != USBH_OK)
+    {
+      break;
+    }
+
+    pch->TxFrames++;
+    pch->TxBytes += count;
+    done += count;
+  }
+
+  return done;
+}
+
+/**
+  * @brief  Parse received data, to be called from
+  *         USBH_CDC_ReceiveStreamCallback before the buffer is released.
+  *         Frames are handled as they complete; the information fields
+  *         passed to CMUX_DataCallback point into pbuff when possible.
+  * @param  pmux: Multiplexer
+  * @param  pbuff: Received data, modified in advanced mode
+  * @param  length: Received length
+  * @retval None
+  */
+void CMUX_Input(CMUX_HandleTypeDef *pmux, uint8_t *pbuff, uint32_t length)
+{
+  if (pmux->Mode == CMUX_MODE_BASIC)
+  {
+    CMUX_InputBasic(pmux, pbuff, length);
+  }
+  else
+  {
+    CMUX_InputAdvanced(pmux, pbuff, length);
+  }
+}
+
+/**
+  * @brief  Timers: SABM and DISC repeated after T1 up to N2 times, MSC
+  *         repeated after T2, CLD given up after T2. To be called from the
+  *         thread running USBH_Process.
+  * @param  pmux: Multiplexer
+  * @retval None
+  */
+void CMUX_Process(CMUX_HandleTypeDef *pmux)
+{
+  CMUX_ChannelTypeDef *pch;
+  uint32_t now;
+  uint8_t dlci;
+
+  if (pmux->phost == NULL)
+  {
+    return;
+  }
+
+  now = CMUX_Now(pmux);
+
+  if ((pmux->Closing != 0U) && ((now - pmux->Channel[0].Timer) >= (CMUX_T2_MS * pmux->TicksPerMs)))
+  {
+    CMUX_CloseAll(pmux);
+    return;
+  }
+
+  CMUX_Kick(pmux);
+
+  for (dlci = 0U; dlci < CMUX_NUM_CHANNELS; dlci++)
+  {
+    pch = &pmux->Channel[dlci];
+
+    if (((pch->state == CMUX_CHANNEL_OPENING) || (pch->state == CMUX_CHANNEL_CLOSING)) &&
+        (pch->Retries != 0U) && ((now - pch->Timer) >= (CMUX_T1_MS * pmux->TicksPerMs)))
+    {
+      if (pch->Retries > CMUX_N2)
+      {
+        USBH_ErrLog("CMUX: no response on DLCI %d", (int)dlci);
+
+        if (dlci == 0U)
+        {
+          CMUX_CloseAll(pmux);
+          return;
+        }
+
+        CMUX_SetState(pmux, dlci, CMUX_CHANNEL_CLOSED);
+      }
+      else
+      {
+        CMUX_SendCommand(pmux, dlci);
+      }
+    }
+    else if ((pch->MscPending != 0U) && ((now - pch->Timer) >= (CMUX_T2_MS * pmux->TicksPerMs)))
+    {
+      pch->Retries++;
+
+      if (pch->Retries > CMUX_N2)
+      {
+        pch->MscPending = 0U;
+      }
+      else
+      {
+        (void)CMUX_SendMsc(pmux, dlci);
+      }
+    }
+    else
+    {
+      /* .. */
+    }
+  }
+}
+
+/**
+  * @brief  State of a channel.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @retval State
+  */
+CMUX_ChannelStateTypeDef CMUX_GetState(CMUX_HandleTypeDef *pmux, uint8_t dlci)
+{
+  return (dlci < CMUX_NUM_CHANNELS) ? pmux->Channel[dlci].state : CMUX_CHANNEL_CLOSED;
+}
+
+/**
+  * @brief  A channel opened or closed.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @param  state: New state
+  * @retval None
+  */
+__weak void CMUX_ChannelStateCallback(CMUX_HandleTypeDef *pmux, uint8_t dlci,
+                                      CMUX_ChannelStateTypeDef state)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pmux);
+  UNUSED(dlci);
+  UNUSED(state);
+}
+
+/**
+  * @brief  Data received on a channel. pbuff is valid during the call only.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @param  pbuff: Information field
+  * @param  length: Information length
+  * @retval None
+  */
+__weak void CMUX_DataCallback(CMUX_HandleTypeDef *pmux, uint8_t dlci,
+                              const uint8_t *pbuff, uint32_t length)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pmux);
+  UNUSED(dlci);
+  UNUSED(pbuff);
+  UNUSED(length);
+}
+
+/**
+  * @brief  The peer let a stopped channel send again.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @retval None
+  */
+__weak void CMUX_TxReadyCallback(CMUX_HandleTypeDef *pmux, uint8_t dlci)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pmux);
+  UNUSED(dlci);
+}
@@ -0,0 +1,196 @@
+/**
+  ******************************************************************************
+  * @file           : usb_cmux.h
+  * @brief          : Header for usb_cmux.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_CMUX_H__
+#define __USB_CMUX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Frame delimiters */
+#define CMUX_BASIC_FLAG                    0xF9U
+#define CMUX_ADVANCED_FLAG                 0x7EU
+#define CMUX_ADVANCED_ESCAPE               0x7DU
+#define CMUX_ADVANCED_XOR                  0x20U
+
+/* Address field */
+#define CMUX_ADDR_EA                       0x01U
+#define CMUX_ADDR_CR                       0x02U
+
+/* Control field, P/F bit clear */
+#define CMUX_CTRL_SABM                     0x2FU
+#define CMUX_CTRL_UA                       0x63U
+#define CMUX_CTRL_DM                       0x0FU
+#define CMUX_CTRL_DISC                     0x43U
+#define CMUX_CTRL_UIH                      0xEFU
+#define CMUX_CTRL_UI                       0x03U
+#define CMUX_CTRL_PF                       0x10U
+
+/* Control channel message types, EA and C/R clear */
+#define CMUX_MSG_PN                        0x80U
+#define CMUX_MSG_PSC                       0x40U
+#define CMUX_MSG_CLD                       0xC0U
+#define CMUX_MSG_TEST                      0x20U
+#define CMUX_MSG_FCON                      0xA0U
+#define CMUX_MSG_FCOFF                     0x60U
+#define CMUX_MSG_MSC                       0xE0U
+#define CMUX_MSG_NSC                       0x10U
+#define CMUX_MSG_EA                        0x01U
+#define CMUX_MSG_CR                        0x02U
+
+/* V.24 signals octet of MSC */
+#define CMUX_V24_FC                        0x02U
+#define CMUX_V24_RTC                       0x04U
+#define CMUX_V24_RTR                       0x08U
+#define CMUX_V24_IC                        0x40U
+#define CMUX_V24_DV                        0x80U
+
+/* DLCIs 0 (control) to CMUX_NUM_CHANNELS - 1: AT control, data, status */
+#ifndef CMUX_NUM_CHANNELS
+#define CMUX_NUM_CHANNELS                  4U
+#endif /* CMUX_NUM_CHANNELS */
+
+/* Largest information field (N1), both ways */
+#ifndef CMUX_MAX_INFO_SIZE
+#define CMUX_MAX_INFO_SIZE                 127U
+#endif /* CMUX_MAX_INFO_SIZE */
+
+/* Acknowledgement timer T1 and retransmissions N2 of SABM and DISC */
+#ifndef CMUX_T1_MS
+#define CMUX_T1_MS                         100U
+#endif /* CMUX_T1_MS */
+
+#ifndef CMUX_N2
+#define CMUX_N2                            3U
+#endif /* CMUX_N2 */
+
+/* Response timer T2 of the control channel commands */
+#ifndef CMUX_T2_MS
+#define CMUX_T2_MS                         300U
+#endif /* CMUX_T2_MS */
+
+#if (CMUX_NUM_CHANNELS < 2U) || (CMUX_NUM_CHANNELS > 64U)
+#error "CMUX_NUM_CHANNELS must be in 2..64"
+#endif
+
+#if (CMUX_MAX_INFO_SIZE == 0U) || (CMUX_MAX_INFO_SIZE > 32767U)
+#error "CMUX_MAX_INFO_SIZE must be in 1..32767"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  CMUX_MODE_BASIC = 0U,
+  CMUX_MODE_ADVANCED,
+}
+CMUX_ModeTypeDef;
+
+typedef enum
+{
+  CMUX_CHANNEL_CLOSED = 0U,
+  CMUX_CHANNEL_OPENING,
+  CMUX_CHANNEL_OPEN,
+  CMUX_CHANNEL_CLOSING,
+}
+CMUX_ChannelStateTypeDef;
+
+typedef enum
+{
+  CMUX_RX_HUNT = 0U,
+  CMUX_RX_ADDRESS,
+  CMUX_RX_CONTROL,
+  CMUX_RX_LENGTH,
+  CMUX_RX_LENGTH2,
+  CMUX_RX_INFO,
+  CMUX_RX_FCS,
+  CMUX_RX_FRAME,                           /* Advanced mode, up to the closing flag */
+}
+CMUX_RxStateTypeDef;
+
+typedef struct
+{
+  CMUX_ChannelStateTypeDef          state;
+  uint8_t                           Retries;
+  uint8_t                           RemoteFc;         /* Peer stopped our transmission */
+  uint8_t                           LocalFc;          /* We stopped the peer */
+  uint8_t                           Signals;          /* Last V.24 signals from the peer */
+  uint8_t                           MscPending;       /* MSC sent, response awaited */
+  uint32_t                          Timer;            /* Host timer at the last command */
+  uint32_t                          TxFrames;
+  uint32_t                          RxFrames;
+  uint32_t                          TxBytes;
+  uint32_t                          RxBytes;
+}
+CMUX_ChannelTypeDef;
+
+typedef struct
+{
+  USBH_HandleTypeDef                *phost;
+  CMUX_ModeTypeDef                  Mode;
+  uint8_t                           FcOff;            /* Peer stopped every channel */
+  uint8_t                           Closing;          /* CLD sent */
+  uint32_t                          TicksPerMs;
+  /* Receiver */
+  CMUX_RxStateTypeDef               RxState;
+  uint8_t                           RxAddress;
+  uint8_t                           RxControl;
+  uint8_t                           RxFcs;            /* Running CRC */
+  uint8_t                           RxEscape;
+  uint16_t                          RxLength;
+  uint16_t                          RxCount;
+  uint8_t                           *pRxInfo;         /* Info field: receive buffer or RxFrame */
+  uint32_t                          FcsErrors;
+  uint32_t                          Oversize;         /* Frames above CMUX_MAX_INFO_SIZE */
+  uint32_t                          Copies;           /* Frames assembled across buffers */
+  CMUX_ChannelTypeDef               Channel[CMUX_NUM_CHANNELS];
+  uint8_t                           RxFrame[CMUX_MAX_INFO_SIZE + 3U];
+  uint8_t                           CtrlBuff[8];
+}
+CMUX_HandleTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+
+USBH_StatusTypeDef CMUX_Start(CMUX_HandleTypeDef *pmux, USBH_HandleTypeDef *phost,
+                              CMUX_ModeTypeDef mode);
+USBH_StatusTypeDef CMUX_Stop(CMUX_HandleTypeDef *pmux);
+USBH_StatusTypeDef CMUX_OpenChannel(CMUX_HandleTypeDef *pmux, uint8_t dlci);
+USBH_StatusTypeDef CMUX_CloseChannel(CMUX_HandleTypeDef *pmux, uint8_t dlci);
+USBH_StatusTypeDef CMUX_SetFlow(CMUX_HandleTypeDef *pmux, uint8_t dlci, uint8_t enable);
+uint32_t           CMUX_Write(CMUX_HandleTypeDef *pmux, uint8_t dlci,
+                              const uint8_t *pbuff, uint32_t length);
+void               CMUX_Input(CMUX_HandleTypeDef *pmux, uint8_t *pbuff, uint32_t length);
+void               CMUX_Process(CMUX_HandleTypeDef *pmux);
+CMUX_ChannelStateTypeDef CMUX_GetState(CMUX_HandleTypeDef *pmux, uint8_t dlci);
+
+void               CMUX_ChannelStateCallback(CMUX_HandleTypeDef *pmux, uint8_t dlci,
+                                             CMUX_ChannelStateTypeDef state);
+void               CMUX_DataCallback(CMUX_HandleTypeDef *pmux, uint8_t dlci,
+                                     const uint8_t *pbuff, uint32_t length);
+void               CMUX_TxReadyCallback(CMUX_HandleTypeDef *pmux, uint8_t dlci);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_CMUX_H__ */
@@ -25,7 +25,11 @@
 #include "usbh_cdc.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "usbh_hub.h"
+#include "usbh_audio.h"
+#if (USBH_USE_URB_TRACE == 1U)
+#include <stdio.h>
+#endif /* (USBH_USE_URB_TRACE == 1U) */
 /* USER CODE END Includes */
 
 /* Private variables ---------------------------------------------------------*/
@@ -85,7 +89,15 @@ void MX_USB_HOST_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN USB_HOST_Init_PostTreatment */
-
+  /* CDC devices behind an external hub are reached with USBH_HUB_GetDevice */
+  if (USBH_RegisterClass(&hUsbHostHS, USBH_HUB_CLASS) != USBH_OK)
+  {
+    Error_Handler();
+  }
+  if (USBH_RegisterClass(&hUsbHostHS, USBH_AUDIO_CLASS) != USBH_OK)
+  {
+    Error_Handler();
+  }
   /* USER CODE END USB_HOST_Init_PostTreatment */
 }
 
@@ -103,6 +115,12 @@ void MX_USB_HOST_Process(void)
 static void USBH_UserProcess  (USBH_HandleTypeDef *phost, uint8_t id)
 {
   /* USER CODE BEGIN CALL_BACK_1 */
+  /* Devices behind a hub do not change the root port state */
+  if (phost != &hUsbHostHS)
+  {
+    return;
+  }
+
   switch(id)
   {
   case HOST_USER_SELECT_CONFIGURATION:
@@ -128,6 +146,77 @@ static void USBH_UserProcess  (USBH_HandleTypeDef *phost, uint8_t id)
 
 /* USER CODE BEGIN 2 */
 
+/**
+  * @brief  Run the host state machine once per event posted by an IRQ or a
+  *         class, or deadline reached. Called from the main loop after
+  *         MX_USB_HOST_Process, which CubeMX keeps generating as one
+  *         polling pass per loop.
+  * @retval None
+  */
+void MX_USB_HOST_ProcessEvents(void)
+{
+#if (USBH_USE_EVENTS == 1U)
+  (void)USBH_ProcessEvents(&hUsbHostHS);
+#endif
+}
+
+/**
+  * @brief  Check whether the USB host has pending work.
+  * @retval 1 if MX_USB_HOST_Process has something to do, 0 if the core may sleep
+  */
+uint8_t MX_USB_HOST_EventPending(void)
+{
+#if (USBH_USE_EVENTS == 1U)
+  return USBH_EventPending(&hUsbHostHS);
+#else
+  return 1U;
+#endif
+}
+
+#if (USBH_USE_URB_TRACE == 1U)
+/**
+  * @brief  Print the URB latency histograms on the console UART and restart
+  *         them. One line per pipe: endpoint, samples, then the submit to IRQ
+  *         and IRQ to class bins, in DWT cycles.
+  * @retval None
+  */
+void MX_USB_HOST_DumpUrbTrace(void)
+{
+  const USBH_UrbTraceTypeDef *ptrace = USBH_GetUrbTrace(&hUsbHostHS);
+  const USBH_UrbTracePipeTypeDef *ppipe;
+  uint32_t pipe;
+  uint32_t bin;
+
+  printf("URB trace: %u bins from 2^%u cycles\r\n", (unsigned int)ptrace->Bins, (unsigned int)ptrace->Shift);
+
+  for (pipe = 0U; pipe < ptrace->Pipes; pipe++)
+  {
+    ppipe = &ptrace->Pipe[pipe];
+
+    if (ppipe->Samples == 0U)
+    {
+      continue;
+    }
+
+    printf("%02X %lu bus %lu:", (unsigned int)ppipe->EpAddr, (unsigned long)ppipe->Samples,
+           (unsigned long)ppipe->BusMax);
+    for (bin = 0U; bin < ptrace->Bins; bin++)
+    {
+      printf(" %lu", (unsigned long)ppipe->BusHist[bin]);
+    }
+
+    printf(" obs %lu:", (unsigned long)ppipe->ObsMax);
+    for (bin = 0U; bin < ptrace->Bins; bin++)
+    {
+      printf(" %lu", (unsigned long)ppipe->ObsHist[bin]);
+    }
+    printf("\r\n");
+  }
+
+  (void)USBH_ClearUrbTrace(&hUsbHostHS);
+}
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
 /* USER CODE END 2 */
 
 /**
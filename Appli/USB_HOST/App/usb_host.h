@@ -31,7 +31,7 @@
 #include "stm32h7rsxx_hal.h"
 
 /* USER CODE BEGIN INCLUDE */
-
+#include "usbh_conf.h"
 /* USER CODE END INCLUDE */
 
 /** @addtogroup USBH_OTG_DRIVER
@@ -72,6 +72,17 @@ void MX_USB_HOST_Init(void);
 
 /* USER CODE BEGIN EFP */
 
+/** @brief Process the USB host events, USBH_USE_EVENTS builds. */
+void MX_USB_HOST_ProcessEvents(void);
+
+/** @brief Return 1 when the USB host has pending events. */
+uint8_t MX_USB_HOST_EventPending(void);
+
+#if (USBH_USE_URB_TRACE == 1U)
+/** @brief Print the URB latency histograms on the console. */
+void MX_USB_HOST_DumpUrbTrace(void);
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
 /* USER CODE END EFP */
 
 void MX_USB_HOST_Process(void);
@@ -0,0 +1,1040 @@
+/**
+  ******************************************************************************
+  * @file           : usb_voice.c
+  * @brief          : Telephony voice processing between the USB ports: G.711
+  *                   mu-law and A-law to linear PCM and back, Q4.12 gain and
+  *                   saturating mixers, and a conference bridge moving 10 ms
+  *                   blocks between CDC voice channels and local ports.
+  *
+  *                   On cores with the DSP extension the kernels work on
+  *                   packed 16-bit pairs (SMUAD, SMLALD, PKHBT, SSAT); the
+  *                   scalar build gives bit identical results.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_voice.h"
+#include "usbh_cdc.h"
+
+/* Private define ------------------------------------------------------------*/
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include "cmsis_compiler.h"
+#define VOICE_SIMD                         1U
+#elif defined(VOICE_SIMD_EMULATION)
+/* Host check of the packed path: C models of the CMSIS intrinsics it uses */
+#define VOICE_SIMD                         1U
+#else
+#define VOICE_SIMD                         0U
+#endif /* __ARM_FEATURE_DSP */
+
+#define VOICE_GAIN_SHIFT                   12U
+
+/* Samples per pass of the scalar mixers, their 64-bit sums live on the stack */
+#define VOICE_CHUNK_SAMPLES                32U
+
+/* VOICE_Mix of fewer channels keeps the sum of each sample in registers:
+   neither the packed channel pairs nor the chunked sums pay off below */
+#define VOICE_MIX_BLOCK_CHANNELS           4U
+
+/* VOICE_MixMinus of fewer channels mixes the other inputs of each output
+   directly: at most two products per output, against the shared sum and the
+   own channel removed from it */
+#define VOICE_MIX_MINUS_BLOCK_CHANNELS     4U
+
+#define VOICE_ULAW_BIAS                    0x84U
+#define VOICE_ULAW_CLIP                    32635U
+
+/* Private macro -------------------------------------------------------------*/
+
+/* Private variables ---------------------------------------------------------*/
+static int16_t VoiceUlawTable[256];
+static int16_t VoiceAlawTable[256];
+static uint8_t VoiceTablesReady;
+
+/* Private function prototypes -----------------------------------------------*/
+#if defined(VOICE_SIMD_EMULATION) && !defined(__ARM_FEATURE_DSP)
+static inline uint32_t __SMUAD(uint32_t op1, uint32_t op2);
+static inline uint64_t __SMLALD(uint32_t op1, uint32_t op2, uint64_t acc);
+static inline int32_t __SSAT(int32_t val, uint32_t sat);
+static inline uint32_t __CLZ(uint32_t val);
+#define __PKHBT(ARG1, ARG2, ARG3)  ((((uint32_t)(ARG1)) & 0x0000FFFFU) | ((((uint32_t)(ARG2)) << (ARG3)) & 0xFFFF0000U))
+#define __PKHTB(ARG1, ARG2, ARG3)  ((((uint32_t)(ARG1)) & 0xFFFF0000U) | ((((uint32_t)(ARG2)) >> (ARG3)) & 0x0000FFFFU))
+#endif /* VOICE_SIMD_EMULATION */
+static inline uint32_t VOICE_Clz(uint32_t val);
+static inline int16_t VOICE_Sat16(int32_t val);
+static inline uint32_t VOICE_Load32(const void *paddr);
+static inline void VOICE_Store32(void *paddr, uint32_t val);
+static int16_t VOICE_UlawDecode(uint8_t code);
+static int16_t VOICE_AlawDecode(uint8_t code);
+static inline uint8_t VOICE_UlawEncode(int32_t sample);
+static inline uint8_t VOICE_AlawEncode(int32_t sample);
+static uint32_t VOICE_BytesPerSample(VOICE_LawTypeDef law);
+static void VOICE_Decode(VOICE_LawTypeDef law, int16_t *pdst, const uint8_t *psrc, uint32_t count);
+static void VOICE_Encode(VOICE_LawTypeDef law, uint8_t *pdst, const int16_t *psrc, uint32_t count);
+static uint32_t VOICE_FifoPut(uint8_t *pfifo, uint32_t *phead, uint32_t tail,
+                              const uint8_t *pbuff, uint32_t length);
+static uint32_t VOICE_FifoGet(const uint8_t *pfifo, uint32_t head, uint32_t *ptail,
+                              uint8_t *pbuff, uint32_t length);
+
+/* Private functions ---------------------------------------------------------*/
+
+#if defined(VOICE_SIMD_EMULATION) && !defined(__ARM_FEATURE_DSP)
+/**
+  * @brief  SMUAD model: sum of the products of the signed halfwords.
+  */
+static inline uint32_t __SMUAD(uint32_t op1, uint32_t op2)
+{
+  int32_t lo = (int32_t)(int16_t)op1 * (int32_t)(int16_t)op2;
+  int32_t hi = (int32_t)(int16_t)(op1 >> 16) * (int32_t)(int16_t)(op2 >> 16);
+
+  return (uint32_t)(lo + hi);
+}
+
+/**
+  * @brief  SMLALD model: SMUAD accumulated on 64 bits.
+  */
+static inline uint64_t __SMLALD(uint32_t op1, uint32_t op2, uint64_t acc)
+{
+  int64_t lo = (int64_t)(int16_t)op1 * (int16_t)op2;
+  int64_t hi = (int64_t)(int16_t)(op1 >> 16) * (int16_t)(op2 >> 16);
+
+  return (uint64_t)((int64_t)acc + lo + hi);
+}
+
+/**
+  * @brief  SSAT model: saturate to a signed range of sat bits.
+  */
+static inline int32_t __SSAT(int32_t val, uint32_t sat)
+{
+  int32_t max = (int32_t)((1UL << (sat - 1U)) - 1U);
+
+  return (val > max) ? max : ((val < (-max - 1)) ? (-max - 1) : val);
+}
+
+/**
+  * @brief  CLZ model.
+  */
+static inline uint32_t __CLZ(uint32_t val)
+{
+  return (val == 0U) ? 32U : (uint32_t)__builtin_clz(val);
+}
+#endif /* VOICE_SIMD_EMULATION */
+
+/**
+  * @brief  Count the leading zeros of a non zero word.
+  * @param  val: Word
+  * @retval Leading zero bits
+  */
+static inline uint32_t VOICE_Clz(uint32_t val)
+{
+#if (VOICE_SIMD == 1U)
+  return (uint32_t)__CLZ(val);
+#elif defined(__GNUC__)
+  return (uint32_t)__builtin_clz(val);
+#else
+  uint32_t count = 0U;
+
+  while ((val & 0x80000000U) == 0U)
+  {
+    val <<= 1;
+    count++;
+  }
+
+  return count;
+#endif /* VOICE_SIMD */
+}
+
+/**
+  * @brief  Saturate to the 16-bit sample range.
+  * @param  val: Value
+  * @retval Sample
+  */
+static inline int16_t VOICE_Sat16(int32_t val)
+{
+#if (VOICE_SIMD == 1U)
+  return (int16_t)__SSAT(val, 16);
+#else
+  /* Two selects rather than nested branches: mixes clip often */
+  val = (val > 32767) ? 32767 : val;
+  val = (val < -32768) ? -32768 : val;
+
+  return (int16_t)val;
+#endif /* VOICE_SIMD */
+}
+
+/**
+  * @brief  Unaligned word load, a single LDR on Cortex-M7.
+  */
+static inline uint32_t VOICE_Load32(const void *paddr)
+{
+  uint32_t val;
+
+  (void)USBH_memcpy(&val, paddr, sizeof(val));
+
+  return val;
+}
+
+/**
+  * @brief  Unaligned word store, a single STR on Cortex-M7.
+  */
+static inline void VOICE_Store32(void *paddr, uint32_t val)
+{
+  (void)USBH_memcpy(paddr, &val, sizeof(val));
+}
+
+/**
+  * @brief  G.711 mu-law code to linear, used to build the decoding table.
+  * @param  code: mu-law code
+  * @retval Sample
+  */
+static int16_t VOICE_UlawDecode(uint8_t code)
+{
+  uint32_t ucode = (uint32_t)code ^ 0xFFU;
+  int32_t  mag;
+
+  mag = (int32_t)((((ucode & 0x0FU) << 3) + VOICE_ULAW_BIAS) << ((ucode & 0x70U) >> 4));
+  mag -= (int32_t)VOICE_ULAW_BIAS;
+
+  return (int16_t)(((ucode & 0x80U) != 0U) ? -mag : mag);
+}
+
+/**
+  * @brief  G.711 A-law code to linear, used to build the decoding table.
+  * @param  code: A-law code
+  * @retval Sample
+  */
+static int16_t VOICE_AlawDecode(uint8_t code)
+{
+  uint32_t acode = (uint32_t)code ^ 0x55U;
+  uint32_t seg = (acode & 0x70U) >> 4;
+  int32_t  mag = (int32_t)((acode & 0x0FU) << 4);
+
+  if (seg == 0U)
+  {
+    mag += 8;
+  }
+  else
+  {
+    mag = (mag + 0x108) << (seg - 1U);
+  }
+
+  return (int16_t)(((acode & 0x80U) != 0U) ? mag : -mag);
+}
+
+/**
+  * @brief  Linear to G.711 mu-law. The segment is the position of the
+  *         leading one of the biased magnitude, found with CLZ rather than
+  *         by searching the segment end table.
+  * @param  sample: Sample
+  * @retval mu-law code
+  */
+static inline uint8_t VOICE_UlawEncode(int32_t sample)
+{
+  uint32_t mask = 0xFFU;
+  uint32_t mag = (uint32_t)sample;
+  uint32_t seg;
+
+  if (sample < 0)
+  {
+    mask = 0x7FU;
+    mag = (uint32_t)(-sample);
+  }
+
+  if (mag > VOICE_ULAW_CLIP)
+  {
+    mag = VOICE_ULAW_CLIP;
+  }
+
+  mag += VOICE_ULAW_BIAS;
+  seg = 24U - VOICE_Clz(mag | 0xFFU);
+
+  return (uint8_t)(((seg << 4) | ((mag >> (seg + 3U)) & 0x0FU)) ^ mask);
+}
+
+/**
+  * @brief  Linear to G.711 A-law, segment found with CLZ.
+  * @param  sample: Sample
+  * @retval A-law code
+  */
+static inline uint8_t VOICE_AlawEncode(int32_t sample)
+{
+  uint32_t mask = 0xD5U;
+  int32_t  val = sample >> 3;
+  uint32_t mag;
+  uint32_t seg;
+
+  if (val < 0)
+  {
+    mask = 0x55U;
+    val = ~val;
+  }
+
+  mag = (uint32_t)val;
+  seg = 27U - VOICE_Clz(mag | 0x1FU);
+
+  return (uint8_t)(((seg << 4) | ((mag >> ((seg != 0U) ? seg : 1U)) & 0x0FU)) ^ mask);
+}
+
+/**
+  * @brief  Size of one sample on the wire.
+  * @param  law: Coding
+  * @retval Bytes
+  */
+static uint32_t VOICE_BytesPerSample(VOICE_LawTypeDef law)
+{
+  return (law == VOICE_LAW_PCM16) ? 2U : 1U;
+}
+
+/**
+  * @brief  Wire samples to linear.
+  * @param  law: Coding of psrc
+  * @param  pdst: Linear samples
+  * @param  psrc: Coded samples
+  * @param  count: Samples
+  * @retval None
+  */
+static void VOICE_Decode(VOICE_LawTypeDef law, int16_t *pdst, const uint8_t *psrc, uint32_t count)
+{
+  switch (law)
+  {
+    case VOICE_LAW_ULAW:
+      VOICE_UlawToPcm(pdst, psrc, count);
+      break;
+
+    case VOICE_LAW_ALAW:
+      VOICE_AlawToPcm(pdst, psrc, count);
+      break;
+
+    default:
+      (void)USBH_memcpy(pdst, psrc, 2U * count);
+      break;
+  }
+}
+
+/**
+  * @brief  Linear samples to the wire.
+  * @param  law: Coding of pdst
+  * @param  pdst: Coded samples
+  * @param  psrc: Linear samples
+  * @param  count: Samples
+  * @retval None
+  */
+static void VOICE_Encode(VOICE_LawTypeDef law, uint8_t *pdst, const int16_t *psrc, uint32_t count)
+{
+  switch (law)
+  {
+    case VOICE_LAW_ULAW:
+      VOICE_PcmToUlaw(pdst, psrc, count);
+      break;
+
+    case VOICE_LAW_ALAW:
+      VOICE_PcmToAlaw(pdst, psrc, count);
+      break;
+
+    default:
+      (void)USBH_memcpy(pdst, psrc, 2U * count);
+      break;
+  }
+}
+
+/**
+  * @brief  Copy into a byte FIFO, what does not fit is dropped.
+  * @param  pfifo: FIFO storage, VOICE_FIFO_SIZE bytes
+  * @param  phead: Free running write count
+  * @param  tail: Free running read count
+  * @param  pbuff: Data
+  * @param  length: Data length
+  * @retval Bytes queued
+  */
+static uint32_t VOICE_FifoPut(uint8_t *pfifo, uint32_t *phead, uint32_t tail,
+                              const uint8_t *pbuff, uint32_t length)
+{
+  uint32_t head = *phead;
+  uint32_t count = VOICE_FIFO_SIZE - (head - tail);
+  uint32_t offset = head & (VOICE_FIFO_SIZE - 1U);
+  uint32_t chunk;
+
+  if (count > length)
+  {
+    count = length;
+  }
+
+  chunk = VOICE_FIFO_SIZE - offset;
+  if (chunk > count)
+  {
+    chunk = count;
+  }
+
+  (void)USBH_memcpy(&pfifo[offset], pbuff, chunk);
+  (void)USBH_memcpy(pfifo, &pbuff[chunk], count - chunk);
+  *phead = head + count;
+
+  return count;
+}
+
+/**
+  * @brief  Copy out of a byte FIFO.
+  * @param  pfifo: FIFO storage, VOICE_FIFO_SIZE bytes
+  * @param  head: Free running write count
+  * @param  ptail: Free running read count
+  * @param  pbuff: Destination
+  * @param  length: Destination size
+  * @retval Bytes copied
+  */
+static uint32_t VOICE_FifoGet(const uint8_t *pfifo, uint32_t head, uint32_t *ptail,
+                              uint8_t *pbuff, uint32_t length)
+{
+  uint32_t tail = *ptail;
+  uint32_t count = head - tail;
+  uint32_t offset = tail & (VOICE_FIFO_SIZE - 1U);
+  uint32_t chunk;
+
+  if (count > length)
+  {
+    count = length;
+  }
+
+  chunk = VOICE_FIFO_SIZE - offset;
+  if (chunk > count)
+  {
+    chunk = count;
+  }
+
+  (void)USBH_memcpy(pbuff, &pfifo[offset], chunk);
+  (void)USBH_memcpy(&pbuff[chunk], pfifo, count - chunk);
+  *ptail = tail + count;
+
+  return count;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Build the G.711 decoding tables. Called by VOICE_Bridge_Init,
+  *         needed once before the kernels are used on their own.
+  * @retval None
+  */
+void VOICE_Init(void)
+{
+  uint32_t code;
+
+  if (VoiceTablesReady != 0U)
+  {
+    return;
+  }
+
+  for (code = 0U; code < 256U; code++)
+  {
+    VoiceUlawTable[code] = VOICE_UlawDecode((uint8_t)code);
+    VoiceAlawTable[code] = VOICE_AlawDecode((uint8_t)code);
+  }
+
+  VoiceTablesReady = 1U;
+}
+
+/**
+  * @brief  G.711 mu-law to linear PCM.
+  * @param  pdst: Linear samples
+  * @param  psrc: mu-law codes
+  * @param  count: Samples
+  * @retval None
+  */
+void VOICE_UlawToPcm(int16_t *pdst, const uint8_t *psrc, uint32_t count)
+{
+  uint32_t idx = 0U;
+
+#if (VOICE_SIMD == 1U)
+  /* Four codes per word load, two packed samples per word store */
+  for (; (idx + 4U) <= count; idx += 4U)
+  {
+    uint32_t codes = VOICE_Load32(&psrc[idx]);
+
+    VOICE_Store32(&pdst[idx], __PKHBT((uint32_t)(uint16_t)VoiceUlawTable[codes & 0xFFU],
+                                      (uint32_t)(uint16_t)VoiceUlawTable[(codes >> 8) & 0xFFU], 16));
+    VOICE_Store32(&pdst[idx + 2U], __PKHBT((uint32_t)(uint16_t)VoiceUlawTable[(codes >> 16) & 0xFFU],
+                                           (uint32_t)(uint16_t)VoiceUlawTable[codes >> 24], 16));
+  }
+#endif /* VOICE_SIMD */
+
+  for (; idx < count; idx++)
+  {
+    pdst[idx] = VoiceUlawTable[psrc[idx]];
+  }
+}
+
+/**
+  * @brief  G.711 A-law to linear PCM.
+  * @param  pdst: Linear samples
+  * @param  psrc: A-law codes
+  * @param  count: Samples
+  * @retval None
+  */
+void VOICE_AlawToPcm(int16_t *pdst, const uint8_t *psrc, uint32_t count)
+{
+  uint32_t idx = 0U;
+
+#if (VOICE_SIMD == 1U)
+  for (; (idx + 4U) <= count; idx += 4U)
+  {
+    uint32_t codes = VOICE_Load32(&psrc[idx]);
+
+    VOICE_Store32(&pdst[idx], __PKHBT((uint32_t)(uint16_t)VoiceAlawTable[codes & 0xFFU],
+                                      (uint32_t)(uint16_t)VoiceAlawTable[(codes >> 8) & 0xFFU], 16));
+    VOICE_Store32(&pdst[idx + 2U], __PKHBT((uint32_t)(uint16_t)VoiceAlawTable[(codes >> 16) & 0xFFU],
+                                           (uint32_t)(uint16_t)VoiceAlawTable[codes >> 24], 16));
+  }
+#endif /* VOICE_SIMD */
+
+  for (; idx < count; idx++)
+  {
+    pdst[idx] = VoiceAlawTable[psrc[idx]];
+  }
+}
+
+/**
+  * @brief  Linear PCM to G.711 mu-law.
+  * @param  pdst: mu-law codes
+  * @param  psrc: Linear samples
+  * @param  count: Samples
+  * @retval None
+  */
+void VOICE_PcmToUlaw(uint8_t *pdst, const int16_t *psrc, uint32_t count)
+{
+  uint32_t idx = 0U;
+
+#if (VOICE_SIMD == 1U)
+  /* Two packed sample loads, one word store of four codes */
+  for (; (idx + 4U) <= count; idx += 4U)
+  {
+    uint32_t lo = VOICE_Load32(&psrc[idx]);
+    uint32_t hi = VOICE_Load32(&psrc[idx + 2U]);
+
+    VOICE_Store32(&pdst[idx], (uint32_t)VOICE_UlawEncode((int16_t)lo) |
+                  ((uint32_t)VOICE_UlawEncode((int16_t)(lo >> 16)) << 8) |
+                  ((uint32_t)VOICE_UlawEncode((int16_t)hi) << 16) |
+                  ((uint32_t)VOICE_UlawEncode((int16_t)(hi >> 16)) << 24));
+  }
+#endif /* VOICE_SIMD */
+
+  for (; idx < count; idx++)
+  {
+    pdst[idx] = VOICE_UlawEncode(psrc[idx]);
+  }
+}
+
+/**
+  * @brief  Linear PCM to G.711 A-law.
+  * @param  pdst: A-law codes
+  * @param  psrc: Linear samples
+  * @param  count: Samples
+  * @retval None
+  */
+void VOICE_PcmToAlaw(uint8_t *pdst, const int16_t *psrc, uint32_t count)
+{
+  uint32_t idx = 0U;
+
+#if (VOICE_SIMD == 1U)
+  for (; (idx + 4U) <= count; idx += 4U)
+  {
+    uint32_t lo = VOICE_Load32(&psrc[idx]);
+    uint32_t hi = VOICE_Load32(&psrc[idx + 2U]);
+
+    VOICE_Store32(&pdst[idx], (uint32_t)VOICE_AlawEncode((int16_t)lo) |
+                  ((uint32_t)VOICE_AlawEncode((int16_t)(lo >> 16)) << 8) |
+                  ((uint32_t)VOICE_AlawEncode((int16_t)hi) << 16) |
+                  ((uint32_t)VOICE_AlawEncode((int16_t)(hi >> 16)) << 24));
+  }
+#endif /* VOICE_SIMD */
+
+  for (; idx < count; idx++)
+  {
+    pdst[idx] = VOICE_AlawEncode(psrc[idx]);
+  }
+}
+
+/**
+  * @brief  Apply a Q4.12 gain with saturation, in place when pdst == psrc.
+  * @param  pdst: Output samples
+  * @param  psrc: Input samples
+  * @param  gain: Q4.12 gain
+  * @param  count: Samples
+  * @retval None
+  */
+void VOICE_Gain(int16_t *pdst, const int16_t *psrc, int16_t gain, uint32_t count)
+{
+  uint32_t idx;
+
+  /* One product per sample either way: a packed pair costs two SMUAD, two
+     shifts and a PKHBT against two MUL and two shifts, so no packed path */
+  for (idx = 0U; idx < count; idx++)
+  {
+    pdst[idx] = VOICE_Sat16(((int32_t)psrc[idx] * gain) >> VOICE_GAIN_SHIFT);
+  }
+}
+
+/**
+  * @brief  Weighted sum of channels: pdst[n] = sat(sum(psrc[c][n] * gain[c]) >> 12).
+  *         The products are accumulated on 64 bits, only the sum saturates.
+  * @param  pdst: Output samples, may alias one of the inputs
+  * @param  psrc: Input channels
+  * @param  gain: Q4.12 gain of each channel
+  * @param  channels: Channels, up to VOICE_MAX_PORTS
+  * @param  count: Samples
+  * @retval None
+  */
+void VOICE_Mix(int16_t *pdst, const int16_t *const psrc[], const int16_t gain[],
+               uint32_t channels, uint32_t count)
+{
+  uint32_t idx = 0U;
+  uint32_t ch;
+#if (VOICE_SIMD == 1U)
+  uint32_t gpair[(VOICE_MAX_PORTS + 1U) / 2U];
+#endif /* VOICE_SIMD */
+
+  if (channels < VOICE_MIX_BLOCK_CHANNELS)
+  {
+    for (; idx < count; idx++)
+    {
+      int64_t acc = 0;
+
+      for (ch = 0U; ch < channels; ch++)
+      {
+        acc += (int32_t)psrc[ch][idx] * gain[ch];
+      }
+
+      pdst[idx] = VOICE_Sat16((int32_t)(acc >> VOICE_GAIN_SHIFT));
+    }
+
+    return;
+  }
+
+#if (VOICE_SIMD == 1U)
+  /* Channel pairs share a packed gain: one SMLALD per pair and sample */
+  for (ch = 0U; ch < channels; ch += 2U)
+  {
+    gpair[ch / 2U] = (uint32_t)(uint16_t)gain[ch] |
+                     (((ch + 1U) < channels) ? ((uint32_t)(uint16_t)gain[ch + 1U] << 16) : 0U);
+  }
+
+  for (; (idx + 2U) <= count; idx += 2U)
+  {
+    uint64_t acc0 = 0U;
+    uint64_t acc1 = 0U;
+
+    for (ch = 0U; (ch + 1U) < channels; ch += 2U)
+    {
+      uint32_t a = VOICE_Load32(&psrc[ch][idx]);
+      uint32_t b = VOICE_Load32(&psrc[ch + 1U][idx]);
+
+      acc0 = __SMLALD(__PKHBT(a, b, 16), gpair[ch / 2U], acc0);
+      acc1 = __SMLALD(__PKHTB(b, a, 16), gpair[ch / 2U], acc1);
+    }
+
+    if (ch < channels)
+    {
+      uint32_t a = VOICE_Load32(&psrc[ch][idx]);
+
+      acc0 = __SMLALD(a, gpair[ch / 2U], acc0);
+      acc1 = __SMLALD(a, gpair[ch / 2U] << 16, acc1);
+    }
+
+    VOICE_Store32(&pdst[idx],
+                  __PKHBT((uint32_t)__SSAT((int32_t)((int64_t)acc0 >> VOICE_GAIN_SHIFT), 16),
+                          (uint32_t)__SSAT((int32_t)((int64_t)acc1 >> VOICE_GAIN_SHIFT), 16), 16));
+  }
+#endif /* VOICE_SIMD */
+
+  while (idx < count)
+  {
+    int64_t  acc[VOICE_CHUNK_SAMPLES];
+    uint32_t chunk = ((count - idx) < VOICE_CHUNK_SAMPLES) ? (count - idx) : VOICE_CHUNK_SAMPLES;
+    uint32_t n;
+
+    /* One channel at a time over a chunk: unit stride, no reload of the
+       channel pointers per sample */
+    (void)USBH_memset(acc, 0, sizeof(acc));
+
+    for (ch = 0U; ch < channels; ch++)
+    {
+      const int16_t *pin = &psrc[ch][idx];
+      int32_t g = gain[ch];
+
+      for (n = 0U; n < chunk; n++)
+      {
+        acc[n] += (int32_t)pin[n] * g;
+      }
+    }
+
+    for (n = 0U; n < chunk; n++)
+    {
+      pdst[idx + n] = VOICE_Sat16((int32_t)(acc[n] >> VOICE_GAIN_SHIFT));
+    }
+
+    idx += chunk;
+  }
+}
+
+/**
+  * @brief  Conference mix: each output is the mix of all the other inputs,
+  *         pdst[c][n] = sat((sum - psrc[c][n] * gain[c]) >> 12). The sum is
+  *         taken once per sample and the own channel removed from it, linear
+  *         in the channel count instead of quadratic. Below
+  *         VOICE_MIX_MINUS_BLOCK_CHANNELS the other inputs are mixed directly.
+  * @param  pdst: Output channels, distinct from the inputs
+  * @param  psrc: Input channels
+  * @param  gain: Q4.12 gain of each input
+  * @param  channels: Channels, up to VOICE_MAX_PORTS
+  * @param  count: Samples
+  * @retval None
+  */
+void VOICE_MixMinus(int16_t *const pdst[], const int16_t *const psrc[], const int16_t gain[],
+                    uint32_t channels, uint32_t count)
+{
+  uint32_t idx = 0U;
+  uint32_t ch;
+#if (VOICE_SIMD == 1U)
+  uint32_t gpair[(VOICE_MAX_PORTS + 1U) / 2U];
+#endif /* VOICE_SIMD */
+
+  if (channels < VOICE_MIX_MINUS_BLOCK_CHANNELS)
+  {
+    for (ch = 0U; ch < channels; ch++)
+    {
+      for (idx = 0U; idx < count; idx++)
+      {
+        int64_t  acc = 0;
+        uint32_t other;
+
+        for (other = 0U; other < channels; other++)
+        {
+          if (other != ch)
+          {
+            acc += (int32_t)psrc[other][idx] * gain[other];
+          }
+        }
+
+        pdst[ch][idx] = VOICE_Sat16((int32_t)(acc >> VOICE_GAIN_SHIFT));
+      }
+    }
+
+    return;
+  }
+
+#if (VOICE_SIMD == 1U)
+  for (ch = 0U; ch < channels; ch += 2U)
+  {
+    gpair[ch / 2U] = (uint32_t)(uint16_t)gain[ch] |
+                     (((ch + 1U) < channels) ? ((uint32_t)(uint16_t)gain[ch + 1U] << 16) : 0U);
+  }
+
+  for (; (idx + 2U) <= count; idx += 2U)
+  {
+    int64_t  sum0;
+    int64_t  sum1;
+    uint64_t acc0 = 0U;
+    uint64_t acc1 = 0U;
+
+    for (ch = 0U; (ch + 1U) < channels; ch += 2U)
+    {
+      uint32_t a = VOICE_Load32(&psrc[ch][idx]);
+      uint32_t b = VOICE_Load32(&psrc[ch + 1U][idx]);
+
+      acc0 = __SMLALD(__PKHBT(a, b, 16), gpair[ch / 2U], acc0);
+      acc1 = __SMLALD(__PKHTB(b, a, 16), gpair[ch / 2U], acc1);
+    }
+
+    if (ch < channels)
+    {
+      uint32_t a = VOICE_Load32(&psrc[ch][idx]);
+
+      acc0 = __SMLALD(a, gpair[ch / 2U], acc0);
+      acc1 = __SMLALD(a, gpair[ch / 2U] << 16, acc1);
+    }
+
+    sum0 = (int64_t)acc0;
+    sum1 = (int64_t)acc1;
+
+    for (ch = 0U; ch < channels; ch++)
+    {
+      uint32_t a = VOICE_Load32(&psrc[ch][idx]);
+      uint32_t glo = (uint32_t)(uint16_t)gain[ch];
+      int32_t  lo = (int32_t)((sum0 - (int32_t)__SMUAD(a, glo)) >> VOICE_GAIN_SHIFT);
+      int32_t  hi = (int32_t)((sum1 - (int32_t)__SMUAD(a, glo << 16)) >> VOICE_GAIN_SHIFT);
+
+      VOICE_Store32(&pdst[ch][idx], __PKHBT((uint32_t)__SSAT(lo, 16), (uint32_t)__SSAT(hi, 16), 16));
+    }
+  }
+#endif /* VOICE_SIMD */
+
+  while (idx < count)
+  {
+    int64_t  sum[VOICE_CHUNK_SAMPLES];
+    uint32_t chunk = ((count - idx) < VOICE_CHUNK_SAMPLES) ? (count - idx) : VOICE_CHUNK_SAMPLES;
+    uint32_t n;
+
+    (void)USBH_memset(sum, 0, sizeof(sum));
+
+    for (ch = 0U; ch < channels; ch++)
+    {
+      const int16_t *pin = &psrc[ch][idx];
+      int32_t g = gain[ch];
+
+      for (n = 0U; n < chunk; n++)
+      {
+        sum[n] += (int32_t)pin[n] * g;
+      }
+    }
+
+    for (ch = 0U; ch < channels; ch++)
+    {
+      const int16_t *pin = &psrc[ch][idx];
+      int16_t *pout = &pdst[ch][idx];
+      int32_t g = gain[ch];
+
+      for (n = 0U; n < chunk; n++)
+      {
+        pout[n] = VOICE_Sat16((int32_t)((sum[n] - ((int32_t)pin[n] * g)) >> VOICE_GAIN_SHIFT));
+      }
+    }
+
+    idx += chunk;
+  }
+}
+
+/**
+  * @brief  Reset a bridge, all its ports closed.
+  * @param  pbridge: Bridge
+  * @retval None
+  */
+void VOICE_Bridge_Init(VOICE_BridgeTypeDef *pbridge)
+{
+  VOICE_Init();
+  (void)USBH_memset(pbridge, 0, sizeof(VOICE_BridgeTypeDef));
+}
+
+/**
+  * @brief  Add a port to the conference. A CDC port is fed by
+  *         VOICE_Bridge_Put from USBH_CDC_ReceiveStreamCallback and sends its
+  *         mix with USBH_CDC_Write; a local port (phost NULL) is fed and
+  *         drained by the application with VOICE_Bridge_Put and
+  *         VOICE_Bridge_Get.
+  * @param  pbridge: Bridge
+  * @param  phost: CDC device of the voice channel, or NULL
+  * @param  law: Coding of the port samples
+  * @param  gain: Q4.12 gain of the port input in the mix
+  * @retval Port index, VOICE_NO_PORT when the bridge is full
+  */
+uint8_t VOICE_Bridge_Open(VOICE_BridgeTypeDef *pbridge, USBH_HandleTypeDef *phost,
+                          VOICE_LawTypeDef law, int16_t gain)
+{
+  VOICE_PortTypeDef *pport;
+  uint8_t idx;
+
+  for (idx = 0U; idx < VOICE_MAX_PORTS; idx++)
+  {
+    pport = &pbridge->Port[idx];
+
+    if (pport->Open == 0U)
+    {
+      pport->phost = phost;
+      pport->Law = law;
+      pport->Gain = gain;
+      pport->Prefill = 1U;
+      pport->RxHead = 0U;
+      pport->RxTail = 0U;
+      pport->TxHead = 0U;
+      pport->TxTail = 0U;
+      pport->Underruns = 0U;
+      pport->Overruns = 0U;
+      pport->Open = 1U;
+
+      return idx;
+    }
+  }
+
+  USBH_ErrLog("VOICE: no free bridge port");
+
+  return VOICE_NO_PORT;
+}
+
+/**
+  * @brief  Remove a port from the conference.
+  * @param  pbridge: Bridge
+  * @param  port: Port index
+  * @retval None
+  */
+void VOICE_Bridge_Close(VOICE_BridgeTypeDef *pbridge, uint8_t port)
+{
+  if (port < VOICE_MAX_PORTS)
+  {
+    pbridge->Port[port].Open = 0U;
+  }
+}
+
+/**
+  * @brief  Port of a CDC device, for the reception stream callback.
+  * @param  pbridge: Bridge
+  * @param  phost: CDC device
+  * @retval Port index, VOICE_NO_PORT when the device has none
+  */
+uint8_t VOICE_Bridge_FindPort(VOICE_BridgeTypeDef *pbridge, USBH_HandleTypeDef *phost)
+{
+  uint8_t idx;
+
+  for (idx = 0U; idx < VOICE_MAX_PORTS; idx++)
+  {
+    if ((pbridge->Port[idx].Open != 0U) && (pbridge->Port[idx].phost == phost) && (phost != NULL))
+    {
+      return idx;
+    }
+  }
+
+  return VOICE_NO_PORT;
+}
+
+/**
+  * @brief  Queue coded samples received on a port.
+  * @param  pbridge: Bridge
+  * @param  port: Port index
+  * @param  pbuff: Coded samples
+  * @param  length: Length in bytes
+  * @retval Bytes queued, the rest is dropped and counted as overrun
+  */
+uint32_t VOICE_Bridge_Put(VOICE_BridgeTypeDef *pbridge, uint8_t port,
+                          const uint8_t *pbuff, uint32_t length)
+{
+  VOICE_PortTypeDef *pport;
+  uint32_t count;
+
+  if ((port >= VOICE_MAX_PORTS) || (pbridge->Port[port].Open == 0U))
+  {
+    return 0U;
+  }
+
+  pport = &pbridge->Port[port];
+  count = VOICE_FifoPut(pport->RxFifo, &pport->RxHead, pport->RxTail, pbuff, length);
+  pport->Overruns += length - count;
+
+  return count;
+}
+
+/**
+  * @brief  Take the coded mix of a local port.
+  * @param  pbridge: Bridge
+  * @param  port: Local port index
+  * @param  pbuff: Destination
+  * @param  length: Destination size
+  * @retval Bytes copied
+  */
+uint32_t VOICE_Bridge_Get(VOICE_BridgeTypeDef *pbridge, uint8_t port,
+                          uint8_t *pbuff, uint32_t length)
+{
+  VOICE_PortTypeDef *pport;
+
+  if ((port >= VOICE_MAX_PORTS) || (pbridge->Port[port].Open == 0U))
+  {
+    return 0U;
+  }
+
+  pport = &pbridge->Port[port];
+
+  return VOICE_FifoGet(pport->TxFifo, pport->TxHead, &pport->TxTail, pbuff, length);
+}
+
+/**
+  * @brief  Mix one block, to be called every VOICE_BLOCK_SAMPLES sample
+  *         periods. Each port input is decoded, silence when the port has
+  *         run dry (it then waits for two blocks again), every port gets
+  *         the mix of the others, coded in its own law.
+  * @param  pbridge: Bridge
+  * @retval None
+  */
+void VOICE_Bridge_Process(VOICE_BridgeTypeDef *pbridge)
+{
+  const int16_t *psrc[VOICE_MAX_PORTS];
+  int16_t *pdst[VOICE_MAX_PORTS];
+  int16_t gain[VOICE_MAX_PORTS];
+  uint8_t ports[VOICE_MAX_PORTS];
+  VOICE_PortTypeDef *pport;
+  uint32_t channels = 0U;
+  uint32_t length;
+  uint32_t count;
+  uint32_t idx;
+
+  for (idx = 0U; idx < VOICE_MAX_PORTS; idx++)
+  {
+    pport = &pbridge->Port[idx];
+
+    if (pport->Open == 0U)
+    {
+      continue;
+    }
+
+    length = VOICE_BLOCK_SAMPLES * VOICE_BytesPerSample(pport->Law);
+
+    if ((pport->Prefill != 0U) && ((pport->RxHead - pport->RxTail) >= (2U * length)))
+    {
+      pport->Prefill = 0U;
+    }
+
+    if ((pport->Prefill == 0U) && ((pport->RxHead - pport->RxTail) >= length))
+    {
+      (void)VOICE_FifoGet(pport->RxFifo, pport->RxHead, &pport->RxTail, pbridge->Coded, length);
+      VOICE_Decode(pport->Law, pbridge->In[channels], pbridge->Coded, VOICE_BLOCK_SAMPLES);
+    }
+    else
+    {
+      if (pport->Prefill == 0U)
+      {
+        pport->Underruns++;
+        pport->Prefill = 1U;
+      }
+
+      (void)USBH_memset(pbridge->In[channels], 0, sizeof(pbridge->In[channels]));
+    }
+
+    psrc[channels] = pbridge->In[channels];
+    pdst[channels] = pbridge->Out[channels];
+    gain[channels] = pport->Gain;
+    ports[channels] = (uint8_t)idx;
+    channels++;
+  }
+
+  if (channels == 0U)
+  {
+    return;
+  }
+
+  VOICE_MixMinus(pdst, psrc, gain, channels, VOICE_BLOCK_SAMPLES);
+
+  for (idx = 0U; idx < channels; idx++)
+  {
+    pport = &pbridge->Port[ports[idx]];
+    length = VOICE_BLOCK_SAMPLES * VOICE_BytesPerSample(pport->Law);
+
+    VOICE_Encode(pport->Law, pbridge->Coded, pbridge->Out[idx], VOICE_BLOCK_SAMPLES);
+
+    if (pport->phost != NULL)
+    {
+      count = USBH_CDC_Write(pport->phost, pbridge->Coded, length);
+    }
+    else
+    {
+      count = VOICE_FifoPut(pport->TxFifo, &pport->TxHead, pport->TxTail, pbridge->Coded, length);
+    }
+
+    pport->Overruns += length - count;
+  }
+
+  pbridge->Blocks++;
+}
@@ -0,0 +1,131 @@
+/**
+  ******************************************************************************
+  * @file           : usb_voice.h
+  * @brief          : Header for usb_voice.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_VOICE_H__
+#define __USB_VOICE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Gains are Q4.12: unity is 4096, the range is [-8, 8) */
+#define VOICE_GAIN_UNITY                   4096
+
+/* Channels of one mix, the bridge ports included */
+#ifndef VOICE_MAX_PORTS
+#define VOICE_MAX_PORTS                    8U
+#endif /* VOICE_MAX_PORTS */
+
+/* Samples moved per VOICE_Bridge_Process call: 10 ms at 8 kHz */
+#ifndef VOICE_BLOCK_SAMPLES
+#define VOICE_BLOCK_SAMPLES                80U
+#endif /* VOICE_BLOCK_SAMPLES */
+
+/* Receive and local transmit FIFO of a port, in bytes */
+#ifndef VOICE_FIFO_SIZE
+#define VOICE_FIFO_SIZE                    1024U
+#endif /* VOICE_FIFO_SIZE */
+
+#define VOICE_NO_PORT                      0xFFU
+
+#if ((VOICE_FIFO_SIZE & (VOICE_FIFO_SIZE - 1U)) != 0U) || (VOICE_FIFO_SIZE < (4U * VOICE_BLOCK_SAMPLES))
+#error "VOICE_FIFO_SIZE must be a power of two holding two PCM16 blocks"
+#endif
+
+#if ((VOICE_BLOCK_SAMPLES & 3U) != 0U)
+#error "VOICE_BLOCK_SAMPLES must be a multiple of 4"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Coding of the samples a port carries */
+typedef enum
+{
+  VOICE_LAW_PCM16 = 0U,                    /* Linear, little endian */
+  VOICE_LAW_ULAW,                          /* G.711 mu-law */
+  VOICE_LAW_ALAW,                          /* G.711 A-law */
+}
+VOICE_LawTypeDef;
+
+typedef struct
+{
+  USBH_HandleTypeDef                *phost;           /* CDC device, NULL for a local port */
+  VOICE_LawTypeDef                  Law;
+  int16_t                           Gain;             /* Q4.12, applied to the port input */
+  uint8_t                           Open;
+  uint8_t                           Prefill;          /* Input held until two blocks are queued */
+  uint32_t                          RxHead;           /* Free running byte counts */
+  uint32_t                          RxTail;
+  uint32_t                          TxHead;
+  uint32_t                          TxTail;
+  uint32_t                          Underruns;        /* Blocks mixed as silence */
+  uint32_t                          Overruns;         /* Bytes dropped, FIFO or CDC ring full */
+  uint8_t                           RxFifo[VOICE_FIFO_SIZE];
+  uint8_t                           TxFifo[VOICE_FIFO_SIZE];
+}
+VOICE_PortTypeDef;
+
+/* Conference of up to VOICE_MAX_PORTS ports: every port receives the sum of
+   the others. All the bridge functions run in the thread calling
+   USBH_Process, USBH_CDC_ReceiveStreamCallback included. */
+typedef struct
+{
+  VOICE_PortTypeDef                 Port[VOICE_MAX_PORTS];
+  int16_t                           In[VOICE_MAX_PORTS][VOICE_BLOCK_SAMPLES];
+  int16_t                           Out[VOICE_MAX_PORTS][VOICE_BLOCK_SAMPLES];
+  uint8_t                           Coded[2U * VOICE_BLOCK_SAMPLES];
+  uint32_t                          Blocks;
+}
+VOICE_BridgeTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+
+void     VOICE_Init(void);
+
+void     VOICE_UlawToPcm(int16_t *pdst, const uint8_t *psrc, uint32_t count);
+void     VOICE_AlawToPcm(int16_t *pdst, const uint8_t *psrc, uint32_t count);
+void     VOICE_PcmToUlaw(uint8_t *pdst, const int16_t *psrc, uint32_t count);
+void     VOICE_PcmToAlaw(uint8_t *pdst, const int16_t *psrc, uint32_t count);
+
+void     VOICE_Gain(int16_t *pdst, const int16_t *psrc, int16_t gain, uint32_t count);
+void     VOICE_Mix(int16_t *pdst, const int16_t *const psrc[], const int16_t gain[],
+                   uint32_t channels, uint32_t count);
+void     VOICE_MixMinus(int16_t *const pdst[], const int16_t *const psrc[], const int16_t gain[],
+                        uint32_t channels, uint32_t count);
+
+void     VOICE_Bridge_Init(VOICE_BridgeTypeDef *pbridge);
+uint8_t  VOICE_Bridge_Open(VOICE_BridgeTypeDef *pbridge, USBH_HandleTypeDef *phost,
+                           VOICE_LawTypeDef law, int16_t gain);
+void     VOICE_Bridge_Close(VOICE_BridgeTypeDef *pbridge, uint8_t port);
+uint8_t  VOICE_Bridge_FindPort(VOICE_BridgeTypeDef *pbridge, USBH_HandleTypeDef *phost);
+uint32_t VOICE_Bridge_Put(VOICE_BridgeTypeDef *pbridge, uint8_t port,
+                          const uint8_t *pbuff, uint32_t length);
+uint32_t VOICE_Bridge_Get(VOICE_BridgeTypeDef *pbridge, uint8_t port,
+                          uint8_t *pbuff, uint32_t length);
+void     VOICE_Bridge_Process(VOICE_BridgeTypeDef *pbridge);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_VOICE_H__ */
@@ -0,0 +1,837 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_conf.c
+  * @brief          : Low level driver of the USB host library on a virtual
+  *                   high-speed host controller, for host builds. Transfers
+  *                   run against the device model of usbh_sim_device.c on a
+  *                   virtual microsecond clock, so that every run of the
+  *                   same scenario gives the same timings. Class data and
+  *                   transfer buffers come from the same static pools as on
+  *                   the target.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+#include "usbh_cdc.h"
+#include "usbh_audio.h"
+#include "usbh_sim_device.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  USBH_SIM_PIPE_IDLE = 0U,
+  USBH_SIM_PIPE_XFER,       /* Waiting for the next transaction */
+  USBH_SIM_PIPE_DONE,       /* Outcome known, reported once on the wire */
+}
+USBH_SimPipeStateTypeDef;
+
+/* Host channel of the virtual controller */
+typedef struct
+{
+  uint8_t                   ep_addr;
+  uint8_t                   dev_address;
+  uint8_t                   ep_type;
+  uint16_t                  mps;
+  uint8_t                   toggle_in;
+  uint8_t                   toggle_out;
+  uint8_t                   direction;
+  uint8_t                   token;
+  uint8_t                  *pbuff;
+  uint32_t                  xfer_len;
+  uint32_t                  xfer_count;
+  uint64_t                  due_us;
+  USBH_SimPipeStateTypeDef  state;
+  USBH_URBStateTypeDef      urb_state;
+  USBH_URBStateTypeDef      next_state;
+}
+USBH_SimPipeTypeDef;
+
+typedef struct
+{
+  USBH_HandleTypeDef       *phost;
+  USBH_SimDevTypeDef       *pdev;
+  uint8_t                   started;
+  uint8_t                   connected;
+  uint8_t                   port_enabled;
+  uint8_t                   enable_pending;
+  uint64_t                  now_us;
+  uint64_t                  enable_us;
+  uint64_t                  next_sof_us;
+  USBH_SimTimingTypeDef     timing;
+  USBH_SimStatsTypeDef      stats;
+  USBH_SimPipeTypeDef       pipe[USBH_SIM_MAX_PIPES];
+}
+USBH_SimTypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define USBH_SIM_NO_EVENT         UINT64_MAX
+
+/* Private variables ---------------------------------------------------------*/
+static USBH_SimTypeDef USBH_Sim =
+{
+  .timing =
+  {
+    .urb_latency_us = 2U,
+    .byte_time_ps = 16667U,
+    .nak_retry_us = 10U,
+    .reset_recovery_us = 1000U,
+  },
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBH_Sim_RunPipe(USBH_SimPipeTypeDef *pipe);
+static void USBH_Sim_CancelPipes(void);
+static uint64_t USBH_Sim_NextEvent(void);
+static uint64_t USBH_Sim_WireTime(uint32_t bytes);
+
+/*******************************************************************************
+                       Virtual controller
+*******************************************************************************/
+
+/**
+  * @brief  Plug a device into the root port, or unplug it with NULL. The
+  *         connection is reported at the next bus event.
+  * @param  pdev: Device model
+  * @retval None
+  */
+void USBH_Sim_Attach(USBH_SimDevTypeDef *pdev)
+{
+  if (pdev != NULL)
+  {
+    USBH_SimDev_Reset(pdev);
+  }
+
+  USBH_Sim.pdev = pdev;
+}
+
+/**
+  * @brief  Set the bus timing.
+  * @param  timing: Timing parameters
+  * @retval None
+  */
+void USBH_Sim_SetTiming(const USBH_SimTimingTypeDef *timing)
+{
+  USBH_Sim.timing = *timing;
+}
+
+/**
+  * @brief  Return the virtual time.
+  * @retval Time in us
+  */
+uint64_t USBH_Sim_GetTimeUs(void)
+{
+  return USBH_Sim.now_us;
+}
+
+/**
+  * @brief  Return the transfer counters.
+  * @retval Counters
+  */
+const USBH_SimStatsTypeDef *USBH_Sim_GetStats(void)
+{
+  return &USBH_Sim.stats;
+}
+
+/**
+  * @brief  Clear the transfer counters.
+  * @retval None
+  */
+void USBH_Sim_ClearStats(void)
+{
+  (void)USBH_memset(&USBH_Sim.stats, 0, sizeof(USBH_Sim.stats));
+}
+
+/**
+  * @brief  Run every bus event due at the current time: port changes, SOFs
+  *         and transactions. The host callbacks are called from here, as the
+  *         OTG interrupt handler does on the target.
+  * @retval None
+  */
+void USBH_Sim_Poll(void)
+{
+  USBH_HandleTypeDef *phost = USBH_Sim.phost;
+  USBH_SimPipeTypeDef *pipe;
+  uint32_t idx;
+
+  if (phost == NULL)
+  {
+    return;
+  }
+
+  if ((USBH_Sim.started != 0U) && (USBH_Sim.connected == 0U) && (USBH_Sim.pdev != NULL))
+  {
+    USBH_Sim.connected = 1U;
+    (void)USBH_LL_Connect(phost);
+  }
+  else if ((USBH_Sim.connected != 0U) && (USBH_Sim.pdev == NULL))
+  {
+    USBH_Sim.connected = 0U;
+    USBH_Sim.port_enabled = 0U;
+    USBH_Sim.enable_pending = 0U;
+    USBH_Sim_CancelPipes();
+    (void)USBH_LL_Disconnect(phost);
+  }
+  else
+  {
+    /* .. */
+  }
+
+  if ((USBH_Sim.enable_pending != 0U) && (USBH_Sim.enable_us <= USBH_Sim.now_us))
+  {
+    USBH_Sim.enable_pending = 0U;
+    USBH_Sim.port_enabled = 1U;
+    USBH_Sim.next_sof_us = USBH_Sim.now_us;
+    USBH_LL_PortEnabled(phost);
+  }
+
+  while ((USBH_Sim.port_enabled != 0U) && (USBH_Sim.next_sof_us <= USBH_Sim.now_us))
+  {
+    USBH_Sim.next_sof_us += USBH_SIM_SOF_PERIOD_US;
+    USBH_Sim.stats.sofs++;
+
+    if (USBH_Sim.pdev != NULL)
+    {
+      USBH_SimDev_Sof(USBH_Sim.pdev);
+    }
+
+    USBH_LL_IncTimer(phost);
+  }
+
+  for (idx = 0U; idx < USBH_SIM_MAX_PIPES; idx++)
+  {
+    pipe = &USBH_Sim.pipe[idx];
+
+    if ((pipe->state == USBH_SIM_PIPE_XFER) && (pipe->due_us <= USBH_Sim.now_us))
+    {
+      USBH_Sim_RunPipe(pipe);
+    }
+
+    if ((pipe->state == USBH_SIM_PIPE_DONE) && (pipe->due_us <= USBH_Sim.now_us))
+    {
+      pipe->state = USBH_SIM_PIPE_IDLE;
+      pipe->urb_state = pipe->next_state;
+      USBH_LL_PipeCompleted(phost, (uint8_t)idx, pipe->urb_state, pipe->xfer_count);
+      (void)USBH_LL_NotifyURBChange(phost);
+    }
+  }
+}
+
+/**
+  * @brief  Move the clock to the next bus event and run it.
+  * @retval None
+  */
+void USBH_Sim_Step(void)
+{
+  uint64_t next = USBH_Sim_NextEvent();
+
+  if (next == USBH_SIM_NO_EVENT)
+  {
+    next = USBH_Sim.now_us + USBH_SIM_SOF_PERIOD_US;
+  }
+
+  if (next > USBH_Sim.now_us)
+  {
+    USBH_Sim.now_us = next;
+  }
+
+  USBH_Sim_Poll();
+}
+
+/**
+  * @brief  Move the clock forward, running the bus events on the way.
+  * @param  us: Time to advance, in us
+  * @retval None
+  */
+void USBH_Sim_Advance(uint32_t us)
+{
+  uint64_t target = USBH_Sim.now_us + us;
+  uint64_t next;
+
+  do
+  {
+    next = USBH_Sim_NextEvent();
+
+    if ((next == USBH_SIM_NO_EVENT) || (next > target))
+    {
+      next = target;
+    }
+
+    if (next > USBH_Sim.now_us)
+    {
+      USBH_Sim.now_us = next;
+    }
+
+    USBH_Sim_Poll();
+  } while (USBH_Sim.now_us < target);
+}
+
+/**
+  * @brief  Return the time of the next bus event.
+  * @retval Time in us, USBH_SIM_NO_EVENT if the bus is idle
+  */
+static uint64_t USBH_Sim_NextEvent(void)
+{
+  uint64_t next = USBH_SIM_NO_EVENT;
+  uint32_t idx;
+
+  if ((USBH_Sim.started != 0U) && ((USBH_Sim.pdev != NULL) != (USBH_Sim.connected != 0U)))
+  {
+    return USBH_Sim.now_us;
+  }
+
+  if (USBH_Sim.enable_pending != 0U)
+  {
+    next = USBH_Sim.enable_us;
+  }
+
+  if ((USBH_Sim.port_enabled != 0U) && (USBH_Sim.next_sof_us < next))
+  {
+    next = USBH_Sim.next_sof_us;
+  }
+
+  for (idx = 0U; idx < USBH_SIM_MAX_PIPES; idx++)
+  {
+    if ((USBH_Sim.pipe[idx].state != USBH_SIM_PIPE_IDLE) && (USBH_Sim.pipe[idx].due_us < next))
+    {
+      next = USBH_Sim.pipe[idx].due_us;
+    }
+  }
+
+  return next;
+}
+
+/**
+  * @brief  Wire time of a number of bytes.
+  * @param  bytes: Byte count
+  * @retval Time in us, at least 1
+  */
+static uint64_t USBH_Sim_WireTime(uint32_t bytes)
+{
+  uint64_t time = (((uint64_t)bytes * USBH_Sim.timing.byte_time_ps) + 999999U) / 1000000U;
+
+  return (time != 0U) ? time : 1U;
+}
+
+/**
+  * @brief  Abort the transfers in flight, as a channel halt does.
+  * @retval None
+  */
+static void USBH_Sim_CancelPipes(void)
+{
+  uint32_t idx;
+
+  for (idx = 0U; idx < USBH_SIM_MAX_PIPES; idx++)
+  {
+    USBH_Sim.pipe[idx].state = USBH_SIM_PIPE_IDLE;
+  }
+}
+
+/**
+  * @brief  Run the transactions of a pipe against the device model.
+  *         Like the OTG core with DMA: bulk and control IN NAKs are retried
+  *         without notice, interrupt IN and every OUT NAK halt the channel
+  *         with URB_NOTREADY; an OUT NAK keeps the count of the packets
+  *         already acknowledged. An isochronous transfer is one packet.
+  * @param  pipe: Pipe
+  * @retval None
+  */
+static void USBH_Sim_RunPipe(USBH_SimPipeTypeDef *pipe)
+{
+  USBH_SimDevTypeDef *pdev = NULL;
+  USBH_SimRespTypeDef resp = USBH_SIM_ACK;
+  uint8_t packet[USBH_SIM_MAX_PACKET];
+  uint32_t start = pipe->xfer_count;
+  uint16_t length;
+  uint16_t mps = (pipe->mps != 0U) ? MIN(pipe->mps, USBH_SIM_MAX_PACKET) : 8U;
+
+  /* Behind a hub, the device is picked by its address */
+  if ((USBH_Sim.pdev != NULL) && (USBH_Sim.port_enabled != 0U))
+  {
+    pdev = USBH_SimDev_Route(USBH_Sim.pdev, pipe->dev_address);
+  }
+
+  if (pdev == NULL)
+  {
+    /* No handshake: transaction error */
+    resp = USBH_SIM_NORESP;
+  }
+  else if (pipe->token == USBH_PID_SETUP)
+  {
+    resp = USBH_SimDev_Setup(pdev, pipe->pbuff);
+    pipe->xfer_count = pipe->xfer_len;
+    USBH_Sim.stats.packets++;
+  }
+  else if (pipe->direction == 0U)
+  {
+    do
+    {
+      length = (uint16_t)MIN(pipe->xfer_len - pipe->xfer_count, (uint32_t)mps);
+      resp = USBH_SimDev_Out(pdev, pipe->ep_addr, &pipe->pbuff[pipe->xfer_count], length);
+
+      if (resp != USBH_SIM_ACK)
+      {
+        break;
+      }
+
+      pipe->xfer_count += length;
+      pipe->toggle_out ^= 1U;
+      USBH_Sim.stats.packets++;
+    } while ((pipe->xfer_count < pipe->xfer_len) && (pipe->ep_type != EP_TYPE_ISOC));
+
+    USBH_Sim.stats.bytes_out += pipe->xfer_count - start;
+  }
+  else
+  {
+    do
+    {
+      resp = USBH_SimDev_In(pdev, pipe->ep_addr, packet, mps, &length);
+
+      if (resp != USBH_SIM_ACK)
+      {
+        break;
+      }
+
+      length = (uint16_t)MIN((uint32_t)length, pipe->xfer_len - pipe->xfer_count);
+      if (length != 0U)
+      {
+        (void)USBH_memcpy(&pipe->pbuff[pipe->xfer_count], packet, length);
+      }
+
+      pipe->xfer_count += length;
+      pipe->toggle_in ^= 1U;
+      USBH_Sim.stats.packets++;
+    } while ((length == mps) && (pipe->xfer_count < pipe->xfer_len) && (pipe->ep_type != EP_TYPE_ISOC));
+
+    USBH_Sim.stats.bytes_in += pipe->xfer_count - start;
+  }
+
+  /* The outcome shows once the data has crossed the bus */
+  pipe->due_us = USBH_Sim.now_us + USBH_Sim_WireTime(pipe->xfer_count - start);
+
+  switch (resp)
+  {
+    case USBH_SIM_ACK:
+      pipe->next_state = USBH_URB_DONE;
+      pipe->state = USBH_SIM_PIPE_DONE;
+      break;
+
+    case USBH_SIM_NAK:
+      USBH_Sim.stats.naks++;
+      if ((pipe->direction != 0U) && (pipe->ep_type != EP_TYPE_INTR))
+      {
+        pipe->due_us += USBH_Sim.timing.nak_retry_us;
+      }
+      else
+      {
+        pipe->next_state = USBH_URB_NOTREADY;
+        pipe->state = USBH_SIM_PIPE_DONE;
+      }
+      break;
+
+    case USBH_SIM_STALL:
+      USBH_Sim.stats.stalls++;
+      pipe->next_state = USBH_URB_STALL;
+      pipe->state = USBH_SIM_PIPE_DONE;
+      break;
+
+    default:
+      USBH_Sim.stats.errors++;
+      pipe->next_state = USBH_URB_ERROR;
+      pipe->state = USBH_SIM_PIPE_DONE;
+      break;
+  }
+}
+
+/*******************************************************************************
+                       LL Driver Interface (USB Host Library --> HCD)
+*******************************************************************************/
+
+/**
+  * @brief  Initialize the low level portion of the host driver.
+  * @param  phost: Host handle
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_Init(USBH_HandleTypeDef *phost)
+{
+  if (phost->id != HOST_HS)
+  {
+    return USBH_FAIL;
+  }
+
+  USBH_Sim.phost = phost;
+  phost->pData = &USBH_Sim;
+
+  (void)USBH_memset(USBH_Sim.pipe, 0, sizeof(USBH_Sim.pipe));
+  USBH_LL_SetTimer(phost, 0U);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  De-Initialize the low level portion of the host driver.
+  * @param  phost: Host handle
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_DeInit(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  USBH_Sim_CancelPipes();
+  USBH_Sim.phost = NULL;
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Start the low level portion of the host driver.
+  * @param  phost: Host handle
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_Start(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  USBH_Sim.started = 1U;
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Stop the low level portion of the host driver. The port is
+  *         powered down: an attached device is reported again on restart.
+  * @param  phost: Host handle
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_Stop(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  USBH_Sim.started = 0U;
+  USBH_Sim.connected = 0U;
+  USBH_Sim.port_enabled = 0U;
+  USBH_Sim.enable_pending = 0U;
+  USBH_Sim_CancelPipes();
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Return the USB host speed from the low level driver.
+  * @param  phost: Host handle
+  * @retval USBH speeds
+  */
+USBH_SpeedTypeDef USBH_LL_GetSpeed(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  return USBH_SPEED_HIGH;
+}
+
+/**
+  * @brief  Reset the Host port of the low level driver.
+  * @param  phost: Host handle
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_ResetPort(USBH_HandleTypeDef *phost)
+{
+  (void)USBH_LL_ResetPort2(phost, 1U);
+  USBH_Delay(10U);
+
+  return USBH_LL_ResetPort2(phost, 0U);
+}
+
+/**
+  * @brief  Drive the Host port reset without waiting; the caller times
+  *         the reset pulse.
+  * @param  phost: Host handle
+  * @param  state: 1 to assert the reset, 0 to release it
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_ResetPort2(USBH_HandleTypeDef *phost, uint8_t state)
+{
+  UNUSED(phost);
+
+  if (state != 0U)
+  {
+    USBH_Sim.port_enabled = 0U;
+    USBH_Sim.enable_pending = 0U;
+    USBH_Sim_CancelPipes();
+
+    if (USBH_Sim.pdev != NULL)
+    {
+      USBH_SimDev_Reset(USBH_Sim.pdev);
+    }
+  }
+  else if (USBH_Sim.connected != 0U)
+  {
+    USBH_Sim.enable_pending = 1U;
+    USBH_Sim.enable_us = USBH_Sim.now_us + USBH_Sim.timing.reset_recovery_us;
+  }
+  else
+  {
+    /* .. */
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Return the last transferred packet size.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @retval Packet size
+  */
+uint32_t USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+  UNUSED(phost);
+
+  return USBH_Sim.pipe[pipe].xfer_count;
+}
+
+/**
+  * @brief  Return the number of bytes acknowledged on a halted OUT pipe.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @retval Acknowledged byte count
+  */
+uint32_t USBH_LL_GetOutXferCount(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+  UNUSED(phost);
+
+  if ((USBH_Sim.pipe[pipe].ep_addr & 0x80U) != 0U)
+  {
+    return 0U;
+  }
+
+  return USBH_Sim.pipe[pipe].xfer_count;
+}
+
+/**
+  * @brief  Open a pipe of the low level driver.
+  * @param  phost: Host handle
+  * @param  pipe_num: Pipe index
+  * @param  epnum: Endpoint number
+  * @param  dev_address: Device USB address
+  * @param  speed: Device Speed
+  * @param  ep_type: Endpoint type
+  * @param  mps: Endpoint max packet size
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num, uint8_t epnum,
+                                    uint8_t dev_address, uint8_t speed, uint8_t ep_type, uint16_t mps)
+{
+  USBH_SimPipeTypeDef *pipe;
+
+  UNUSED(phost);
+  UNUSED(speed);
+
+  if (pipe_num >= USBH_SIM_MAX_PIPES)
+  {
+    return USBH_FAIL;
+  }
+
+  pipe = &USBH_Sim.pipe[pipe_num];
+  (void)USBH_memset(pipe, 0, sizeof(USBH_SimPipeTypeDef));
+
+  pipe->ep_addr = epnum;
+  pipe->dev_address = dev_address;
+  pipe->ep_type = ep_type;
+  pipe->mps = mps;
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Close a pipe of the low level driver.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_ClosePipe(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+  UNUSED(phost);
+
+  if (pipe >= USBH_SIM_MAX_PIPES)
+  {
+    return USBH_FAIL;
+  }
+
+  USBH_Sim.pipe[pipe].state = USBH_SIM_PIPE_IDLE;
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Submit a new URB to the low level driver.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @param  direction: 0 for OUT, 1 for IN
+  * @param  ep_type: Endpoint type
+  * @param  token: 0 for PID_SETUP, 1 for PID_DATA
+  * @param  pbuff: pointer to URB data
+  * @param  length: Length of URB data
+  * @param  do_ping: unused, the virtual bus has no PING protocol
+  * @retval Status
+  */
+USBH_StatusTypeDef USBH_LL_SubmitURB(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t direction,
+                                     uint8_t ep_type, uint8_t token, uint8_t *pbuff, uint16_t length,
+                                     uint8_t do_ping)
+{
+  USBH_SimPipeTypeDef *ppipe;
+
+  UNUSED(phost);
+  UNUSED(do_ping);
+
+  if (pipe >= USBH_SIM_MAX_PIPES)
+  {
+    return USBH_FAIL;
+  }
+
+  ppipe = &USBH_Sim.pipe[pipe];
+
+  ppipe->direction = direction;
+  ppipe->ep_type = ep_type;
+  ppipe->token = token;
+  ppipe->pbuff = pbuff;
+  ppipe->xfer_len = length;
+  ppipe->xfer_count = 0U;
+  ppipe->urb_state = USBH_URB_IDLE;
+  /* Isochronous transfers go out in the next (micro)frame */
+  ppipe->due_us = ((ep_type == EP_TYPE_ISOC) ? USBH_Sim.next_sof_us : USBH_Sim.now_us) +
+                  USBH_Sim.timing.urb_latency_us;
+  ppipe->state = USBH_SIM_PIPE_XFER;
+
+  USBH_Sim.stats.urbs++;
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Get a URB state from the low level driver.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @retval URB state
+  */
+USBH_URBStateTypeDef USBH_LL_GetURBState(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+  UNUSED(phost);
+
+  if (pipe >= USBH_SIM_MAX_PIPES)
+  {
+    return USBH_URB_ERROR;
+  }
+
+#if (USBH_USE_URB_TRACE == 1U)
+  if (USBH_Sim.pipe[pipe].urb_state == USBH_URB_DONE)
+  {
+    USBH_LL_PipeObserved(phost, pipe);
+  }
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+  return USBH_Sim.pipe[pipe].urb_state;
+}
+
+#if (USBH_USE_URB_TRACE == 1U)
+/**
+  * @brief  Read the cycle counter stamping the URB latencies: the virtual
+  *         clock seen by a core running at USBH_SIM_CPU_MHZ.
+  * @param  phost: Host handle
+  * @retval Cycles
+  */
+uint32_t USBH_LL_GetCycles(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  return (uint32_t)(USBH_Sim.now_us * USBH_SIM_CPU_MHZ);
+}
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+/**
+  * @brief  Drive VBUS. Removing VBUS resets the attached device.
+  * @param  phost: Host handle
+  * @param  state : VBUS state
+  * @retval Status
+  */
+USBH_StatusTypeDef USBH_LL_DriverVBUS(USBH_HandleTypeDef *phost, uint8_t state)
+{
+  UNUSED(phost);
+
+  if ((state == 0U) && (USBH_Sim.pdev != NULL))
+  {
+    USBH_SimDev_Reset(USBH_Sim.pdev);
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Set toggle for a pipe.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @param  toggle: toggle (0/1)
+  * @retval Status
+  */
+USBH_StatusTypeDef USBH_LL_SetToggle(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t toggle)
+{
+  UNUSED(phost);
+
+  if ((USBH_Sim.pipe[pipe].ep_addr & 0x80U) != 0U)
+  {
+    USBH_Sim.pipe[pipe].toggle_in = toggle;
+  }
+  else
+  {
+    USBH_Sim.pipe[pipe].toggle_out = toggle;
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Return the current toggle of a pipe.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @retval toggle (0/1)
+  */
+uint8_t USBH_LL_GetToggle(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+  UNUSED(phost);
+
+  if ((USBH_Sim.pipe[pipe].ep_addr & 0x80U) != 0U)
+  {
+    return USBH_Sim.pipe[pipe].toggle_in;
+  }
+
+  return USBH_Sim.pipe[pipe].toggle_out;
+}
+
+/**
+  * @brief  Delay routine for the USB Host Library: the virtual clock moves
+  *         on and the bus keeps running, as it does under HAL_Delay.
+  * @param  Delay: Delay in ms
+  * @retval None
+  */
+void USBH_Delay(uint32_t Delay)
+{
+  USBH_Sim_Advance(Delay * 1000U);
+}
+
+/**
+  * @brief  Millisecond tick for the USB Host Library deadlines
+  * @retval Tick in ms
+  */
+uint32_t USBH_GetTick(void)
+{
+  return (uint32_t)(USBH_Sim.now_us / 1000U);
+}
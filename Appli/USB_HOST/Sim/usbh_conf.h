@@ -0,0 +1,292 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_conf.h
+  * @brief          : Host build of the USB host library configuration; the low
+  *                   level driver runs against a virtual device instead of the
+  *                   OTG_HS core.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBH_CONF__H__
+#define __USBH_CONF__H__
+#ifdef __cplusplus
+ extern "C" {
+#endif
+/* Includes ------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/** @addtogroup STM32_USB_HOST_LIBRARY
+  * @{
+  */
+
+/** @defgroup USBH_CONF
+  * @brief usb host low level driver configuration file
+  * @{
+  */
+
+/** @defgroup USBH_CONF_Exported_Defines USBH_CONF_Exported_Defines
+  * @brief Defines for configuration of the Usb host.
+  * @{
+  */
+
+/* Same class and core configuration as Target/usbh_conf.h */
+#define USBH_MAX_NUM_ENDPOINTS      2U
+#define USBH_MAX_NUM_INTERFACES      2U
+#define USBH_MAX_NUM_CONFIGURATION      1U
+#define USBH_KEEP_CFG_DESCRIPTOR      1U
+#define USBH_MAX_NUM_SUPPORTED_CLASS      3U
+#define USBH_MAX_SIZE_CONFIGURATION      256U
+#define USBH_MAX_DATA_BUFFER      512U
+#ifndef USBH_DEBUG_LEVEL
+#define USBH_DEBUG_LEVEL      0U
+#endif
+#define USBH_USE_OS      0U
+#define USBH_USE_EVENTS      1U
+#define USBH_EVENT_QUEUE_SIZE      16U
+#define USBH_USE_DMA      1U
+#define USBH_DMA_POOL_BLOCK_SIZE      512U
+#define USBH_HUB_MAX_PORTS      2U
+#define USBH_DMA_POOL_BLOCKS(size)    (((size) + USBH_DMA_POOL_BLOCK_SIZE - 1U) / USBH_DMA_POOL_BLOCK_SIZE)
+#define USBH_DMA_POOL_HUB_BLOCKS      USBH_DMA_POOL_BLOCKS(USBH_HUB_BUFF_SIZE)
+#define USBH_DMA_POOL_CDC_BLOCKS      (USBH_DMA_POOL_BLOCKS(USBH_CDC_TX_RING_SIZE) + \
+                                       USBH_DMA_POOL_BLOCKS(USBH_CDC_NOTIF_BUFFER_SIZE + 64U) + \
+                                       (USBH_CDC_RX_STREAM_NUM_BUFFERS * \
+                                        USBH_DMA_POOL_BLOCKS(USBH_CDC_RX_STREAM_BUFFER_SIZE)))
+#define USBH_DMA_POOL_AUDIO_BLOCKS    (2U * USBH_DMA_POOL_BLOCKS(USBH_AUDIO_MAX_PACKET_SIZE + 32U))
+#define USBH_DMA_POOL_NUM_BLOCKS      (USBH_DMA_POOL_HUB_BLOCKS + (USBH_HUB_MAX_PORTS * \
+                                       MAX(USBH_DMA_POOL_CDC_BLOCKS, USBH_DMA_POOL_AUDIO_BLOCKS)))
+/* Target/usbh_pool.c: the DMA pool is only non-cacheable memory on the target */
+#define USBH_DMA_POOL_ATTRIBUTES      __attribute__((aligned(32U)))
+#ifndef USBH_USE_CTL_CHAIN
+#define USBH_USE_CTL_CHAIN      1U
+#endif /* USBH_USE_CTL_CHAIN */
+#ifndef USBH_USE_URB_TRACE
+#define USBH_USE_URB_TRACE      1U
+#endif /* USBH_USE_URB_TRACE */
+/* On here, unlike the target: the warm enumeration test checks cache hits */
+#define USBH_USE_ENUM_CACHE      1U
+#define USBH_ENUM_CACHE_ENTRIES      4U
+#define USBH_ENUM_CACHE_BKPSRAM      0U
+
+/* Host channels of the virtual controller, as on the OTG_HS core */
+#define USBH_SIM_MAX_PIPES      16U
+
+/* Microframe length of the virtual high-speed bus, in us */
+#define USBH_SIM_SOF_PERIOD_US      125U
+
+/* Core clock of the URB trace cycle counter, in MHz */
+#define USBH_SIM_CPU_MHZ      600U
+
+/****************************************/
+/* #define for FS and HS identification */
+#define HOST_HS 		0
+#define HOST_FS 		1
+
+/* HAL definitions used by the library, without the HAL */
+#ifndef __IO
+#define __IO                volatile
+#endif
+#ifndef UNUSED
+#define UNUSED(X)           (void)(X)
+#endif
+/* Single threaded host build: no interrupt to mask around the pools */
+#define __get_PRIMASK()     0U
+#define __disable_irq()     do {} while (0)
+#define __set_PRIMASK(X)    UNUSED(X)
+#define EP_TYPE_CTRL        0U
+#define EP_TYPE_ISOC        1U
+#define EP_TYPE_BULK        2U
+#define EP_TYPE_INTR        3U
+#define EP_TYPE_MSK         3U
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_CONF_Exported_Macros USBH_CONF_Exported_Macros
+  * @brief Aliases.
+  * @{
+  */
+
+/* Memory management macros: the static pools of the target */
+
+/** Alias for memory allocation from the static class pool. */
+#define USBH_malloc         USBH_Pool_Alloc
+
+/** Alias for memory release to the static class pool. */
+#define USBH_free           USBH_Pool_Free
+
+/** Alias for memory set. */
+#define USBH_memset         memset
+
+/** Alias for memory copy. */
+#define USBH_memcpy         memcpy
+
+/** Alias for memory compare. */
+#define USBH_memcmp         memcmp
+
+/** Alias for DMA-safe memory allocation. */
+#define USBH_dma_malloc     USBH_DMA_Alloc
+
+/** Alias for DMA-safe memory release. */
+#define USBH_dma_free       USBH_DMA_Free
+
+/* DEBUG macros */
+
+#if (USBH_DEBUG_LEVEL > 0U)
+#define  USBH_UsrLog(...)   do { \
+                            printf(__VA_ARGS__); \
+                            printf("\n"); \
+} while (0)
+#else
+#define USBH_UsrLog(...) do {} while (0)
+#endif
+
+#if (USBH_DEBUG_LEVEL > 1U)
+
+#define  USBH_ErrLog(...) do { \
+                            printf("ERROR: "); \
+                            printf(__VA_ARGS__); \
+                            printf("\n"); \
+} while (0)
+#else
+#define USBH_ErrLog(...) do {} while (0)
+#endif
+
+#if (USBH_DEBUG_LEVEL > 2U)
+#define  USBH_DbgLog(...)   do { \
+                            printf("DEBUG : "); \
+                            printf(__VA_ARGS__); \
+                            printf("\n"); \
+} while (0)
+#else
+#define USBH_DbgLog(...) do {} while (0)
+#endif
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_CONF_Exported_Types USBH_CONF_Exported_Types
+  * @brief Types.
+  * @{
+  */
+
+/* Bus timing of the virtual controller */
+typedef struct
+{
+  uint32_t  urb_latency_us;    /* From SubmitURB to the first transaction */
+  uint32_t  byte_time_ps;      /* Wire time per byte: 16667 ps at 480 Mbit/s */
+  uint32_t  nak_retry_us;      /* Interval of the IN retries after a NAK */
+  uint32_t  reset_recovery_us; /* From the port reset release to port enabled */
+} USBH_SimTimingTypeDef;
+
+/* Transfer counters of the virtual controller */
+typedef struct
+{
+  uint32_t  urbs;
+  uint32_t  packets;
+  uint32_t  naks;
+  uint32_t  stalls;
+  uint32_t  errors;
+  uint32_t  sofs;
+  uint64_t  bytes_out;
+  uint64_t  bytes_in;
+} USBH_SimStatsTypeDef;
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_CONF_Exported_FunctionsPrototype USBH_CONF_Exported_FunctionsPrototype
+  * @brief Declaration of public functions for Usb host.
+  * @{
+  */
+
+/* Exported functions -------------------------------------------------------*/
+
+/** @brief Allocate a class data block from the static pool. */
+void    *USBH_Pool_Alloc(uint32_t size);
+
+/** @brief Release a block obtained with USBH_Pool_Alloc. */
+void     USBH_Pool_Free(void *ptr);
+
+/** @brief Return the number of class pool blocks currently allocated. */
+uint32_t USBH_Pool_GetUsedBlocks(void);
+
+/** @brief Return the highest number of class pool blocks allocated at once. */
+uint32_t USBH_Pool_GetPeakBlocks(void);
+
+/** @brief Return the number of class pool requests that could not be served. */
+uint32_t USBH_Pool_GetFailCount(void);
+
+/** @brief Allocate a transfer buffer from the DMA pool. */
+void    *USBH_DMA_Alloc(uint32_t size);
+
+/** @brief Release a buffer obtained with USBH_DMA_Alloc. */
+void     USBH_DMA_Free(void *ptr);
+
+/** @brief Return 1 when ptr lies in the DMA pool. */
+uint8_t  USBH_DMA_IsPoolBuffer(const void *ptr);
+
+/** @brief Return the number of DMA pool blocks currently allocated. */
+uint32_t USBH_DMA_GetUsedBlocks(void);
+
+struct _USBH_SimDevTypeDef;
+
+/** @brief Plug a virtual device into the root port, NULL to unplug it. */
+void      USBH_Sim_Attach(struct _USBH_SimDevTypeDef *pdev);
+
+/** @brief Set the bus timing of the virtual controller. */
+void      USBH_Sim_SetTiming(const USBH_SimTimingTypeDef *timing);
+
+/** @brief Run the virtual bus up to the current time. */
+void      USBH_Sim_Poll(void);
+
+/** @brief Move the virtual clock to the next bus event and run it. */
+void      USBH_Sim_Step(void);
+
+/** @brief Move the virtual clock forward by us and run the bus. */
+void      USBH_Sim_Advance(uint32_t us);
+
+/** @brief Return the virtual time in us. */
+uint64_t  USBH_Sim_GetTimeUs(void);
+
+/** @brief Return the transfer counters of the virtual controller. */
+const USBH_SimStatsTypeDef *USBH_Sim_GetStats(void);
+
+/** @brief Clear the transfer counters of the virtual controller. */
+void      USBH_Sim_ClearStats(void);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBH_CONF__H__ */
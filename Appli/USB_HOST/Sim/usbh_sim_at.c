@@ -0,0 +1,583 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_sim_at.c
+  * @brief          : AT engine benchmark: modem transcripts are replayed
+  *                   through usb_at.c in receive buffers of several sizes,
+  *                   the commands queued as the engine takes them, and
+  *                   through a naive parser, the way applications read
+  *                   USBH_CDC_Receive data: bytes copied to a line buffer,
+  *                   the line compared with every known code in turn. Both
+  *                   must report the same events. One JSON object per line.
+  *
+  *                   The CDC writer is stubbed: commands are counted, not
+  *                   sent, so the numbers are those of the parser alone.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_at.h"
+#include "usbh_cdc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLE_UNIT          "tsc"
+#else
+#include <time.h>
+#define BENCH_CYCLE_UNIT          "ns"
+#endif
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_STREAM_SIZE         (1024U * 1024U)
+#define BENCH_REPEAT              8U
+#define BENCH_LINE_SIZE           AT_MAX_LINE_SIZE
+#define BENCH_FNV_BASIS           0x811C9DC5U
+#define BENCH_FNV_PRIME           0x01000193U
+
+/* Private typedef -----------------------------------------------------------*/
+
+/* One exchange: the command, or NULL for output the modem sends on its own,
+   and what the modem sent back */
+typedef struct
+{
+  const char *pCmd;
+  const char *pPrefix;
+  const char *pReply;
+}
+Bench_ExchangeTypeDef;
+
+typedef struct
+{
+  const char *pKey;
+  AT_ResultTypeDef Result;
+  AT_UrcTypeDef Urc;
+}
+Naive_CodeTypeDef;
+
+typedef struct
+{
+  uint32_t Hash;                 /* Over every event and its data */
+  uint32_t Results;
+  uint32_t Infos;
+  uint32_t Urcs;
+  uint32_t Prompts;
+}
+Bench_EventsTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+
+/* Registration, PDP context, SMS in PDU mode, a call and USSD, on a
+   27.007 LTE module, V1 result codes */
+static const Bench_ExchangeTypeDef BenchTranscript[] =
+{
+  { "ATE0", NULL, "ATE0\r\r\nOK\r\n" },
+  { "ATI", NULL, "\r\nQuectel\r\nEG25\r\nRevision: EG25GGBR07A08M2G\r\n\r\nOK\r\n" },
+  { "AT+CGSN", NULL, "\r\n867698041234567\r\n\r\nOK\r\n" },
+  { "AT+CMEE=1", NULL, "\r\nOK\r\n" },
+  { "AT+CPIN?", "+CPIN:", "\r\n+CPIN: READY\r\n\r\nOK\r\n" },
+  { NULL, NULL, "\r\n+QIND: SMS DONE\r\n" },
+  { "AT+CSQ", "+CSQ:", "\r\n+CSQ: 21,99\r\n\r\nOK\r\n" },
+  { "AT+CREG=2", NULL, "\r\nOK\r\n" },
+  { NULL, NULL, "\r\n+CREG: 1,\"1A2B\",\"01C4D5E6\",7\r\n" },
+  { "AT+CREG?", "+CREG:", "\r\n+CREG: 2,1,\"1A2B\",\"01C4D5E6\",7\r\n\r\nOK\r\n" },
+  { "AT+CEREG?", "+CEREG:", "\r\n+CEREG: 0,1\r\n\r\nOK\r\n" },
+  { "AT+COPS?", "+COPS:", "\r\n+COPS: 0,0,\"Operator\",7\r\n\r\nOK\r\n" },
+  { "AT+COPS=?", "+COPS:",
+    "\r\n+COPS: (2,\"Operator\",\"Oper\",\"26201\",7),(1,\"Other Net\",\"Other\",\"26202\",7),"
+    "(1,\"Third Mobile\",\"Third\",\"26203\",2),(3,\"Fourth\",\"Fourth\",\"26207\",0),,"
+    "(0,1,2,3,4),(0,1,2)\r\n\r\nOK\r\n" },
+  { "AT+CGDCONT?", "+CGDCONT:",
+    "\r\n+CGDCONT: 1,\"IP\",\"internet\",\"0.0.0.0\",0,0,0,0\r\n"
+    "+CGDCONT: 2,\"IPV4V6\",\"ims\",\"0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0\",0,0,0,0\r\n\r\nOK\r\n" },
+  { "AT+CGACT=1,1", NULL, "\r\nOK\r\n" },
+  { NULL, NULL, "\r\n+CGEV: ME PDN ACT 1\r\n" },
+  { "AT+CGPADDR=1", "+CGPADDR:", "\r\n+CGPADDR: 1,\"10.84.121.17\"\r\n\r\nOK\r\n" },
+  { "AT+CMGF=0", NULL, "\r\nOK\r\n" },
+  { "AT+CNMI=2,1,0,0,0", NULL, "\r\nOK\r\n" },
+  { NULL, NULL, "\r\n+CMTI: \"SM\",3\r\n" },
+  { "AT+CMGR=3", NULL,
+    "\r\n+CMGR: 0,,24\r\n07911326040000F0040B911346610089F60000208062917314080CC8F71D14969741F977FD07\r\n"
+    "\r\nOK\r\n" },
+  { "AT+CMGS=23", "+CMGS:", "\r\n> \r\n+CMGS: 12\r\n\r\nOK\r\n" },
+  { "AT+CMGD=3", NULL, "\r\n+CMS ERROR: 321\r\n" },
+  { NULL, NULL, "\r\nRING\r\n\r\n+CLIP: \"+4915112345678\",145,,,,0\r\n" },
+  { "ATA", NULL, "\r\nOK\r\n" },
+  { "AT+CLCC", "+CLCC:", "\r\n+CLCC: 1,1,0,0,0,\"+4915112345678\",145\r\n\r\nOK\r\n" },
+  { NULL, NULL, "\r\n+CIEV: \"call\",1\r\n" },
+  { "AT+CHUP", NULL, "\r\nOK\r\n" },
+  { "ATD+4915187654321;", NULL, "\r\nBUSY\r\n" },
+  { "ATD+4915100000000;", NULL, "\r\nNO CARRIER\r\n" },
+  { "AT+CUSD=1,\"*100#\",15", NULL, "\r\nOK\r\n" },
+  { NULL, NULL, "\r\n+CUSD: 0,\"Balance: 12.34 EUR, valid until 31.12.\",15\r\n" },
+  { "AT+CCLK?", "+CCLK:", "\r\n+CCLK: \"24/06/12,10:15:42+08\"\r\n\r\nOK\r\n" },
+  { NULL, NULL, "\r\n+CTZE: \"+08\",0,\"2024/06/12,08:15:42\"\r\n" },
+  { "AT+CPBR=1,3", "+CPBR:",
+    "\r\n+CPBR: 1,\"+4915112345678\",145,\"Office\"\r\n+CPBR: 2,\"0301234567\",129,\"Home\"\r\n"
+    "+CPBR: 3,\"112\",129,\"Emergency\"\r\n\r\nOK\r\n" },
+  { "AT+CGATT=1", NULL, "\r\n+CME ERROR: SIM busy\r\n" },
+  { "AT+QCFG=\"band\"", "+QCFG:", "\r\n+QCFG: \"band\",0x260,0x42000000000000381a,0x0\r\n\r\nOK\r\n" },
+  { "AT+CMGL=4", NULL, "\r\nOK\r\n" },
+  { "AT+CPMS?", "+CPMS:", "\r\n+CPMS: \"SM\",2,50,\"SM\",2,50,\"SM\",2,50\r\n\r\nOK\r\n" },
+  { "AT+CEER", "+CEER:", "\r\n+CEER: \"No cause information available\"\r\n\r\nOK\r\n" },
+  { "AT+CGREG?", "+CGREG:", "\r\n+CGREG: 0,1\r\n\r\nOK\r\n" },
+  { NULL, NULL, "\r\n+CGREG: 1\r\n" },
+  { "AT+QPING=1,\"8.8.8.8\"", NULL, "\r\n+CME ERROR: 3\r\n" },
+};
+
+static const Naive_CodeTypeDef NaiveCodes[] =
+{
+  { "OK", AT_RESULT_OK, AT_URC_OTHER },
+  { "CONNECT", AT_RESULT_CONNECT, AT_URC_OTHER },
+  { "ERROR", AT_RESULT_ERROR, AT_URC_OTHER },
+  { "+CME ERROR", AT_RESULT_CME_ERROR, AT_URC_OTHER },
+  { "+CMS ERROR", AT_RESULT_CMS_ERROR, AT_URC_OTHER },
+  { "NO CARRIER", AT_RESULT_NO_CARRIER, AT_URC_NO_CARRIER },
+  { "BUSY", AT_RESULT_BUSY, AT_URC_OTHER },
+  { "NO ANSWER", AT_RESULT_NO_ANSWER, AT_URC_OTHER },
+  { "NO DIALTONE", AT_RESULT_NO_DIALTONE, AT_URC_OTHER },
+  { "RING", AT_RESULT_NONE, AT_URC_RING },
+  { "+CRING", AT_RESULT_NONE, AT_URC_CRING },
+  { "+CLIP", AT_RESULT_NONE, AT_URC_CLIP },
+  { "+CCWA", AT_RESULT_NONE, AT_URC_CCWA },
+  { "+CREG", AT_RESULT_NONE, AT_URC_CREG },
+  { "+CGREG", AT_RESULT_NONE, AT_URC_CGREG },
+  { "+CEREG", AT_RESULT_NONE, AT_URC_CEREG },
+  { "+CMTI", AT_RESULT_NONE, AT_URC_CMTI },
+  { "+CMT", AT_RESULT_NONE, AT_URC_CMT },
+  { "+CDS", AT_RESULT_NONE, AT_URC_CDS },
+  { "+CBM", AT_RESULT_NONE, AT_URC_CBM },
+  { "+CUSD", AT_RESULT_NONE, AT_URC_CUSD },
+  { "+CIEV", AT_RESULT_NONE, AT_URC_CIEV },
+  { "+CGEV", AT_RESULT_NONE, AT_URC_CGEV },
+  { "+CTZV", AT_RESULT_NONE, AT_URC_CTZV },
+  { "+CTZE", AT_RESULT_NONE, AT_URC_CTZE },
+  { "+CSSI", AT_RESULT_NONE, AT_URC_CSSI },
+  { "+CSSU", AT_RESULT_NONE, AT_URC_CSSU },
+};
+
+static const uint32_t BenchChunks[] = { 512U, 64U, 61U, 7U };
+
+static USBH_HandleTypeDef BenchHost;
+static AT_HandleTypeDef BenchAt;
+static uint8_t BenchStream[BENCH_STREAM_SIZE];
+static uint32_t BenchStreamSize;
+static uint32_t BenchCommands;
+static uint32_t BenchNextCmd;
+static uint32_t BenchChunk;
+static uint64_t BenchTxBytes;
+static Bench_EventsTypeDef BenchEvents;
+
+/* Naive parser state */
+static char NaiveLine[BENCH_LINE_SIZE + 1U];
+static uint32_t NaiveLength;
+static uint32_t NaiveTail;
+static uint8_t NaivePrompt;
+static Bench_EventsTypeDef NaiveEvents;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t Bench_GetCycles(void);
+static void Bench_Hash(Bench_EventsTypeDef *pev, uint32_t kind, uint32_t value,
+                       const uint8_t *pdata, uint32_t length);
+static const Bench_ExchangeTypeDef *Bench_Command(uint32_t tag);
+static void Bench_Build(void);
+static void Bench_Fill(void);
+static void Bench_Engine(void);
+static void Naive_Dispatch(void);
+static void Naive_Input(const uint8_t *pbuff, uint32_t length);
+static void Bench_Naive(void);
+
+/**
+  * @brief  Cycle or nanosecond counter.
+  * @retval Count
+  */
+static uint64_t Bench_GetCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+  * @brief  Fold an event into the FNV-1a hash of a run.
+  */
+static void Bench_Hash(Bench_EventsTypeDef *pev, uint32_t kind, uint32_t value,
+                       const uint8_t *pdata, uint32_t length)
+{
+  uint32_t hash = pev->Hash;
+  uint32_t idx;
+
+  hash = (hash ^ kind) * BENCH_FNV_PRIME;
+  hash = (hash ^ value) * BENCH_FNV_PRIME;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    hash = (hash ^ pdata[idx]) * BENCH_FNV_PRIME;
+  }
+
+  pev->Hash = hash;
+}
+
+/**
+  * @brief  Exchange of the n-th command of the stream.
+  */
+static const Bench_ExchangeTypeDef *Bench_Command(uint32_t tag)
+{
+  static const Bench_ExchangeTypeDef *pcmds[sizeof(BenchTranscript) / sizeof(BenchTranscript[0])];
+  static uint32_t count;
+  uint32_t idx;
+
+  if (count == 0U)
+  {
+    for (idx = 0U; idx < (sizeof(BenchTranscript) / sizeof(BenchTranscript[0])); idx++)
+    {
+      if (BenchTranscript[idx].pCmd != NULL)
+      {
+        pcmds[count++] = &BenchTranscript[idx];
+      }
+    }
+  }
+
+  return pcmds[tag % count];
+}
+
+/**
+  * @brief  Repeat the transcript up to the stream size.
+  */
+static void Bench_Build(void)
+{
+  uint32_t idx = 0U;
+  uint32_t length;
+
+  BenchStreamSize = 0U;
+  BenchCommands = 0U;
+
+  for (;;)
+  {
+    length = (uint32_t)strlen(BenchTranscript[idx].pReply);
+
+    if ((BenchStreamSize + length) > BENCH_STREAM_SIZE)
+    {
+      break;
+    }
+
+    (void)memcpy(&BenchStream[BenchStreamSize], BenchTranscript[idx].pReply, length);
+    BenchStreamSize += length;
+    BenchCommands += (BenchTranscript[idx].pCmd != NULL) ? 1U : 0U;
+    idx = (idx + 1U) % (sizeof(BenchTranscript) / sizeof(BenchTranscript[0]));
+  }
+}
+
+/**
+  * @brief  Keep the engine queue full, as an application pipelining its
+  *         commands does.
+  */
+static void Bench_Fill(void)
+{
+  const Bench_ExchangeTypeDef *pex;
+
+  while (BenchNextCmd < BenchCommands)
+  {
+    pex = Bench_Command(BenchNextCmd);
+
+    if (AT_Send(&BenchAt, pex->pCmd, pex->pPrefix, 1000U, BenchNextCmd) != USBH_OK)
+    {
+      break;
+    }
+
+    BenchNextCmd++;
+  }
+}
+
+/**
+  * @brief  Stream through usb_at.c.
+  */
+static void Bench_Engine(void)
+{
+  uint32_t offset;
+
+  (void)AT_Init(&BenchAt, &BenchHost, NULL, 0U);
+  (void)memset(&BenchEvents, 0, sizeof(BenchEvents));
+  BenchEvents.Hash = BENCH_FNV_BASIS;
+  BenchNextCmd = 0U;
+  Bench_Fill();
+
+  for (offset = 0U; offset < BenchStreamSize; offset += BenchChunk)
+  {
+    AT_Input(&BenchAt, &BenchStream[offset], MIN(BenchChunk, BenchStreamSize - offset));
+  }
+}
+
+/**
+  * @brief  Naive line handling: every code compared in turn, then the same
+  *         routing rules as usb_at.c.
+  */
+static void Naive_Dispatch(void)
+{
+  const Bench_ExchangeTypeDef *pex;
+  const Naive_CodeTypeDef *pcode = NULL;
+  char *pline = NaiveLine;
+  uint32_t length = NaiveLength;
+  uint32_t idx;
+  size_t key = 0U;
+  int32_t code;
+
+  NaiveLength = 0U;
+
+  while ((length != 0U) && (pline[0] == '\r'))
+  {
+    pline++;
+    length--;
+  }
+
+  while ((length != 0U) && (pline[length - 1U] == '\r'))
+  {
+    length--;
+  }
+
+  if (length == 0U)
+  {
+    return;
+  }
+
+  pline[length] = '\0';
+
+  for (idx = 0U; idx < (sizeof(NaiveCodes) / sizeof(NaiveCodes[0])); idx++)
+  {
+    key = strlen(NaiveCodes[idx].pKey);
+
+    if ((strncmp(pline, NaiveCodes[idx].pKey, key) == 0) &&
+        ((pline[key] == ':') || (pline[key] == '\0') || ((pline[key] == ' ') && (strchr(pline, ':') == NULL))))
+    {
+      pcode = &NaiveCodes[idx];
+      break;
+    }
+  }
+
+  if (NaiveTail < BenchCommands)
+  {
+    pex = Bench_Command(NaiveTail);
+
+    if ((pcode != NULL) && (pcode->Result != AT_RESULT_NONE))
+    {
+      code = 0;
+
+      if (pline[key] == ':')
+      {
+        code = (sscanf(&pline[key + 1U], "%d", &code) == 1) ? code : -1;
+      }
+
+      NaiveEvents.Results++;
+      Bench_Hash(&NaiveEvents, 1U, (NaiveTail << 8) | (uint32_t)pcode->Result, (const uint8_t *)&code,
+                 sizeof(code));
+      NaiveTail++;
+      return;
+    }
+
+    if ((strncmp(pline, "AT", 2) == 0) || (strncmp(pline, "at", 2) == 0))
+    {
+      return;
+    }
+
+    if (((pex->pPrefix != NULL) && (strncmp(pline, pex->pPrefix, strlen(pex->pPrefix)) == 0)) ||
+        ((pex->pPrefix == NULL) && ((pcode == NULL) || (pcode->Urc == AT_URC_OTHER))))
+    {
+      NaiveEvents.Infos++;
+      Bench_Hash(&NaiveEvents, 2U, NaiveTail, (const uint8_t *)pline, length);
+      return;
+    }
+  }
+
+  NaiveEvents.Urcs++;
+  Bench_Hash(&NaiveEvents, 3U, (pcode != NULL) ? (uint32_t)pcode->Urc : 0U, (const uint8_t *)pline, length);
+}
+
+/**
+  * @brief  Naive reception: bytes copied one by one to the line buffer.
+  */
+static void Naive_Input(const uint8_t *pbuff, uint32_t length)
+{
+  uint32_t idx;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    if (NaivePrompt != 0U)
+    {
+      NaivePrompt = 0U;
+
+      if (pbuff[idx] == (uint8_t)' ')
+      {
+        continue;
+      }
+    }
+
+    if ((NaiveLength == 0U) && (pbuff[idx] == (uint8_t)'>') && (NaiveTail < BenchCommands))
+    {
+      NaiveEvents.Prompts++;
+      Bench_Hash(&NaiveEvents, 4U, NaiveTail, NULL, 0U);
+      NaivePrompt = 1U;
+    }
+    else if (pbuff[idx] == (uint8_t)'\n')
+    {
+      Naive_Dispatch();
+    }
+    else if (NaiveLength < BENCH_LINE_SIZE)
+    {
+      NaiveLine[NaiveLength++] = (char)pbuff[idx];
+    }
+    else
+    {
+      /* .. */
+    }
+  }
+}
+
+/**
+  * @brief  Stream through the naive parser.
+  */
+static void Bench_Naive(void)
+{
+  uint32_t offset;
+
+  (void)memset(&NaiveEvents, 0, sizeof(NaiveEvents));
+  NaiveEvents.Hash = BENCH_FNV_BASIS;
+  NaiveLength = 0U;
+  NaiveTail = 0U;
+  NaivePrompt = 0U;
+
+  for (offset = 0U; offset < BenchStreamSize; offset += BenchChunk)
+  {
+    Naive_Input(&BenchStream[offset], MIN(BenchChunk, BenchStreamSize - offset));
+  }
+}
+
+/**
+  * @brief  Stubs of the CDC writer: the commands are counted.
+  */
+uint32_t USBH_CDC_Write(USBH_HandleTypeDef *phost, const uint8_t *pbuff, uint32_t length)
+{
+  UNUSED(phost);
+  UNUSED(pbuff);
+
+  BenchTxBytes += length;
+
+  return length;
+}
+
+uint32_t USBH_CDC_GetTxFree(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  return USBH_CDC_TX_RING_SIZE;
+}
+
+/**
+  * @brief  Engine callbacks, folded into the run hash as the naive parser
+  *         folds its events.
+  */
+void AT_InfoCallback(AT_HandleTypeDef *pat, uint32_t tag, const uint8_t *pline, uint32_t length)
+{
+  UNUSED(pat);
+
+  BenchEvents.Infos++;
+  Bench_Hash(&BenchEvents, 2U, tag, pline, length);
+}
+
+void AT_ResultCallback(AT_HandleTypeDef *pat, uint32_t tag, AT_ResultTypeDef result, int32_t code)
+{
+  UNUSED(pat);
+
+  BenchEvents.Results++;
+  Bench_Hash(&BenchEvents, 1U, (tag << 8) | (uint32_t)result, (const uint8_t *)&code, sizeof(code));
+  Bench_Fill();
+}
+
+void AT_PromptCallback(AT_HandleTypeDef *pat, uint32_t tag)
+{
+  UNUSED(pat);
+
+  BenchEvents.Prompts++;
+  Bench_Hash(&BenchEvents, 4U, tag, NULL, 0U);
+}
+
+void AT_UrcCallback(AT_HandleTypeDef *pat, AT_UrcTypeDef urc, const uint8_t *pline, uint32_t length)
+{
+  UNUSED(pat);
+
+  BenchEvents.Urcs++;
+  Bench_Hash(&BenchEvents, 3U, (uint32_t)urc, pline, length);
+}
+
+/**
+  * @brief  Check then time both parsers over each receive buffer size.
+  * @retval 0 when both report the same events
+  */
+int main(void)
+{
+  uint64_t naive_best;
+  uint64_t best;
+  uint64_t start;
+  uint64_t cycles;
+  uint32_t failures = 0U;
+  uint32_t mismatch;
+  uint32_t idx;
+  uint32_t rep;
+
+  BenchHost.pRoot = &BenchHost;
+  BenchHost.device.speed = (uint8_t)USBH_SPEED_HIGH;
+  Bench_Build();
+
+  for (idx = 0U; idx < (sizeof(BenchChunks) / sizeof(BenchChunks[0])); idx++)
+  {
+    BenchChunk = BenchChunks[idx];
+    naive_best = UINT64_MAX;
+    best = UINT64_MAX;
+
+    for (rep = 0U; rep < BENCH_REPEAT; rep++)
+    {
+      start = Bench_GetCycles();
+      Bench_Naive();
+      cycles = Bench_GetCycles() - start;
+      naive_best = MIN(naive_best, cycles);
+
+      start = Bench_GetCycles();
+      Bench_Engine();
+      cycles = Bench_GetCycles() - start;
+      best = MIN(best, cycles);
+    }
+
+    mismatch = ((BenchEvents.Hash != NaiveEvents.Hash) || (BenchEvents.Results != BenchCommands) ||
+                (NaiveEvents.Results != BenchCommands)) ? 1U : 0U;
+    failures += mismatch;
+
+    printf("{\"parser\":\"at\",\"chunk\":%u,\"bytes\":%u,\"commands\":%u,\"infos\":%u,\"urcs\":%u,"
+           "\"prompts\":%u,\"lines_assembled\":%u,\"mismatch\":%u,\"naive_" BENCH_CYCLE_UNIT "_per_byte\":%.3f,"
+           "\"" BENCH_CYCLE_UNIT "_per_byte\":%.3f,\"speedup\":%.2f}\n",
+           (unsigned int)BenchChunk, (unsigned int)BenchStreamSize, (unsigned int)BenchEvents.Results,
+           (unsigned int)BenchEvents.Infos, (unsigned int)BenchEvents.Urcs, (unsigned int)BenchEvents.Prompts,
+           (unsigned int)BenchAt.Copies, (unsigned int)mismatch, (double)naive_best / BenchStreamSize,
+           (double)best / BenchStreamSize, (double)naive_best / (double)best);
+  }
+
+  if (failures != 0U)
+  {
+    fprintf(stderr, "at bench: %u runs differ from the naive parser\n", (unsigned int)failures);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,367 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_sim_bench.c
+  * @brief          : CDC throughput and latency benchmark on the virtual host
+  *                   controller. Each run sweeps the endpoint sizes, the NAK
+  *                   rate and the transfer size, and loops transfers through
+  *                   USBH_CDC_Transmit and USBH_CDC_Receive. One JSON object
+  *                   per line is printed for each point of the sweep.
+  *
+  *                   The bus figures (throughput, latency, URBs, NAKs) are in
+  *                   virtual time and repeat exactly from run to run. The CPU
+  *                   figures count the time spent in USBH_ProcessEvents only,
+  *                   in TSC cycles where available, else in ns.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+#include "usbh_cdc.h"
+#include "usbh_sim_device.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLE_UNIT          "tsc"
+#else
+#include <time.h>
+#define BENCH_CYCLE_UNIT          "ns"
+#endif
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_TIMEOUT_US          10000000U
+#define BENCH_MAX_SIZE            32768U
+#define BENCH_BYTES_PER_POINT     (1024U * 1024U)
+#define BENCH_MIN_TRANSFERS       16U
+#define BENCH_MAX_TRANSFERS       1024U
+#define BENCH_SEED                0x2545F491U
+
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_COUNT(a)            (sizeof(a) / sizeof((a)[0]))
+
+/* Private variables ---------------------------------------------------------*/
+static const uint16_t BenchEpSizes[] = { 64U, 512U };
+static const uint32_t BenchNakRates[] = { 0U, 655U, 6554U };   /* 0, 1 and 10 % of 65536 */
+static const uint32_t BenchSizes[] = { 16U, 64U, 512U, 4096U, 32768U };
+
+static USBH_HandleTypeDef hUsbHostBench;
+static USBH_SimDevTypeDef BenchDevice;
+
+static volatile uint8_t BenchClassActive;
+static volatile uint8_t BenchTxDone;
+static volatile uint8_t BenchRxDone;
+
+static uint8_t BenchTxBuff[BENCH_MAX_SIZE];
+static uint8_t BenchRxBuff[BENCH_MAX_SIZE + USBH_SIM_MAX_PACKET];
+static uint32_t BenchRxCount;
+static uint32_t BenchRxTarget;
+
+static uint64_t BenchLatency[BENCH_MAX_TRANSFERS];
+static uint64_t BenchCycles;
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id);
+static uint64_t Bench_GetCycles(void);
+static uint8_t Bench_Run(volatile uint8_t *flag);
+static int Bench_Enumerate(uint16_t in_mps, uint16_t out_mps);
+static int Bench_Point(uint16_t in_mps, uint16_t out_mps, uint32_t nak_rate, uint32_t size);
+static int Bench_CompareU64(const void *a, const void *b);
+
+/**
+  * @brief  User callback of the host library.
+  * @param  phost: Host handle
+  * @param  id: Event
+  * @retval None
+  */
+static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id)
+{
+  UNUSED(phost);
+
+  switch (id)
+  {
+    case HOST_USER_CLASS_ACTIVE:
+      BenchClassActive = 1U;
+      break;
+
+    case HOST_USER_DISCONNECTION:
+      BenchClassActive = 0U;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  CDC transmit complete.
+  * @param  phost: Host handle
+  * @retval None
+  */
+void USBH_CDC_TransmitCallback(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  BenchTxDone = 1U;
+}
+
+/**
+  * @brief  CDC reception complete: a short packet ends a reception early,
+  *         the rest of the transfer is asked for again.
+  * @param  phost: Host handle
+  * @retval None
+  */
+void USBH_CDC_ReceiveCallback(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  BenchRxCount = (uint32_t)(CDC_Handle->pRxData - BenchRxBuff) + USBH_CDC_GetLastReceivedDataSize(phost);
+
+  if (BenchRxCount < BenchRxTarget)
+  {
+    (void)USBH_CDC_Receive(phost, &BenchRxBuff[BenchRxCount], BenchRxTarget - BenchRxCount);
+  }
+  else
+  {
+    BenchRxDone = 1U;
+  }
+}
+
+/**
+  * @brief  Read the CPU cycle counter.
+  * @retval Cycles, or ns without a cycle counter
+  */
+static uint64_t Bench_GetCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000U) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+  * @brief  Run the host process and the virtual bus until a flag is set.
+  *         Only the host process is timed.
+  * @param  flag: Completion flag, NULL to run until the host is idle
+  * @retval 1 on completion, 0 on timeout
+  */
+static uint8_t Bench_Run(volatile uint8_t *flag)
+{
+  uint64_t deadline = USBH_Sim_GetTimeUs() + BENCH_TIMEOUT_US;
+  uint64_t start;
+
+  while (USBH_Sim_GetTimeUs() < deadline)
+  {
+    start = Bench_GetCycles();
+    (void)USBH_ProcessEvents(&hUsbHostBench);
+    BenchCycles += Bench_GetCycles() - start;
+
+    if (flag == NULL)
+    {
+      if (hUsbHostBench.gState == HOST_IDLE)
+      {
+        return 1U;
+      }
+    }
+    else if (*flag != 0U)
+    {
+      return 1U;
+    }
+    else
+    {
+      /* .. */
+    }
+
+    USBH_Sim_Step();
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Plug a device with the given endpoint sizes and enumerate it.
+  * @param  in_mps: Bulk IN max packet size
+  * @param  out_mps: Bulk OUT max packet size
+  * @retval 0 on success
+  */
+static int Bench_Enumerate(uint16_t in_mps, uint16_t out_mps)
+{
+  if (BenchClassActive != 0U)
+  {
+    USBH_Sim_Attach(NULL);
+    (void)Bench_Run(NULL);
+  }
+
+  USBH_SimDev_Defaults(&BenchDevice);
+  BenchDevice.InEpSize = in_mps;
+  BenchDevice.OutEpSize = out_mps;
+  USBH_SimDev_Init(&BenchDevice);
+
+  /* Same device descriptor, other endpoints: do not replay the cached ones */
+  USBH_EnumCacheClear();
+
+  USBH_Sim_Attach(&BenchDevice);
+
+  return (Bench_Run(&BenchClassActive) != 0U) ? 0 : 1;
+}
+
+/**
+  * @brief  Sort helper.
+  * @param  a: First value
+  * @param  b: Second value
+  * @retval Comparison
+  */
+static int Bench_CompareU64(const void *a, const void *b)
+{
+  uint64_t va = *(const uint64_t *)a;
+  uint64_t vb = *(const uint64_t *)b;
+
+  return (va > vb) - (va < vb);
+}
+
+/**
+  * @brief  Loop transfers of one size and print the point.
+  * @param  in_mps: Bulk IN max packet size
+  * @param  out_mps: Bulk OUT max packet size
+  * @param  nak_rate: Data transactions NAKed, per 65536
+  * @param  size: Transfer size
+  * @retval 0 on success
+  */
+static int Bench_Point(uint16_t in_mps, uint16_t out_mps, uint32_t nak_rate, uint32_t size)
+{
+  const USBH_SimStatsTypeDef *stats = USBH_Sim_GetStats();
+  uint32_t transfers = BENCH_BYTES_PER_POINT / size;
+  uint32_t events;
+  uint64_t start;
+  uint64_t elapsed;
+  uint64_t bytes;
+  uint32_t idx;
+
+  transfers = MAX(transfers, BENCH_MIN_TRANSFERS);
+  transfers = MIN(transfers, BENCH_MAX_TRANSFERS);
+
+  USBH_SimDev_SetNakRate(&BenchDevice, nak_rate, BENCH_SEED);
+  USBH_Sim_ClearStats();
+  BenchCycles = 0U;
+  events = hUsbHostBench.events.tail;
+  start = USBH_Sim_GetTimeUs();
+
+  for (idx = 0U; idx < transfers; idx++)
+  {
+    uint64_t t0 = USBH_Sim_GetTimeUs();
+
+    BenchTxDone = 0U;
+    BenchRxDone = 0U;
+    BenchRxCount = 0U;
+    BenchRxTarget = size;
+
+    if ((USBH_CDC_Receive(&hUsbHostBench, BenchRxBuff, size) != USBH_OK) ||
+        (USBH_CDC_Transmit(&hUsbHostBench, BenchTxBuff, size) != USBH_OK))
+    {
+      fprintf(stderr, "bench: CDC busy\n");
+      return 1;
+    }
+
+    if ((Bench_Run(&BenchRxDone) == 0U) || (Bench_Run(&BenchTxDone) == 0U))
+    {
+      fprintf(stderr, "bench: timeout at %u/%u bytes\n", (unsigned int)BenchRxCount, (unsigned int)size);
+      return 1;
+    }
+
+    if (USBH_memcmp(BenchTxBuff, BenchRxBuff, size) != 0)
+    {
+      fprintf(stderr, "bench: data mismatch\n");
+      return 1;
+    }
+
+    BenchLatency[idx] = USBH_Sim_GetTimeUs() - t0;
+  }
+
+  elapsed = USBH_Sim_GetTimeUs() - start;
+  events = hUsbHostBench.events.tail - events;
+  bytes = (uint64_t)transfers * size;
+
+  qsort(BenchLatency, transfers, sizeof(BenchLatency[0]), Bench_CompareU64);
+
+  printf("{\"in_mps\":%u,\"out_mps\":%u,\"nak_rate\":%.4f,\"size\":%u,\"transfers\":%u,"
+         "\"throughput_Bps\":%.0f,\"lat_p50_us\":%llu,\"lat_p99_us\":%llu,"
+         "\"urbs\":%u,\"naks\":%u,\"process_per_kB\":%.2f,\"cycles_per_byte\":%.2f}\n",
+         in_mps, out_mps, (double)nak_rate / 65536.0, (unsigned int)size, (unsigned int)transfers,
+         (elapsed != 0U) ? ((double)bytes * 1e6 / (double)elapsed) : 0.0,
+         (unsigned long long)BenchLatency[(transfers - 1U) / 2U],
+         (unsigned long long)BenchLatency[((transfers * 99U) + 99U) / 100U - 1U],
+         (unsigned int)stats->urbs, (unsigned int)stats->naks,
+         (double)events * 1024.0 / (double)bytes,
+         (double)BenchCycles / (double)bytes);
+
+  return 0;
+}
+
+/**
+  * @brief  Benchmark entry point.
+  * @retval 0 on success
+  */
+int main(void)
+{
+  uint32_t in;
+  uint32_t out;
+  uint32_t nak;
+  uint32_t sz;
+  uint32_t idx;
+
+  for (idx = 0U; idx < BENCH_MAX_SIZE; idx++)
+  {
+    BenchTxBuff[idx] = (uint8_t)((idx * 7U) + (idx >> 8));
+  }
+
+  USBH_SimDev_Defaults(&BenchDevice);
+  USBH_SimDev_Init(&BenchDevice);
+
+  if ((USBH_Init(&hUsbHostBench, USBH_UserProcess, HOST_HS) != USBH_OK) ||
+      (USBH_RegisterClass(&hUsbHostBench, USBH_CDC_CLASS) != USBH_OK) ||
+      (USBH_Start(&hUsbHostBench) != USBH_OK))
+  {
+    fprintf(stderr, "bench: host init failed\n");
+    return 1;
+  }
+
+  printf("{\"bench\":\"usbh_cdc_loopback\",\"cycle_unit\":\"%s\",\"sof_us\":%u}\n",
+         BENCH_CYCLE_UNIT, (unsigned int)USBH_SIM_SOF_PERIOD_US);
+
+  for (in = 0U; in < BENCH_COUNT(BenchEpSizes); in++)
+  {
+    for (out = 0U; out < BENCH_COUNT(BenchEpSizes); out++)
+    {
+      if (Bench_Enumerate(BenchEpSizes[in], BenchEpSizes[out]) != 0)
+      {
+        fprintf(stderr, "bench: enumeration failed\n");
+        return 1;
+      }
+
+      for (nak = 0U; nak < BENCH_COUNT(BenchNakRates); nak++)
+      {
+        for (sz = 0U; sz < BENCH_COUNT(BenchSizes); sz++)
+        {
+          if (Bench_Point(BenchEpSizes[in], BenchEpSizes[out], BenchNakRates[nak], BenchSizes[sz]) != 0)
+          {
+            return 1;
+          }
+        }
+      }
+    }
+  }
+
+  return 0;
+}
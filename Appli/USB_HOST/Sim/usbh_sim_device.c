@@ -0,0 +1,1771 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_sim_device.c
+  * @brief          : Virtual CDC ACM loopback device for the host build of the
+  *                   USB host library. It answers the standard and CDC control
+  *                   requests and loops the bulk OUT data back on the bulk IN
+  *                   endpoint. NAKs and STALLs can be forced per endpoint.
+  *                   The same model can be a UAC2 headset: an asynchronous
+  *                   speaker with explicit feedback and a microphone, both
+  *                   paced by a device clock off by ClockPpm.
+  *                   With Cmux set, the CDC function is a modem switched to
+  *                   TS 27.010: it accepts every channel, answers the control
+  *                   channel commands and echoes the channel data.
+  *                   As a high-speed hub, it switches the power of its ports
+  *                   and reports the devices plugged into them on its status
+  *                   change endpoint; the controller reaches them through it.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_sim_device.h"
+#include "usbh_cdc.h"
+
+/* Private define ------------------------------------------------------------*/
+#define USBH_SIM_STR_MANUFACTURER         1U
+#define USBH_SIM_STR_PRODUCT              2U
+#define USBH_SIM_STR_SERIAL               3U
+
+/* SERIAL_STATE notification (CDC PSTN 6.5.4) */
+#define USBH_SIM_SERIAL_STATE             0x20U
+#define USBH_SIM_SERIAL_STATE_SIZE        10U
+
+/* UAC2 clock source and CUR request of the headset */
+#define USBH_SIM_AUDIO_CLOCK_ID           0x10U
+#define USBH_SIM_AUDIO_CUR                0x01U
+#define USBH_SIM_AUDIO_FREQ_CONTROL       0x0100U
+
+/* The speaker starts playing once 2 ms are queued */
+#define USBH_SIM_SPEAKER_PREFILL_MS       2U
+
+/* Hub descriptor and port requests (USB 2.0 chapter 11) */
+#define USBH_SIM_HUB_DESC_TYPE            0x29U
+#define USBH_SIM_HUB_DESC_SIZE            9U
+#define USBH_SIM_HUB_PWRON2PWRGOOD        10U     /* 20 ms */
+
+#define USBH_SIM_PORT_ENABLE              1U
+#define USBH_SIM_PORT_RESET               4U
+#define USBH_SIM_PORT_POWER               8U
+#define USBH_SIM_C_PORT_CONNECTION        16U
+#define USBH_SIM_C_PORT_RESET             20U
+
+/* wPortStatus and wPortChange bits */
+#define USBH_SIM_PORT_STAT_CONNECTION     0x0001U
+#define USBH_SIM_PORT_STAT_ENABLE         0x0002U
+#define USBH_SIM_PORT_STAT_POWER          0x0100U
+#define USBH_SIM_PORT_STAT_HIGH_SPEED     0x0400U
+#define USBH_SIM_PORT_CHANGE_CONNECTION   0x0001U
+#define USBH_SIM_PORT_CHANGE_RESET        0x0010U
+
+/* Private macro -------------------------------------------------------------*/
+#define LOBYTE(x)                         ((uint8_t)((x) & 0x00FFU))
+#define HIBYTE(x)                         ((uint8_t)(((x) & 0xFF00U) >> 8U))
+#define USB_REQ_TYPE_MASK                 0x60U
+#define USB_REQ_RECIPIENT_MASK            0x1FU
+
+#define USBH_SIM_EP_DIR(ep)               ((((ep) & 0x80U) != 0U) ? 1U : 0U)
+#define USBH_SIM_EP_BIT(ep)               (1UL << (((ep) & 0x0FU) + (USBH_SIM_EP_DIR(ep) * 16U)))
+
+/* Private variables ---------------------------------------------------------*/
+static const char *const USBH_SimDev_Strings[] =
+{
+  NULL,
+  "STMicroelectronics",
+  "Virtual COM Port",
+  "00000000001A",
+};
+
+/* UAC2 headset: clock source, USB streaming input terminal to a speaker,
+   microphone to a USB streaming output terminal, and one streaming
+   interface per direction with a zero bandwidth alternate setting */
+static const uint8_t USBH_SimDev_AudioCfgDesc[] =
+{
+  /* Configuration, wTotalLength patched at init */
+  0x09U, USB_DESC_TYPE_CONFIGURATION, 0x00U, 0x00U, 0x03U, 0x01U, 0x00U, 0xC0U, 0x32U,
+  /* Interface association */
+  0x08U, 0x0BU, 0x00U, 0x03U, 0x01U, 0x00U, 0x20U, 0x00U,
+  /* Audio control interface */
+  0x09U, USB_DESC_TYPE_INTERFACE, 0x00U, 0x00U, 0x00U, 0x01U, 0x01U, 0x20U, 0x00U,
+  /* Header: ADC 2.00, headset, 75 bytes */
+  0x09U, 0x24U, 0x01U, 0x00U, 0x02U, 0x04U, 0x4BU, 0x00U, 0x00U,
+  /* Clock source: internal programmable, frequency control read/write */
+  0x08U, 0x24U, 0x0AU, USBH_SIM_AUDIO_CLOCK_ID, 0x03U, 0x07U, 0x00U, 0x00U,
+  /* Input terminal 1: USB streaming, stereo */
+  0x11U, 0x24U, 0x02U, 0x01U, 0x01U, 0x01U, 0x00U, USBH_SIM_AUDIO_CLOCK_ID, 0x02U,
+  0x03U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U,
+  /* Output terminal 2: speaker, from terminal 1 */
+  0x0CU, 0x24U, 0x03U, 0x02U, 0x01U, 0x03U, 0x00U, 0x01U, USBH_SIM_AUDIO_CLOCK_ID,
+  0x00U, 0x00U, 0x00U,
+  /* Input terminal 3: microphone, stereo */
+  0x11U, 0x24U, 0x02U, 0x03U, 0x01U, 0x02U, 0x00U, USBH_SIM_AUDIO_CLOCK_ID, 0x02U,
+  0x03U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U,
+  /* Output terminal 4: USB streaming, from terminal 3 */
+  0x0CU, 0x24U, 0x03U, 0x04U, 0x01U, 0x01U, 0x00U, 0x03U, USBH_SIM_AUDIO_CLOCK_ID,
+  0x00U, 0x00U, 0x00U,
+
+  /* Speaker streaming interface, zero bandwidth then operational */
+  0x09U, USB_DESC_TYPE_INTERFACE, 0x01U, 0x00U, 0x00U, 0x01U, 0x02U, 0x20U, 0x00U,
+  0x09U, USB_DESC_TYPE_INTERFACE, 0x01U, 0x01U, 0x02U, 0x01U, 0x02U, 0x20U, 0x00U,
+  /* General: terminal 1, PCM, stereo */
+  0x10U, 0x24U, 0x01U, 0x01U, 0x00U, 0x01U, 0x01U, 0x00U, 0x00U, 0x00U, 0x02U,
+  0x03U, 0x00U, 0x00U, 0x00U, 0x00U,
+  /* Type I: 2 byte subslots, 16 bits */
+  0x06U, 0x24U, 0x02U, 0x01U, USBH_SIM_AUDIO_SUBFRAME, 0x10U,
+  /* Isochronous asynchronous OUT, every 1 ms */
+  0x07U, USB_DESC_TYPE_ENDPOINT, USBH_SIM_SPEAKER_EP, 0x05U,
+  (uint8_t)USBH_SIM_AUDIO_EP_SIZE, (uint8_t)(USBH_SIM_AUDIO_EP_SIZE >> 8), 0x04U,
+  0x08U, 0x25U, 0x01U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U,
+  /* Explicit feedback, every 1 ms */
+  0x07U, USB_DESC_TYPE_ENDPOINT, USBH_SIM_FEEDBACK_EP, 0x11U, 0x04U, 0x00U, 0x04U,
+
+  /* Microphone streaming interface */
+  0x09U, USB_DESC_TYPE_INTERFACE, 0x02U, 0x00U, 0x00U, 0x01U, 0x02U, 0x20U, 0x00U,
+  0x09U, USB_DESC_TYPE_INTERFACE, 0x02U, 0x01U, 0x01U, 0x01U, 0x02U, 0x20U, 0x00U,
+  /* General: terminal 4, PCM, stereo */
+  0x10U, 0x24U, 0x01U, 0x04U, 0x00U, 0x01U, 0x01U, 0x00U, 0x00U, 0x00U, 0x02U,
+  0x03U, 0x00U, 0x00U, 0x00U, 0x00U,
+  0x06U, 0x24U, 0x02U, 0x01U, USBH_SIM_AUDIO_SUBFRAME, 0x10U,
+  /* Isochronous asynchronous IN, every 1 ms */
+  0x07U, USB_DESC_TYPE_ENDPOINT, USBH_SIM_MIC_EP, 0x05U,
+  (uint8_t)USBH_SIM_AUDIO_EP_SIZE, (uint8_t)(USBH_SIM_AUDIO_EP_SIZE >> 8), 0x04U,
+  0x08U, 0x25U, 0x01U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U,
+};
+
+/* Hub: one interface with the status change endpoint, polled every
+   128 microframes */
+static const uint8_t USBH_SimDev_HubCfgDesc[] =
+{
+  0x09U, USB_DESC_TYPE_CONFIGURATION, 0x19U, 0x00U, 0x01U, 0x01U, 0x00U, 0xE0U, 0x00U,
+  0x09U, USB_DESC_TYPE_INTERFACE, 0x00U, 0x00U, 0x01U, 0x09U, 0x00U, 0x00U, 0x00U,
+  0x07U, USB_DESC_TYPE_ENDPOINT, USBH_SIM_HUB_STATUS_EP, 0x03U, 0x01U, 0x00U, 0x08U,
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t USBH_SimDev_GetDescriptor(USBH_SimDevTypeDef *pdev, uint16_t wValue);
+static USBH_SimRespTypeDef USBH_SimDev_Standard(USBH_SimDevTypeDef *pdev, uint16_t wValue,
+                                                uint16_t wIndex);
+static USBH_SimRespTypeDef USBH_SimDev_Class(USBH_SimDevTypeDef *pdev, uint16_t wValue,
+                                             uint16_t wIndex);
+static USBH_SimRespTypeDef USBH_SimDev_HubClass(USBH_SimDevTypeDef *pdev, uint16_t wValue,
+                                                uint16_t wIndex);
+static USBH_SimRespTypeDef USBH_SimDev_HubIn(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                             uint8_t *pbuff, uint16_t *length);
+static void USBH_SimDev_OutData(USBH_SimDevTypeDef *pdev);
+static void USBH_SimDev_Status(USBH_SimDevTypeDef *pdev);
+static uint8_t USBH_SimDev_ForceNak(USBH_SimDevTypeDef *pdev, uint8_t ep_addr);
+static uint8_t USBH_SimDev_ForceCtrlNak(USBH_SimDevTypeDef *pdev, uint8_t ep_addr);
+static void USBH_SimDev_BuildCdc(USBH_SimDevTypeDef *pdev);
+static void USBH_SimDev_SetRate(USBH_SimDevTypeDef *pdev, uint32_t rate);
+static void USBH_SimDev_Play(USBH_SimDevTypeDef *pdev, uint32_t frames);
+static USBH_SimRespTypeDef USBH_SimDev_AudioIn(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                               uint8_t *pbuff, uint16_t mps, uint16_t *length);
+static USBH_SimRespTypeDef USBH_SimDev_AudioOut(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                                const uint8_t *pbuff, uint16_t length);
+static void USBH_SimDev_Push(USBH_SimDevTypeDef *pdev, const uint8_t *pbuff, uint32_t length);
+static uint8_t USBH_SimDev_CmuxFcs(const uint8_t *pbuff, uint32_t length);
+static void USBH_SimDev_CmuxFrame(USBH_SimDevTypeDef *pdev);
+static void USBH_SimDev_CmuxOut(USBH_SimDevTypeDef *pdev, const uint8_t *pbuff, uint16_t length);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Load the parameters of a high-speed CDC ACM loopback device.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+void USBH_SimDev_Defaults(USBH_SimDevTypeDef *pdev)
+{
+  (void)USBH_memset(pdev, 0, sizeof(USBH_SimDevTypeDef));
+
+  pdev->VID = 0x0483U;
+  pdev->PID = 0x5740U;
+  pdev->InEpSize = USBH_SIM_MAX_PACKET;
+  pdev->OutEpSize = USBH_SIM_MAX_PACKET;
+  pdev->NotifEpSize = 16U;
+  pdev->FifoSize = USBH_SIM_FIFO_SIZE;
+  pdev->NakRate = 0U;
+  pdev->Seed = 1U;
+}
+
+/**
+  * @brief  Load the parameters of a high-speed UAC2 headset at 48 kHz with
+  *         an exact clock.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+void USBH_SimDev_AudioDefaults(USBH_SimDevTypeDef *pdev)
+{
+  USBH_SimDev_Defaults(pdev);
+
+  pdev->Function = USBH_SIM_FUNCTION_AUDIO;
+  pdev->PID = 0x5730U;
+  pdev->SampleRate = 48000U;
+  pdev->ClockPpm = 0;
+}
+
+/**
+  * @brief  Load the parameters of a high-speed hub with USBH_SIM_HUB_PORTS
+  *         ports, all empty.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+void USBH_SimDev_HubDefaults(USBH_SimDevTypeDef *pdev)
+{
+  USBH_SimDev_Defaults(pdev);
+
+  pdev->Function = USBH_SIM_FUNCTION_HUB;
+  pdev->PID = 0x5750U;
+}
+
+/**
+  * @brief  Build the descriptors from the model parameters and reset the
+  *         device state.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+void USBH_SimDev_Init(USBH_SimDevTypeDef *pdev)
+{
+  uint8_t *pdesc = pdev->DevDesc;
+
+  if ((pdev->FifoSize == 0U) || (pdev->FifoSize > USBH_SIM_FIFO_SIZE))
+  {
+    pdev->FifoSize = USBH_SIM_FIFO_SIZE;
+  }
+
+  pdesc[0] = USB_DEVICE_DESC_SIZE;
+  pdesc[1] = USB_DESC_TYPE_DEVICE;
+  pdesc[2] = 0x00U;                         /* bcdUSB 2.00 */
+  pdesc[3] = 0x02U;
+  if (pdev->Function == USBH_SIM_FUNCTION_AUDIO)
+  {
+    pdesc[4] = 0xEFU;                       /* Miscellaneous, interface association */
+    pdesc[5] = 0x02U;
+    pdesc[6] = 0x01U;
+  }
+  else if (pdev->Function == USBH_SIM_FUNCTION_HUB)
+  {
+    pdesc[4] = 0x09U;                       /* Hub, single TT */
+    pdesc[5] = 0x00U;
+    pdesc[6] = 0x01U;
+  }
+  else
+  {
+    pdesc[4] = COMMUNICATION_INTERFACE_CLASS_CODE;
+    pdesc[5] = 0x00U;
+    pdesc[6] = 0x00U;
+  }
+  pdesc[7] = 64U;                           /* bMaxPacketSize0 */
+  pdesc[8] = LOBYTE(pdev->VID);
+  pdesc[9] = HIBYTE(pdev->VID);
+  pdesc[10] = LOBYTE(pdev->PID);
+  pdesc[11] = HIBYTE(pdev->PID);
+  pdesc[12] = 0x00U;                        /* bcdDevice 2.00 */
+  pdesc[13] = 0x02U;
+  pdesc[14] = USBH_SIM_STR_MANUFACTURER;
+  pdesc[15] = USBH_SIM_STR_PRODUCT;
+  pdesc[16] = USBH_SIM_STR_SERIAL;
+  pdesc[17] = 1U;                           /* bNumConfigurations */
+
+  if (pdev->Function == USBH_SIM_FUNCTION_AUDIO)
+  {
+    pdev->CfgDescSize = (uint16_t)sizeof(USBH_SimDev_AudioCfgDesc);
+    (void)USBH_memcpy(pdev->CfgDesc, USBH_SimDev_AudioCfgDesc, pdev->CfgDescSize);
+    pdev->CfgDesc[2] = LOBYTE(pdev->CfgDescSize);
+    pdev->CfgDesc[3] = HIBYTE(pdev->CfgDescSize);
+  }
+  else if (pdev->Function == USBH_SIM_FUNCTION_HUB)
+  {
+    pdev->CfgDescSize = (uint16_t)sizeof(USBH_SimDev_HubCfgDesc);
+    (void)USBH_memcpy(pdev->CfgDesc, USBH_SimDev_HubCfgDesc, pdev->CfgDescSize);
+  }
+  else
+  {
+    USBH_SimDev_BuildCdc(pdev);
+  }
+
+  /* 115200 8N1 */
+  pdev->line_coding[0] = 0x00U;
+  pdev->line_coding[1] = 0xC2U;
+  pdev->line_coding[2] = 0x01U;
+  pdev->line_coding[3] = 0x00U;
+  pdev->line_coding[4] = 0U;
+  pdev->line_coding[5] = 0U;
+  pdev->line_coding[6] = 8U;
+
+  pdev->rand = (pdev->Seed != 0U) ? pdev->Seed : 1U;
+
+  USBH_SimDev_Reset(pdev);
+}
+
+/**
+  * @brief  Build the configuration descriptor of the CDC ACM function.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+static void USBH_SimDev_BuildCdc(USBH_SimDevTypeDef *pdev)
+{
+  uint8_t *pdesc = pdev->CfgDesc;
+
+  pdev->CfgDescSize = USBH_SIM_CFG_DESC_SIZE;
+
+  /* Configuration */
+  *pdesc++ = USB_CONFIGURATION_DESC_SIZE;
+  *pdesc++ = USB_DESC_TYPE_CONFIGURATION;
+  *pdesc++ = LOBYTE(USBH_SIM_CFG_DESC_SIZE);
+  *pdesc++ = HIBYTE(USBH_SIM_CFG_DESC_SIZE);
+  *pdesc++ = 2U;                            /* bNumInterfaces */
+  *pdesc++ = 1U;                            /* bConfigurationValue */
+  *pdesc++ = 0U;
+  *pdesc++ = 0xC0U;                         /* Self powered */
+  *pdesc++ = 50U;
+
+  /* Communication interface */
+  *pdesc++ = 9U;
+  *pdesc++ = USB_DESC_TYPE_INTERFACE;
+  *pdesc++ = 0U;
+  *pdesc++ = 0U;
+  *pdesc++ = 1U;
+  *pdesc++ = COMMUNICATION_INTERFACE_CLASS_CODE;
+  *pdesc++ = ABSTRACT_CONTROL_MODEL;
+  *pdesc++ = COMMON_AT_COMMAND;
+  *pdesc++ = 0U;
+
+  /* Header, call management, ACM and union functional descriptors */
+  *pdesc++ = 5U;
+  *pdesc++ = CS_INTERFACE;
+  *pdesc++ = 0x00U;
+  *pdesc++ = 0x10U;
+  *pdesc++ = 0x01U;
+
+  *pdesc++ = 5U;
+  *pdesc++ = CS_INTERFACE;
+  *pdesc++ = 0x01U;
+  *pdesc++ = 0x00U;
+  *pdesc++ = 1U;
+
+  *pdesc++ = 4U;
+  *pdesc++ = CS_INTERFACE;
+  *pdesc++ = 0x02U;
+  *pdesc++ = 0x02U;
+
+  *pdesc++ = 5U;
+  *pdesc++ = CS_INTERFACE;
+  *pdesc++ = 0x06U;
+  *pdesc++ = 0U;
+  *pdesc++ = 1U;
+
+  /* Notification endpoint */
+  *pdesc++ = USB_ENDPOINT_DESC_SIZE;
+  *pdesc++ = USB_DESC_TYPE_ENDPOINT;
+  *pdesc++ = USBH_SIM_NOTIF_EP;
+  *pdesc++ = USB_EP_TYPE_INTR;
+  *pdesc++ = LOBYTE(pdev->NotifEpSize);
+  *pdesc++ = HIBYTE(pdev->NotifEpSize);
+  *pdesc++ = 0x10U;
+
+  /* Data interface */
+  *pdesc++ = 9U;
+  *pdesc++ = USB_DESC_TYPE_INTERFACE;
+  *pdesc++ = 1U;
+  *pdesc++ = 0U;
+  *pdesc++ = 2U;
+  *pdesc++ = DATA_INTERFACE_CLASS_CODE;
+  *pdesc++ = 0U;
+  *pdesc++ = 0U;
+  *pdesc++ = 0U;
+
+  *pdesc++ = USB_ENDPOINT_DESC_SIZE;
+  *pdesc++ = USB_DESC_TYPE_ENDPOINT;
+  *pdesc++ = USBH_SIM_DATA_OUT_EP;
+  *pdesc++ = USB_EP_TYPE_BULK;
+  *pdesc++ = LOBYTE(pdev->OutEpSize);
+  *pdesc++ = HIBYTE(pdev->OutEpSize);
+  *pdesc++ = 0U;
+
+  *pdesc++ = USB_ENDPOINT_DESC_SIZE;
+  *pdesc++ = USB_DESC_TYPE_ENDPOINT;
+  *pdesc++ = USBH_SIM_DATA_IN_EP;
+  *pdesc++ = USB_EP_TYPE_BULK;
+  *pdesc++ = LOBYTE(pdev->InEpSize);
+  *pdesc++ = HIBYTE(pdev->InEpSize);
+  *pdesc = 0U;
+}
+
+/**
+  * @brief  Bus reset: back to the default address, unconfigured, FIFO empty.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+void USBH_SimDev_Reset(USBH_SimDevTypeDef *pdev)
+{
+  uint32_t idx;
+
+  pdev->address = 0U;
+  pdev->pending_address = 0U;
+  pdev->configuration = 0U;
+  pdev->ctrl_state = USBH_SIM_CTRL_IDLE;
+  pdev->ctrl_stall = 0U;
+  pdev->line_state = 0U;
+  pdev->serial_state = 0U;
+  pdev->notif_pending = 0U;
+  pdev->StallMap = 0U;
+  pdev->fifo_head = 0U;
+  pdev->fifo_tail = 0U;
+  pdev->cmux_len = 0U;
+  pdev->cmux_active = 0U;
+  pdev->cmux_escape = 0U;
+
+  (void)USBH_memset(pdev->alt, 0, sizeof(pdev->alt));
+  pdev->spk_running = 0U;
+  pdev->spk_started = 0U;
+  pdev->mic_pending = 0U;
+  pdev->clock_acc = 0U;
+  USBH_SimDev_SetRate(pdev, pdev->SampleRate);
+
+  if (pdev->Function == USBH_SIM_FUNCTION_HUB)
+  {
+    /* Ports unpowered: the devices plugged into them lose their bus */
+    for (idx = 0U; idx < USBH_SIM_HUB_PORTS; idx++)
+    {
+      pdev->port_status[idx] = 0U;
+      pdev->port_change[idx] = 0U;
+
+      if (pdev->port_dev[idx] != NULL)
+      {
+        USBH_SimDev_Reset(pdev->port_dev[idx]);
+      }
+    }
+  }
+}
+
+/**
+  * @brief  Start of frame: the device clock moves on by one microframe. The
+  *         speaker plays its samples and the microphone records new ones.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+void USBH_SimDev_Sof(USBH_SimDevTypeDef *pdev)
+{
+  uint32_t frames;
+  uint32_t idx;
+
+  if (pdev->Function == USBH_SIM_FUNCTION_HUB)
+  {
+    /* The hub repeats the SOFs on its enabled ports */
+    for (idx = 0U; idx < USBH_SIM_HUB_PORTS; idx++)
+    {
+      if ((pdev->port_dev[idx] != NULL) && ((pdev->port_status[idx] & USBH_SIM_PORT_STAT_ENABLE) != 0U))
+      {
+        USBH_SimDev_Sof(pdev->port_dev[idx]);
+      }
+    }
+    return;
+  }
+
+  if ((pdev->Function != USBH_SIM_FUNCTION_AUDIO) || (pdev->configuration == 0U))
+  {
+    return;
+  }
+
+  pdev->clock_acc += pdev->clock_q16;
+  frames = pdev->clock_acc >> 16;
+  pdev->clock_acc &= 0xFFFFU;
+
+  if (pdev->alt[1] != 0U)
+  {
+    USBH_SimDev_Play(pdev, frames);
+  }
+
+  if (pdev->alt[2] != 0U)
+  {
+    /* Samples of the packets the host did not fetch are lost */
+    pdev->mic_pending = MIN(pdev->mic_pending + frames,
+                            2U * (USBH_SIM_AUDIO_EP_SIZE / USBH_SIM_AUDIO_FRAME));
+  }
+}
+
+/**
+  * @brief  Set the sampling frequency: the device clock runs ClockPpm off it.
+  * @param  pdev: Device handle
+  * @param  rate: Sampling frequency in Hz
+  * @retval None
+  */
+static void USBH_SimDev_SetRate(USBH_SimDevTypeDef *pdev, uint32_t rate)
+{
+  pdev->sample_rate = rate;
+  pdev->clock_q16 = (uint32_t)((((uint64_t)rate << 16) * (uint64_t)(1000000 + pdev->ClockPpm)) /
+                               (1000000ULL * 8000ULL));
+}
+
+/**
+  * @brief  Play sample frames from the speaker FIFO, checking that the left
+  *         channel carries a ramp. Silence is not checked.
+  * @param  pdev: Device handle
+  * @param  frames: Sample frames due
+  * @retval None
+  */
+static void USBH_SimDev_Play(USBH_SimDevTypeDef *pdev, uint32_t frames)
+{
+  uint32_t level = pdev->fifo_head - pdev->fifo_tail;
+  uint32_t pos;
+  uint16_t sample;
+
+  if (pdev->spk_running == 0U)
+  {
+    if (level < ((pdev->sample_rate / 1000U) * USBH_SIM_SPEAKER_PREFILL_MS * USBH_SIM_AUDIO_FRAME))
+    {
+      return;
+    }
+
+    pdev->spk_running = 1U;
+  }
+
+  if (level < (frames * USBH_SIM_AUDIO_FRAME))
+  {
+    pdev->stats.audio_underruns++;
+    pdev->spk_running = 0U;
+    frames = level / USBH_SIM_AUDIO_FRAME;
+  }
+
+  while (frames != 0U)
+  {
+    pos = pdev->fifo_tail % pdev->FifoSize;
+    sample = (uint16_t)(pdev->fifo[pos] | ((uint16_t)pdev->fifo[(pos + 1U) % pdev->FifoSize] << 8));
+
+    if (sample == 0U)
+    {
+      pdev->spk_started = 0U;
+    }
+    else
+    {
+      if ((pdev->spk_started != 0U) && (sample != (uint16_t)(pdev->spk_last + 1U)))
+      {
+        pdev->stats.audio_glitches++;
+      }
+
+      pdev->spk_started = 1U;
+    }
+
+    pdev->spk_last = sample;
+    pdev->fifo_tail += USBH_SIM_AUDIO_FRAME;
+    pdev->stats.audio_played++;
+    frames--;
+  }
+}
+
+/**
+  * @brief  Force NAKs on the next transactions of an endpoint. On endpoint 0
+  *         the data and status stages are NAKed, never the SETUP.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address, bit 7 set for IN
+  * @param  count: Number of transactions to NAK
+  * @retval None
+  */
+void USBH_SimDev_InjectNak(USBH_SimDevTypeDef *pdev, uint8_t ep_addr, uint32_t count)
+{
+  pdev->NakCount[USBH_SIM_EP_DIR(ep_addr)][ep_addr & 0x0FU] = count;
+}
+
+/**
+  * @brief  Halt an endpoint. A data endpoint stalls until the host clears
+  *         ENDPOINT_HALT; endpoint 0 stalls the current control transfer.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address, bit 7 set for IN
+  * @retval None
+  */
+void USBH_SimDev_InjectStall(USBH_SimDevTypeDef *pdev, uint8_t ep_addr)
+{
+  if ((ep_addr & 0x0FU) == 0U)
+  {
+    pdev->ctrl_stall = 1U;
+  }
+  else
+  {
+    pdev->StallMap |= USBH_SIM_EP_BIT(ep_addr);
+  }
+}
+
+/**
+  * @brief  Set the random NAK rate of the data endpoints and restart the
+  *         NAK pattern from a seed.
+  * @param  pdev: Device handle
+  * @param  rate: Transactions NAKed, per 65536
+  * @param  seed: Pattern seed, 0 is replaced by 1
+  * @retval None
+  */
+void USBH_SimDev_SetNakRate(USBH_SimDevTypeDef *pdev, uint32_t rate, uint32_t seed)
+{
+  pdev->NakRate = rate;
+  pdev->Seed = (seed != 0U) ? seed : 1U;
+  pdev->rand = pdev->Seed;
+}
+
+/**
+  * @brief  Change the modem lines and queue a SERIAL_STATE notification.
+  * @param  pdev: Device handle
+  * @param  state: SERIAL_STATE bitmap, see CDC_SERIAL_STATE_xxx
+  * @retval None
+  */
+void USBH_SimDev_SetSerialState(USBH_SimDevTypeDef *pdev, uint16_t state)
+{
+  pdev->serial_state = state;
+  pdev->notif_pending = 1U;
+}
+
+/**
+  * @brief  Find the device answering an address: the device itself, or for
+  *         a hub a device on one of its enabled ports.
+  * @param  pdev: Device on the root port
+  * @param  address: USB address of the transaction
+  * @retval Device, NULL if none answers
+  */
+USBH_SimDevTypeDef *USBH_SimDev_Route(USBH_SimDevTypeDef *pdev, uint8_t address)
+{
+  uint32_t idx;
+
+  if (pdev->address == address)
+  {
+    return pdev;
+  }
+
+  if (pdev->Function == USBH_SIM_FUNCTION_HUB)
+  {
+    for (idx = 0U; idx < USBH_SIM_HUB_PORTS; idx++)
+    {
+      if ((pdev->port_dev[idx] != NULL) && ((pdev->port_status[idx] & USBH_SIM_PORT_STAT_ENABLE) != 0U) &&
+          (pdev->port_dev[idx]->address == address))
+      {
+        return pdev->port_dev[idx];
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  * @brief  Plug a device into a hub port, or unplug it with NULL. A powered
+  *         port reports the change on the status change endpoint.
+  * @param  phub: Hub device
+  * @param  port: Port number (1..USBH_SIM_HUB_PORTS)
+  * @param  pdev: Device model, or NULL
+  * @retval None
+  */
+void USBH_SimDev_HubPlug(USBH_SimDevTypeDef *phub, uint8_t port, USBH_SimDevTypeDef *pdev)
+{
+  uint32_t idx = (uint32_t)port - 1U;
+
+  if ((port == 0U) || (port > USBH_SIM_HUB_PORTS))
+  {
+    return;
+  }
+
+  if (pdev != NULL)
+  {
+    USBH_SimDev_Reset(pdev);
+  }
+
+  phub->port_dev[idx] = pdev;
+
+  if ((phub->port_status[idx] & USBH_SIM_PORT_STAT_POWER) != 0U)
+  {
+    phub->port_status[idx] &= (uint16_t)~(USBH_SIM_PORT_STAT_CONNECTION | USBH_SIM_PORT_STAT_ENABLE |
+                                          USBH_SIM_PORT_STAT_HIGH_SPEED);
+    phub->port_status[idx] |= (pdev != NULL) ? USBH_SIM_PORT_STAT_CONNECTION : 0U;
+    phub->port_change[idx] |= USBH_SIM_PORT_CHANGE_CONNECTION;
+  }
+}
+
+/**
+  * @brief  SETUP transaction.
+  * @param  pdev: Device handle
+  * @param  setup: 8 byte setup packet
+  * @retval Handshake
+  */
+USBH_SimRespTypeDef USBH_SimDev_Setup(USBH_SimDevTypeDef *pdev, const uint8_t *setup)
+{
+  uint16_t wValue = LE16(&setup[2]);
+  uint16_t wIndex = LE16(&setup[4]);
+  uint16_t wLength = LE16(&setup[6]);
+  USBH_SimRespTypeDef resp;
+
+  /* A SETUP is always acknowledged and clears a protocol stall */
+  (void)USBH_memcpy(pdev->setup, setup, sizeof(pdev->setup));
+  pdev->stats.setups++;
+  pdev->ctrl_len = 0U;
+  pdev->ctrl_pos = 0U;
+
+  if ((setup[0] & USB_REQ_DIR_MASK) == USB_D2H)
+  {
+    pdev->ctrl_state = (wLength != 0U) ? USBH_SIM_CTRL_DATA_IN : USBH_SIM_CTRL_STATUS_OUT;
+  }
+  else
+  {
+    pdev->ctrl_state = (wLength != 0U) ? USBH_SIM_CTRL_DATA_OUT : USBH_SIM_CTRL_STATUS_IN;
+  }
+
+  if ((wLength > USBH_SIM_CTRL_BUFF_SIZE) && ((setup[0] & USB_REQ_DIR_MASK) == USB_H2D))
+  {
+    resp = USBH_SIM_STALL;
+  }
+  else if (pdev->ctrl_state == USBH_SIM_CTRL_DATA_OUT)
+  {
+    /* Handled once the data stage is in */
+    resp = USBH_SIM_ACK;
+  }
+  else if ((setup[0] & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_STANDARD)
+  {
+    resp = USBH_SimDev_Standard(pdev, wValue, wIndex);
+  }
+  else if ((setup[0] & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_CLASS)
+  {
+    resp = USBH_SimDev_Class(pdev, wValue, wIndex);
+  }
+  else
+  {
+    resp = USBH_SIM_STALL;
+  }
+
+  if (pdev->ctrl_len > wLength)
+  {
+    pdev->ctrl_len = wLength;
+  }
+
+  /* Unsupported requests stall the data or status stage */
+  pdev->ctrl_stall = (resp == USBH_SIM_STALL) ? 1U : 0U;
+
+  return USBH_SIM_ACK;
+}
+
+/**
+  * @brief  IN transaction.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address
+  * @param  pbuff: Packet buffer, mps bytes
+  * @param  mps: Max packet size of the host pipe
+  * @param  length: Returns the packet length
+  * @retval Handshake
+  */
+USBH_SimRespTypeDef USBH_SimDev_In(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                   uint8_t *pbuff, uint16_t mps, uint16_t *length)
+{
+  uint32_t count;
+  uint32_t idx;
+
+  *length = 0U;
+
+  if ((ep_addr & 0x0FU) == 0U)
+  {
+    if (pdev->ctrl_stall != 0U)
+    {
+      pdev->stats.stalls++;
+      return USBH_SIM_STALL;
+    }
+
+    if (USBH_SimDev_ForceCtrlNak(pdev, ep_addr) != 0U)
+    {
+      return USBH_SIM_NAK;
+    }
+
+    if (pdev->ctrl_state == USBH_SIM_CTRL_DATA_IN)
+    {
+      count = MIN((uint32_t)pdev->ctrl_len - pdev->ctrl_pos, (uint32_t)mps);
+      (void)USBH_memcpy(pbuff, &pdev->ctrl_buff[pdev->ctrl_pos], count);
+      pdev->ctrl_pos += (uint16_t)count;
+      *length = (uint16_t)count;
+      return USBH_SIM_ACK;
+    }
+
+    if (pdev->ctrl_state == USBH_SIM_CTRL_STATUS_IN)
+    {
+      USBH_SimDev_Status(pdev);
+      return USBH_SIM_ACK;
+    }
+
+    return USBH_SIM_NAK;
+  }
+
+  if (pdev->configuration == 0U)
+  {
+    return USBH_SIM_NORESP;
+  }
+
+  if ((pdev->StallMap & USBH_SIM_EP_BIT(ep_addr)) != 0U)
+  {
+    pdev->stats.stalls++;
+    return USBH_SIM_STALL;
+  }
+
+  if (USBH_SimDev_ForceNak(pdev, ep_addr) != 0U)
+  {
+    return USBH_SIM_NAK;
+  }
+
+  if (pdev->Function == USBH_SIM_FUNCTION_AUDIO)
+  {
+    return USBH_SimDev_AudioIn(pdev, ep_addr, pbuff, mps, length);
+  }
+
+  if (pdev->Function == USBH_SIM_FUNCTION_HUB)
+  {
+    return USBH_SimDev_HubIn(pdev, ep_addr, pbuff, length);
+  }
+
+  if (ep_addr == USBH_SIM_NOTIF_EP)
+  {
+    if ((pdev->notif_pending == 0U) || (mps < USBH_SIM_SERIAL_STATE_SIZE))
+    {
+      return USBH_SIM_NAK;
+    }
+
+    pbuff[0] = 0xA1U;
+    pbuff[1] = USBH_SIM_SERIAL_STATE;
+    pbuff[2] = 0U;
+    pbuff[3] = 0U;
+    pbuff[4] = 0U;                        /* wIndex: communication interface */
+    pbuff[5] = 0U;
+    pbuff[6] = 2U;
+    pbuff[7] = 0U;
+    pbuff[8] = LOBYTE(pdev->serial_state);
+    pbuff[9] = HIBYTE(pdev->serial_state);
+    pdev->notif_pending = 0U;
+    *length = USBH_SIM_SERIAL_STATE_SIZE;
+    return USBH_SIM_ACK;
+  }
+
+  if (ep_addr == USBH_SIM_DATA_IN_EP)
+  {
+    count = MIN(pdev->fifo_head - pdev->fifo_tail, (uint32_t)MIN(mps, pdev->InEpSize));
+
+    if (count == 0U)
+    {
+      return USBH_SIM_NAK;
+    }
+
+    for (idx = 0U; idx < count; idx++)
+    {
+      pbuff[idx] = pdev->fifo[(pdev->fifo_tail + idx) % pdev->FifoSize];
+    }
+
+    pdev->fifo_tail += count;
+    pdev->stats.looped += count;
+    *length = (uint16_t)count;
+    return USBH_SIM_ACK;
+  }
+
+  return USBH_SIM_NORESP;
+}
+
+/**
+  * @brief  OUT transaction.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address
+  * @param  pbuff: Packet data
+  * @param  length: Packet length
+  * @retval Handshake
+  */
+USBH_SimRespTypeDef USBH_SimDev_Out(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                    const uint8_t *pbuff, uint16_t length)
+{
+  uint32_t idx;
+
+  if ((ep_addr & 0x0FU) == 0U)
+  {
+    if (pdev->ctrl_stall != 0U)
+    {
+      pdev->stats.stalls++;
+      return USBH_SIM_STALL;
+    }
+
+    if (USBH_SimDev_ForceCtrlNak(pdev, ep_addr) != 0U)
+    {
+      return USBH_SIM_NAK;
+    }
+
+    if (pdev->ctrl_state == USBH_SIM_CTRL_DATA_OUT)
+    {
+      length = (uint16_t)MIN((uint32_t)length, (uint32_t)LE16(&pdev->setup[6]) - pdev->ctrl_len);
+      (void)USBH_memcpy(&pdev->ctrl_buff[pdev->ctrl_len], pbuff, length);
+      pdev->ctrl_len += length;
+
+      if (pdev->ctrl_len >= LE16(&pdev->setup[6]))
+      {
+        USBH_SimDev_OutData(pdev);
+      }
+      return USBH_SIM_ACK;
+    }
+
+    if ((pdev->ctrl_state == USBH_SIM_CTRL_DATA_IN) || (pdev->ctrl_state == USBH_SIM_CTRL_STATUS_OUT))
+    {
+      /* Status stage of a control read */
+      USBH_SimDev_Status(pdev);
+      return USBH_SIM_ACK;
+    }
+
+    return USBH_SIM_NAK;
+  }
+
+  if (pdev->configuration == 0U)
+  {
+    return USBH_SIM_NORESP;
+  }
+
+  if ((pdev->StallMap & USBH_SIM_EP_BIT(ep_addr)) != 0U)
+  {
+    pdev->stats.stalls++;
+    return USBH_SIM_STALL;
+  }
+
+  if (USBH_SimDev_ForceNak(pdev, ep_addr) != 0U)
+  {
+    return USBH_SIM_NAK;
+  }
+
+  if (pdev->Function == USBH_SIM_FUNCTION_AUDIO)
+  {
+    return USBH_SimDev_AudioOut(pdev, ep_addr, pbuff, length);
+  }
+
+  if (ep_addr != USBH_SIM_DATA_OUT_EP)
+  {
+    return USBH_SIM_NORESP;
+  }
+
+  /* The whole packet or nothing: a full FIFO NAKs. The CMUX answers to a
+     packet, escaped, take at most three times its size plus the frame it
+     completes. */
+  if ((pdev->FifoSize - (pdev->fifo_head - pdev->fifo_tail)) <
+      ((pdev->Cmux != USBH_SIM_CMUX_OFF) ? ((3U * (uint32_t)length) + (2U * USBH_SIM_CMUX_FRAME_MAX)) : length))
+  {
+    pdev->stats.naks++;
+    pdev->stats.overruns++;
+    return USBH_SIM_NAK;
+  }
+
+  if (pdev->Cmux != USBH_SIM_CMUX_OFF)
+  {
+    USBH_SimDev_CmuxOut(pdev, pbuff, length);
+    return USBH_SIM_ACK;
+  }
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    pdev->fifo[(pdev->fifo_head + idx) % pdev->FifoSize] = pbuff[idx];
+  }
+
+  pdev->fifo_head += length;
+
+  return USBH_SIM_ACK;
+}
+
+/**
+  * @brief  Queue data on the bulk IN endpoint.
+  * @param  pdev: Device handle
+  * @param  pbuff: Data
+  * @param  length: Data length, room checked by the caller
+  * @retval None
+  */
+static void USBH_SimDev_Push(USBH_SimDevTypeDef *pdev, const uint8_t *pbuff, uint32_t length)
+{
+  uint32_t idx;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    pdev->fifo[(pdev->fifo_head + idx) % pdev->FifoSize] = pbuff[idx];
+  }
+
+  pdev->fifo_head += length;
+}
+
+/**
+  * @brief  TS 27.010 FCS, computed bit by bit.
+  * @param  pbuff: Checked octets
+  * @param  length: Octet count
+  * @retval FCS octet
+  */
+static uint8_t USBH_SimDev_CmuxFcs(const uint8_t *pbuff, uint32_t length)
+{
+  uint8_t crc = 0xFFU;
+  uint32_t idx;
+  uint32_t bit;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    crc ^= pbuff[idx];
+
+    for (bit = 0U; bit < 8U; bit++)
+    {
+      crc = ((crc & 0x01U) != 0U) ? (uint8_t)((crc >> 1) ^ 0xE0U) : (uint8_t)(crc >> 1);
+    }
+  }
+
+  return (uint8_t)(0xFFU - crc);
+}
+
+/**
+  * @brief  Send a frame as the modem. Data of the channels goes back the
+  *         way it came; the test also uses it to send MSC.
+  * @param  pdev: Device handle
+  * @param  dlci: Channel
+  * @param  control: Control field
+  * @param  pinfo: Information field
+  * @param  length: Information length
+  * @retval 1 when queued, 0 when the FIFO lacks room
+  */
+uint8_t USBH_SimDev_CmuxSend(USBH_SimDevTypeDef *pdev, uint8_t dlci, uint8_t control,
+                             const uint8_t *pinfo, uint16_t length)
+{
+  uint8_t frame[USBH_SIM_CMUX_FRAME_MAX + 8U];
+  uint8_t out[(2U * USBH_SIM_CMUX_FRAME_MAX) + 16U];
+  uint32_t hlen;
+  uint32_t size;
+  uint32_t idx;
+  uint8_t basic = (pdev->Cmux == USBH_SIM_CMUX_BASIC) ? 1U : 0U;
+
+  frame[0] = (uint8_t)((dlci << 2) | 0x03U);
+  frame[1] = control;
+  hlen = 2U;
+
+  if (basic != 0U)
+  {
+    if (length < 128U)
+    {
+      frame[2] = (uint8_t)((length << 1) | 0x01U);
+      hlen = 3U;
+    }
+    else
+    {
+      frame[2] = (uint8_t)(length << 1);
+      frame[3] = (uint8_t)(length >> 7);
+      hlen = 4U;
+    }
+  }
+
+  (void)USBH_memcpy(&frame[hlen], pinfo, length);
+  frame[hlen + length] = USBH_SimDev_CmuxFcs(frame, ((control & 0xEFU) == 0xEFU) ? hlen : (hlen + length));
+  size = 0U;
+  out[size++] = (basic != 0U) ? 0xF9U : 0x7EU;
+
+  for (idx = 0U; idx <= (hlen + length); idx++)
+  {
+    if ((basic == 0U) && ((frame[idx] == 0x7EU) || (frame[idx] == 0x7DU) ||
+                          (frame[idx] == 0x11U) || (frame[idx] == 0x13U)))
+    {
+      out[size++] = 0x7DU;
+      out[size++] = frame[idx] ^ 0x20U;
+    }
+    else
+    {
+      out[size++] = frame[idx];
+    }
+  }
+
+  out[size++] = out[0];
+
+  if ((pdev->FifoSize - (pdev->fifo_head - pdev->fifo_tail)) < size)
+  {
+    return 0U;
+  }
+
+  USBH_SimDev_Push(pdev, out, size);
+
+  return 1U;
+}
+
+/**
+  * @brief  Answer a frame taken by the CMUX modem: UA to SABM and DISC,
+  *         control channel commands echoed as responses, data echoed.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+static void USBH_SimDev_CmuxFrame(USBH_SimDevTypeDef *pdev)
+{
+  uint8_t *frame = pdev->cmux_frame;
+  uint32_t hlen = (pdev->Cmux == USBH_SIM_CMUX_BASIC) ? (((frame[2] & 0x01U) != 0U) ? 3U : 4U) : 2U;
+  uint32_t length = (uint32_t)pdev->cmux_len - hlen - 1U;
+  uint8_t dlci = frame[0] >> 2;
+  uint8_t control = frame[1] & 0xEFU;
+  uint8_t *pinfo = &frame[hlen];
+
+  if (USBH_SimDev_CmuxFcs(frame, (control == 0xEFU) ? hlen : (hlen + length)) != frame[hlen + length])
+  {
+    pdev->stats.cmux_errors++;
+    return;
+  }
+
+  pdev->stats.cmux_frames++;
+
+  switch (control)
+  {
+    case 0x2FU:   /* SABM */
+    case 0x43U:   /* DISC */
+      (void)USBH_SimDev_CmuxSend(pdev, dlci, 0x73U, NULL, 0U);
+      break;
+
+    case 0xEFU:   /* UIH */
+      if ((dlci == 0U) && (length >= 2U) && ((pinfo[0] & 0x02U) != 0U))
+      {
+        /* Command: the response carries the same values */
+        pinfo[0] &= (uint8_t)~0x02U;
+      }
+      else if (dlci == 0U)
+      {
+        break;
+      }
+      else
+      {
+        /* .. */
+      }
+
+      (void)USBH_SimDev_CmuxSend(pdev, dlci, 0xEFU, pinfo, (uint16_t)length);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Data OUT of the CMUX modem: frames are collected, unescaped in
+  *         advanced mode, then answered.
+  * @param  pdev: Device handle
+  * @param  pbuff: Packet data
+  * @param  length: Packet length
+  * @retval None
+  */
+static void USBH_SimDev_CmuxOut(USBH_SimDevTypeDef *pdev, const uint8_t *pbuff, uint16_t length)
+{
+  uint8_t flag = (pdev->Cmux == USBH_SIM_CMUX_BASIC) ? 0xF9U : 0x7EU;
+  uint32_t idx;
+  uint32_t need;
+  uint8_t data;
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    data = pbuff[idx];
+
+    if (pdev->Cmux == USBH_SIM_CMUX_ADVANCED)
+    {
+      if (data == flag)
+      {
+        if ((pdev->cmux_active != 0U) && (pdev->cmux_len >= 3U))
+        {
+          USBH_SimDev_CmuxFrame(pdev);
+        }
+
+        pdev->cmux_active = 1U;
+        pdev->cmux_len = 0U;
+        pdev->cmux_escape = 0U;
+      }
+      else if ((pdev->cmux_active != 0U) && (data == 0x7DU))
+      {
+        pdev->cmux_escape = 1U;
+      }
+      else if ((pdev->cmux_active != 0U) && (pdev->cmux_len < USBH_SIM_CMUX_FRAME_MAX))
+      {
+        pdev->cmux_frame[pdev->cmux_len++] = (pdev->cmux_escape != 0U) ? (data ^ 0x20U) : data;
+        pdev->cmux_escape = 0U;
+      }
+      else
+      {
+        /* .. */
+      }
+
+      continue;
+    }
+
+    /* Basic mode: the length field tells where the frame ends */
+    if (pdev->cmux_active == 0U)
+    {
+      pdev->cmux_active = (data == flag) ? 1U : 0U;
+      pdev->cmux_len = 0U;
+      continue;
+    }
+
+    if ((pdev->cmux_len == 0U) && (data == flag))
+    {
+      continue;
+    }
+
+    pdev->cmux_frame[pdev->cmux_len++] = data;
+
+    if (pdev->cmux_len < 3U)
+    {
+      continue;
+    }
+
+    if ((pdev->cmux_frame[2] & 0x01U) != 0U)
+    {
+      need = 4U + ((uint32_t)pdev->cmux_frame[2] >> 1);
+    }
+    else if (pdev->cmux_len >= 4U)
+    {
+      need = 5U + (((uint32_t)pdev->cmux_frame[2] >> 1) | ((uint32_t)pdev->cmux_frame[3] << 7));
+    }
+    else
+    {
+      continue;
+    }
+
+    if (need > USBH_SIM_CMUX_FRAME_MAX)
+    {
+      pdev->stats.cmux_errors++;
+      pdev->cmux_active = 0U;
+    }
+    else if (pdev->cmux_len == need)
+    {
+      USBH_SimDev_CmuxFrame(pdev);
+      pdev->cmux_active = 0U;
+    }
+    else
+    {
+      /* .. */
+    }
+  }
+}
+
+/**
+  * @brief  IN transaction on an endpoint of the headset. Isochronous
+  *         endpoints always answer, with a zero-length packet when the
+  *         microphone has nothing recorded.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address
+  * @param  pbuff: Packet buffer, mps bytes
+  * @param  mps: Max packet size of the host pipe
+  * @param  length: Returns the packet length
+  * @retval Handshake
+  */
+static USBH_SimRespTypeDef USBH_SimDev_AudioIn(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                               uint8_t *pbuff, uint16_t mps, uint16_t *length)
+{
+  uint32_t frames;
+  uint32_t idx;
+
+  if ((ep_addr == USBH_SIM_FEEDBACK_EP) && (pdev->alt[1] != 0U) && (mps >= 4U))
+  {
+    /* High speed: Q16.16 sample frames per microframe */
+    pbuff[0] = (uint8_t)(pdev->clock_q16);
+    pbuff[1] = (uint8_t)(pdev->clock_q16 >> 8);
+    pbuff[2] = (uint8_t)(pdev->clock_q16 >> 16);
+    pbuff[3] = (uint8_t)(pdev->clock_q16 >> 24);
+    *length = 4U;
+    return USBH_SIM_ACK;
+  }
+
+  if ((ep_addr == USBH_SIM_MIC_EP) && (pdev->alt[2] != 0U))
+  {
+    frames = MIN(pdev->mic_pending, (uint32_t)mps / USBH_SIM_AUDIO_FRAME);
+
+    for (idx = 0U; idx < frames; idx++)
+    {
+      pdev->mic_value++;
+      pbuff[(idx * USBH_SIM_AUDIO_FRAME) + 0U] = LOBYTE(pdev->mic_value);
+      pbuff[(idx * USBH_SIM_AUDIO_FRAME) + 1U] = HIBYTE(pdev->mic_value);
+      pbuff[(idx * USBH_SIM_AUDIO_FRAME) + 2U] = LOBYTE(pdev->mic_value);
+      pbuff[(idx * USBH_SIM_AUDIO_FRAME) + 3U] = HIBYTE(pdev->mic_value);
+    }
+
+    pdev->mic_pending -= frames;
+    pdev->stats.audio_recorded += frames;
+    *length = (uint16_t)(frames * USBH_SIM_AUDIO_FRAME);
+    return USBH_SIM_ACK;
+  }
+
+  return USBH_SIM_NORESP;
+}
+
+/**
+  * @brief  OUT transaction on the speaker endpoint. A packet that does not
+  *         fit in the FIFO is dropped: isochronous data is not retried.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address
+  * @param  pbuff: Packet data
+  * @param  length: Packet length
+  * @retval Handshake
+  */
+static USBH_SimRespTypeDef USBH_SimDev_AudioOut(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                                const uint8_t *pbuff, uint16_t length)
+{
+  uint32_t idx;
+
+  if ((ep_addr != USBH_SIM_SPEAKER_EP) || (pdev->alt[1] == 0U))
+  {
+    return USBH_SIM_NORESP;
+  }
+
+  if ((pdev->FifoSize - (pdev->fifo_head - pdev->fifo_tail)) < length)
+  {
+    pdev->stats.audio_overruns++;
+    return USBH_SIM_ACK;
+  }
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    pdev->fifo[(pdev->fifo_head + idx) % pdev->FifoSize] = pbuff[idx];
+  }
+
+  pdev->fifo_head += length;
+
+  return USBH_SIM_ACK;
+}
+
+/**
+  * @brief  IN transaction on the status change endpoint of the hub: bit n
+  *         of the bitmap flags a change on port n, NAK without a change.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address
+  * @param  pbuff: Packet buffer
+  * @param  length: Returns the packet length
+  * @retval Handshake
+  */
+static USBH_SimRespTypeDef USBH_SimDev_HubIn(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                             uint8_t *pbuff, uint16_t *length)
+{
+  uint32_t idx;
+  uint8_t map = 0U;
+
+  if (ep_addr != USBH_SIM_HUB_STATUS_EP)
+  {
+    return USBH_SIM_NORESP;
+  }
+
+  for (idx = 0U; idx < USBH_SIM_HUB_PORTS; idx++)
+  {
+    if (pdev->port_change[idx] != 0U)
+    {
+      map |= (uint8_t)(2U << idx);
+    }
+  }
+
+  if (map == 0U)
+  {
+    return USBH_SIM_NAK;
+  }
+
+  pbuff[0] = map;
+  *length = 1U;
+  return USBH_SIM_ACK;
+}
+
+/**
+  * @brief  Hub class requests: hub descriptor, port status and the port
+  *         power, reset and change features. A port reset completes at once.
+  * @param  pdev: Device handle
+  * @param  wValue: Request value
+  * @param  wIndex: Request index, the port for a port request
+  * @retval USBH_SIM_STALL for an unsupported request
+  */
+static USBH_SimRespTypeDef USBH_SimDev_HubClass(USBH_SimDevTypeDef *pdev, uint16_t wValue,
+                                                uint16_t wIndex)
+{
+  uint8_t to_port = ((pdev->setup[0] & USB_REQ_RECIPIENT_MASK) == USB_REQ_RECIPIENT_OTHER) ? 1U : 0U;
+  uint32_t idx = (uint32_t)wIndex - 1U;
+
+  if ((to_port != 0U) && ((wIndex == 0U) || (wIndex > USBH_SIM_HUB_PORTS)))
+  {
+    return USBH_SIM_STALL;
+  }
+
+  switch (pdev->setup[1])
+  {
+    case USB_REQ_GET_DESCRIPTOR:
+      if ((to_port != 0U) || (HIBYTE(wValue) != USBH_SIM_HUB_DESC_TYPE))
+      {
+        return USBH_SIM_STALL;
+      }
+      pdev->ctrl_buff[0] = USBH_SIM_HUB_DESC_SIZE;
+      pdev->ctrl_buff[1] = USBH_SIM_HUB_DESC_TYPE;
+      pdev->ctrl_buff[2] = USBH_SIM_HUB_PORTS;
+      pdev->ctrl_buff[3] = 0x01U;           /* Individual port power switching */
+      pdev->ctrl_buff[4] = 0x00U;
+      pdev->ctrl_buff[5] = USBH_SIM_HUB_PWRON2PWRGOOD;
+      pdev->ctrl_buff[6] = 0U;
+      pdev->ctrl_buff[7] = 0U;              /* DeviceRemovable */
+      pdev->ctrl_buff[8] = 0xFFU;
+      pdev->ctrl_len = USBH_SIM_HUB_DESC_SIZE;
+      return USBH_SIM_ACK;
+
+    case USB_REQ_GET_STATUS:
+      (void)USBH_memset(pdev->ctrl_buff, 0, 4U);
+      if (to_port != 0U)
+      {
+        pdev->ctrl_buff[0] = LOBYTE(pdev->port_status[idx]);
+        pdev->ctrl_buff[1] = HIBYTE(pdev->port_status[idx]);
+        pdev->ctrl_buff[2] = LOBYTE(pdev->port_change[idx]);
+        pdev->ctrl_buff[3] = HIBYTE(pdev->port_change[idx]);
+      }
+      pdev->ctrl_len = 4U;
+      return USBH_SIM_ACK;
+
+    case USB_REQ_SET_FEATURE:
+      if (to_port == 0U)
+      {
+        return USBH_SIM_ACK;
+      }
+
+      if ((wValue == USBH_SIM_PORT_POWER) && ((pdev->port_status[idx] & USBH_SIM_PORT_STAT_POWER) == 0U))
+      {
+        pdev->port_status[idx] |= USBH_SIM_PORT_STAT_POWER;
+        if (pdev->port_dev[idx] != NULL)
+        {
+          pdev->port_status[idx] |= USBH_SIM_PORT_STAT_CONNECTION;
+          pdev->port_change[idx] |= USBH_SIM_PORT_CHANGE_CONNECTION;
+        }
+      }
+      else if ((wValue == USBH_SIM_PORT_RESET) &&
+               ((pdev->port_status[idx] & USBH_SIM_PORT_STAT_CONNECTION) != 0U))
+      {
+        USBH_SimDev_Reset(pdev->port_dev[idx]);
+        pdev->port_status[idx] |= (USBH_SIM_PORT_STAT_ENABLE | USBH_SIM_PORT_STAT_HIGH_SPEED);
+        pdev->port_change[idx] |= USBH_SIM_PORT_CHANGE_RESET;
+      }
+      else
+      {
+        /* .. */
+      }
+      return USBH_SIM_ACK;
+
+    case USB_REQ_CLEAR_FEATURE:
+      if (to_port == 0U)
+      {
+        return USBH_SIM_ACK;
+      }
+
+      if ((wValue >= USBH_SIM_C_PORT_CONNECTION) && (wValue <= USBH_SIM_C_PORT_RESET))
+      {
+        pdev->port_change[idx] &= (uint16_t)~(1U << (wValue - USBH_SIM_C_PORT_CONNECTION));
+      }
+      else if (wValue == USBH_SIM_PORT_ENABLE)
+      {
+        pdev->port_status[idx] &= (uint16_t)~USBH_SIM_PORT_STAT_ENABLE;
+      }
+      else if (wValue == USBH_SIM_PORT_POWER)
+      {
+        pdev->port_status[idx] = 0U;
+        pdev->port_change[idx] = 0U;
+      }
+      else
+      {
+        /* .. */
+      }
+      return USBH_SIM_ACK;
+
+    default:
+      return USBH_SIM_STALL;
+  }
+}
+
+/**
+  * @brief  Decide whether a data or status stage transaction of the control
+  *         endpoint is NAKed by injection. The NAK rate does not apply.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address, 0x00 or 0x80
+  * @retval 1 to NAK the transaction
+  */
+static uint8_t USBH_SimDev_ForceCtrlNak(USBH_SimDevTypeDef *pdev, uint8_t ep_addr)
+{
+  uint32_t *pcount = &pdev->NakCount[USBH_SIM_EP_DIR(ep_addr)][0];
+
+  if ((*pcount == 0U) || (pdev->ctrl_state == USBH_SIM_CTRL_IDLE))
+  {
+    return 0U;
+  }
+
+  (*pcount)--;
+  pdev->stats.naks++;
+
+  return 1U;
+}
+
+/**
+  * @brief  Decide whether a data transaction is NAKed by injection.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint address
+  * @retval 1 to NAK the transaction
+  */
+static uint8_t USBH_SimDev_ForceNak(USBH_SimDevTypeDef *pdev, uint8_t ep_addr)
+{
+  uint32_t *pcount = &pdev->NakCount[USBH_SIM_EP_DIR(ep_addr)][ep_addr & 0x0FU];
+
+  if (*pcount != 0U)
+  {
+    (*pcount)--;
+    pdev->stats.naks++;
+    return 1U;
+  }
+
+  if ((pdev->NakRate != 0U) && (ep_addr != USBH_SIM_NOTIF_EP))
+  {
+    /* xorshift32: the same seed replays the same NAK pattern */
+    pdev->rand ^= pdev->rand << 13;
+    pdev->rand ^= pdev->rand >> 17;
+    pdev->rand ^= pdev->rand << 5;
+
+    if ((pdev->rand & 0xFFFFU) < pdev->NakRate)
+    {
+      pdev->stats.naks++;
+      return 1U;
+    }
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Standard requests.
+  * @param  pdev: Device handle
+  * @param  wValue: Request value
+  * @param  wIndex: Request index
+  * @retval USBH_SIM_STALL for an unsupported request
+  */
+static USBH_SimRespTypeDef USBH_SimDev_Standard(USBH_SimDevTypeDef *pdev, uint16_t wValue,
+                                                uint16_t wIndex)
+{
+  switch (pdev->setup[1])
+  {
+    case USB_REQ_GET_DESCRIPTOR:
+      pdev->ctrl_len = USBH_SimDev_GetDescriptor(pdev, wValue);
+      return (pdev->ctrl_len != 0U) ? USBH_SIM_ACK : USBH_SIM_STALL;
+
+    case USB_REQ_GET_STATUS:
+      pdev->ctrl_buff[0] = 0U;
+      pdev->ctrl_buff[1] = 0U;
+      if ((pdev->setup[0] & USB_REQ_RECIPIENT_MASK) == USB_REQ_RECIPIENT_ENDPOINT)
+      {
+        pdev->ctrl_buff[0] = ((pdev->StallMap & USBH_SIM_EP_BIT(wIndex)) != 0U) ? 1U : 0U;
+      }
+      pdev->ctrl_len = 2U;
+      return USBH_SIM_ACK;
+
+    case USB_REQ_GET_CONFIGURATION:
+      pdev->ctrl_buff[0] = pdev->configuration;
+      pdev->ctrl_len = 1U;
+      return USBH_SIM_ACK;
+
+    case USB_REQ_SET_ADDRESS:
+      /* Takes effect after the status stage */
+      pdev->pending_address = (uint8_t)(wValue & 0x7FU);
+      return USBH_SIM_ACK;
+
+    case USB_REQ_SET_CONFIGURATION:
+      return (wValue <= 1U) ? USBH_SIM_ACK : USBH_SIM_STALL;
+
+    case USB_REQ_SET_INTERFACE:
+      if ((pdev->Function == USBH_SIM_FUNCTION_AUDIO) && (wIndex >= 1U) && (wIndex <= 2U) &&
+          (wValue <= 1U))
+      {
+        /* A new stream starts from an empty FIFO */
+        pdev->alt[wIndex] = (uint8_t)wValue;
+        if (wIndex == 1U)
+        {
+          pdev->fifo_head = 0U;
+          pdev->fifo_tail = 0U;
+          pdev->spk_running = 0U;
+          pdev->spk_started = 0U;
+        }
+        else
+        {
+          pdev->mic_pending = 0U;
+        }
+        return USBH_SIM_ACK;
+      }
+      return (wValue == 0U) ? USBH_SIM_ACK : USBH_SIM_STALL;
+
+    case USB_REQ_CLEAR_FEATURE:
+      if (((pdev->setup[0] & USB_REQ_RECIPIENT_MASK) == USB_REQ_RECIPIENT_ENDPOINT) &&
+          (wValue == FEATURE_SELECTOR_ENDPOINT))
+      {
+        pdev->StallMap &= ~USBH_SIM_EP_BIT(wIndex);
+      }
+      return USBH_SIM_ACK;
+
+    case USB_REQ_SET_FEATURE:
+      return USBH_SIM_ACK;
+
+    default:
+      return USBH_SIM_STALL;
+  }
+}
+
+/**
+  * @brief  Class requests without an OUT data stage.
+  * @param  pdev: Device handle
+  * @param  wValue: Request value
+  * @param  wIndex: Request index
+  * @retval USBH_SIM_STALL for an unsupported request
+  */
+static USBH_SimRespTypeDef USBH_SimDev_Class(USBH_SimDevTypeDef *pdev, uint16_t wValue,
+                                             uint16_t wIndex)
+{
+  if (pdev->Function == USBH_SIM_FUNCTION_AUDIO)
+  {
+    /* Audio GET requests are not modelled */
+    return USBH_SIM_STALL;
+  }
+
+  if (pdev->Function == USBH_SIM_FUNCTION_HUB)
+  {
+    return USBH_SimDev_HubClass(pdev, wValue, wIndex);
+  }
+
+  switch (pdev->setup[1])
+  {
+    case CDC_GET_LINE_CODING:
+      (void)USBH_memcpy(pdev->ctrl_buff, pdev->line_coding, sizeof(pdev->line_coding));
+      pdev->ctrl_len = sizeof(pdev->line_coding);
+      return USBH_SIM_ACK;
+
+    case CDC_SET_CONTROL_LINE_STATE:
+      /* DTR changes are reported back on the notification endpoint */
+      pdev->line_state = wValue;
+      pdev->serial_state &= (uint16_t)~(CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR);
+
+      if ((wValue & CDC_ACTIVATE_SIGNAL_DTR) != 0U)
+      {
+        pdev->serial_state |= (CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR);
+      }
+
+      pdev->notif_pending = 1U;
+      return USBH_SIM_ACK;
+
+    case CDC_SEND_BREAK:
+      return USBH_SIM_ACK;
+
+    default:
+      return USBH_SIM_STALL;
+  }
+}
+
+/**
+  * @brief  Handle a request once its OUT data stage is complete.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+static void USBH_SimDev_OutData(USBH_SimDevTypeDef *pdev)
+{
+  if ((pdev->Function == USBH_SIM_FUNCTION_AUDIO) &&
+      ((pdev->setup[0] & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_CLASS) &&
+      (pdev->setup[1] == USBH_SIM_AUDIO_CUR) && (LE16(&pdev->setup[2]) == USBH_SIM_AUDIO_FREQ_CONTROL) &&
+      (pdev->setup[5] == USBH_SIM_AUDIO_CLOCK_ID) && (pdev->ctrl_len >= 4U))
+  {
+    USBH_SimDev_SetRate(pdev, LE32(pdev->ctrl_buff));
+  }
+  else if ((pdev->Function == USBH_SIM_FUNCTION_CDC) &&
+           ((pdev->setup[0] & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_CLASS) &&
+           (pdev->setup[1] == CDC_SET_LINE_CODING) && (pdev->ctrl_len >= sizeof(pdev->line_coding)))
+  {
+    (void)USBH_memcpy(pdev->line_coding, pdev->ctrl_buff, sizeof(pdev->line_coding));
+  }
+  else
+  {
+    pdev->ctrl_stall = 1U;
+  }
+
+  pdev->ctrl_state = USBH_SIM_CTRL_STATUS_IN;
+}
+
+/**
+  * @brief  Status stage: commit the request.
+  * @param  pdev: Device handle
+  * @retval None
+  */
+static void USBH_SimDev_Status(USBH_SimDevTypeDef *pdev)
+{
+  if ((pdev->setup[0] & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_STANDARD)
+  {
+    if (pdev->setup[1] == USB_REQ_SET_ADDRESS)
+    {
+      pdev->address = pdev->pending_address;
+    }
+    else if (pdev->setup[1] == USB_REQ_SET_CONFIGURATION)
+    {
+      pdev->configuration = pdev->setup[2];
+      pdev->fifo_head = 0U;
+      pdev->fifo_tail = 0U;
+    }
+    else
+    {
+      /* .. */
+    }
+  }
+
+  pdev->ctrl_state = USBH_SIM_CTRL_IDLE;
+}
+
+/**
+  * @brief  Copy a descriptor into the control buffer.
+  * @param  pdev: Device handle
+  * @param  wValue: Descriptor type and index
+  * @retval Descriptor length, 0 if there is none
+  */
+static uint16_t USBH_SimDev_GetDescriptor(USBH_SimDevTypeDef *pdev, uint16_t wValue)
+{
+  uint8_t index = LOBYTE(wValue);
+  const char *pstr;
+  uint16_t len;
+
+  switch (HIBYTE(wValue))
+  {
+    case USB_DESC_TYPE_DEVICE:
+      (void)USBH_memcpy(pdev->ctrl_buff, pdev->DevDesc, USB_DEVICE_DESC_SIZE);
+      return USB_DEVICE_DESC_SIZE;
+
+    case USB_DESC_TYPE_CONFIGURATION:
+      (void)USBH_memcpy(pdev->ctrl_buff, pdev->CfgDesc, pdev->CfgDescSize);
+      return pdev->CfgDescSize;
+
+    case USB_DESC_TYPE_STRING:
+      if (index == 0U)
+      {
+        /* LANGID: English (United States) */
+        pdev->ctrl_buff[0] = 4U;
+        pdev->ctrl_buff[1] = USB_DESC_TYPE_STRING;
+        pdev->ctrl_buff[2] = 0x09U;
+        pdev->ctrl_buff[3] = 0x04U;
+        return 4U;
+      }
+
+      if (index > USBH_SIM_STR_SERIAL)
+      {
+        return 0U;
+      }
+
+      pstr = USBH_SimDev_Strings[index];
+      if ((index == USBH_SIM_STR_PRODUCT) && (pdev->Function == USBH_SIM_FUNCTION_AUDIO))
+      {
+        pstr = "Virtual Headset";
+      }
+      else if ((index == USBH_SIM_STR_PRODUCT) && (pdev->Function == USBH_SIM_FUNCTION_HUB))
+      {
+        pstr = "Virtual Hub";
+      }
+      else
+      {
+        /* .. */
+      }
+      len = 2U;
+      while ((*pstr != '\0') && (len < (USBH_SIM_CTRL_BUFF_SIZE - 1U)))
+      {
+        pdev->ctrl_buff[len] = (uint8_t)*pstr;
+        pdev->ctrl_buff[len + 1U] = 0U;
+        len += 2U;
+        pstr++;
+      }
+      pdev->ctrl_buff[0] = (uint8_t)len;
+      pdev->ctrl_buff[1] = USB_DESC_TYPE_STRING;
+      return len;
+
+    default:
+      return 0U;
+  }
+}
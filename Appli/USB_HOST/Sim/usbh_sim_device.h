@@ -0,0 +1,251 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_sim_device.h
+  * @brief          : Header for usbh_sim_device.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBH_SIM_DEVICE_H
+#define __USBH_SIM_DEVICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_def.h"
+
+/** @addtogroup USBH_SIM
+  * @{
+  */
+
+/** @defgroup USBH_SIM_DEVICE
+  * @brief Virtual CDC ACM, USB audio or hub device answering the virtual
+  *        host controller
+  * @{
+  */
+
+/* Endpoints of the virtual CDC ACM function */
+#define USBH_SIM_NOTIF_EP                 0x82U
+#define USBH_SIM_DATA_IN_EP               0x81U
+#define USBH_SIM_DATA_OUT_EP              0x01U
+
+/* Largest packet the device handles, high-speed bulk */
+#define USBH_SIM_MAX_PACKET               512U
+
+/* Loopback FIFO of the data interface */
+#ifndef USBH_SIM_FIFO_SIZE
+#define USBH_SIM_FIFO_SIZE                4096U
+#endif /* USBH_SIM_FIFO_SIZE */
+
+/* Endpoints of the virtual UAC2 headset */
+#define USBH_SIM_SPEAKER_EP               0x03U
+#define USBH_SIM_FEEDBACK_EP              0x83U
+#define USBH_SIM_MIC_EP                   0x84U
+
+/* Stereo 16-bit streams, one packet per millisecond with room for one
+   extra sample frame */
+#define USBH_SIM_AUDIO_CHANNELS           2U
+#define USBH_SIM_AUDIO_SUBFRAME           2U
+#define USBH_SIM_AUDIO_FRAME              (USBH_SIM_AUDIO_CHANNELS * USBH_SIM_AUDIO_SUBFRAME)
+#define USBH_SIM_AUDIO_EP_SIZE            (49U * USBH_SIM_AUDIO_FRAME)
+
+/* Virtual hub: downstream ports and status change endpoint */
+#define USBH_SIM_HUB_PORTS                4U
+#define USBH_SIM_HUB_STATUS_EP            0x81U
+
+/* CMUX modem: largest frame it takes, header and FCS included */
+#define USBH_SIM_CMUX_FRAME_MAX           512U
+
+#define USBH_SIM_CFG_DESC_SIZE            67U
+#define USBH_SIM_CFG_DESC_MAX             256U
+#define USBH_SIM_CTRL_BUFF_SIZE           256U
+
+/** @defgroup USBH_SIM_DEVICE_Exported_Types
+  * @{
+  */
+
+/* Handshake of a device transaction */
+typedef enum
+{
+  USBH_SIM_ACK = 0U,
+  USBH_SIM_NAK,
+  USBH_SIM_STALL,
+  USBH_SIM_NORESP,
+}
+USBH_SimRespTypeDef;
+
+/* Function of the device */
+typedef enum
+{
+  USBH_SIM_FUNCTION_CDC = 0U,
+  USBH_SIM_FUNCTION_AUDIO,
+  USBH_SIM_FUNCTION_HUB,
+}
+USBH_SimFunctionTypeDef;
+
+/* TS 27.010 framing of the CDC data, once the modem took AT+CMUX */
+typedef enum
+{
+  USBH_SIM_CMUX_OFF = 0U,
+  USBH_SIM_CMUX_BASIC,
+  USBH_SIM_CMUX_ADVANCED,
+}
+USBH_SimCmuxTypeDef;
+
+typedef enum
+{
+  USBH_SIM_CTRL_IDLE = 0U,
+  USBH_SIM_CTRL_DATA_IN,
+  USBH_SIM_CTRL_DATA_OUT,
+  USBH_SIM_CTRL_STATUS_IN,
+  USBH_SIM_CTRL_STATUS_OUT,
+}
+USBH_SimCtrlStateTypeDef;
+
+/* Device transaction counters */
+typedef struct
+{
+  uint32_t  setups;
+  uint32_t  naks;
+  uint32_t  stalls;
+  uint32_t  overruns;
+  uint64_t  looped;
+  uint32_t  audio_underruns;  /* Speaker FIFO ran dry */
+  uint32_t  audio_overruns;   /* Speaker samples dropped on a full FIFO */
+  uint32_t  audio_glitches;   /* Breaks in the ramp played by the speaker */
+  uint64_t  audio_played;     /* Sample frames played */
+  uint64_t  audio_recorded;   /* Sample frames sent by the microphone */
+  uint32_t  cmux_frames;      /* Frames taken by the CMUX modem */
+  uint32_t  cmux_errors;      /* Frames with a bad FCS or length */
+}
+USBH_SimDevStatsTypeDef;
+
+typedef struct _USBH_SimDevTypeDef
+{
+  /* Model parameters, set before USBH_SimDev_Init */
+  USBH_SimFunctionTypeDef   Function;
+  uint16_t                  VID;
+  uint16_t                  PID;
+  uint16_t                  InEpSize;
+  uint16_t                  OutEpSize;
+  uint16_t                  NotifEpSize;
+  uint32_t                  FifoSize;       /* Loopback depth, up to USBH_SIM_FIFO_SIZE */
+  uint32_t                  NakRate;        /* Data transactions NAKed, per 65536 */
+  uint32_t                  Seed;
+  uint32_t                  SampleRate;     /* Audio: rate set at reset */
+  int32_t                   ClockPpm;       /* Audio: device clock error */
+  USBH_SimCmuxTypeDef       Cmux;           /* CDC: frames answered instead of looped */
+
+  /* Fault injection */
+  uint32_t                  NakCount[2][16];  /* Forced NAKs, per direction and endpoint */
+  uint32_t                  StallMap;         /* Bit n: endpoint n halted, bit n + 16: IN n */
+
+  /* Device state */
+  uint8_t                   address;
+  uint8_t                   pending_address;
+  uint8_t                   configuration;
+  uint8_t                   ctrl_stall;
+  USBH_SimCtrlStateTypeDef  ctrl_state;
+  uint8_t                   setup[8];
+  uint8_t                   ctrl_buff[USBH_SIM_CTRL_BUFF_SIZE];
+  uint16_t                  ctrl_len;
+  uint16_t                  ctrl_pos;
+  uint8_t                   line_coding[7];
+  uint16_t                  line_state;
+  uint16_t                  serial_state;
+  uint8_t                   notif_pending;
+  uint32_t                  rand;
+
+  /* Audio state: the device clock advances on the SOFs */
+  uint8_t                   alt[3];
+  uint8_t                   spk_running;
+  uint8_t                   spk_started;
+  uint16_t                  spk_last;
+  uint32_t                  sample_rate;
+  uint32_t                  clock_q16;      /* Sample frames per microframe, Q16.16 */
+  uint32_t                  clock_acc;
+  uint32_t                  mic_pending;
+  uint16_t                  mic_value;
+
+  /* Hub ports: device plugged, wPortStatus and wPortChange */
+  struct _USBH_SimDevTypeDef *port_dev[USBH_SIM_HUB_PORTS];
+  uint16_t                  port_status[USBH_SIM_HUB_PORTS];
+  uint16_t                  port_change[USBH_SIM_HUB_PORTS];
+
+  /* CMUX modem receiver */
+  uint8_t                   cmux_frame[USBH_SIM_CMUX_FRAME_MAX];
+  uint16_t                  cmux_len;
+  uint8_t                   cmux_active;
+  uint8_t                   cmux_escape;
+
+  uint8_t                   DevDesc[USB_DEVICE_DESC_SIZE];
+  uint8_t                   CfgDesc[USBH_SIM_CFG_DESC_MAX];
+  uint16_t                  CfgDescSize;
+
+  uint8_t                   fifo[USBH_SIM_FIFO_SIZE];
+  uint32_t                  fifo_head;
+  uint32_t                  fifo_tail;
+
+  USBH_SimDevStatsTypeDef   stats;
+}
+USBH_SimDevTypeDef;
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_SIM_DEVICE_Exported_FunctionsPrototype
+  * @{
+  */
+
+void                USBH_SimDev_Defaults(USBH_SimDevTypeDef *pdev);
+void                USBH_SimDev_AudioDefaults(USBH_SimDevTypeDef *pdev);
+void                USBH_SimDev_HubDefaults(USBH_SimDevTypeDef *pdev);
+void                USBH_SimDev_Init(USBH_SimDevTypeDef *pdev);
+void                USBH_SimDev_Reset(USBH_SimDevTypeDef *pdev);
+void                USBH_SimDev_Sof(USBH_SimDevTypeDef *pdev);
+USBH_SimDevTypeDef *USBH_SimDev_Route(USBH_SimDevTypeDef *pdev, uint8_t address);
+void                USBH_SimDev_HubPlug(USBH_SimDevTypeDef *phub, uint8_t port, USBH_SimDevTypeDef *pdev);
+
+USBH_SimRespTypeDef USBH_SimDev_Setup(USBH_SimDevTypeDef *pdev, const uint8_t *setup);
+USBH_SimRespTypeDef USBH_SimDev_In(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                   uint8_t *pbuff, uint16_t mps, uint16_t *length);
+USBH_SimRespTypeDef USBH_SimDev_Out(USBH_SimDevTypeDef *pdev, uint8_t ep_addr,
+                                    const uint8_t *pbuff, uint16_t length);
+
+void                USBH_SimDev_InjectNak(USBH_SimDevTypeDef *pdev, uint8_t ep_addr, uint32_t count);
+void                USBH_SimDev_InjectStall(USBH_SimDevTypeDef *pdev, uint8_t ep_addr);
+void                USBH_SimDev_SetNakRate(USBH_SimDevTypeDef *pdev, uint32_t rate, uint32_t seed);
+void                USBH_SimDev_SetSerialState(USBH_SimDevTypeDef *pdev, uint16_t state);
+uint8_t             USBH_SimDev_CmuxSend(USBH_SimDevTypeDef *pdev, uint8_t dlci, uint8_t control,
+                                         const uint8_t *pinfo, uint16_t length);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBH_SIM_DEVICE_H */
@@ -0,0 +1,1363 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_sim_main.c
+  * @brief          : Host build of the USB host stack: enumerates the virtual
+  *                   CDC ACM device twice, with a cold then a warm enumeration
+  *                   cache, counting the wakeups of an event driven main loop
+  *                   and the worst time spent in one call of the host
+  *                   process, times a modem line change through the
+  *                   notification endpoint, times a line coding change,
+  *                   holds a transmission under
+  *                   device flow control and loops a buffer through it.
+  *                   Bridges a local PCM port with a mu-law voice channel
+  *                   carried by the loopback, then swaps in a UAC2 headset with a drifting clock and
+  *                   streams a ramp both ways through the jitter buffers.
+  *                   Ends behind a hub: enumerates a CDC device on each port
+  *                   served, loops data through both, unplugs and replugs
+  *                   one, then unplugs the hub and checks the pools empty.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+#include "usbh_cdc.h"
+#include "usbh_audio.h"
+#include "usbh_hub.h"
+#include "usbh_sim_device.h"
+#include "usb_voice.h"
+#include "usb_cmux.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SIM_CYCLE_UNIT            "tsc"
+#else
+#include <time.h>
+#define SIM_CYCLE_UNIT            "ns"
+#endif
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_TIMEOUT_US            5000000U
+#define SIM_LOOPBACK_SIZE         65536U
+#define SIM_SETTLE_US             20000U
+#define SIM_FLOW_SIZE             8192U
+#define SIM_FLOW_HOLD_US          50000U
+
+/* NAKs on a control stage, four times what the interrupt resends */
+#define SIM_CTL_NAKS              (4U * USBH_CTL_CHAIN_MAX_NAKS)
+
+/* Main loop wakeups allowed for an enumeration: the waits of the host
+   process are deadlines, not events posted on every pass */
+#define SIM_ENUM_MAX_WAKEUPS      200U
+
+/* Tolerance on the waits of two enumerations: one USBH_GetTick period */
+#define SIM_ENUM_WAIT_SLACK_US    1000U
+
+/* Voice call: 10 ms blocks of 8 kHz samples, a 400 Hz triangle */
+#define SIM_VOICE_BLOCKS          100U
+#define SIM_VOICE_BLOCK_US        10000U
+#define SIM_VOICE_SAMPLES         (SIM_VOICE_BLOCKS * VOICE_BLOCK_SAMPLES)
+#define SIM_VOICE_PERIOD          20U
+#define SIM_VOICE_PEAK            12000
+
+/* CMUX run: patterned data echoed on two channels at once */
+#define SIM_CMUX_SIZE             16384U
+#define SIM_CMUX_CHUNK            300U
+#define SIM_CMUX_FC_DLCI          2U
+
+/* Headset run: 48 kHz stereo 16-bit, the application moving 10 ms blocks */
+#define SIM_AUDIO_RATE            48000U
+#define SIM_AUDIO_PPM             250
+#define SIM_AUDIO_FRAME           4U
+#define SIM_AUDIO_BLOCK           480U
+#define SIM_AUDIO_BLOCK_US        10000U
+#define SIM_AUDIO_BLOCKS          200U
+#define SIM_AUDIO_RING_SIZE       8192U
+#define SIM_AUDIO_MS_BYTES        ((SIM_AUDIO_RATE / 1000U) * SIM_AUDIO_FRAME)
+
+/* Bounds of the run: the lowest level of each jitter buffer, just before a
+   write or just after a read, stays within the trim margin of 1 ms and one
+   packet over the target; slips only make up for the clock drift */
+#define SIM_AUDIO_LEVEL_SLACK     (2U * SIM_AUDIO_MS_BYTES)
+#define SIM_AUDIO_MAX_SLIPS       ((((SIM_AUDIO_BLOCKS * SIM_AUDIO_BLOCK) / 1000U) * SIM_AUDIO_PPM) / 1000U + 1U)
+
+/* Hub run: a CDC device on each hub port, the host serving the first
+   USBH_HUB_MAX_PORTS of them */
+#define SIM_HUB_DEVICES           USBH_SIM_HUB_PORTS
+#define SIM_HUB_LOOPBACK_SIZE     8192U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t wakeups;       /* Calls of USBH_ProcessEvents, one per main loop wakeup */
+  uint32_t worst_passes;  /* Host process passes of the slowest call */
+  uint64_t worst_cycles;  /* Slowest call */
+  uint64_t blocked_us;    /* Virtual time spent inside the calls */
+} Sim_ProcessStatsTypeDef;
+
+typedef struct
+{
+  uint64_t total_us;      /* Attach to class active */
+  uint64_t reset_us;      /* Attach debounce and bus reset, to the port enabled */
+  uint64_t recovery_us;   /* Reset recovery, to the first control transfer */
+  uint64_t control_us;    /* Control transfers and class start */
+  uint32_t setups;
+} Sim_EnumTimesTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static USBH_HandleTypeDef hUsbHostSim;
+static Sim_ProcessStatsTypeDef SimProcess;
+static USBH_SimDevTypeDef SimDevice;
+static USBH_SimDevTypeDef SimAudioDevice;
+static USBH_SimDevTypeDef SimHub;
+static USBH_SimDevTypeDef SimHubDevice[SIM_HUB_DEVICES];
+
+static volatile uint8_t SimClassActive;
+static uint64_t SimConnectedUs;
+static uint64_t SimEnumStartUs;
+static volatile uint8_t SimTxDone;
+static volatile uint8_t SimSerialStateSeen;
+static volatile uint8_t SimLineCodingDone;
+static uint16_t SimSerialState;
+static CDC_LineCodingTypeDef SimLineCoding;
+
+static uint8_t SimTxBuff[SIM_LOOPBACK_SIZE];
+static uint8_t SimRxBuff[SIM_LOOPBACK_SIZE];
+static uint32_t SimRxCount;
+
+static VOICE_BridgeTypeDef SimBridge;
+static uint8_t SimVoiceActive;
+static int16_t SimVoiceIn[SIM_VOICE_SAMPLES];
+static int16_t SimVoiceOut[SIM_VOICE_SAMPLES];
+
+static CMUX_HandleTypeDef SimCmux;
+static uint8_t SimCmuxActive;
+static volatile uint8_t SimCmuxTxReady;
+static uint32_t SimCmuxRxCount[CMUX_NUM_CHANNELS];
+static uint32_t SimCmuxBad[CMUX_NUM_CHANNELS];
+
+static volatile uint8_t SimAudioStarted;
+static volatile uint8_t SimAudioStopped;
+static uint8_t SimPlayRing[SIM_AUDIO_RING_SIZE];
+static uint8_t SimCaptureRing[SIM_AUDIO_RING_SIZE];
+static uint8_t SimAudioBlock[SIM_AUDIO_BLOCK * SIM_AUDIO_FRAME];
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id);
+static uint64_t Sim_GetCycles(void);
+static void Sim_Process(void);
+static uint8_t Sim_RunUntil(volatile uint8_t *flag, uint32_t *rx_count, uint32_t rx_target);
+static void Sim_Run(uint32_t us);
+static void Sim_PrintPipeStats(void);
+#if (USBH_USE_URB_TRACE == 1U)
+static void Sim_PrintUrbTrace(void);
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+static int Sim_Enumerate(const char *name, USBH_SimDevTypeDef *pdev, Sim_EnumTimesTypeDef *ptimes);
+static int Sim_Detach(void);
+static int Sim_Voice(void);
+static void Sim_CmuxRun(uint32_t us);
+static uint8_t Sim_CmuxAll(CMUX_ChannelStateTypeDef state);
+static int Sim_Cmux(CMUX_ModeTypeDef mode);
+static int Sim_Audio(void);
+static uint8_t Sim_WaitHubPorts(uint8_t ready_map);
+static int Sim_Hub(void);
+
+/**
+  * @brief  User callback of the host library.
+  * @param  phost: Host handle
+  * @param  id: Event
+  * @retval None
+  */
+static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id)
+{
+  UNUSED(phost);
+
+  switch (id)
+  {
+    case HOST_USER_CONNECTION:
+      SimConnectedUs = USBH_Sim_GetTimeUs();
+      break;
+
+    case HOST_USER_CLASS_ACTIVE:
+      SimClassActive = 1U;
+      break;
+
+    case HOST_USER_DISCONNECTION:
+      SimClassActive = 0U;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  CDC transmit complete.
+  * @param  phost: Host handle
+  * @retval None
+  */
+void USBH_CDC_TransmitCallback(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  SimTxDone = 1U;
+}
+
+/**
+  * @brief  CDC modem line change.
+  * @param  phost: Host handle
+  * @param  state: SERIAL_STATE bitmap
+  * @retval None
+  */
+void USBH_CDC_SerialStateCallback(USBH_HandleTypeDef *phost, uint16_t state)
+{
+  UNUSED(phost);
+
+  SimSerialState = state;
+  SimSerialStateSeen = 1U;
+}
+
+/**
+  * @brief  CDC line coding applied and read back.
+  * @param  phost: Host handle
+  * @retval None
+  */
+void USBH_CDC_LineCodingChanged(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  SimLineCodingDone = 1U;
+}
+
+/**
+  * @brief  CDC reception stream data.
+  * @param  phost: Host handle
+  * @param  pbuff: Received data
+  * @param  length: Received length
+  * @retval None
+  */
+void USBH_CDC_ReceiveStreamCallback(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length)
+{
+  if (SimVoiceActive != 0U)
+  {
+    (void)VOICE_Bridge_Put(&SimBridge, VOICE_Bridge_FindPort(&SimBridge, phost), pbuff, length);
+    (void)USBH_CDC_ReleaseStreamBuffer(phost);
+    return;
+  }
+
+  if (SimCmuxActive != 0U)
+  {
+    CMUX_Input(&SimCmux, pbuff, length);
+    (void)USBH_CDC_ReleaseStreamBuffer(phost);
+    return;
+  }
+
+  if ((SimRxCount + length) <= SIM_LOOPBACK_SIZE)
+  {
+    (void)USBH_memcpy(&SimRxBuff[SimRxCount], pbuff, length);
+  }
+
+  SimRxCount += length;
+  (void)USBH_CDC_ReleaseStreamBuffer(phost);
+}
+
+/**
+  * @brief  CMUX channel data: checked against the pattern sent on it.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @param  pbuff: Information field
+  * @param  length: Information length
+  * @retval None
+  */
+void CMUX_DataCallback(CMUX_HandleTypeDef *pmux, uint8_t dlci, const uint8_t *pbuff, uint32_t length)
+{
+  uint32_t idx;
+  uint32_t pos;
+
+  UNUSED(pmux);
+
+  for (idx = 0U; idx < length; idx++)
+  {
+    pos = SimCmuxRxCount[dlci] + idx;
+    SimCmuxBad[dlci] += (pbuff[idx] != SimTxBuff[(pos + (dlci * 4096U)) % SIM_LOOPBACK_SIZE]) ? 1U : 0U;
+  }
+
+  SimCmuxRxCount[dlci] += length;
+}
+
+/**
+  * @brief  CMUX channel released by the peer flow control.
+  * @param  pmux: Multiplexer
+  * @param  dlci: Channel
+  * @retval None
+  */
+void CMUX_TxReadyCallback(CMUX_HandleTypeDef *pmux, uint8_t dlci)
+{
+  UNUSED(pmux);
+
+  SimCmuxTxReady |= (uint8_t)(1U << dlci);
+}
+
+/**
+  * @brief  Audio stream running.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @retval None
+  */
+void USBH_AUDIO_StreamStarted(USBH_HandleTypeDef *phost, uint8_t dir)
+{
+  UNUSED(phost);
+
+  SimAudioStarted |= (uint8_t)(1U << dir);
+}
+
+/**
+  * @brief  Audio stream stopped.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @retval None
+  */
+void USBH_AUDIO_StreamStopped(USBH_HandleTypeDef *phost, uint8_t dir)
+{
+  UNUSED(phost);
+
+  SimAudioStopped |= (uint8_t)(1U << dir);
+}
+
+/**
+  * @brief  Read the CPU cycle counter.
+  * @retval Cycles, or ns without a cycle counter
+  */
+static uint64_t Sim_GetCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000U) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+  * @brief  One pass of the main loop of usb_host.c/main.c: the host process
+  *         runs only when USBH_EventPending says so, the core sleeps
+  *         otherwise. The call is timed.
+  * @retval None
+  */
+static void Sim_Process(void)
+{
+  uint64_t start_us;
+  uint64_t start;
+  uint64_t cycles;
+  uint32_t passes;
+
+  if (USBH_EventPending(&hUsbHostSim) == 0U)
+  {
+    return;
+  }
+
+  passes = hUsbHostSim.events.tail;
+  start_us = USBH_Sim_GetTimeUs();
+  start = Sim_GetCycles();
+  (void)USBH_ProcessEvents(&hUsbHostSim);
+  cycles = Sim_GetCycles() - start;
+
+  SimProcess.wakeups++;
+  SimProcess.blocked_us += USBH_Sim_GetTimeUs() - start_us;
+
+  if ((SimEnumStartUs == 0U) && (hUsbHostSim.gState == HOST_ENUMERATION))
+  {
+    SimEnumStartUs = USBH_Sim_GetTimeUs();
+  }
+
+  if (cycles > SimProcess.worst_cycles)
+  {
+    SimProcess.worst_cycles = cycles;
+    SimProcess.worst_passes = hUsbHostSim.events.tail - passes;
+  }
+}
+
+/**
+  * @brief  Run the host process and the virtual bus until a flag is set, or
+  *         a reception count is reached when rx_count is not NULL.
+  * @param  flag: Completion flag
+  * @param  rx_count: Reception counter, or NULL
+  * @param  rx_target: Reception count to reach
+  * @retval 1 on completion, 0 on timeout
+  */
+static uint8_t Sim_RunUntil(volatile uint8_t *flag, uint32_t *rx_count, uint32_t rx_target)
+{
+  uint64_t deadline = USBH_Sim_GetTimeUs() + SIM_TIMEOUT_US;
+
+  while (USBH_Sim_GetTimeUs() < deadline)
+  {
+    Sim_Process();
+
+    if ((*flag != 0U) && ((rx_count == NULL) || (*rx_count >= rx_target)))
+    {
+      return 1U;
+    }
+
+    USBH_Sim_Step();
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Run the host process and the virtual bus for a while.
+  * @param  us: Virtual time to run, in microseconds
+  * @retval None
+  */
+static void Sim_Run(uint32_t us)
+{
+  uint64_t start = USBH_Sim_GetTimeUs();
+
+  while ((USBH_Sim_GetTimeUs() - start) < us)
+  {
+    Sim_Process();
+    USBH_Sim_Step();
+  }
+}
+
+/**
+  * @brief  Print the traffic of the allocated pipes.
+  * @retval None
+  */
+static void Sim_PrintPipeStats(void)
+{
+  const USBH_PipeStatsTypeDef *pstats;
+  uint32_t map = USBH_GetPipeMap(&hUsbHostSim);
+  uint8_t pipe;
+
+  printf("pipe  ep    urbs     bytes  naks  nyets  stalls  errors  last\n");
+
+  for (pipe = 0U; pipe < USBH_MAX_PIPES_NBR; pipe++)
+  {
+    if ((map & (1U << pipe)) != 0U)
+    {
+      pstats = USBH_GetPipeStats(&hUsbHostSim, pipe);
+      printf("%4u  0x%02x %5u %9u %5u %6u %7u %7u  %u\n", (unsigned int)pipe,
+             (unsigned int)hUsbHostSim.Pipes[pipe], (unsigned int)pstats->Urbs,
+             (unsigned int)pstats->Bytes, (unsigned int)pstats->Naks, (unsigned int)pstats->Nyets,
+             (unsigned int)pstats->Stalls, (unsigned int)pstats->Errors, (unsigned int)pstats->LastDone);
+    }
+  }
+}
+
+#if (USBH_USE_URB_TRACE == 1U)
+/**
+  * @brief  Print the submission to completion latency histograms, one
+  *         "cycles:count" pair per bin in use, bins named by their lower bound.
+  * @retval None
+  */
+static void Sim_PrintUrbTrace(void)
+{
+  const USBH_UrbTraceTypeDef *ptrace = USBH_GetUrbTrace(&hUsbHostSim);
+  const USBH_UrbTracePipeTypeDef *ppipe;
+  uint32_t pipe;
+  uint32_t bin;
+
+  printf("urb latency at %u MHz, submit to IRQ\n", (unsigned int)USBH_SIM_CPU_MHZ);
+
+  for (pipe = 0U; pipe < ptrace->Pipes; pipe++)
+  {
+    ppipe = &ptrace->Pipe[pipe];
+
+    if (ppipe->Samples == 0U)
+    {
+      continue;
+    }
+
+    printf("%4u  0x%02x %5u max %7u:", (unsigned int)pipe, (unsigned int)ppipe->EpAddr,
+           (unsigned int)ppipe->Samples, (unsigned int)ppipe->BusMax);
+
+    for (bin = 0U; bin < ptrace->Bins; bin++)
+    {
+      if (ppipe->BusHist[bin] != 0U)
+      {
+        printf(" %u:%u", (bin == 0U) ? 0U : (1U << (bin + ptrace->Shift - 1U)),
+               (unsigned int)ppipe->BusHist[bin]);
+      }
+    }
+    printf("\n");
+  }
+}
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+/**
+  * @brief  Plug a device and time its enumeration, phase by phase.
+  * @param  name: Run name
+  * @param  pdev: Device model
+  * @param  ptimes: Phase durations, or NULL
+  * @retval 0 on success
+  */
+static int Sim_Enumerate(const char *name, USBH_SimDevTypeDef *pdev, Sim_EnumTimesTypeDef *ptimes)
+{
+  Sim_EnumTimesTypeDef times;
+  uint64_t start;
+  uint32_t wakeups;
+
+  USBH_Sim_ClearStats();
+  start = USBH_Sim_GetTimeUs();
+  wakeups = SimProcess.wakeups;
+  SimClassActive = 0U;
+  SimConnectedUs = 0U;
+  SimEnumStartUs = 0U;
+  USBH_Sim_Attach(pdev);
+
+  if (Sim_RunUntil(&SimClassActive, NULL, 0U) == 0U)
+  {
+    printf("%s enumeration: timeout in state %d\n", name, (int)hUsbHostSim.gState);
+    return 1;
+  }
+
+  wakeups = SimProcess.wakeups - wakeups;
+  times.total_us = USBH_Sim_GetTimeUs() - start;
+  times.reset_us = SimConnectedUs - start;
+  times.recovery_us = SimEnumStartUs - SimConnectedUs;
+  times.control_us = USBH_Sim_GetTimeUs() - SimEnumStartUs;
+  times.setups = pdev->stats.setups;
+
+  printf("%s enumeration: %llu us (debounce and reset %llu, reset recovery %llu, control %llu), "
+         "%u setups, %u URBs, %u wakeups\n", name,
+         (unsigned long long)times.total_us, (unsigned long long)times.reset_us,
+         (unsigned long long)times.recovery_us, (unsigned long long)times.control_us,
+         (unsigned int)times.setups, (unsigned int)USBH_Sim_GetStats()->urbs, (unsigned int)wakeups);
+
+  if (ptimes != NULL)
+  {
+    *ptimes = times;
+  }
+
+  if (wakeups > SIM_ENUM_MAX_WAKEUPS)
+  {
+    printf("%s enumeration: the host process polls its deadlines\n", name);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Unplug the device and wait for the host to go idle.
+  * @retval 0 on success
+  */
+static int Sim_Detach(void)
+{
+  uint64_t start;
+
+  USBH_Sim_Attach(NULL);
+  start = USBH_Sim_GetTimeUs();
+  while ((hUsbHostSim.gState != HOST_IDLE) && ((USBH_Sim_GetTimeUs() - start) < SIM_TIMEOUT_US))
+  {
+    Sim_Process();
+    USBH_Sim_Step();
+  }
+
+  return (hUsbHostSim.gState == HOST_IDLE) ? 0 : 1;
+}
+
+/**
+  * @brief  Conference a local PCM port with a mu-law voice channel over the
+  *         CDC loopback: the local port hears its own voice back through the
+  *         modem, delayed by the bridge prefill and coded twice.
+  * @retval 0 on success
+  */
+static int Sim_Voice(void)
+{
+  uint8_t expect[2U * VOICE_BLOCK_SAMPLES];
+  int16_t decoded[VOICE_BLOCK_SAMPLES];
+  uint8_t modem;
+  uint8_t local;
+  uint32_t mismatches;
+  uint32_t delay;
+  uint32_t count = 0U;
+  uint32_t blk;
+  uint32_t idx;
+
+  for (idx = 0U; idx < SIM_VOICE_SAMPLES; idx++)
+  {
+    uint32_t phase = idx % SIM_VOICE_PERIOD;
+    int32_t ramp = (int32_t)((phase < (SIM_VOICE_PERIOD / 2U)) ? phase : (SIM_VOICE_PERIOD - phase));
+
+    SimVoiceIn[idx] = (int16_t)(((ramp * 4 * SIM_VOICE_PEAK) / (int32_t)SIM_VOICE_PERIOD) - SIM_VOICE_PEAK);
+  }
+
+  VOICE_Bridge_Init(&SimBridge);
+  modem = VOICE_Bridge_Open(&SimBridge, &hUsbHostSim, VOICE_LAW_ULAW, VOICE_GAIN_UNITY);
+  local = VOICE_Bridge_Open(&SimBridge, NULL, VOICE_LAW_PCM16, VOICE_GAIN_UNITY);
+  SimVoiceActive = 1U;
+
+  if (USBH_CDC_StartReceiveStream(&hUsbHostSim) != USBH_OK)
+  {
+    printf("voice: stream start failed\n");
+    return 1;
+  }
+
+  for (blk = 0U; blk < SIM_VOICE_BLOCKS; blk++)
+  {
+    (void)VOICE_Bridge_Put(&SimBridge, local, (const uint8_t *)&SimVoiceIn[blk * VOICE_BLOCK_SAMPLES],
+                           2U * VOICE_BLOCK_SAMPLES);
+    VOICE_Bridge_Process(&SimBridge);
+    Sim_Run(SIM_VOICE_BLOCK_US);
+    count += VOICE_Bridge_Get(&SimBridge, local, (uint8_t *)&SimVoiceOut[count / 2U],
+                              sizeof(SimVoiceOut) - count);
+  }
+
+  SimVoiceActive = 0U;
+
+  /* The echo is the input after a mu-law round trip, whole blocks late */
+  for (delay = 0U; delay < (count / 2U); delay += VOICE_BLOCK_SAMPLES)
+  {
+    if (SimVoiceOut[delay] != 0)
+    {
+      break;
+    }
+  }
+
+  mismatches = 0U;
+  for (idx = 0U; (delay + idx + VOICE_BLOCK_SAMPLES) <= (count / 2U); idx += VOICE_BLOCK_SAMPLES)
+  {
+    VOICE_PcmToUlaw(expect, &SimVoiceIn[idx], VOICE_BLOCK_SAMPLES);
+    VOICE_UlawToPcm(decoded, expect, VOICE_BLOCK_SAMPLES);
+    mismatches += (USBH_memcmp(decoded, &SimVoiceOut[delay + idx], sizeof(decoded)) != 0) ? 1U : 0U;
+  }
+
+  printf("voice: %u blocks bridged, echo after %u ms, %u blocks differ, %u/%u underruns, %u/%u overruns\n",
+         (unsigned int)SimBridge.Blocks, (unsigned int)(delay / 8U), (unsigned int)mismatches,
+         (unsigned int)SimBridge.Port[local].Underruns, (unsigned int)SimBridge.Port[modem].Underruns,
+         (unsigned int)SimBridge.Port[local].Overruns, (unsigned int)SimBridge.Port[modem].Overruns);
+
+  return ((mismatches == 0U) && (delay < (count / 2U))) ? 0 : 1;
+}
+
+/**
+  * @brief  Run the host process, the multiplexer timers and the virtual bus
+  *         for a while.
+  * @param  us: Virtual time to run, in microseconds
+  * @retval None
+  */
+static void Sim_CmuxRun(uint32_t us)
+{
+  uint64_t start = USBH_Sim_GetTimeUs();
+
+  while ((USBH_Sim_GetTimeUs() - start) < us)
+  {
+    Sim_Process();
+    CMUX_Process(&SimCmux);
+    USBH_Sim_Step();
+  }
+}
+
+/**
+  * @brief  Check the state of every CMUX channel.
+  * @param  state: Expected state
+  * @retval 1 when all the channels are in that state
+  */
+static uint8_t Sim_CmuxAll(CMUX_ChannelStateTypeDef state)
+{
+  uint8_t dlci;
+
+  for (dlci = 0U; dlci < CMUX_NUM_CHANNELS; dlci++)
+  {
+    if (CMUX_GetState(&SimCmux, dlci) != state)
+    {
+      return 0U;
+    }
+  }
+
+  return 1U;
+}
+
+/**
+  * @brief  Switch the modem to CMUX, open every channel, echo patterned data
+  *         on DLCI 1 and 2 at once, stop DLCI 2 from the modem side while
+  *         DLCI 1 keeps going, then close down with CLD.
+  * @param  mode: Basic or advanced framing
+  * @retval 0 on success
+  */
+static int Sim_Cmux(CMUX_ModeTypeDef mode)
+{
+  static const uint8_t msc_off[4] = { CMUX_MSG_MSC | CMUX_MSG_CR | CMUX_MSG_EA, (2U << 1) | CMUX_MSG_EA,
+                                      (SIM_CMUX_FC_DLCI << 2) | CMUX_ADDR_CR | CMUX_ADDR_EA,
+                                      CMUX_MSG_EA | CMUX_V24_FC | CMUX_V24_RTC | CMUX_V24_RTR | CMUX_V24_DV };
+  static const uint8_t msc_on[4] = { CMUX_MSG_MSC | CMUX_MSG_CR | CMUX_MSG_EA, (2U << 1) | CMUX_MSG_EA,
+                                     (SIM_CMUX_FC_DLCI << 2) | CMUX_ADDR_CR | CMUX_ADDR_EA,
+                                     CMUX_MSG_EA | CMUX_V24_RTC | CMUX_V24_RTR | CMUX_V24_DV };
+  const char *name = (mode == CMUX_MODE_BASIC) ? "basic" : "advanced";
+  uint64_t deadline;
+  uint64_t start;
+  uint64_t open_us;
+  uint32_t sent[CMUX_NUM_CHANNELS] = { 0U };
+  uint32_t held;
+  uint32_t frames = 0U;
+  uint8_t dlci;
+
+  /* Drain the plain stream, then AT+CMUX took effect on the modem */
+  Sim_Run(SIM_SETTLE_US);
+  SimDevice.Cmux = (mode == CMUX_MODE_BASIC) ? USBH_SIM_CMUX_BASIC : USBH_SIM_CMUX_ADVANCED;
+  SimDevice.stats.cmux_frames = 0U;
+  SimDevice.stats.cmux_errors = 0U;
+  (void)USBH_memset(SimCmuxRxCount, 0, sizeof(SimCmuxRxCount));
+  (void)USBH_memset(SimCmuxBad, 0, sizeof(SimCmuxBad));
+  SimCmuxActive = 1U;
+
+  start = USBH_Sim_GetTimeUs();
+  deadline = start + SIM_TIMEOUT_US;
+
+  if ((USBH_CDC_StartReceiveStream(&hUsbHostSim) != USBH_OK) ||
+      (CMUX_Start(&SimCmux, &hUsbHostSim, mode) != USBH_OK))
+  {
+    printf("cmux %s: start failed\n", name);
+    return 1;
+  }
+
+  while ((Sim_CmuxAll(CMUX_CHANNEL_OPEN) == 0U) && (USBH_Sim_GetTimeUs() < deadline))
+  {
+    Sim_CmuxRun(125U);
+  }
+
+  open_us = USBH_Sim_GetTimeUs() - start;
+
+  if (Sim_CmuxAll(CMUX_CHANNEL_OPEN) == 0U)
+  {
+    printf("cmux %s: channels not opened\n", name);
+    return 1;
+  }
+
+  /* Two channels interleaved, the modem stopping DLCI 2 halfway */
+  start = USBH_Sim_GetTimeUs();
+  held = 0U;
+  SimCmuxTxReady = 0U;
+
+  while (((SimCmuxRxCount[1] < SIM_CMUX_SIZE) || (SimCmuxRxCount[2] < SIM_CMUX_SIZE)) &&
+         (USBH_Sim_GetTimeUs() < deadline))
+  {
+    for (dlci = 1U; dlci <= 2U; dlci++)
+    {
+      if (sent[dlci] < SIM_CMUX_SIZE)
+      {
+        sent[dlci] += CMUX_Write(&SimCmux, dlci, &SimTxBuff[sent[dlci] + (dlci * 4096U)],
+                                 MIN(SIM_CMUX_CHUNK, SIM_CMUX_SIZE - sent[dlci]));
+      }
+    }
+
+    if ((held == 0U) && (sent[SIM_CMUX_FC_DLCI] >= (SIM_CMUX_SIZE / 2U)) &&
+        (USBH_SimDev_CmuxSend(&SimDevice, 0U, CMUX_CTRL_UIH, msc_off, sizeof(msc_off)) != 0U))
+    {
+      held = sent[SIM_CMUX_FC_DLCI];
+      Sim_CmuxRun(SIM_FLOW_HOLD_US);
+
+      /* Stopped: nothing more goes on DLCI 2, DLCI 1 goes on */
+      if ((CMUX_Write(&SimCmux, SIM_CMUX_FC_DLCI, SimTxBuff, 1U) != 0U) || (sent[1] >= SIM_CMUX_SIZE) ||
+          (CMUX_Write(&SimCmux, 1U, &SimTxBuff[sent[1] + 4096U], 1U) != 1U))
+      {
+        printf("cmux %s: flow control not applied per channel\n", name);
+        return 1;
+      }
+
+      sent[1]++;
+
+      if ((USBH_SimDev_CmuxSend(&SimDevice, 0U, CMUX_CTRL_UIH, msc_on, sizeof(msc_on)) == 0U) ||
+          (Sim_CmuxRun(SIM_SETTLE_US), ((SimCmuxTxReady & (1U << SIM_CMUX_FC_DLCI)) == 0U)))
+      {
+        printf("cmux %s: channel not released\n", name);
+        return 1;
+      }
+    }
+
+    Sim_CmuxRun(125U);
+  }
+
+  for (dlci = 1U; dlci <= 2U; dlci++)
+  {
+    frames += SimCmux.Channel[dlci].RxFrames;
+
+    if ((SimCmuxRxCount[dlci] != SIM_CMUX_SIZE) || (SimCmuxBad[dlci] != 0U))
+    {
+      printf("cmux %s: DLCI %u: %u bytes back, %u differ\n", name, (unsigned int)dlci,
+             (unsigned int)SimCmuxRxCount[dlci], (unsigned int)SimCmuxBad[dlci]);
+      return 1;
+    }
+  }
+
+  /* Our side stopping the modem on DLCI 1: MSC answered by the modem */
+  if ((CMUX_SetFlow(&SimCmux, 1U, 0U) != USBH_OK) ||
+      (Sim_CmuxRun(SIM_SETTLE_US), (SimCmux.Channel[1].MscPending != 0U)) ||
+      (CMUX_SetFlow(&SimCmux, 1U, 1U) != USBH_OK))
+  {
+    printf("cmux %s: MSC not answered\n", name);
+    return 1;
+  }
+
+  printf("cmux %s: %u channels open in %llu us, 2x%u bytes echoed in %llu us, DLCI %u held at %u, "
+         "%u frames, %u assembled across buffers, %u FCS errors\n",
+         name, (unsigned int)CMUX_NUM_CHANNELS, (unsigned long long)open_us, (unsigned int)SIM_CMUX_SIZE,
+         (unsigned long long)(USBH_Sim_GetTimeUs() - start), (unsigned int)SIM_CMUX_FC_DLCI,
+         (unsigned int)held, (unsigned int)frames, (unsigned int)SimCmux.Copies,
+         (unsigned int)(SimCmux.FcsErrors + SimDevice.stats.cmux_errors));
+
+  /* CLD: every channel closed on the modem response */
+  if ((CMUX_Stop(&SimCmux) != USBH_OK) || (Sim_CmuxRun(SIM_SETTLE_US), (Sim_CmuxAll(CMUX_CHANNEL_CLOSED) == 0U)))
+  {
+    printf("cmux %s: not closed down\n", name);
+    return 1;
+  }
+
+  Sim_Run(SIM_SETTLE_US);
+  SimCmuxActive = 0U;
+  SimDevice.Cmux = USBH_SIM_CMUX_OFF;
+
+  return ((SimCmux.FcsErrors + SimDevice.stats.cmux_errors) == 0U) ? 0 : 1;
+}
+
+/**
+  * @brief  Stream a ramp to the headset speaker and from its microphone in
+  *         10 ms blocks, as an application on its own clock does, and check
+  *         the ramps on both ends.
+  * @retval 0 on success
+  */
+static int Sim_Audio(void)
+{
+  const AUDIO_FormatTypeDef format = { SIM_AUDIO_RATE, 2U, 2U, 16U };
+  AUDIO_StatsTypeDef play;
+  AUDIO_StatsTypeDef capture;
+  uint32_t play_low = 0U;
+  uint32_t capture_low = 0U;
+  uint32_t capture_glitches = 0U;
+  uint32_t captured = 0U;
+  uint16_t play_value = 0U;
+  uint16_t capture_last = 0U;
+  uint16_t sample;
+  uint32_t block;
+  uint32_t length;
+  uint32_t idx;
+
+  USBH_SimDev_AudioDefaults(&SimAudioDevice);
+  SimAudioDevice.ClockPpm = SIM_AUDIO_PPM;
+  USBH_SimDev_Init(&SimAudioDevice);
+
+  if ((Sim_Detach() != 0) || (Sim_Enumerate("audio", &SimAudioDevice, NULL) != 0))
+  {
+    return 1;
+  }
+
+  SimAudioStarted = 0U;
+
+  if ((USBH_AUDIO_SetLatency(&hUsbHostSim, AUDIO_PLAYBACK, 4U, 20U) != USBH_OK) ||
+      (USBH_AUDIO_SetLatency(&hUsbHostSim, AUDIO_CAPTURE, 4U, 20U) != USBH_OK) ||
+      (USBH_AUDIO_Start(&hUsbHostSim, AUDIO_PLAYBACK, &format, SimPlayRing, sizeof(SimPlayRing)) != USBH_OK) ||
+      (USBH_AUDIO_Start(&hUsbHostSim, AUDIO_CAPTURE, &format, SimCaptureRing, sizeof(SimCaptureRing)) != USBH_OK))
+  {
+    printf("audio: start failed\n");
+    return 1;
+  }
+
+  Sim_Run(SIM_SETTLE_US);
+
+  if (SimAudioStarted != 3U)
+  {
+    printf("audio: streams not running\n");
+    return 1;
+  }
+
+  for (block = 0U; block < SIM_AUDIO_BLOCKS; block++)
+  {
+    for (idx = 0U; idx < SIM_AUDIO_BLOCK; idx++)
+    {
+      sample = (uint16_t)(play_value + idx + 1U);
+      SimAudioBlock[(idx * SIM_AUDIO_FRAME) + 0U] = (uint8_t)sample;
+      SimAudioBlock[(idx * SIM_AUDIO_FRAME) + 1U] = (uint8_t)(sample >> 8);
+      SimAudioBlock[(idx * SIM_AUDIO_FRAME) + 2U] = (uint8_t)sample;
+      SimAudioBlock[(idx * SIM_AUDIO_FRAME) + 3U] = (uint8_t)(sample >> 8);
+    }
+
+    /* Lowest levels once both buffers are filled: the second block on */
+    (void)USBH_AUDIO_GetStats(&hUsbHostSim, AUDIO_PLAYBACK, &play);
+    if ((block > 1U) && (play.Level > (play.Target + play_low)))
+    {
+      play_low = play.Level - play.Target;
+    }
+
+    /* The ramp goes on from the last sample frame accepted */
+    length = USBH_AUDIO_Write(&hUsbHostSim, SimAudioBlock, sizeof(SimAudioBlock));
+    play_value = (uint16_t)(play_value + (length / SIM_AUDIO_FRAME));
+
+    length = USBH_AUDIO_Read(&hUsbHostSim, SimAudioBlock, sizeof(SimAudioBlock));
+    captured += length / SIM_AUDIO_FRAME;
+
+    (void)USBH_AUDIO_GetStats(&hUsbHostSim, AUDIO_CAPTURE, &capture);
+    if ((block > 1U) && (capture.Level > (capture.Target + capture_low)))
+    {
+      capture_low = capture.Level - capture.Target;
+    }
+
+    for (idx = 0U; idx < (length / SIM_AUDIO_FRAME); idx++)
+    {
+      sample = LE16(&SimAudioBlock[idx * SIM_AUDIO_FRAME]);
+
+      if ((captured > (length / SIM_AUDIO_FRAME)) || (idx != 0U))
+      {
+        if (sample != (uint16_t)(capture_last + 1U))
+        {
+          capture_glitches++;
+        }
+      }
+      capture_last = sample;
+    }
+
+    Sim_Run(SIM_AUDIO_BLOCK_US);
+  }
+
+  (void)USBH_AUDIO_GetStats(&hUsbHostSim, AUDIO_PLAYBACK, &play);
+  (void)USBH_AUDIO_GetStats(&hUsbHostSim, AUDIO_CAPTURE, &capture);
+
+  printf("audio: %u Hz stereo 16-bit, device clock %+d ppm, feedback %u.%04u frames/uframe\n",
+         (unsigned int)SIM_AUDIO_RATE, (int)SIM_AUDIO_PPM, (unsigned int)(play.Feedback >> 16),
+         (unsigned int)(((play.Feedback & 0xFFFFU) * 10000U) >> 16));
+  printf("playback: %u packets, target %u us, level %u us, up to %u us over the target before a write, "
+         "%u underruns, %u slips, %u overruns, %u late\n",
+         (unsigned int)play.Packets, (unsigned int)((play.Target * 1000U) / SIM_AUDIO_MS_BYTES),
+         (unsigned int)((play.Level * 1000U) / SIM_AUDIO_MS_BYTES),
+         (unsigned int)((play_low * 1000U) / SIM_AUDIO_MS_BYTES), (unsigned int)play.Underruns, (unsigned int)play.Slips, (unsigned int)play.Overruns,
+         (unsigned int)play.LateUrbs);
+  printf("speaker: %u frames played, %u underruns, %u overruns, %u ramp breaks\n",
+         (unsigned int)SimAudioDevice.stats.audio_played, (unsigned int)SimAudioDevice.stats.audio_underruns,
+         (unsigned int)SimAudioDevice.stats.audio_overruns, (unsigned int)SimAudioDevice.stats.audio_glitches);
+  printf("capture: %u packets, target %u us, level %u us, up to %u us over the target after a read, "
+         "%u underruns, %u slips, %u overruns, %u late\n",
+         (unsigned int)capture.Packets, (unsigned int)((capture.Target * 1000U) / SIM_AUDIO_MS_BYTES),
+         (unsigned int)((capture.Level * 1000U) / SIM_AUDIO_MS_BYTES),
+         (unsigned int)((capture_low * 1000U) / SIM_AUDIO_MS_BYTES), (unsigned int)capture.Underruns, (unsigned int)capture.Slips, (unsigned int)capture.Overruns,
+         (unsigned int)capture.LateUrbs);
+  printf("microphone: %u frames recorded, %u frames read, %u ramp breaks\n",
+         (unsigned int)SimAudioDevice.stats.audio_recorded, (unsigned int)captured,
+         (unsigned int)capture_glitches);
+
+  if ((play.Underruns != 0U) || (capture.Underruns != 0U) || (SimAudioDevice.stats.audio_underruns != 0U) ||
+      ((play.Slips + capture.Slips) > SIM_AUDIO_MAX_SLIPS) ||
+      (SimAudioDevice.stats.audio_glitches > play.Slips) || (capture_glitches > capture.Slips) ||
+      (play_low > SIM_AUDIO_LEVEL_SLACK) || (capture_low > SIM_AUDIO_LEVEL_SLACK))
+  {
+    printf("audio: jitter buffers out of bounds, %u slips allowed, %u us over the target\n",
+           (unsigned int)SIM_AUDIO_MAX_SLIPS, (unsigned int)((SIM_AUDIO_LEVEL_SLACK * 1000U) / SIM_AUDIO_MS_BYTES));
+    return 1;
+  }
+
+  SimAudioStopped = 0U;
+
+  if ((USBH_AUDIO_Stop(&hUsbHostSim, AUDIO_PLAYBACK) != USBH_OK) ||
+      (USBH_AUDIO_Stop(&hUsbHostSim, AUDIO_CAPTURE) != USBH_OK))
+  {
+    printf("audio: stop failed\n");
+    return 1;
+  }
+
+  Sim_Run(SIM_SETTLE_US);
+
+  if ((SimAudioStopped != 3U) || (SimAudioDevice.alt[1] != 0U) || (SimAudioDevice.alt[2] != 0U))
+  {
+    printf("audio: streams not stopped\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Run the host until the hub ports with a device in class state are
+  *         exactly the ones of a map.
+  * @param  ready_map: Bit n set for a device expected ready on port n
+  * @retval 1 once reached, 0 on timeout
+  */
+static uint8_t Sim_WaitHubPorts(uint8_t ready_map)
+{
+  uint64_t deadline = USBH_Sim_GetTimeUs() + SIM_TIMEOUT_US;
+  uint8_t map;
+  uint8_t port;
+
+  while (USBH_Sim_GetTimeUs() < deadline)
+  {
+    Sim_Process();
+
+    map = 0U;
+    for (port = 1U; port <= USBH_HUB_MAX_PORTS; port++)
+    {
+      map |= (USBH_HUB_GetDevice(&hUsbHostSim, port) != NULL) ? (uint8_t)(1U << port) : 0U;
+    }
+
+    if (map == ready_map)
+    {
+      return 1U;
+    }
+
+    USBH_Sim_Step();
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Plug a hub with a CDC device on each of its ports. The devices on
+  *         the ports served enumerate and loop data; the others stay
+  *         unpowered. One device is unplugged and plugged again while the
+  *         other keeps its class state, then the hub leaves with both.
+  * @retval 0 on success
+  */
+static int Sim_Hub(void)
+{
+  USBH_HandleTypeDef *pdevice;
+  uint64_t start;
+  uint32_t used;
+  uint8_t all_map = (uint8_t)((2U << USBH_HUB_MAX_PORTS) - 2U);
+  uint8_t port;
+  uint32_t idx;
+
+  if (Sim_Detach() != 0)
+  {
+    printf("hub: previous device not released\n");
+    return 1;
+  }
+
+  USBH_SimDev_HubDefaults(&SimHub);
+  USBH_SimDev_Init(&SimHub);
+
+  for (idx = 0U; idx < SIM_HUB_DEVICES; idx++)
+  {
+    USBH_SimDev_Defaults(&SimHubDevice[idx]);
+    SimHubDevice[idx].PID = (uint16_t)(0x5740U + idx);
+    USBH_SimDev_Init(&SimHubDevice[idx]);
+    USBH_SimDev_HubPlug(&SimHub, (uint8_t)(idx + 1U), &SimHubDevice[idx]);
+  }
+
+  if (Sim_Enumerate("hub", &SimHub, NULL) != 0)
+  {
+    return 1;
+  }
+
+  start = USBH_Sim_GetTimeUs();
+
+  if (Sim_WaitHubPorts(all_map) == 0U)
+  {
+    printf("hub: port devices not enumerated\n");
+    return 1;
+  }
+
+  printf("hub: %u of %u port devices enumerated in %llu us, %u host channels in use\n",
+         (unsigned int)USBH_HUB_GetNbrPorts(&hUsbHostSim), (unsigned int)SIM_HUB_DEVICES,
+         (unsigned long long)(USBH_Sim_GetTimeUs() - start),
+         (unsigned int)__builtin_popcount(USBH_GetPipeMap(&hUsbHostSim)));
+
+  for (idx = USBH_HUB_MAX_PORTS; idx < SIM_HUB_DEVICES; idx++)
+  {
+    if (SimHubDevice[idx].stats.setups != 0U)
+    {
+      printf("hub: device on port %u not served but enumerated\n", (unsigned int)(idx + 1U));
+      return 1;
+    }
+  }
+
+  for (port = 1U; port <= USBH_HUB_MAX_PORTS; port++)
+  {
+    pdevice = USBH_HUB_GetDevice(&hUsbHostSim, port);
+    SimTxDone = 0U;
+    SimRxCount = 0U;
+
+    if ((USBH_CDC_StartReceiveStream(pdevice) != USBH_OK) ||
+        (USBH_CDC_Transmit(pdevice, SimTxBuff, SIM_HUB_LOOPBACK_SIZE) != USBH_OK) ||
+        (Sim_RunUntil(&SimTxDone, &SimRxCount, SIM_HUB_LOOPBACK_SIZE) == 0U) ||
+        (SimRxCount != SIM_HUB_LOOPBACK_SIZE) ||
+        (USBH_memcmp(SimTxBuff, SimRxBuff, SIM_HUB_LOOPBACK_SIZE) != 0))
+    {
+      printf("hub: loopback on port %u failed, %u bytes back\n", (unsigned int)port,
+             (unsigned int)SimRxCount);
+      return 1;
+    }
+  }
+
+  /* Unplug the device of port 1: its class data goes back to the pools */
+  used = USBH_Pool_GetUsedBlocks();
+  start = USBH_Sim_GetTimeUs();
+  USBH_SimDev_HubPlug(&SimHub, 1U, NULL);
+
+  if ((Sim_WaitHubPorts((uint8_t)(all_map & ~2U)) == 0U) || (USBH_Pool_GetUsedBlocks() >= used))
+  {
+    printf("hub: port 1 device not detached\n");
+    return 1;
+  }
+
+  printf("hub: port 1 device detached in %llu us, %u class blocks released\n",
+         (unsigned long long)(USBH_Sim_GetTimeUs() - start), (unsigned int)(used - USBH_Pool_GetUsedBlocks()));
+
+  /* Let the hub clear the disconnection before the device comes back */
+  Sim_Run(SIM_SETTLE_US);
+
+  start = USBH_Sim_GetTimeUs();
+  USBH_SimDev_HubPlug(&SimHub, 1U, &SimHubDevice[0]);
+
+  if ((Sim_WaitHubPorts(all_map) == 0U) || (USBH_Pool_GetUsedBlocks() != used))
+  {
+    printf("hub: port 1 device not enumerated again\n");
+    return 1;
+  }
+
+  printf("hub: port 1 device enumerated again in %llu us\n", (unsigned long long)(USBH_Sim_GetTimeUs() - start));
+
+  /* The hub leaves with its devices */
+  if ((Sim_Detach() != 0) || (USBH_Pool_GetUsedBlocks() != 0U) || (USBH_DMA_GetUsedBlocks() != 0U))
+  {
+    printf("hub: detach left %u class and %u DMA blocks\n", (unsigned int)USBH_Pool_GetUsedBlocks(),
+           (unsigned int)USBH_DMA_GetUsedBlocks());
+    return 1;
+  }
+
+  printf("hub: detached, class pool peak %u blocks\n", (unsigned int)USBH_Pool_GetPeakBlocks());
+
+  return 0;
+}
+
+/**
+  * @brief  Host build entry point.
+  * @retval 0 on success
+  */
+int main(void)
+{
+  Sim_EnumTimesTypeDef cold;
+  Sim_EnumTimesTypeDef warm;
+  uint64_t start;
+  uint32_t idx;
+  uint32_t passes;
+  uint32_t naks;
+  uint32_t setups;
+  uint8_t out_pipe;
+
+  USBH_SimDev_Defaults(&SimDevice);
+  USBH_SimDev_Init(&SimDevice);
+
+  if ((USBH_Init(&hUsbHostSim, USBH_UserProcess, HOST_HS) != USBH_OK) ||
+      (USBH_RegisterClass(&hUsbHostSim, USBH_CDC_CLASS) != USBH_OK) ||
+      (USBH_RegisterClass(&hUsbHostSim, USBH_AUDIO_CLASS) != USBH_OK) ||
+      (USBH_RegisterClass(&hUsbHostSim, USBH_HUB_CLASS) != USBH_OK) ||
+      (USBH_Start(&hUsbHostSim) != USBH_OK))
+  {
+    printf("host init failed\n");
+    return 1;
+  }
+
+  if (Sim_Enumerate("cold", &SimDevice, &cold) != 0)
+  {
+    return 1;
+  }
+
+  /* Replug: the second enumeration is served from the descriptor cache */
+  (void)Sim_Detach();
+  SimDevice.stats.setups = 0U;
+
+  if (Sim_Enumerate("warm", &SimDevice, &warm) != 0)
+  {
+    return 1;
+  }
+
+  /* The cache only saves control transfers: the debounce, reset and reset
+     recovery waits are the same for a known device */
+  if ((warm.setups >= cold.setups) || (warm.control_us >= cold.control_us) ||
+      ((cold.total_us - warm.total_us) + SIM_ENUM_WAIT_SLACK_US < (cold.control_us - warm.control_us)) ||
+      ((cold.total_us - warm.total_us) > (cold.control_us - warm.control_us) + SIM_ENUM_WAIT_SLACK_US))
+  {
+    printf("enumeration cache: warm control %llu us against %llu us cold, total %llu us against %llu us\n",
+           (unsigned long long)warm.control_us, (unsigned long long)cold.control_us,
+           (unsigned long long)warm.total_us, (unsigned long long)cold.total_us);
+    return 1;
+  }
+
+  printf("enumeration cache: %u setups and %llu us of control traffic saved\n",
+         (unsigned int)(cold.setups - warm.setups), (unsigned long long)(cold.control_us - warm.control_us));
+
+  /* Let the notification polling settle into its interval first */
+  Sim_Run(SIM_SETTLE_US);
+
+  /* Carrier and ring raised by the modem, reported on the interrupt endpoint */
+  start = USBH_Sim_GetTimeUs();
+  SimSerialStateSeen = 0U;
+  USBH_SimDev_SetSerialState(&SimDevice, CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR | CDC_SERIAL_STATE_RING);
+
+  if ((Sim_RunUntil(&SimSerialStateSeen, NULL, 0U) == 0U) ||
+      (SimSerialState != (CDC_SERIAL_STATE_DCD | CDC_SERIAL_STATE_DSR | CDC_SERIAL_STATE_RING)))
+  {
+    printf("serial state: not reported\n");
+    return 1;
+  }
+
+  printf("serial state: 0x%04x in %llu us\n", (unsigned int)SimSerialState,
+         (unsigned long long)(USBH_Sim_GetTimeUs() - start));
+
+  /* SET_LINE_CODING then GET_LINE_CODING, two control transfers */
+  passes = hUsbHostSim.events.tail;
+  start = USBH_Sim_GetTimeUs();
+  SimLineCodingDone = 0U;
+  SimLineCoding.b.dwDTERate = 921600U;
+  SimLineCoding.b.bCharFormat = 0U;
+  SimLineCoding.b.bParityType = 0U;
+  SimLineCoding.b.bDataBits = 8U;
+
+  if ((USBH_CDC_SetLineCoding(&hUsbHostSim, &SimLineCoding) != USBH_OK) ||
+      (Sim_RunUntil(&SimLineCodingDone, NULL, 0U) == 0U))
+  {
+    printf("line coding: not applied\n");
+    return 1;
+  }
+
+  printf("line coding: %u baud in %llu us, %u process passes\n", (unsigned int)SimLineCoding.b.dwDTERate,
+         (unsigned long long)(USBH_Sim_GetTimeUs() - start),
+         (unsigned int)(hUsbHostSim.events.tail - passes));
+
+  /* A device NAKing the data stage: past USBH_CTL_CHAIN_MAX_NAKS the
+     retries leave the interrupt, one process pass each */
+  passes = hUsbHostSim.events.tail;
+  start = USBH_Sim_GetTimeUs();
+  SimLineCodingDone = 0U;
+  USBH_SimDev_InjectNak(&SimDevice, 0x00U, SIM_CTL_NAKS);
+
+  if ((USBH_CDC_SetLineCoding(&hUsbHostSim, &SimLineCoding) != USBH_OK) ||
+      (Sim_RunUntil(&SimLineCodingDone, NULL, 0U) == 0U) ||
+      ((hUsbHostSim.events.tail - passes) < (SIM_CTL_NAKS - USBH_CTL_CHAIN_MAX_NAKS)))
+  {
+    printf("control NAKs: line coding not applied, %u process passes\n",
+           (unsigned int)(hUsbHostSim.events.tail - passes));
+    return 1;
+  }
+
+  printf("control NAKs: %u on the data stage, %u from the interrupt, done in %llu us, %u process passes\n",
+         (unsigned int)SIM_CTL_NAKS, (unsigned int)USBH_CTL_CHAIN_MAX_NAKS,
+         (unsigned long long)(USBH_Sim_GetTimeUs() - start),
+         (unsigned int)(hUsbHostSim.events.tail - passes));
+
+  /* A device NAKing the status stage past USBH_CTL_TIMEOUT: the chained
+     transfer is taken back and sent again from its SETUP */
+  setups = SimDevice.stats.setups;
+  start = USBH_Sim_GetTimeUs();
+  SimLineCodingDone = 0U;
+  USBH_SimDev_InjectNak(&SimDevice, 0x80U, 0xFFFFFFFFU);
+
+  if (USBH_CDC_SetLineCoding(&hUsbHostSim, &SimLineCoding) != USBH_OK)
+  {
+    printf("control timeout: line coding not started\n");
+    return 1;
+  }
+
+  Sim_Run((USBH_CTL_TIMEOUT * 1000U) + SIM_SETTLE_US);
+  USBH_SimDev_InjectNak(&SimDevice, 0x80U, 0U);
+
+  if ((Sim_RunUntil(&SimLineCodingDone, NULL, 0U) == 0U) || ((SimDevice.stats.setups - setups) != 3U))
+  {
+    printf("control timeout: line coding not applied, %u setups\n",
+           (unsigned int)(SimDevice.stats.setups - setups));
+    return 1;
+  }
+
+  printf("control timeout: status stage sent again after %u ms, done in %llu us\n",
+         (unsigned int)USBH_CTL_TIMEOUT, (unsigned long long)(USBH_Sim_GetTimeUs() - start));
+
+  for (idx = 0U; idx < SIM_LOOPBACK_SIZE; idx++)
+  {
+    SimTxBuff[idx] = (uint8_t)((idx * 7U) + (idx >> 8));
+  }
+
+  /* Device-side flow control: nothing drains the loopback FIFO for a while */
+  passes = hUsbHostSim.events.tail;
+  out_pipe = ((CDC_HandleTypeDef *)hUsbHostSim.pActiveClass->pData)->DataItf.OutPipe;
+  naks = USBH_GetPipeStats(&hUsbHostSim, out_pipe)->Naks;
+  SimTxDone = 0U;
+  SimRxCount = 0U;
+
+  if (USBH_CDC_Transmit(&hUsbHostSim, SimTxBuff, SIM_FLOW_SIZE) != USBH_OK)
+  {
+    printf("flow control: transmit failed\n");
+    return 1;
+  }
+
+  Sim_Run(SIM_FLOW_HOLD_US);
+
+  printf("flow control: %u us held, %u process passes, %u NAKs\n", (unsigned int)SIM_FLOW_HOLD_US,
+         (unsigned int)(hUsbHostSim.events.tail - passes),
+         (unsigned int)(USBH_GetPipeStats(&hUsbHostSim, out_pipe)->Naks - naks));
+
+  if ((USBH_CDC_StartReceiveStream(&hUsbHostSim) != USBH_OK) ||
+      (Sim_RunUntil(&SimTxDone, &SimRxCount, SIM_FLOW_SIZE) == 0U))
+  {
+    printf("flow control: transmission not resumed\n");
+    return 1;
+  }
+
+  USBH_Sim_ClearStats();
+  start = USBH_Sim_GetTimeUs();
+  SimTxDone = 0U;
+  SimRxCount = 0U;
+
+  if ((USBH_CDC_StartReceiveStream(&hUsbHostSim) != USBH_OK) ||
+      (USBH_CDC_Transmit(&hUsbHostSim, SimTxBuff, SIM_LOOPBACK_SIZE) != USBH_OK))
+  {
+    printf("loopback start failed\n");
+    return 1;
+  }
+
+  if (Sim_RunUntil(&SimTxDone, &SimRxCount, SIM_LOOPBACK_SIZE) == 0U)
+  {
+    printf("loopback: timeout, %u bytes back\n", (unsigned int)SimRxCount);
+    return 1;
+  }
+
+  if ((SimRxCount != SIM_LOOPBACK_SIZE) || (USBH_memcmp(SimTxBuff, SimRxBuff, SIM_LOOPBACK_SIZE) != 0))
+  {
+    printf("loopback: data mismatch\n");
+    return 1;
+  }
+
+  printf("loopback: %u bytes in %llu us, %u URBs, %u NAKs\n", (unsigned int)SIM_LOOPBACK_SIZE,
+         (unsigned long long)(USBH_Sim_GetTimeUs() - start),
+         (unsigned int)USBH_Sim_GetStats()->urbs, (unsigned int)USBH_Sim_GetStats()->naks);
+
+  Sim_PrintPipeStats();
+#if (USBH_USE_URB_TRACE == 1U)
+  Sim_PrintUrbTrace();
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+  if (Sim_Voice() != 0)
+  {
+    return 1;
+  }
+
+  if ((Sim_Cmux(CMUX_MODE_BASIC) != 0) || (Sim_Cmux(CMUX_MODE_ADVANCED) != 0))
+  {
+    return 1;
+  }
+
+  if (Sim_Audio() != 0)
+  {
+    return 1;
+  }
+
+  if (Sim_Hub() != 0)
+  {
+    return 1;
+  }
+
+  /* No wait left inside the host process: a call only costs its own work */
+  printf("process: %u wakeups, worst call %llu %s for %u passes, %llu us blocked\n",
+         (unsigned int)SimProcess.wakeups, (unsigned long long)SimProcess.worst_cycles, SIM_CYCLE_UNIT,
+         (unsigned int)SimProcess.worst_passes, (unsigned long long)SimProcess.blocked_us);
+
+  return (SimProcess.blocked_us == 0U) ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_sim_stress.c
+  * @brief          : Hot-plug stress of the USB host stack on the virtual host
+  *                   controller: plugs the CDC ACM device and the UAC2
+  *                   headset in turn, starts their streams, unplugs them, and
+  *                   checks after every cycle that the class and DMA pools are
+  *                   empty again. The process heap must not grow over the run.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <unistd.h>
+#include "usbh_core.h"
+#include "usbh_cdc.h"
+#include "usbh_audio.h"
+#include "usbh_hub.h"
+#include "usbh_sim_device.h"
+
+/* Private define ------------------------------------------------------------*/
+#define STRESS_CYCLES             1000000U
+#define STRESS_REPORT             100000U
+#define STRESS_TIMEOUT_US         5000000U
+#define STRESS_STREAM_US          2000U
+#define STRESS_RING_SIZE          4096U
+
+/* Private variables ---------------------------------------------------------*/
+static USBH_HandleTypeDef hUsbHostStress;
+static USBH_SimDevTypeDef StressCdc;
+static USBH_SimDevTypeDef StressAudio;
+
+static volatile uint8_t StressClassActive;
+static uint8_t StressRing[STRESS_RING_SIZE];
+static uint32_t StressDmaPeak;
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id);
+static void Stress_Step(void);
+static uint8_t Stress_Cycle(USBH_SimDevTypeDef *pdev);
+static uint8_t Stress_NoBuffers(void);
+
+/**
+  * @brief  User callback of the host library.
+  * @param  phost: Host handle
+  * @param  id: Event
+  * @retval None
+  */
+static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id)
+{
+  UNUSED(phost);
+
+  switch (id)
+  {
+    case HOST_USER_CLASS_ACTIVE:
+      StressClassActive = 1U;
+      break;
+
+    case HOST_USER_DISCONNECTION:
+      StressClassActive = 0U;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  CDC reception stream data, dropped.
+  * @param  phost: Host handle
+  * @param  pbuff: Received data
+  * @param  length: Received length
+  * @retval None
+  */
+void USBH_CDC_ReceiveStreamCallback(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length)
+{
+  UNUSED(pbuff);
+  UNUSED(length);
+
+  (void)USBH_CDC_ReleaseStreamBuffer(phost);
+}
+
+/**
+  * @brief  One pass of the main loop: the host process when it has work,
+  *         then the virtual bus.
+  * @retval None
+  */
+static void Stress_Step(void)
+{
+  if (USBH_EventPending(&hUsbHostStress) != 0U)
+  {
+    (void)USBH_ProcessEvents(&hUsbHostStress);
+  }
+
+  USBH_Sim_Step();
+}
+
+/**
+  * @brief  Plug a device, start its streams, unplug it.
+  * @param  pdev: Device model
+  * @retval 1 on success, 0 on a timeout or a stream not started
+  */
+static uint8_t Stress_Cycle(USBH_SimDevTypeDef *pdev)
+{
+  const AUDIO_FormatTypeDef format = { 48000U, 2U, 2U, 16U };
+  uint64_t start = USBH_Sim_GetTimeUs();
+
+  StressClassActive = 0U;
+  USBH_Sim_Attach(pdev);
+
+  while (StressClassActive == 0U)
+  {
+    if ((USBH_Sim_GetTimeUs() - start) >= STRESS_TIMEOUT_US)
+    {
+      return 0U;
+    }
+
+    Stress_Step();
+  }
+
+  /* Every buffer the class can hold while running */
+  if (((pdev == &StressCdc) && (USBH_CDC_StartReceiveStream(&hUsbHostStress) != USBH_OK)) ||
+      ((pdev == &StressAudio) &&
+       (USBH_AUDIO_Start(&hUsbHostStress, AUDIO_PLAYBACK, &format, StressRing, sizeof(StressRing)) != USBH_OK)))
+  {
+    return 0U;
+  }
+
+  start = USBH_Sim_GetTimeUs();
+  while ((USBH_Sim_GetTimeUs() - start) < STRESS_STREAM_US)
+  {
+    Stress_Step();
+  }
+
+  if (USBH_DMA_GetUsedBlocks() > StressDmaPeak)
+  {
+    StressDmaPeak = USBH_DMA_GetUsedBlocks();
+  }
+
+  USBH_Sim_Attach(NULL);
+  start = USBH_Sim_GetTimeUs();
+
+  while ((StressClassActive != 0U) || (hUsbHostStress.gState != HOST_IDLE))
+  {
+    if ((USBH_Sim_GetTimeUs() - start) >= STRESS_TIMEOUT_US)
+    {
+      return 0U;
+    }
+
+    Stress_Step();
+  }
+
+  return 1U;
+}
+
+/**
+  * @brief  Plug the CDC device with the DMA pool exhausted: the class init
+  *         must fail, stop the enumeration and give back what it took.
+  * @retval 1 on success, 0 when the class started or leaked a block
+  */
+static uint8_t Stress_NoBuffers(void)
+{
+  void *hog[USBH_DMA_POOL_NUM_BLOCKS];
+  uint64_t start = USBH_Sim_GetTimeUs();
+  uint8_t aborted = 0U;
+  uint32_t idx;
+
+  for (idx = 0U; idx < USBH_DMA_POOL_NUM_BLOCKS; idx++)
+  {
+    hog[idx] = USBH_DMA_Alloc(USBH_DMA_POOL_BLOCK_SIZE);
+  }
+
+  StressClassActive = 0U;
+  USBH_Sim_Attach(&StressCdc);
+
+  while (((USBH_Sim_GetTimeUs() - start) < STRESS_TIMEOUT_US) && (StressClassActive == 0U))
+  {
+    Stress_Step();
+
+    if (hUsbHostStress.gState == HOST_ABORT_STATE)
+    {
+      aborted = 1U;
+      break;
+    }
+  }
+
+  USBH_Sim_Attach(NULL);
+  start = USBH_Sim_GetTimeUs();
+
+  while (((USBH_Sim_GetTimeUs() - start) < STRESS_TIMEOUT_US) && (hUsbHostStress.gState != HOST_IDLE))
+  {
+    Stress_Step();
+  }
+
+  for (idx = 0U; idx < USBH_DMA_POOL_NUM_BLOCKS; idx++)
+  {
+    USBH_DMA_Free(hog[idx]);
+  }
+
+  printf("stress: CDC with no DMA blocks %s, %u class and %u DMA blocks left\n",
+         (aborted != 0U) ? "aborted" : "did not abort",
+         (unsigned int)USBH_Pool_GetUsedBlocks(), (unsigned int)USBH_DMA_GetUsedBlocks());
+
+  return ((aborted != 0U) && (hUsbHostStress.gState == HOST_IDLE) &&
+          (USBH_Pool_GetUsedBlocks() == 0U) && (USBH_DMA_GetUsedBlocks() == 0U)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Stress entry point.
+  * @param  argc: Argument count
+  * @param  argv: Cycle count, STRESS_CYCLES by default
+  * @retval 0 when the pools and the heap came back to their start
+  */
+int main(int argc, char *argv[])
+{
+  uint32_t cycles = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : STRESS_CYCLES;
+  uintptr_t heap = 0U;
+  uint32_t cycle;
+
+  USBH_SimDev_Defaults(&StressCdc);
+  USBH_SimDev_Init(&StressCdc);
+  USBH_SimDev_AudioDefaults(&StressAudio);
+  USBH_SimDev_Init(&StressAudio);
+
+  if ((USBH_Init(&hUsbHostStress, USBH_UserProcess, HOST_HS) != USBH_OK) ||
+      (USBH_RegisterClass(&hUsbHostStress, USBH_CDC_CLASS) != USBH_OK) ||
+      (USBH_RegisterClass(&hUsbHostStress, USBH_AUDIO_CLASS) != USBH_OK) ||
+      (USBH_Start(&hUsbHostStress) != USBH_OK))
+  {
+    printf("host init failed\n");
+    return 1;
+  }
+
+  printf("stress: %u connect/disconnect cycles, CDC and audio in turn\n", (unsigned int)cycles);
+
+  for (cycle = 0U; cycle < cycles; cycle++)
+  {
+    if (Stress_Cycle(((cycle & 1U) == 0U) ? &StressCdc : &StressAudio) == 0U)
+    {
+      printf("stress: cycle %u failed in state %d\n", (unsigned int)cycle, (int)hUsbHostStress.gState);
+      return 1;
+    }
+
+    if ((USBH_Pool_GetUsedBlocks() != 0U) || (USBH_DMA_GetUsedBlocks() != 0U))
+    {
+      printf("stress: cycle %u left %u class and %u DMA blocks allocated\n", (unsigned int)cycle,
+             (unsigned int)USBH_Pool_GetUsedBlocks(), (unsigned int)USBH_DMA_GetUsedBlocks());
+      return 1;
+    }
+
+    /* The first cycles set up stdio; the heap is measured from there */
+    if (cycle == 1U)
+    {
+      heap = (uintptr_t)sbrk(0);
+    }
+
+    if (((cycle + 1U) % STRESS_REPORT) == 0U)
+    {
+      printf("stress: %u cycles\n", (unsigned int)(cycle + 1U));
+    }
+  }
+
+  if (Stress_NoBuffers() == 0U)
+  {
+    return 1;
+  }
+
+  printf("stress: %u cycles, class pool peak %u blocks, DMA pool peak %u blocks, %u failed allocations, "
+         "heap %+ld bytes\n",
+         (unsigned int)cycles, (unsigned int)USBH_Pool_GetPeakBlocks(), (unsigned int)StressDmaPeak,
+         (unsigned int)USBH_Pool_GetFailCount(),
+         (cycles > 1U) ? (long)((uintptr_t)sbrk(0) - heap) : 0L);
+
+  return ((USBH_Pool_GetFailCount() == 0U) && ((cycles <= 1U) || ((uintptr_t)sbrk(0) == heap))) ? 0 : 1;
+}
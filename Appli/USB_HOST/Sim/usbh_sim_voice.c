@@ -0,0 +1,590 @@
+/**
+  ******************************************************************************
+  * @file           : Sim/usbh_sim_voice.c
+  * @brief          : Voice kernel benchmark: each kernel of usb_voice.c is
+  *                   checked against a naive per-sample version over the same
+  *                   data, then both are timed. One JSON object per line.
+  *
+  *                   The naive versions are the textbook ones: G.711 segment
+  *                   search, decoding by formula, and a conference mix that
+  *                   sums the other channels for every port. Built with
+  *                   VOICE_SIMD_EMULATION, the packed path of usb_voice.c is
+  *                   checked on the host with C models of the intrinsics;
+  *                   its timings then mean nothing.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_voice.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLE_UNIT          "tsc"
+#else
+#include <time.h>
+#define BENCH_CYCLE_UNIT          "ns"
+#endif
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_SAMPLES             65536U
+#define BENCH_REPEAT              16U
+#define BENCH_SEED                0x2545F491U
+
+#if defined(VOICE_SIMD_EMULATION)
+#define BENCH_PATH                "simd-emulated"
+#else
+#define BENCH_PATH                "scalar"
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+typedef void (*Bench_KernelTypeDef)(void);
+
+/* Private variables ---------------------------------------------------------*/
+static const int16_t BenchSegUlaw[8] = { 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF, 0x3FFF, 0x7FFF };
+static const int16_t BenchSegAlaw[8] = { 0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF };
+
+static int16_t BenchPcm[VOICE_MAX_PORTS][BENCH_SAMPLES];
+static int16_t BenchOut[VOICE_MAX_PORTS][BENCH_SAMPLES];
+static int16_t BenchRef[VOICE_MAX_PORTS][BENCH_SAMPLES];
+static uint8_t BenchCodes[BENCH_SAMPLES];
+static uint8_t BenchCodesRef[BENCH_SAMPLES];
+static int16_t BenchGain[VOICE_MAX_PORTS];
+static uint32_t BenchChannels;
+static uint32_t BenchSeed = BENCH_SEED;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t Bench_GetCycles(void);
+static uint32_t Bench_Random(void);
+static int16_t Bench_Clamp(int64_t val);
+static uint8_t Naive_UlawEncode(int16_t sample);
+static uint8_t Naive_AlawEncode(int16_t sample);
+static int16_t Naive_UlawDecode(uint8_t code);
+static int16_t Naive_AlawDecode(uint8_t code);
+static void Naive_UlawToPcm(void);
+static void Naive_AlawToPcm(void);
+static void Naive_PcmToUlaw(void);
+static void Naive_PcmToAlaw(void);
+static void Naive_Gain(void);
+static void Naive_Mix(void);
+static void Naive_MixMinus(void);
+static void Fast_UlawToPcm(void);
+static void Fast_AlawToPcm(void);
+static void Fast_PcmToUlaw(void);
+static void Fast_PcmToAlaw(void);
+static void Fast_Gain(void);
+static void Fast_Mix(void);
+static void Fast_MixMinus(void);
+static double Bench_Time(Bench_KernelTypeDef kernel);
+static void Bench_Report(const char *name, Bench_KernelTypeDef naive, Bench_KernelTypeDef fast,
+                         uint32_t mismatches, uint32_t samples);
+static uint32_t Bench_ComparePcm(uint32_t channels);
+static uint32_t Bench_CompareCodes(void);
+
+/**
+  * @brief  Cycle or nanosecond counter.
+  * @retval Count
+  */
+static uint64_t Bench_GetCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+  * @brief  xorshift32, the same sequence on every run.
+  * @retval Random word
+  */
+static uint32_t Bench_Random(void)
+{
+  BenchSeed ^= BenchSeed << 13;
+  BenchSeed ^= BenchSeed >> 17;
+  BenchSeed ^= BenchSeed << 5;
+
+  return BenchSeed;
+}
+
+/**
+  * @brief  Clamp to the 16-bit sample range.
+  */
+static int16_t Bench_Clamp(int64_t val)
+{
+  if (val > 32767)
+  {
+    return 32767;
+  }
+
+  if (val < -32768)
+  {
+    return -32768;
+  }
+
+  return (int16_t)val;
+}
+
+/**
+  * @brief  G.711 mu-law encoder with the segment table search.
+  */
+static uint8_t Naive_UlawEncode(int16_t sample)
+{
+  int32_t pcm = sample;
+  uint32_t mask;
+  uint32_t seg;
+
+  if (pcm < 0)
+  {
+    pcm = 0x84 - pcm;
+    mask = 0x7FU;
+  }
+  else
+  {
+    pcm += 0x84;
+    mask = 0xFFU;
+  }
+
+  for (seg = 0U; seg < 8U; seg++)
+  {
+    if (pcm <= BenchSegUlaw[seg])
+    {
+      break;
+    }
+  }
+
+  if (seg >= 8U)
+  {
+    return (uint8_t)(0x7FU ^ mask);
+  }
+
+  return (uint8_t)(((seg << 4) | (((uint32_t)pcm >> (seg + 3U)) & 0x0FU)) ^ mask);
+}
+
+/**
+  * @brief  G.711 A-law encoder with the segment table search.
+  */
+static uint8_t Naive_AlawEncode(int16_t sample)
+{
+  int32_t pcm = sample >> 3;
+  uint32_t mask;
+  uint32_t seg;
+  uint32_t aval;
+
+  if (pcm >= 0)
+  {
+    mask = 0xD5U;
+  }
+  else
+  {
+    mask = 0x55U;
+    pcm = -pcm - 1;
+  }
+
+  for (seg = 0U; seg < 8U; seg++)
+  {
+    if (pcm <= BenchSegAlaw[seg])
+    {
+      break;
+    }
+  }
+
+  if (seg >= 8U)
+  {
+    return (uint8_t)(0x7FU ^ mask);
+  }
+
+  aval = seg << 4;
+  aval |= ((uint32_t)pcm >> ((seg < 2U) ? 1U : seg)) & 0x0FU;
+
+  return (uint8_t)(aval ^ mask);
+}
+
+/**
+  * @brief  G.711 mu-law decoder by formula.
+  */
+static int16_t Naive_UlawDecode(uint8_t code)
+{
+  uint32_t u = (uint32_t)code ^ 0xFFU;
+  int32_t t = (int32_t)((((u & 0x0FU) << 3) + 0x84U) << ((u & 0x70U) >> 4));
+
+  return (int16_t)(((u & 0x80U) != 0U) ? (0x84 - t) : (t - 0x84));
+}
+
+/**
+  * @brief  G.711 A-law decoder by formula.
+  */
+static int16_t Naive_AlawDecode(uint8_t code)
+{
+  uint32_t a = (uint32_t)code ^ 0x55U;
+  uint32_t seg = (a & 0x70U) >> 4;
+  int32_t t = (int32_t)((a & 0x0FU) << 4);
+
+  switch (seg)
+  {
+    case 0U:
+      t += 8;
+      break;
+
+    case 1U:
+      t += 0x108;
+      break;
+
+    default:
+      t = (t + 0x108) << (seg - 1U);
+      break;
+  }
+
+  return (int16_t)(((a & 0x80U) != 0U) ? t : -t);
+}
+
+__attribute__((noinline)) static void Naive_UlawToPcm(void)
+{
+  uint32_t n;
+
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    BenchRef[0][n] = Naive_UlawDecode(BenchCodes[n]);
+  }
+}
+
+__attribute__((noinline)) static void Naive_AlawToPcm(void)
+{
+  uint32_t n;
+
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    BenchRef[0][n] = Naive_AlawDecode(BenchCodes[n]);
+  }
+}
+
+__attribute__((noinline)) static void Naive_PcmToUlaw(void)
+{
+  uint32_t n;
+
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    BenchCodesRef[n] = Naive_UlawEncode(BenchPcm[0][n]);
+  }
+}
+
+__attribute__((noinline)) static void Naive_PcmToAlaw(void)
+{
+  uint32_t n;
+
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    BenchCodesRef[n] = Naive_AlawEncode(BenchPcm[0][n]);
+  }
+}
+
+__attribute__((noinline)) static void Naive_Gain(void)
+{
+  uint32_t n;
+
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    BenchRef[0][n] = Bench_Clamp(((int64_t)BenchPcm[0][n] * BenchGain[0]) >> 12);
+  }
+}
+
+__attribute__((noinline)) static void Naive_Mix(void)
+{
+  uint32_t n;
+  uint32_t ch;
+
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    int64_t acc = 0;
+
+    for (ch = 0U; ch < BenchChannels; ch++)
+    {
+      acc += (int64_t)BenchPcm[ch][n] * BenchGain[ch];
+    }
+
+    BenchRef[0][n] = Bench_Clamp(acc >> 12);
+  }
+}
+
+__attribute__((noinline)) static void Naive_MixMinus(void)
+{
+  uint32_t n;
+  uint32_t ch;
+  uint32_t other;
+
+  for (ch = 0U; ch < BenchChannels; ch++)
+  {
+    for (n = 0U; n < BENCH_SAMPLES; n++)
+    {
+      int64_t acc = 0;
+
+      for (other = 0U; other < BenchChannels; other++)
+      {
+        if (other != ch)
+        {
+          acc += (int64_t)BenchPcm[other][n] * BenchGain[other];
+        }
+      }
+
+      BenchRef[ch][n] = Bench_Clamp(acc >> 12);
+    }
+  }
+}
+
+__attribute__((noinline)) static void Fast_UlawToPcm(void)
+{
+  VOICE_UlawToPcm(BenchOut[0], BenchCodes, BENCH_SAMPLES);
+}
+
+__attribute__((noinline)) static void Fast_AlawToPcm(void)
+{
+  VOICE_AlawToPcm(BenchOut[0], BenchCodes, BENCH_SAMPLES);
+}
+
+__attribute__((noinline)) static void Fast_PcmToUlaw(void)
+{
+  /* Odd length and offset: the word loop and the tail both run */
+  VOICE_PcmToUlaw(BenchCodes, BenchPcm[0], 3U);
+  VOICE_PcmToUlaw(&BenchCodes[3], &BenchPcm[0][3], BENCH_SAMPLES - 3U);
+}
+
+__attribute__((noinline)) static void Fast_PcmToAlaw(void)
+{
+  VOICE_PcmToAlaw(BenchCodes, BenchPcm[0], 3U);
+  VOICE_PcmToAlaw(&BenchCodes[3], &BenchPcm[0][3], BENCH_SAMPLES - 3U);
+}
+
+__attribute__((noinline)) static void Fast_Gain(void)
+{
+  VOICE_Gain(BenchOut[0], BenchPcm[0], BenchGain[0], BENCH_SAMPLES - 1U);
+  VOICE_Gain(&BenchOut[0][BENCH_SAMPLES - 1U], &BenchPcm[0][BENCH_SAMPLES - 1U], BenchGain[0], 1U);
+}
+
+__attribute__((noinline)) static void Fast_Mix(void)
+{
+  const int16_t *psrc[VOICE_MAX_PORTS];
+  uint32_t ch;
+
+  for (ch = 0U; ch < BenchChannels; ch++)
+  {
+    psrc[ch] = BenchPcm[ch];
+  }
+
+  VOICE_Mix(BenchOut[0], psrc, BenchGain, BenchChannels, BENCH_SAMPLES);
+}
+
+__attribute__((noinline)) static void Fast_MixMinus(void)
+{
+  const int16_t *psrc[VOICE_MAX_PORTS];
+  int16_t *pdst[VOICE_MAX_PORTS];
+  uint32_t ch;
+
+  for (ch = 0U; ch < BenchChannels; ch++)
+  {
+    psrc[ch] = BenchPcm[ch];
+    pdst[ch] = BenchOut[ch];
+  }
+
+  VOICE_MixMinus(pdst, psrc, BenchGain, BenchChannels, BENCH_SAMPLES);
+}
+
+/**
+  * @brief  Best of BENCH_REPEAT runs of a kernel.
+  * @param  kernel: Kernel
+  * @retval Cycles
+  */
+static double Bench_Time(Bench_KernelTypeDef kernel)
+{
+  uint64_t best = UINT64_MAX;
+  uint64_t start;
+  uint64_t cycles;
+  uint32_t rep;
+
+  for (rep = 0U; rep < BENCH_REPEAT; rep++)
+  {
+    start = Bench_GetCycles();
+    kernel();
+    cycles = Bench_GetCycles() - start;
+
+    if (cycles < best)
+    {
+      best = cycles;
+    }
+  }
+
+  return (double)best;
+}
+
+/**
+  * @brief  Time a kernel against its naive version and print the result.
+  * @param  name: Kernel name
+  * @param  naive: Naive version
+  * @param  fast: usb_voice.c version
+  * @param  mismatches: Outputs differing between the two
+  * @param  samples: Samples per run
+  * @retval None
+  */
+static void Bench_Report(const char *name, Bench_KernelTypeDef naive, Bench_KernelTypeDef fast,
+                         uint32_t mismatches, uint32_t samples)
+{
+  double naive_cycles = Bench_Time(naive);
+  double fast_cycles = Bench_Time(fast);
+
+  printf("{\"kernel\":\"%s\",\"channels\":%u,\"samples\":%u,\"mismatches\":%u,"
+         "\"naive_cycles_per_sample\":%.3f,\"cycles_per_sample\":%.3f,\"speedup\":%.2f}\n",
+         name, (unsigned int)BenchChannels, (unsigned int)samples, (unsigned int)mismatches,
+         naive_cycles / samples, fast_cycles / samples, naive_cycles / fast_cycles);
+}
+
+/**
+  * @brief  Count the samples differing between BenchOut and BenchRef.
+  */
+static uint32_t Bench_ComparePcm(uint32_t channels)
+{
+  uint32_t mismatches = 0U;
+  uint32_t ch;
+  uint32_t n;
+
+  for (ch = 0U; ch < channels; ch++)
+  {
+    for (n = 0U; n < BENCH_SAMPLES; n++)
+    {
+      mismatches += (BenchOut[ch][n] != BenchRef[ch][n]) ? 1U : 0U;
+    }
+  }
+
+  return mismatches;
+}
+
+/**
+  * @brief  Count the codes differing between BenchCodes and BenchCodesRef.
+  */
+static uint32_t Bench_CompareCodes(void)
+{
+  uint32_t mismatches = 0U;
+  uint32_t n;
+
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    mismatches += (BenchCodes[n] != BenchCodesRef[n]) ? 1U : 0U;
+  }
+
+  return mismatches;
+}
+
+/**
+  * @brief  Benchmark entry point.
+  * @retval 0 when every kernel matches its naive version
+  */
+int main(void)
+{
+  static const uint32_t channels[] = { 2U, 3U, 4U, VOICE_MAX_PORTS };
+  static const int16_t gains[] = { VOICE_GAIN_UNITY, VOICE_GAIN_UNITY / 2, 3 * VOICE_GAIN_UNITY,
+                                   -VOICE_GAIN_UNITY, 32767, -32768 };
+  uint32_t failures = 0U;
+  uint32_t mismatches;
+  uint32_t idx;
+  uint32_t ch;
+  uint32_t n;
+
+  VOICE_Init();
+
+  printf("{\"bench\":\"usb_voice\",\"path\":\"%s\",\"cycle_unit\":\"%s\"}\n", BENCH_PATH, BENCH_CYCLE_UNIT);
+
+  /* Every 16-bit value once in channel 0, speech-like noise in the others */
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    BenchPcm[0][n] = (int16_t)(uint16_t)((n * 40503U) & 0xFFFFU);
+    BenchCodes[n] = (uint8_t)n;
+  }
+
+  for (ch = 1U; ch < VOICE_MAX_PORTS; ch++)
+  {
+    for (n = 0U; n < BENCH_SAMPLES; n++)
+    {
+      BenchPcm[ch][n] = (int16_t)((int32_t)(Bench_Random() & 0x3FFFU) - 0x2000);
+    }
+  }
+
+  BenchChannels = 1U;
+
+  Naive_UlawToPcm();
+  Fast_UlawToPcm();
+  mismatches = Bench_ComparePcm(1U);
+  failures += mismatches;
+  Bench_Report("ulaw_to_pcm", Naive_UlawToPcm, Fast_UlawToPcm, mismatches, BENCH_SAMPLES);
+
+  Naive_AlawToPcm();
+  Fast_AlawToPcm();
+  mismatches = Bench_ComparePcm(1U);
+  failures += mismatches;
+  Bench_Report("alaw_to_pcm", Naive_AlawToPcm, Fast_AlawToPcm, mismatches, BENCH_SAMPLES);
+
+  Naive_PcmToUlaw();
+  Fast_PcmToUlaw();
+  mismatches = Bench_CompareCodes();
+  failures += mismatches;
+  Bench_Report("pcm_to_ulaw", Naive_PcmToUlaw, Fast_PcmToUlaw, mismatches, BENCH_SAMPLES);
+
+  Naive_PcmToAlaw();
+  Fast_PcmToAlaw();
+  mismatches = Bench_CompareCodes();
+  failures += mismatches;
+  Bench_Report("pcm_to_alaw", Naive_PcmToAlaw, Fast_PcmToAlaw, mismatches, BENCH_SAMPLES);
+
+  /* Gains at the ends of the Q4.12 range saturate and round towards -inf */
+  mismatches = 0U;
+  for (idx = 0U; idx < (sizeof(gains) / sizeof(gains[0])); idx++)
+  {
+    BenchGain[0] = gains[idx];
+    Naive_Gain();
+    Fast_Gain();
+    mismatches += Bench_ComparePcm(1U);
+  }
+  failures += mismatches;
+  BenchGain[0] = 3 * VOICE_GAIN_UNITY;
+  Bench_Report("gain", Naive_Gain, Fast_Gain, mismatches, BENCH_SAMPLES);
+
+  for (idx = 0U; idx < (sizeof(channels) / sizeof(channels[0])); idx++)
+  {
+    BenchChannels = channels[idx];
+
+    for (ch = 0U; ch < BenchChannels; ch++)
+    {
+      BenchGain[ch] = gains[(ch + idx) % (sizeof(gains) / sizeof(gains[0]))];
+    }
+
+    Naive_Mix();
+    Fast_Mix();
+    mismatches = Bench_ComparePcm(1U);
+    failures += mismatches;
+    Bench_Report("mix", Naive_Mix, Fast_Mix, mismatches, BENCH_SAMPLES);
+
+    Naive_MixMinus();
+    Fast_MixMinus();
+    mismatches = Bench_ComparePcm(BenchChannels);
+    failures += mismatches;
+    Bench_Report("mix_minus", Naive_MixMinus, Fast_MixMinus, mismatches, BENCH_SAMPLES);
+  }
+
+  if (failures != 0U)
+  {
+    fprintf(stderr, "voice bench: %u mismatches\n", (unsigned int)failures);
+    return 1;
+  }
+
+  return 0;
+}
@@ -22,6 +22,9 @@
 #include "usbh_core.h"
 
 /* USER CODE BEGIN Includes */
+#include "usbh_cdc.h"
+#include "usbh_hub.h"
+#include "usbh_audio.h"
 
 /* USER CODE END Includes */
 
@@ -31,7 +34,28 @@
 
 /* USER CODE BEGIN PV */
 /* Private variables ---------------------------------------------------------*/
+#if (USBH_USE_DMA == 1U)
+/* MPU region covering the RW_NONCACHEABLE section; must match
+   __RAM_NONCACHEABLEBUFFER_SIZE in the STM32H7S3L8HX_*_app.ld scripts,
+   which place it on a multiple of its size (ASSERT in each script, and
+   checked against the linker symbols by USBH_DMA_MPU_Config()). */
+#define USBH_DMA_MPU_REGION_NUMBER      MPU_REGION_NUMBER15
+#define USBH_DMA_MPU_REGION_SIZE        MPU_REGION_SIZE_16KB
+#define USBH_DMA_MPU_REGION_BYTES       0x4000U
+#define USBH_DMA_CACHE_LINE             32U
+
+#if ((USBH_DMA_POOL_NUM_BLOCKS * USBH_DMA_POOL_BLOCK_SIZE) > USBH_DMA_MPU_REGION_BYTES)
+#error "USBH DMA pool does not fit in the non-cacheable region"
+#endif
+
+extern uint8_t __NONCACHEABLEBUFFER_BEGIN[];
+extern uint8_t __NONCACHEABLEBUFFER_END[];
+extern uint8_t __RAM_NONCACHEABLEBUFFER_SIZE[];   /* Linker constant, its address is the value */
 
+/* Cacheable IN buffers in flight, invalidated when their URB completes */
+static uint8_t *USBH_DMA_InBuff[16];
+static uint32_t USBH_DMA_InLength[16];
+#endif /* (USBH_USE_DMA == 1U) */
 /* USER CODE END PV */
 
 HCD_HandleTypeDef hhcd_USB_OTG_HS;
@@ -43,13 +67,70 @@ HCD_HandleTypeDef hhcd_USB_OTG_HS;
 /* USER CODE BEGIN PFP */
 /* Private function prototypes -----------------------------------------------*/
 USBH_StatusTypeDef USBH_Get_USB_Status(HAL_StatusTypeDef hal_status);
+#if (USBH_USE_DMA == 1U)
+static void USBH_DMA_MPU_Config(void);
+static void USBH_DMA_CacheRange(uint8_t *pbuff, uint32_t length, uint32_t *addr, int32_t *size);
+#endif /* (USBH_USE_DMA == 1U) */
 
 /* USER CODE END PFP */
 
 /* Private functions ---------------------------------------------------------*/
 
 /* USER CODE BEGIN 1 */
+#if (USBH_USE_DMA == 1U)
+/**
+  * @brief  Map the RW_NONCACHEABLE section as non-cacheable, shareable memory.
+  * @note   Stops in Error_Handler() if the linker script region does not
+  *         match the MPU region: the pool would be cached past its end.
+  * @retval None
+  */
+static void USBH_DMA_MPU_Config(void)
+{
+  MPU_Region_InitTypeDef MPU_InitStruct = {0};
+  uint32_t base = (uint32_t)__NONCACHEABLEBUFFER_BEGIN;
+
+  if (((uint32_t)__RAM_NONCACHEABLEBUFFER_SIZE != USBH_DMA_MPU_REGION_BYTES) ||
+      ((base & (USBH_DMA_MPU_REGION_BYTES - 1U)) != 0U) ||
+      (((uint32_t)__NONCACHEABLEBUFFER_END - base) > USBH_DMA_MPU_REGION_BYTES))
+  {
+    Error_Handler();
+  }
 
+  HAL_MPU_Disable();
+
+  MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+  MPU_InitStruct.Number = USBH_DMA_MPU_REGION_NUMBER;
+  MPU_InitStruct.BaseAddress = base;
+  MPU_InitStruct.Size = USBH_DMA_MPU_REGION_SIZE;
+  MPU_InitStruct.SubRegionDisable = 0x0U;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_SHAREABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+}
+
+/**
+  * @brief  Widen a buffer to whole D-cache lines for maintenance operations.
+  * @param  pbuff: buffer start
+  * @param  length: buffer length
+  * @param  addr: line aligned start address
+  * @param  size: line aligned size
+  * @retval None
+  */
+static void USBH_DMA_CacheRange(uint8_t *pbuff, uint32_t length, uint32_t *addr, int32_t *size)
+{
+  uint32_t start = (uint32_t)pbuff & ~(USBH_DMA_CACHE_LINE - 1U);
+  uint32_t end = ((uint32_t)pbuff + length + USBH_DMA_CACHE_LINE - 1U) & ~(USBH_DMA_CACHE_LINE - 1U);
+
+  *addr = start;
+  *size = (int32_t)(end - start);
+}
+#endif /* (USBH_USE_DMA == 1U) */
 /* USER CODE END 1 */
 
 /*******************************************************************************
@@ -151,8 +232,36 @@ void HAL_HCD_Disconnect_Callback(HCD_HandleTypeDef *hhcd)
   */
 void HAL_HCD_HC_NotifyURBChange_Callback(HCD_HandleTypeDef *hhcd, uint8_t chnum, HCD_URBStateTypeDef urb_state)
 {
-  /* To be used with OS to sync URB state with the global state machine */
-#if (USBH_USE_OS == 1)
+  uint32_t count;
+
+  /* The OUT byte count is only kept for a NAK halting the channel */
+  if (hhcd->hc[chnum].ep_is_in != 0U)
+  {
+    count = hhcd->hc[chnum].xfer_count;
+  }
+  else
+  {
+    count = (urb_state == URB_DONE) ? hhcd->hc[chnum].xfer_len : USBH_LL_GetOutXferCount(hhcd->pData, chnum);
+  }
+
+  USBH_LL_PipeCompleted(hhcd->pData, chnum, (USBH_URBStateTypeDef)urb_state, count);
+
+#if (USBH_USE_DMA == 1U)
+  /* Drop stale lines over a cacheable IN buffer now that the DMA is done with it,
+     whatever the outcome: a halted transfer may have written part of it */
+  if ((urb_state != URB_IDLE) && (USBH_DMA_InBuff[chnum] != NULL))
+  {
+    uint32_t addr;
+    int32_t size;
+
+    USBH_DMA_CacheRange(USBH_DMA_InBuff[chnum], USBH_DMA_InLength[chnum], &addr, &size);
+    SCB_InvalidateDCache_by_Addr((uint32_t *)addr, size);
+    USBH_DMA_InBuff[chnum] = NULL;
+  }
+#endif /* (USBH_USE_DMA == 1U) */
+
+  /* To be used with OS or event mode to sync URB state with the global state machine */
+#if (USBH_USE_OS == 1) || (USBH_USE_EVENTS == 1U)
   USBH_LL_NotifyURBChange(hhcd->pData);
 #endif
 }
@@ -196,7 +305,12 @@ USBH_StatusTypeDef USBH_LL_Init(USBH_HandleTypeDef *phost)
   hhcd_USB_OTG_HS.Instance = USB_OTG_HS;
   hhcd_USB_OTG_HS.Init.Host_channels = 16;
   hhcd_USB_OTG_HS.Init.speed = HCD_SPEED_HIGH;
+#if (USBH_USE_DMA == 1U)
+  hhcd_USB_OTG_HS.Init.dma_enable = ENABLE;
+  USBH_DMA_MPU_Config();
+#else
   hhcd_USB_OTG_HS.Init.dma_enable = DISABLE;
+#endif /* (USBH_USE_DMA == 1U) */
   hhcd_USB_OTG_HS.Init.phy_itface = USB_OTG_HS_EMBEDDED_PHY;
   hhcd_USB_OTG_HS.Init.Sof_enable = DISABLE;
   hhcd_USB_OTG_HS.Init.low_power_enable = DISABLE;
@@ -207,6 +321,19 @@ USBH_StatusTypeDef USBH_LL_Init(USBH_HandleTypeDef *phost)
   }
 
   USBH_LL_SetTimer(phost, HAL_HCD_GetCurrentFrame(&hhcd_USB_OTG_HS));
+
+#if (USBH_USE_URB_TRACE == 1U)
+  /* Start the DWT cycle counter, left running for other users */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+#if (USBH_USE_ENUM_CACHE == 1U) && (USBH_ENUM_CACHE_BKPSRAM == 1U)
+  /* The enumeration cache lives in the backup SRAM */
+  HAL_PWR_EnableBkUpAccess();
+  __HAL_RCC_BKPRAM_CLK_ENABLE();
+#endif /* (USBH_USE_ENUM_CACHE == 1U) && (USBH_ENUM_CACHE_BKPSRAM == 1U) */
   }
   return USBH_OK;
 }
@@ -309,6 +436,37 @@ USBH_StatusTypeDef USBH_LL_ResetPort(USBH_HandleTypeDef *phost)
   return usb_status;
 }
 
+/**
+  * @brief  Drive the Host port reset without waiting; the caller times
+  *         the reset pulse.
+  * @param  phost: Host handle
+  * @param  state: 1 to assert the reset, 0 to release it
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_ResetPort2(USBH_HandleTypeDef *phost, uint8_t state)
+{
+  HCD_HandleTypeDef *pHandle = phost->pData;
+  uint32_t USBx_BASE = (uint32_t)pHandle->Instance;
+  __IO uint32_t hprt0;
+
+  hprt0 = USBx_HPRT0;
+
+  /* Do not clear the write-1-to-clear status bits */
+  hprt0 &= ~(USB_OTG_HPRT_PENA | USB_OTG_HPRT_PCDET |
+             USB_OTG_HPRT_PENCHNG | USB_OTG_HPRT_POCCHNG);
+
+  if (state != 0U)
+  {
+    USBx_HPRT0 = (USB_OTG_HPRT_PRST | hprt0);
+  }
+  else
+  {
+    USBx_HPRT0 = ((~USB_OTG_HPRT_PRST) & hprt0);
+  }
+
+  return USBH_OK;
+}
+
 /**
   * @brief  Return the last transferred packet size.
   * @param  phost: Host handle
@@ -320,6 +478,60 @@ uint32_t USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost, uint8_t pipe)
   return HAL_HCD_HC_GetXferCount(phost->pData, pipe);
 }
 
+/**
+  * @brief  Return the number of bytes acknowledged on a halted OUT pipe.
+  *         A multi-packet DMA transfer can be cut short by a NAK; the packets
+  *         sent before it must not be sent again, and the data toggle is
+  *         resynchronised with the PID the channel stopped on.
+  * @param  phost: Host handle
+  * @param  pipe: Pipe index
+  * @retval Acknowledged byte count
+  */
+uint32_t USBH_LL_GetOutXferCount(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+  HCD_HandleTypeDef *pHandle = phost->pData;
+  uint32_t USBx_BASE = (uint32_t)pHandle->Instance;
+  uint32_t hctsiz;
+  uint32_t num_packets;
+  uint32_t pkt_left;
+  uint32_t count;
+
+  if ((pHandle->Init.dma_enable == 0U) || (pHandle->hc[pipe].ep_is_in != 0U) ||
+      (pHandle->hc[pipe].xfer_len == 0U) || (pHandle->hc[pipe].max_packet == 0U))
+  {
+    return 0U;
+  }
+
+  hctsiz = USBx_HC((uint32_t)pipe)->HCTSIZ;
+
+  num_packets = (pHandle->hc[pipe].xfer_len + pHandle->hc[pipe].max_packet - 1U) /
+                pHandle->hc[pipe].max_packet;
+
+  if (num_packets > HC_MAX_PKT_CNT)
+  {
+    num_packets = HC_MAX_PKT_CNT;
+  }
+
+  pkt_left = (hctsiz & USB_OTG_HCTSIZ_PKTCNT) >> USB_OTG_HCTSIZ_PKTCNT_Pos;
+
+  if (pkt_left > num_packets)
+  {
+    pkt_left = num_packets;
+  }
+
+  count = (num_packets - pkt_left) * pHandle->hc[pipe].max_packet;
+
+  if (count > pHandle->hc[pipe].xfer_len)
+  {
+    count = pHandle->hc[pipe].xfer_len;
+  }
+
+  /* DPID reads 2 (DATA1) or 0 (DATA0) for the next packet */
+  pHandle->hc[pipe].toggle_out = (((hctsiz & USB_OTG_HCTSIZ_DPID) >> USB_OTG_HCTSIZ_DPID_Pos) == 2U) ? 1U : 0U;
+
+  return count;
+}
+
 /**
   * @brief  Open a pipe of the low level driver.
   * @param  phost: Host handle
@@ -340,6 +552,15 @@ USBH_StatusTypeDef USBH_LL_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num,
   hal_status = HAL_HCD_HC_Init(phost->pData, pipe_num, epnum,
                                dev_address, speed, ep_type, mps);
 
+  /* Devices behind a hub: HC_Init clears the hub info, restore it so that
+     LS/FS devices behind a HS hub are reached through split transactions */
+  if ((hal_status == HAL_OK) && (phost->device.hub_address != 0U))
+  {
+    hal_status = HAL_HCD_HC_SetHubInfo(phost->pData, pipe_num,
+                                       phost->device.hub_address,
+                                       phost->device.hub_port);
+  }
+
   usb_status = USBH_Get_USB_Status(hal_status);
 
   return usb_status;
@@ -397,6 +618,41 @@ USBH_StatusTypeDef USBH_LL_SubmitURB(USBH_HandleTypeDef *phost, uint8_t pipe, ui
   HAL_StatusTypeDef hal_status = HAL_OK;
   USBH_StatusTypeDef usb_status = USBH_OK;
 
+#if (USBH_USE_DMA == 1U)
+  /* Only a cacheable IN buffer of this URB may be invalidated on completion */
+  USBH_DMA_InBuff[pipe] = NULL;
+
+  /* Pool buffers are non-cacheable; anything else needs cache maintenance */
+  if ((length != 0U) && (USBH_DMA_IsPoolBuffer(pbuff) == 0U) && ((SCB->CCR & SCB_CCR_DC_Msk) != 0U))
+  {
+    HCD_HandleTypeDef *pHandle = phost->pData;
+    uint32_t xfer_len = length;
+    uint32_t addr;
+    int32_t size;
+
+    if (direction != 0U)
+    {
+      /* The core rounds IN transfers up to whole max-packets */
+      xfer_len = ((xfer_len + pHandle->hc[pipe].max_packet - 1U) / pHandle->hc[pipe].max_packet) *
+                 pHandle->hc[pipe].max_packet;
+    }
+
+    USBH_DMA_CacheRange(pbuff, xfer_len, &addr, &size);
+
+    if (direction == 0U)
+    {
+      SCB_CleanDCache_by_Addr((uint32_t *)addr, size);
+    }
+    else
+    {
+      /* Write back dirty neighbours so that no eviction lands over the DMA data */
+      SCB_CleanInvalidateDCache_by_Addr((uint32_t *)addr, size);
+      USBH_DMA_InBuff[pipe] = pbuff;
+      USBH_DMA_InLength[pipe] = xfer_len;
+    }
+  }
+#endif /* (USBH_USE_DMA == 1U) */
+
   hal_status = HAL_HCD_HC_SubmitRequest(phost->pData, pipe, direction ,
                                         ep_type, token, pbuff, length,
                                         do_ping);
@@ -421,9 +677,35 @@ USBH_StatusTypeDef USBH_LL_SubmitURB(USBH_HandleTypeDef *phost, uint8_t pipe, ui
   */
 USBH_URBStateTypeDef USBH_LL_GetURBState(USBH_HandleTypeDef *phost, uint8_t pipe)
 {
+#if (USBH_USE_URB_TRACE == 1U)
+  USBH_URBStateTypeDef state = (USBH_URBStateTypeDef)HAL_HCD_HC_GetURBState(phost->pData, pipe);
+
+  /* The class sees the completion now */
+  if (state == USBH_URB_DONE)
+  {
+    USBH_LL_PipeObserved(phost, pipe);
+  }
+
+  return state;
+#else
   return (USBH_URBStateTypeDef)HAL_HCD_HC_GetURBState (phost->pData, pipe);
+#endif /* (USBH_USE_URB_TRACE == 1U) */
 }
 
+#if (USBH_USE_URB_TRACE == 1U)
+/**
+  * @brief  Read the DWT cycle counter stamping the URB latencies.
+  * @param  phost: Host handle
+  * @retval Core clock cycles
+  */
+uint32_t USBH_LL_GetCycles(USBH_HandleTypeDef *phost)
+{
+  UNUSED(phost);
+
+  return DWT->CYCCNT;
+}
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
 /**
   * @brief  Drive VBUS.
   * @param  phost: Host handle
@@ -459,7 +741,7 @@ USBH_StatusTypeDef USBH_LL_DriverVBUS(USBH_HandleTypeDef *phost, uint8_t state)
       /* USER CODE END DRIVE_LOW_CHARGE_FOR_HS */
     }
   }
-  HAL_Delay(200);
+  /* VBUS settling is covered by the connection debounce in USBH_Process */
   return USBH_OK;
 }
 
@@ -520,6 +802,15 @@ void USBH_Delay(uint32_t Delay)
   HAL_Delay(Delay);
 }
 
+/**
+  * @brief  Millisecond tick for the USB Host Library deadlines
+  * @retval Tick in ms
+  */
+uint32_t USBH_GetTick(void)
+{
+  return HAL_GetTick();
+}
+
 /**
   * @brief  Returns the USB status depending on the HAL status:
   * @param  hal_status: HAL status
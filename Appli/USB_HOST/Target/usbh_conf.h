@@ -74,10 +74,10 @@
 #define USBH_KEEP_CFG_DESCRIPTOR      1U
 
 /*----------   -----------*/
-#define USBH_MAX_NUM_SUPPORTED_CLASS      1U
+#define USBH_MAX_NUM_SUPPORTED_CLASS      3U
 
 /*----------   -----------*/
-#define USBH_MAX_SIZE_CONFIGURATION      256U
+#define USBH_MAX_SIZE_CONFIGURATION      512U
 
 /*----------   -----------*/
 #define USBH_MAX_DATA_BUFFER      512U
@@ -88,6 +88,65 @@
 /*----------   -----------*/
 #define USBH_USE_OS      0U
 
+/*----------   -----------*/
+#define USBH_USE_EVENTS      1U
+
+/*----------   -----------*/
+#define USBH_EVENT_QUEUE_SIZE      16U
+
+/*----------   -----------*/
+#define USBH_USE_DMA      1U
+
+/*----------   -----------*/
+#define USBH_DMA_POOL_BLOCK_SIZE      512U
+
+/*----------   -----------*/
+/* Hub port devices share the 16 host channels of the OTG_HS core with the
+   hub: 2 go to the root control pipes and 1 to the hub status change
+   endpoint, leaving 13. A port device takes 2 for its control pipes plus
+   3 for a CDC ACM function or 5 for the UAC2 headset, so 2 ports are served:
+   two CDC devices, or a CDC device and the headset. Higher hub ports are
+   left unpowered. */
+#define USBH_HUB_MAX_PORTS      2U
+
+/*----------   -----------*/
+/* DMA pool blocks held by one allocation of a given size */
+#define USBH_DMA_POOL_BLOCKS(size)    (((size) + USBH_DMA_POOL_BLOCK_SIZE - 1U) / USBH_DMA_POOL_BLOCK_SIZE)
+
+/* A hub: its status change buffer */
+#define USBH_DMA_POOL_HUB_BLOCKS      USBH_DMA_POOL_BLOCKS(USBH_HUB_BUFF_SIZE)
+
+/* A streaming CDC ACM device: transmit ring, notification buffer behind a
+   64-byte packet, receive stream buffers */
+#define USBH_DMA_POOL_CDC_BLOCKS      (USBH_DMA_POOL_BLOCKS(USBH_CDC_TX_RING_SIZE) + \
+                                       USBH_DMA_POOL_BLOCKS(USBH_CDC_NOTIF_BUFFER_SIZE + 64U) + \
+                                       (USBH_CDC_RX_STREAM_NUM_BUFFERS * \
+                                        USBH_DMA_POOL_BLOCKS(USBH_CDC_RX_STREAM_BUFFER_SIZE)))
+
+/* A UAC2 headset: one packet slot and its feedback word per direction */
+#define USBH_DMA_POOL_AUDIO_BLOCKS    (2U * USBH_DMA_POOL_BLOCKS(USBH_AUDIO_MAX_PACKET_SIZE + 32U))
+
+/* A hub with the largest function on each of its ports */
+#define USBH_DMA_POOL_NUM_BLOCKS      (USBH_DMA_POOL_HUB_BLOCKS + (USBH_HUB_MAX_PORTS * \
+                                       MAX(USBH_DMA_POOL_CDC_BLOCKS, USBH_DMA_POOL_AUDIO_BLOCKS)))
+
+/*----------   -----------*/
+#define USBH_USE_CTL_CHAIN      1U
+
+/*----------   -----------*/
+#define USBH_USE_URB_TRACE      0U
+
+/* Off: a cache hit only saves the control transfers of an attach, well under
+   a millisecond at high speed against the ~400 ms of bus timings every attach
+   waits out, and costs a configuration descriptor copy per entry */
+#define USBH_USE_ENUM_CACHE      0U
+
+/*----------   -----------*/
+#define USBH_ENUM_CACHE_ENTRIES      4U
+
+/*----------   -----------*/
+#define USBH_ENUM_CACHE_BKPSRAM      0U
+
 /****************************************/
 /* #define for FS and HS identification */
 #define HOST_HS 		0
@@ -110,11 +169,11 @@
 
 /* Memory management macros */
 
-/** Alias for memory allocation. */
-#define USBH_malloc         malloc
+/** Alias for memory allocation from the static class pool. */
+#define USBH_malloc         USBH_Pool_Alloc
 
-/** Alias for memory release. */
-#define USBH_free           free
+/** Alias for memory release to the static class pool. */
+#define USBH_free           USBH_Pool_Free
 
 /** Alias for memory set. */
 #define USBH_memset         memset
@@ -122,6 +181,15 @@
 /** Alias for memory copy. */
 #define USBH_memcpy         memcpy
 
+/** Alias for memory compare. */
+#define USBH_memcmp         memcmp
+
+/** Alias for DMA-safe (non-cacheable) memory allocation. */
+#define USBH_dma_malloc     USBH_DMA_Alloc
+
+/** Alias for DMA-safe memory release. */
+#define USBH_dma_free       USBH_DMA_Free
+
 /* DEBUG macros */
 
 #if (USBH_DEBUG_LEVEL > 0U)
@@ -174,6 +242,33 @@
 
 /* Exported functions -------------------------------------------------------*/
 
+/** @brief Allocate a class data block from the static pool. */
+void    *USBH_Pool_Alloc(uint32_t size);
+
+/** @brief Release a block obtained with USBH_Pool_Alloc. */
+void     USBH_Pool_Free(void *ptr);
+
+/** @brief Return the number of class pool blocks currently allocated. */
+uint32_t USBH_Pool_GetUsedBlocks(void);
+
+/** @brief Return the highest number of class pool blocks allocated at once. */
+uint32_t USBH_Pool_GetPeakBlocks(void);
+
+/** @brief Return the number of class pool requests that could not be served. */
+uint32_t USBH_Pool_GetFailCount(void);
+
+/** @brief Allocate a DMA-safe buffer from the non-cacheable pool. */
+void    *USBH_DMA_Alloc(uint32_t size);
+
+/** @brief Release a buffer obtained with USBH_DMA_Alloc. */
+void     USBH_DMA_Free(void *ptr);
+
+/** @brief Return 1 when ptr lies in the non-cacheable pool. */
+uint8_t  USBH_DMA_IsPoolBuffer(const void *ptr);
+
+/** @brief Return the number of pool blocks currently allocated. */
+uint32_t USBH_DMA_GetUsedBlocks(void);
+
 /**
   * @}
   */
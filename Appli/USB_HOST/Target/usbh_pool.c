@@ -0,0 +1,290 @@
+/**
+  ******************************************************************************
+  * @file           : Target/usbh_pool.c
+  * @brief          : Static pools behind USBH_malloc and USBH_dma_malloc,
+  *                   shared by the target and the host (Sim) builds
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+#include "usbh_cdc.h"
+#include "usbh_hub.h"
+#include "usbh_audio.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Class data pool behind USBH_malloc: one block per interface of each class,
+   plus one class handle per hub port device. Without the OTG DMA the hub
+   buffer and the CDC ring and stream buffers of every device come from it too.
+   The hub handle holds the host handles of its port devices: it takes a
+   block of its own, sized for it, one hub being served at a time. */
+#define USBH_POOL_HANDLE_SIZE     ((sizeof(CDC_HandleTypeDef) > sizeof(AUDIO_HandleTypeDef)) ? \
+                                   sizeof(CDC_HandleTypeDef) : sizeof(AUDIO_HandleTypeDef))
+#define USBH_POOL_HUB_SIZE        sizeof(HUB_HandleTypeDef)
+#if (USBH_USE_DMA == 1U)
+#define USBH_POOL_BLOCK_SIZE      USBH_POOL_HANDLE_SIZE
+#define USBH_POOL_NUM_BLOCKS      ((USBH_MAX_NUM_SUPPORTED_CLASS * USBH_MAX_NUM_INTERFACES) + \
+                                   USBH_HUB_MAX_PORTS)
+#else
+#define USBH_POOL_BLOCK_SIZE      ((USBH_POOL_HANDLE_SIZE > USBH_CDC_TX_RING_SIZE) ? \
+                                   USBH_POOL_HANDLE_SIZE : USBH_CDC_TX_RING_SIZE)
+#define USBH_POOL_NUM_BLOCKS      ((USBH_MAX_NUM_SUPPORTED_CLASS * USBH_MAX_NUM_INTERFACES) + \
+                                   USBH_HUB_MAX_PORTS + 1U + \
+                                   ((1U + USBH_HUB_MAX_PORTS) * (1U + USBH_CDC_RX_STREAM_NUM_BUFFERS)))
+#endif /* (USBH_USE_DMA == 1U) */
+
+#if (USBH_POOL_NUM_BLOCKS > 32U)
+#error "USBH class pool is limited to 32 blocks"
+#endif
+
+#if (USBH_USE_DMA == 1U)
+/* Placement of the DMA pool: the non-cacheable section mapped by the MPU on
+   the target (see USBH_DMA_MPU_Config in usbh_conf.c) */
+#ifndef USBH_DMA_POOL_ATTRIBUTES
+#define USBH_DMA_POOL_ATTRIBUTES  __attribute__((section("noncacheable_buffer"), aligned(32U)))
+#endif /* USBH_DMA_POOL_ATTRIBUTES */
+
+#if (USBH_DMA_POOL_NUM_BLOCKS > 32U)
+#error "USBH DMA pool is limited to 32 blocks"
+#endif
+#endif /* (USBH_USE_DMA == 1U) */
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t USBH_Pool[USBH_POOL_NUM_BLOCKS][(USBH_POOL_BLOCK_SIZE + 3U) / 4U];
+
+/* Bit n set: pool block n is allocated */
+static uint32_t USBH_PoolMap;
+static uint32_t USBH_PoolPeak;
+static uint32_t USBH_PoolFail;
+
+/* Hub handle block, allocated when USBH_PoolHubUsed is 1 */
+static uint32_t USBH_PoolHub[(USBH_POOL_HUB_SIZE + 3U) / 4U];
+static uint32_t USBH_PoolHubUsed;
+
+#if (USBH_USE_DMA == 1U)
+/* URB buffers for the OTG DMA */
+static uint8_t USBH_DMA_Pool[USBH_DMA_POOL_NUM_BLOCKS][USBH_DMA_POOL_BLOCK_SIZE] USBH_DMA_POOL_ATTRIBUTES;
+
+/* Bit n set: pool block n is allocated */
+static uint32_t USBH_DMA_PoolMap;
+
+/* Number of blocks owned by the allocation starting at block n */
+static uint8_t USBH_DMA_PoolRun[USBH_DMA_POOL_NUM_BLOCKS];
+#endif /* (USBH_USE_DMA == 1U) */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Allocate a class data block from the static pool in O(1).
+  *         Safe to call from thread and interrupt context.
+  * @param  size: requested size in bytes, at most one block, or the size of
+  *         the hub handle
+  * @retval Block address, word aligned, or NULL if the pool is exhausted
+  */
+void *USBH_Pool_Alloc(uint32_t size)
+{
+  void *pbuff = NULL;
+  uint32_t free_map;
+  uint32_t idx;
+  uint32_t used;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  free_map = ~USBH_PoolMap & ((USBH_POOL_NUM_BLOCKS == 32U) ? 0xFFFFFFFFU : ((1UL << USBH_POOL_NUM_BLOCKS) - 1U));
+
+  if ((size > sizeof(USBH_Pool[0])) && (size <= sizeof(USBH_PoolHub)) && (USBH_PoolHubUsed == 0U))
+  {
+    USBH_PoolHubUsed = 1U;
+    pbuff = USBH_PoolHub;
+  }
+  else if ((size == 0U) || (size > sizeof(USBH_Pool[0])) || (free_map == 0U))
+  {
+    USBH_PoolFail++;
+  }
+  else
+  {
+    idx = (uint32_t)__builtin_ctz(free_map);
+    USBH_PoolMap |= (1UL << idx);
+    pbuff = USBH_Pool[idx];
+  }
+
+  if (pbuff != NULL)
+  {
+    used = (uint32_t)__builtin_popcount(USBH_PoolMap) + USBH_PoolHubUsed;
+    if (used > USBH_PoolPeak)
+    {
+      USBH_PoolPeak = used;
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  return pbuff;
+}
+
+/**
+  * @brief  Release a block obtained with USBH_Pool_Alloc.
+  * @param  ptr: block address, NULL is ignored
+  * @retval None
+  */
+void USBH_Pool_Free(void *ptr)
+{
+  uintptr_t addr = (uintptr_t)ptr;
+  uintptr_t base = (uintptr_t)USBH_Pool;
+  uint32_t idx;
+  uint32_t primask;
+
+  if (ptr == (void *)USBH_PoolHub)
+  {
+    USBH_PoolHubUsed = 0U;
+    return;
+  }
+
+  if ((addr < base) || (addr >= (base + sizeof(USBH_Pool))))
+  {
+    return;
+  }
+
+  idx = (uint32_t)((addr - base) / sizeof(USBH_Pool[0]));
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  USBH_PoolMap &= ~(1UL << idx);
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Return the number of class pool blocks currently allocated,
+  *         the hub handle block included.
+  * @retval Allocated block count
+  */
+uint32_t USBH_Pool_GetUsedBlocks(void)
+{
+  return (uint32_t)__builtin_popcount(USBH_PoolMap) + USBH_PoolHubUsed;
+}
+
+/**
+  * @brief  Return the highest number of class pool blocks allocated at once.
+  * @retval Peak block count
+  */
+uint32_t USBH_Pool_GetPeakBlocks(void)
+{
+  return USBH_PoolPeak;
+}
+
+/**
+  * @brief  Return the number of class pool requests that could not be served.
+  * @retval Failed allocation count
+  */
+uint32_t USBH_Pool_GetFailCount(void)
+{
+  return USBH_PoolFail;
+}
+
+#if (USBH_USE_DMA == 1U)
+/**
+  * @brief  Allocate a DMA-safe buffer from the non-cacheable pool.
+  *         Safe to call from thread and interrupt context.
+  * @param  size: requested size in bytes
+  * @retval Buffer address, 32-byte aligned, or NULL if the pool is exhausted
+  */
+void *USBH_DMA_Alloc(uint32_t size)
+{
+  void *pbuff = NULL;
+  uint32_t nblocks = (size + USBH_DMA_POOL_BLOCK_SIZE - 1U) / USBH_DMA_POOL_BLOCK_SIZE;
+  uint32_t mask;
+  uint32_t idx;
+  uint32_t primask;
+
+  if ((nblocks == 0U) || (nblocks > USBH_DMA_POOL_NUM_BLOCKS))
+  {
+    return NULL;
+  }
+
+  mask = (nblocks == 32U) ? 0xFFFFFFFFU : ((1UL << nblocks) - 1U);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  for (idx = 0U; idx <= (USBH_DMA_POOL_NUM_BLOCKS - nblocks); idx++)
+  {
+    if ((USBH_DMA_PoolMap & (mask << idx)) == 0U)
+    {
+      USBH_DMA_PoolMap |= (mask << idx);
+      USBH_DMA_PoolRun[idx] = (uint8_t)nblocks;
+      pbuff = USBH_DMA_Pool[idx];
+      break;
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  return pbuff;
+}
+
+/**
+  * @brief  Release a buffer obtained with USBH_DMA_Alloc.
+  * @param  ptr: buffer address, NULL is ignored
+  * @retval None
+  */
+void USBH_DMA_Free(void *ptr)
+{
+  uint32_t idx;
+  uint32_t nblocks;
+  uint32_t primask;
+
+  if (USBH_DMA_IsPoolBuffer(ptr) == 0U)
+  {
+    return;
+  }
+
+  idx = (uint32_t)(((uintptr_t)ptr - (uintptr_t)USBH_DMA_Pool) / USBH_DMA_POOL_BLOCK_SIZE);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  nblocks = USBH_DMA_PoolRun[idx];
+  if (nblocks != 0U)
+  {
+    USBH_DMA_PoolMap &= ~((((nblocks == 32U) ? 0xFFFFFFFFU : ((1UL << nblocks) - 1U))) << idx);
+    USBH_DMA_PoolRun[idx] = 0U;
+  }
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Check whether a buffer lies in the non-cacheable pool.
+  * @param  ptr: buffer address
+  * @retval 1 if the buffer belongs to the pool, 0 otherwise
+  */
+uint8_t USBH_DMA_IsPoolBuffer(const void *ptr)
+{
+  uintptr_t addr = (uintptr_t)ptr;
+  uintptr_t base = (uintptr_t)USBH_DMA_Pool;
+
+  return ((addr >= base) && (addr < (base + sizeof(USBH_DMA_Pool)))) ? 1U : 0U;
+}
+
+/**
+  * @brief  Return the number of pool blocks currently allocated.
+  * @retval Allocated block count
+  */
+uint32_t USBH_DMA_GetUsedBlocks(void)
+{
+  return (uint32_t)__builtin_popcount(USBH_DMA_PoolMap);
+}
+#endif /* (USBH_USE_DMA == 1U) */
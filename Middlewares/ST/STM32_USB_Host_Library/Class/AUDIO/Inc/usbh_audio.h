@@ -0,0 +1,314 @@
+/**
+  ******************************************************************************
+  * @file    usbh_audio.h
+  * @author  MCD Application Team
+  * @brief   This file contains all the prototypes for the usbh_audio.c
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2015 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive  ----------------------------------------------*/
+#ifndef __USBH_AUDIO_H
+#define __USBH_AUDIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+
+
+/** @addtogroup USBH_LIB
+  * @{
+  */
+
+/** @addtogroup USBH_CLASS
+  * @{
+  */
+
+/** @addtogroup USBH_AUDIO_CLASS
+  * @{
+  */
+
+/** @defgroup USBH_AUDIO_CORE
+  * @brief This file is the Header file for usbh_audio.c
+  * @{
+  */
+
+
+/* Audio Class codes */
+#define USB_AUDIO_CLASS                                         0x01U
+
+/* Audio sub class codes */
+#define AUDIO_SUBCLASS_AUDIOCONTROL                             0x01U
+#define AUDIO_SUBCLASS_AUDIOSTREAMING                           0x02U
+
+/* Audio interface protocol codes */
+#define AUDIO_PROTOCOL_UAC1                                     0x00U
+#define AUDIO_PROTOCOL_UAC2                                     0x20U
+
+/* Class specific descriptor types */
+#define AUDIO_CS_INTERFACE                                      0x24U
+#define AUDIO_CS_ENDPOINT                                       0x25U
+
+/* Audio control interface descriptor subtypes */
+#define AUDIO_AC_HEADER                                         0x01U
+#define AUDIO_AC_INPUT_TERMINAL                                 0x02U
+#define AUDIO_AC_OUTPUT_TERMINAL                                0x03U
+#define AUDIO_AC_CLOCK_SOURCE                                   0x0AU
+
+/* Audio streaming interface descriptor subtypes */
+#define AUDIO_AS_GENERAL                                        0x01U
+#define AUDIO_AS_FORMAT_TYPE                                    0x02U
+
+#define AUDIO_FORMAT_TYPE_I                                     0x01U
+
+/* Class specific requests: UAC1 SET_CUR, UAC2 CUR */
+#define AUDIO_REQ_SET_CUR                                       0x01U
+
+/* UAC1 endpoint and UAC2 clock source sampling frequency control */
+#define AUDIO_SAMPLING_FREQ_CONTROL                             0x01U
+
+/* Isochronous endpoint bmAttributes */
+#define AUDIO_EP_SYNC_MASK                                      0x0CU
+#define AUDIO_EP_SYNC_ASYNC                                     0x04U
+#define AUDIO_EP_USAGE_MASK                                     0x30U
+#define AUDIO_EP_USAGE_FEEDBACK                                 0x10U
+
+/* Streams of the function */
+#define AUDIO_PLAYBACK                                          0x00U
+#define AUDIO_CAPTURE                                           0x01U
+#define AUDIO_NUM_STREAMS                                       2U
+
+/* Largest isochronous packet of a stream, data endpoints above are skipped */
+#ifndef USBH_AUDIO_MAX_PACKET_SIZE
+#define USBH_AUDIO_MAX_PACKET_SIZE                              1024U
+#endif /* USBH_AUDIO_MAX_PACKET_SIZE */
+
+/* Jitter buffer bounds used until USBH_AUDIO_SetLatency is called */
+#ifndef USBH_AUDIO_MIN_LATENCY_MS
+#define USBH_AUDIO_MIN_LATENCY_MS                               4U
+#endif /* USBH_AUDIO_MIN_LATENCY_MS */
+
+#ifndef USBH_AUDIO_MAX_LATENCY_MS
+#define USBH_AUDIO_MAX_LATENCY_MS                               32U
+#endif /* USBH_AUDIO_MAX_LATENCY_MS */
+
+/* Fill level observation window of the latency trimming, in milliseconds
+   of audio consumed */
+#ifndef USBH_AUDIO_TRIM_WINDOW_MS
+#define USBH_AUDIO_TRIM_WINDOW_MS                               500U
+#endif /* USBH_AUDIO_TRIM_WINDOW_MS */
+
+/* Windows without underrun before the prefill target drops by 1 ms */
+#ifndef USBH_AUDIO_TRIM_QUIET_WINDOWS
+#define USBH_AUDIO_TRIM_QUIET_WINDOWS                           8U
+#endif /* USBH_AUDIO_TRIM_QUIET_WINDOWS */
+
+#if (USBH_AUDIO_MIN_LATENCY_MS == 0U) || (USBH_AUDIO_MAX_LATENCY_MS < USBH_AUDIO_MIN_LATENCY_MS)
+#error "USBH_AUDIO latency bounds must satisfy 0 < MIN <= MAX"
+#endif
+/**
+  * @}
+  */
+
+/** @defgroup USBH_AUDIO_CORE_Exported_Types
+  * @{
+  */
+
+/* PCM format of a stream, matched against the Type I alternate settings */
+typedef struct
+{
+  uint32_t                          SampleRate;       /* Hz */
+  uint8_t                           Channels;
+  uint8_t                           SubframeSize;     /* Bytes per sample: 1 to 4 */
+  uint8_t                           BitResolution;    /* 0 matches any */
+}
+AUDIO_FormatTypeDef;
+
+typedef struct
+{
+  uint32_t                          Packets;
+  uint32_t                          LateUrbs;         /* Packets not done by their next service slot */
+  uint32_t                          Underruns;        /* Silence inserted, the target grows by 1 ms */
+  uint32_t                          Overruns;         /* Writes beyond the latency bound, dropped */
+  uint32_t                          Slips;            /* Sample frames dropped to cut the latency */
+  uint32_t                          Level;            /* Bytes buffered */
+  uint32_t                          Target;           /* Prefill level in bytes */
+  uint32_t                          Feedback;         /* Device rate, Q16.16 samples per (micro)frame */
+}
+AUDIO_StatsTypeDef;
+
+typedef enum
+{
+  AUDIO_STREAM_IDLE = 0U,
+  AUDIO_STREAM_SET_INTERFACE,
+  AUDIO_STREAM_SET_FREQUENCY,
+  AUDIO_STREAM_OPEN,
+  AUDIO_STREAM_RUN,
+  AUDIO_STREAM_CLOSE,
+  AUDIO_STREAM_RESET_INTERFACE,
+}
+AUDIO_StreamStateTypeDef;
+
+/* Adaptive jitter buffer over an application supplied ring. Head and Burst
+   are only written by the producer, every other field by the consumer. */
+typedef struct
+{
+  uint8_t                           *pRing;
+  uint32_t                          Size;             /* Ring bytes, a power of two */
+  uint32_t                          Head;             /* Bytes written, free running */
+  uint32_t                          Tail;             /* Bytes read, free running */
+  uint32_t                          Burst;            /* Bytes of the last write */
+  uint32_t                          MsBytes;          /* One millisecond of audio */
+  uint32_t                          MinTarget;
+  uint32_t                          Target;
+  uint32_t                          MaxLevel;         /* Latency bound */
+  uint32_t                          WindowMin;        /* Lowest level of the window */
+  uint32_t                          WindowLeft;       /* Bytes to consume before the window closes */
+  uint32_t                          Trim;             /* Bytes left to slip down to the target */
+  uint8_t                           Prefill;
+  uint8_t                           Quiet;            /* Windows since the last underrun */
+}
+AUDIO_JitterTypeDef;
+
+typedef struct
+{
+  AUDIO_StreamStateTypeDef          state;
+  AUDIO_FormatTypeDef               Format;
+  uint8_t                           Itf;
+  uint8_t                           Alt;
+  uint8_t                           Ep;
+  uint8_t                           FbEp;
+  uint8_t                           ClockId;          /* UAC2 clock source of the terminal */
+  uint8_t                           Slots;            /* Pipes taking the packets in turn */
+  uint8_t                           Slot;
+  uint8_t                           FbBusy;
+  uint8_t                           Pipe[2];
+  uint8_t                           Busy[2];
+  uint8_t                           FbPipe;
+  uint8_t                           LatencyMin;       /* ms */
+  uint8_t                           LatencyMax;       /* ms */
+  uint8_t                           Interval;         /* log2 of the (micro)frames between packets */
+  uint8_t                           FbInterval;       /* Same for the feedback endpoint */
+  uint16_t                          EpSize;
+  uint16_t                          FbEpSize;
+  uint32_t                          FrameSize;        /* Bytes per sample frame */
+  uint32_t                          Period;           /* Host (micro)frames between packets */
+  uint32_t                          FbPeriod;
+  uint32_t                          NextTick;
+  uint32_t                          FbTick;
+  uint32_t                          PacketFrames;     /* Device (micro)frames per packet */
+  uint32_t                          Nominal;          /* Q16.16 samples per device (micro)frame */
+  uint32_t                          Rate;             /* Same, as the device feeds back */
+  uint32_t                          Accum;            /* Q16.16 sample frames carried over */
+  uint8_t                           *pBuff;           /* Packet slots, then the feedback buffer */
+  uint32_t                          SlotSize;
+  AUDIO_JitterTypeDef               Jitter;
+  AUDIO_StatsTypeDef                Stats;
+}
+AUDIO_StreamTypeDef;
+
+/* Structure for AUDIO process */
+typedef struct _AUDIO_Process
+{
+  uint8_t                           Uac2;
+  uint8_t                           CtrlItf;
+  uint8_t                           ReqBuff[4];
+  AUDIO_StreamTypeDef               Stream[AUDIO_NUM_STREAMS];
+}
+AUDIO_HandleTypeDef;
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_AUDIO_CORE_Exported_Defines
+  * @{
+  */
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_AUDIO_CORE_Exported_Macros
+  * @{
+  */
+/**
+  * @}
+  */
+
+/** @defgroup USBH_AUDIO_CORE_Exported_Variables
+  * @{
+  */
+extern USBH_ClassTypeDef  AUDIO_Class;
+#define USBH_AUDIO_CLASS    &AUDIO_Class
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_AUDIO_CORE_Exported_FunctionsPrototype
+  * @{
+  */
+
+USBH_StatusTypeDef  USBH_AUDIO_Start(USBH_HandleTypeDef *phost, uint8_t dir,
+                                     const AUDIO_FormatTypeDef *format,
+                                     uint8_t *pring, uint32_t size);
+
+USBH_StatusTypeDef  USBH_AUDIO_Stop(USBH_HandleTypeDef *phost, uint8_t dir);
+
+USBH_StatusTypeDef  USBH_AUDIO_SetLatency(USBH_HandleTypeDef *phost, uint8_t dir,
+                                          uint8_t min_ms, uint8_t max_ms);
+
+uint32_t            USBH_AUDIO_Write(USBH_HandleTypeDef *phost,
+                                     const uint8_t *pbuff,
+                                     uint32_t length);
+
+uint32_t            USBH_AUDIO_Read(USBH_HandleTypeDef *phost,
+                                    uint8_t *pbuff,
+                                    uint32_t length);
+
+USBH_StatusTypeDef  USBH_AUDIO_GetStats(USBH_HandleTypeDef *phost, uint8_t dir,
+                                        AUDIO_StatsTypeDef *pstats);
+
+void                USBH_AUDIO_StreamStarted(USBH_HandleTypeDef *phost, uint8_t dir);
+
+void                USBH_AUDIO_StreamStopped(USBH_HandleTypeDef *phost, uint8_t dir);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBH_AUDIO_H */
+
@@ -0,0 +1,1514 @@
+/**
+  ******************************************************************************
+  * @file    usbh_audio.c
+  * @author  MCD Application Team
+  * @brief   This file is the AUDIO Layer Handlers for USB Host AUDIO class.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2015 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  *  @verbatim
+  *
+  *          ===================================================================
+  *                                AUDIO Class Driver Description
+  *          ===================================================================
+  *           This driver manages the "Universal Serial Bus Device Class Definition
+  *           for Audio Devices Release 1.0 March 18, 1998" and "Release 2.0 May 31,
+  *           2006" specifications. It implements the following aspects:
+  *             - Audio control interface discovery, UAC1 or UAC2 from its protocol
+  *             - PCM Type I alternate setting selection per stream direction
+  *             - Sampling frequency request, on the endpoint (UAC1) or on the
+  *               clock source of the streaming terminal (UAC2)
+  *             - Isochronous IN and OUT streaming, one packet per service
+  *               interval, scheduled on the SOF counter
+  *             - Explicit feedback endpoint of asynchronous sinks
+  *             - Adaptive jitter buffer with a latency bound per stream
+  *
+  *           The application supplies the ring of each stream, the class only
+  *           allocates the packet buffers: USBH_AUDIO_Write feeds the playback
+  *           stream and USBH_AUDIO_Read drains the capture stream, both
+  *           lock-free against the SOF interrupt that moves the packets.
+  *
+  *  @endverbatim
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_audio.h"
+
+/** @addtogroup USBH_LIB
+  * @{
+  */
+
+/** @addtogroup USBH_CLASS
+  * @{
+  */
+
+/** @addtogroup USBH_AUDIO_CLASS
+  * @{
+  */
+
+/** @defgroup USBH_AUDIO_CORE
+  * @brief    This file includes AUDIO Layer Handlers for USB Host AUDIO class.
+  * @{
+  */
+
+/** @defgroup USBH_AUDIO_CORE_Private_TypesDefinitions
+  * @{
+  */
+/* Alternate setting collected while walking the configuration descriptor */
+typedef struct
+{
+  uint8_t                           Itf;
+  uint8_t                           Alt;
+  uint8_t                           Class;
+  uint8_t                           SubClass;
+  uint8_t                           Link;
+  uint8_t                           Channels;
+  uint8_t                           SubframeSize;
+  uint8_t                           BitResolution;
+  uint8_t                           RateOk;
+  uint8_t                           Ep;
+  uint8_t                           EpAttr;
+  uint8_t                           Interval;
+  uint8_t                           FbEp;
+  uint8_t                           FbInterval;
+  uint16_t                          EpSize;
+  uint16_t                          FbEpSize;
+}
+AUDIO_SettingTypeDef;
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_AUDIO_CORE_Private_Defines
+  * @{
+  */
+/* Terminals remembered to find the clock source of a UAC2 stream */
+#define AUDIO_MAX_TERMINALS                  8U
+
+#define AUDIO_EP_TYPE_MASK                   0x03U
+
+/* Packet slots start on a cache line */
+#define AUDIO_SLOT_ALIGN                     32U
+
+/* Feedback values further than 1/8 from the nominal rate are discarded */
+#define AUDIO_FEEDBACK_TOLERANCE_SHIFT       3U
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_AUDIO_CORE_Private_Macros
+  * @{
+  */
+#if (USBH_USE_DMA == 1U)
+#define AUDIO_BUFF_ALLOC(size)               USBH_dma_malloc(size)
+#define AUDIO_BUFF_FREE(ptr)                 USBH_dma_free(ptr)
+#else
+#define AUDIO_BUFF_ALLOC(size)               USBH_malloc(size)
+#define AUDIO_BUFF_FREE(ptr)                 USBH_free(ptr)
+#endif /* (USBH_USE_DMA == 1U) */
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_AUDIO_CORE_Private_Variables
+  * @{
+  */
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_AUDIO_CORE_Private_FunctionPrototypes
+  * @{
+  */
+
+static USBH_StatusTypeDef USBH_AUDIO_InterfaceInit(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_AUDIO_InterfaceDeInit(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_AUDIO_Process(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_AUDIO_SOFProcess(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_AUDIO_ClassRequest(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef AUDIO_ProcessStream(USBH_HandleTypeDef *phost, uint8_t dir);
+
+static USBH_StatusTypeDef AUDIO_FindSetting(USBH_HandleTypeDef *phost, uint8_t dir,
+                                            const AUDIO_FormatTypeDef *format);
+
+static uint8_t AUDIO_SettingMatches(const AUDIO_SettingTypeDef *psetting, uint8_t dir,
+                                    const AUDIO_FormatTypeDef *format);
+
+static uint8_t AUDIO_RateSupported(const uint8_t *pdesc, uint32_t rate);
+
+static USBH_StatusTypeDef AUDIO_SetSampleRate(USBH_HandleTypeDef *phost,
+                                              AUDIO_StreamTypeDef *stream);
+
+static USBH_StatusTypeDef AUDIO_OpenStream(USBH_HandleTypeDef *phost,
+                                           AUDIO_StreamTypeDef *stream);
+
+static void AUDIO_CloseStream(USBH_HandleTypeDef *phost, AUDIO_StreamTypeDef *stream);
+
+static void AUDIO_ServiceStream(USBH_HandleTypeDef *phost, AUDIO_StreamTypeDef *stream,
+                                uint8_t dir);
+
+static void AUDIO_ServiceFeedback(USBH_HandleTypeDef *phost, AUDIO_StreamTypeDef *stream);
+
+static void AUDIO_DecodeFeedback(AUDIO_StreamTypeDef *stream, const uint8_t *pbuff,
+                                 uint32_t length, uint8_t high_speed);
+
+static void AUDIO_JitterLimits(AUDIO_StreamTypeDef *stream);
+
+static uint32_t AUDIO_JitterPut(AUDIO_StreamTypeDef *stream, const uint8_t *pbuff,
+                                uint32_t length);
+
+static uint32_t AUDIO_JitterGet(AUDIO_StreamTypeDef *stream, uint8_t *pbuff,
+                                uint32_t length);
+
+USBH_ClassTypeDef  AUDIO_Class =
+{
+  "AUDIO",
+  USB_AUDIO_CLASS,
+  USBH_AUDIO_InterfaceInit,
+  USBH_AUDIO_InterfaceDeInit,
+  USBH_AUDIO_ClassRequest,
+  USBH_AUDIO_Process,
+  USBH_AUDIO_SOFProcess,
+  NULL,
+};
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_AUDIO_CORE_Private_Functions
+  * @{
+  */
+
+/**
+  * @brief  USBH_AUDIO_InterfaceInit
+  *         The function init the AUDIO class. The streaming interfaces are
+  *         looked up in the raw configuration descriptor when a stream
+  *         starts, as they sit beyond USBH_MAX_NUM_INTERFACES on most devices.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_AUDIO_InterfaceInit(USBH_HandleTypeDef *phost)
+{
+  USBH_StatusTypeDef status;
+  uint8_t interface;
+  uint32_t dir;
+  AUDIO_HandleTypeDef *AUDIO_Handle;
+
+  interface = USBH_FindInterface(phost, USB_AUDIO_CLASS, AUDIO_SUBCLASS_AUDIOCONTROL, 0xFFU);
+
+  if ((interface == 0xFFU) || (interface >= USBH_MAX_NUM_INTERFACES)) /* No Valid Interface */
+  {
+    USBH_DbgLog("Cannot Find the interface for Audio Control Class.", phost->pActiveClass->Name);
+    return USBH_FAIL;
+  }
+
+  status = USBH_SelectInterface(phost, interface);
+
+  if (status != USBH_OK)
+  {
+    return USBH_FAIL;
+  }
+
+  phost->pActiveClass->pData = (AUDIO_HandleTypeDef *)USBH_malloc(sizeof(AUDIO_HandleTypeDef));
+  AUDIO_Handle = (AUDIO_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if (AUDIO_Handle == NULL)
+  {
+    USBH_DbgLog("Cannot allocate memory for AUDIO Handle");
+    return USBH_FAIL;
+  }
+
+  /* Initialize audio handler */
+  (void)USBH_memset(AUDIO_Handle, 0, sizeof(AUDIO_HandleTypeDef));
+
+  AUDIO_Handle->CtrlItf = phost->device.CfgDesc.Itf_Desc[interface].bInterfaceNumber;
+  AUDIO_Handle->Uac2 = (phost->device.CfgDesc.Itf_Desc[interface].bInterfaceProtocol ==
+                        AUDIO_PROTOCOL_UAC2) ? 1U : 0U;
+
+  for (dir = 0U; dir < AUDIO_NUM_STREAMS; dir++)
+  {
+    AUDIO_Handle->Stream[dir].LatencyMin = USBH_AUDIO_MIN_LATENCY_MS;
+    AUDIO_Handle->Stream[dir].LatencyMax = USBH_AUDIO_MAX_LATENCY_MS;
+  }
+
+  USBH_UsrLog("AUDIO: UAC%d control interface %d", (AUDIO_Handle->Uac2 != 0U) ? 2 : 1,
+              (int)AUDIO_Handle->CtrlItf);
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_AUDIO_InterfaceDeInit
+  *         The function DeInit the Pipes used for the AUDIO class.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_AUDIO_InterfaceDeInit(USBH_HandleTypeDef *phost)
+{
+  AUDIO_HandleTypeDef *AUDIO_Handle = (AUDIO_HandleTypeDef *) phost->pActiveClass->pData;
+  uint32_t dir;
+
+  if (AUDIO_Handle != NULL)
+  {
+    for (dir = 0U; dir < AUDIO_NUM_STREAMS; dir++)
+    {
+      AUDIO_CloseStream(phost, &AUDIO_Handle->Stream[dir]);
+    }
+
+    USBH_free(phost->pActiveClass->pData);
+    phost->pActiveClass->pData = 0U;
+  }
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_AUDIO_ClassRequest
+  *         The function is responsible for handling Standard requests
+  *         for AUDIO class. Nothing is needed before the streams start.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_AUDIO_ClassRequest(USBH_HandleTypeDef *phost)
+{
+  phost->pUser(phost, HOST_USER_CLASS_ACTIVE);
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_AUDIO_Process
+  *         The function is for managing the stream set up and tear down.
+  *         The streams share the control pipe: the playback stream completes
+  *         its requests before the capture stream issues any.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_AUDIO_Process(USBH_HandleTypeDef *phost)
+{
+  uint8_t dir;
+
+  for (dir = 0U; dir < AUDIO_NUM_STREAMS; dir++)
+  {
+    if (AUDIO_ProcessStream(phost, dir) == USBH_BUSY)
+    {
+      break;
+    }
+  }
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_AUDIO_SOFProcess
+  *         The function is for managing SOF callback: it moves the packets of
+  *         the running streams and polls the feedback endpoint. Called from
+  *         the SOF interrupt, so that every service interval is kept.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_AUDIO_SOFProcess(USBH_HandleTypeDef *phost)
+{
+  AUDIO_HandleTypeDef *AUDIO_Handle = (AUDIO_HandleTypeDef *) phost->pActiveClass->pData;
+  AUDIO_StreamTypeDef *stream;
+  uint8_t dir;
+
+  if (AUDIO_Handle == NULL)
+  {
+    return USBH_OK;
+  }
+
+  for (dir = 0U; dir < AUDIO_NUM_STREAMS; dir++)
+  {
+    stream = &AUDIO_Handle->Stream[dir];
+
+    if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) == AUDIO_STREAM_RUN)
+    {
+      AUDIO_ServiceStream(phost, stream, dir);
+
+      if (stream->FbPipe != 0U)
+      {
+        AUDIO_ServiceFeedback(phost, stream);
+      }
+    }
+  }
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  AUDIO_ProcessStream
+  *         Run the set up or tear down of one stream.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @retval USBH_BUSY while a control transfer of the stream is in progress
+  */
+static USBH_StatusTypeDef AUDIO_ProcessStream(USBH_HandleTypeDef *phost, uint8_t dir)
+{
+  AUDIO_HandleTypeDef *AUDIO_Handle = (AUDIO_HandleTypeDef *) phost->pActiveClass->pData;
+  AUDIO_StreamTypeDef *stream = &AUDIO_Handle->Stream[dir];
+  USBH_StatusTypeDef status = USBH_OK;
+  USBH_StatusTypeDef req_status;
+
+  switch (stream->state)
+  {
+    case AUDIO_STREAM_SET_INTERFACE:
+      req_status = USBH_SetInterface(phost, stream->Itf, stream->Alt);
+
+      if (req_status == USBH_OK)
+      {
+        stream->state = AUDIO_STREAM_SET_FREQUENCY;
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      else if (req_status == USBH_BUSY)
+      {
+        status = USBH_BUSY;
+      }
+      else
+      {
+        USBH_ErrLog("AUDIO: interface %d alternate %d refused", (int)stream->Itf, (int)stream->Alt);
+        stream->state = AUDIO_STREAM_IDLE;
+        USBH_AUDIO_StreamStopped(phost, dir);
+      }
+      break;
+
+    case AUDIO_STREAM_SET_FREQUENCY:
+      req_status = AUDIO_SetSampleRate(phost, stream);
+
+      if (req_status == USBH_BUSY)
+      {
+        status = USBH_BUSY;
+      }
+      else
+      {
+        /* Fixed clocks stall the request, the stream runs at their rate */
+        if (req_status != USBH_OK)
+        {
+          USBH_UsrLog("AUDIO: sampling frequency %lu Hz not set",
+                      (unsigned long)stream->Format.SampleRate);
+        }
+
+        stream->state = AUDIO_STREAM_OPEN;
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      break;
+
+    case AUDIO_STREAM_OPEN:
+      if (AUDIO_OpenStream(phost, stream) == USBH_OK)
+      {
+        USBH_AUDIO_StreamStarted(phost, dir);
+      }
+      else
+      {
+        AUDIO_CloseStream(phost, stream);
+        stream->state = AUDIO_STREAM_RESET_INTERFACE;
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      break;
+
+    case AUDIO_STREAM_CLOSE:
+      AUDIO_CloseStream(phost, stream);
+      stream->state = AUDIO_STREAM_RESET_INTERFACE;
+      (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      break;
+
+    case AUDIO_STREAM_RESET_INTERFACE:
+      req_status = USBH_SetInterface(phost, stream->Itf, 0U);
+
+      if (req_status == USBH_BUSY)
+      {
+        status = USBH_BUSY;
+      }
+      else
+      {
+        stream->state = AUDIO_STREAM_IDLE;
+        USBH_AUDIO_StreamStopped(phost, dir);
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  return status;
+}
+
+
+/**
+  * @brief  AUDIO_FindSetting
+  *         Walk the raw configuration descriptor for the first alternate
+  *         setting streaming the format in the requested direction, and
+  *         record it in the stream.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @param  format: PCM format
+  * @retval USBH_OK if a setting was found, USBH_NOT_SUPPORTED otherwise
+  */
+static USBH_StatusTypeDef AUDIO_FindSetting(USBH_HandleTypeDef *phost, uint8_t dir,
+                                            const AUDIO_FormatTypeDef *format)
+{
+  AUDIO_HandleTypeDef *AUDIO_Handle = (AUDIO_HandleTypeDef *) phost->pActiveClass->pData;
+  AUDIO_StreamTypeDef *stream = &AUDIO_Handle->Stream[dir];
+  AUDIO_SettingTypeDef setting;
+  uint8_t term_id[AUDIO_MAX_TERMINALS];
+  uint8_t term_clock[AUDIO_MAX_TERMINALS];
+  uint8_t *pdesc;
+  uint16_t total = MIN(phost->device.CfgDesc.wTotalLength, (uint16_t)USBH_MAX_SIZE_CONFIGURATION);
+  uint16_t ptr = 0U;
+  uint8_t terms = 0U;
+  uint8_t clock = 0U;
+  uint8_t found = 0U;
+  uint8_t idx;
+
+  (void)USBH_memset(&setting, 0, sizeof(setting));
+
+  while (((uint32_t)ptr + 2U) <= total)
+  {
+    pdesc = &phost->device.CfgDesc_Raw[ptr];
+
+    if ((pdesc[0] < 2U) || (((uint32_t)ptr + pdesc[0]) > total))
+    {
+      break;
+    }
+
+    if ((pdesc[1] == USB_DESC_TYPE_INTERFACE) && (pdesc[0] >= USB_INTERFACE_DESC_SIZE))
+    {
+      if (AUDIO_SettingMatches(&setting, dir, format) != 0U)
+      {
+        found = 1U;
+        break;
+      }
+
+      (void)USBH_memset(&setting, 0, sizeof(setting));
+      setting.Itf = pdesc[2];
+      setting.Alt = pdesc[3];
+      setting.Class = pdesc[5];
+      setting.SubClass = pdesc[6];
+    }
+    else if ((pdesc[1] == AUDIO_CS_INTERFACE) && (setting.Class == USB_AUDIO_CLASS) && (pdesc[0] >= 4U))
+    {
+      if (setting.SubClass == AUDIO_SUBCLASS_AUDIOCONTROL)
+      {
+        if ((pdesc[2] == AUDIO_AC_CLOCK_SOURCE) && (clock == 0U))
+        {
+          clock = pdesc[3];
+        }
+        else if ((AUDIO_Handle->Uac2 != 0U) && (terms < AUDIO_MAX_TERMINALS) &&
+                 (((pdesc[2] == AUDIO_AC_INPUT_TERMINAL) && (pdesc[0] >= 8U)) ||
+                  ((pdesc[2] == AUDIO_AC_OUTPUT_TERMINAL) && (pdesc[0] >= 9U))))
+        {
+          /* bCSourceID follows bAssocTerminal, behind bSourceID on an output terminal */
+          term_id[terms] = pdesc[3];
+          term_clock[terms] = (pdesc[2] == AUDIO_AC_INPUT_TERMINAL) ? pdesc[7] : pdesc[8];
+          terms++;
+        }
+        else
+        {
+          /* .. */
+        }
+      }
+      else if (setting.SubClass == AUDIO_SUBCLASS_AUDIOSTREAMING)
+      {
+        if (pdesc[2] == AUDIO_AS_GENERAL)
+        {
+          setting.Link = pdesc[3];
+
+          if ((AUDIO_Handle->Uac2 != 0U) && (pdesc[0] >= 11U))
+          {
+            setting.Channels = pdesc[10];
+          }
+        }
+        else if ((pdesc[2] == AUDIO_AS_FORMAT_TYPE) && (pdesc[3] == AUDIO_FORMAT_TYPE_I))
+        {
+          if ((AUDIO_Handle->Uac2 != 0U) && (pdesc[0] >= 6U))
+          {
+            /* The rates of a UAC2 clock are not checked, the request reports a refusal */
+            setting.SubframeSize = pdesc[4];
+            setting.BitResolution = pdesc[5];
+            setting.RateOk = 1U;
+          }
+          else if ((AUDIO_Handle->Uac2 == 0U) && (pdesc[0] >= 8U))
+          {
+            setting.Channels = pdesc[4];
+            setting.SubframeSize = pdesc[5];
+            setting.BitResolution = pdesc[6];
+            setting.RateOk = AUDIO_RateSupported(pdesc, format->SampleRate);
+          }
+          else
+          {
+            /* .. */
+          }
+        }
+        else
+        {
+          /* .. */
+        }
+      }
+      else
+      {
+        /* .. */
+      }
+    }
+    else if ((pdesc[1] == USB_DESC_TYPE_ENDPOINT) && (pdesc[0] >= USB_ENDPOINT_DESC_SIZE) &&
+             (setting.Class == USB_AUDIO_CLASS) && (setting.SubClass == AUDIO_SUBCLASS_AUDIOSTREAMING) &&
+             ((pdesc[3] & AUDIO_EP_TYPE_MASK) == USB_EP_TYPE_ISOC))
+    {
+      /* UAC1 feedback endpoints have no usage bits: an IN endpoint beside an OUT one */
+      if (((pdesc[3] & AUDIO_EP_USAGE_MASK) == AUDIO_EP_USAGE_FEEDBACK) ||
+          ((setting.Ep != 0U) && ((setting.Ep & 0x80U) == 0U) && ((pdesc[2] & 0x80U) != 0U)))
+      {
+        setting.FbEp = pdesc[2];
+        setting.FbEpSize = LE16(&pdesc[4]) & 0x7FFU;
+
+        /* bRefresh of a UAC1 synch endpoint gives the period as a power of 2 frames */
+        if ((AUDIO_Handle->Uac2 == 0U) && (pdesc[0] >= 9U) && (pdesc[7] != 0U))
+        {
+          setting.FbInterval = MIN(pdesc[7], 9U);
+        }
+        else
+        {
+          setting.FbInterval = (uint8_t)(MIN(MAX(pdesc[6], 1U), 16U) - 1U);
+        }
+      }
+      else if (setting.Ep == 0U)
+      {
+        setting.Ep = pdesc[2];
+        setting.EpAttr = pdesc[3];
+        setting.EpSize = LE16(&pdesc[4]);
+        setting.Interval = (uint8_t)(MIN(MAX(pdesc[6], 1U), 16U) - 1U);
+      }
+      else
+      {
+        /* .. */
+      }
+    }
+    else
+    {
+      /* .. */
+    }
+
+    ptr += pdesc[0];
+  }
+
+  if ((found == 0U) && (AUDIO_SettingMatches(&setting, dir, format) == 0U))
+  {
+    return USBH_NOT_SUPPORTED;
+  }
+
+  stream->Itf = setting.Itf;
+  stream->Alt = setting.Alt;
+  stream->Ep = setting.Ep;
+  stream->EpSize = setting.EpSize;
+  stream->Interval = setting.Interval;
+  stream->FbEp = 0U;
+  stream->FbEpSize = 0U;
+  stream->ClockId = clock;
+
+  /* Explicit feedback only paces an asynchronous sink */
+  if ((setting.FbEp != 0U) && (setting.FbEpSize >= 3U) && (dir == AUDIO_PLAYBACK) &&
+      ((setting.EpAttr & AUDIO_EP_SYNC_MASK) == AUDIO_EP_SYNC_ASYNC))
+  {
+    stream->FbEp = setting.FbEp;
+    stream->FbEpSize = MIN(setting.FbEpSize, 4U);
+    stream->FbInterval = setting.FbInterval;
+  }
+
+  for (idx = 0U; idx < terms; idx++)
+  {
+    if (term_id[idx] == setting.Link)
+    {
+      stream->ClockId = term_clock[idx];
+    }
+  }
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  AUDIO_SettingMatches
+  *         Check an alternate setting against the requested stream.
+  * @param  psetting: Alternate setting
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @param  format: PCM format
+  * @retval 1 if the setting streams the format
+  */
+static uint8_t AUDIO_SettingMatches(const AUDIO_SettingTypeDef *psetting, uint8_t dir,
+                                    const AUDIO_FormatTypeDef *format)
+{
+  uint8_t ep_dir = ((psetting->Ep & 0x80U) != 0U) ? AUDIO_CAPTURE : AUDIO_PLAYBACK;
+
+  /* High bandwidth endpoints, several packets per microframe, are not handled */
+  return ((psetting->Alt != 0U) && (psetting->Ep != 0U) && (ep_dir == dir) &&
+          (psetting->Channels == format->Channels) &&
+          (psetting->SubframeSize == format->SubframeSize) &&
+          ((format->BitResolution == 0U) || (psetting->BitResolution == format->BitResolution)) &&
+          (psetting->RateOk != 0U) && ((psetting->EpSize & 0x1800U) == 0U) &&
+          (psetting->EpSize <= USBH_AUDIO_MAX_PACKET_SIZE) &&
+          (psetting->EpSize >= ((uint16_t)format->Channels * format->SubframeSize))) ? 1U : 0U;
+}
+
+
+/**
+  * @brief  AUDIO_RateSupported
+  *         Check a rate against a UAC1 Type I format descriptor.
+  * @param  pdesc: Format type descriptor
+  * @param  rate: Sampling frequency in Hz
+  * @retval 1 if the rate is in the discrete list or the continuous range
+  */
+static uint8_t AUDIO_RateSupported(const uint8_t *pdesc, uint32_t rate)
+{
+  uint32_t count = pdesc[7];
+  uint32_t idx;
+
+  if (count == 0U)
+  {
+    return ((pdesc[0] >= 14U) && (rate >= LE24(&pdesc[8])) && (rate <= LE24(&pdesc[11]))) ? 1U : 0U;
+  }
+
+  for (idx = 0U; (idx < count) && ((8U + (3U * idx) + 3U) <= pdesc[0]); idx++)
+  {
+    if (LE24(&pdesc[8U + (3U * idx)]) == rate)
+    {
+      return 1U;
+    }
+  }
+
+  return 0U;
+}
+
+
+/**
+  * @brief  AUDIO_SetSampleRate
+  *         Issue the sampling frequency request of a stream: SET_CUR on the
+  *         endpoint for UAC1, CUR on the clock source for UAC2.
+  * @param  phost: Host handle
+  * @param  stream: Stream
+  * @retval USBH_StatusTypeDef : USB ctl xfer status
+  */
+static USBH_StatusTypeDef AUDIO_SetSampleRate(USBH_HandleTypeDef *phost,
+                                              AUDIO_StreamTypeDef *stream)
+{
+  AUDIO_HandleTypeDef *AUDIO_Handle = (AUDIO_HandleTypeDef *) phost->pActiveClass->pData;
+  uint16_t length = (AUDIO_Handle->Uac2 != 0U) ? 4U : 3U;
+
+  if (phost->RequestState == CMD_SEND)
+  {
+    AUDIO_Handle->ReqBuff[0] = (uint8_t)(stream->Format.SampleRate);
+    AUDIO_Handle->ReqBuff[1] = (uint8_t)(stream->Format.SampleRate >> 8);
+    AUDIO_Handle->ReqBuff[2] = (uint8_t)(stream->Format.SampleRate >> 16);
+    AUDIO_Handle->ReqBuff[3] = (uint8_t)(stream->Format.SampleRate >> 24);
+
+    if (AUDIO_Handle->Uac2 != 0U)
+    {
+      phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_TYPE_CLASS |
+                                             USB_REQ_RECIPIENT_INTERFACE;
+
+      phost->Control.setup.b.wIndex.w = ((uint16_t)stream->ClockId << 8) | AUDIO_Handle->CtrlItf;
+    }
+    else
+    {
+      phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_TYPE_CLASS |
+                                             USB_REQ_RECIPIENT_ENDPOINT;
+
+      phost->Control.setup.b.wIndex.w = stream->Ep;
+    }
+
+    phost->Control.setup.b.bRequest = AUDIO_REQ_SET_CUR;
+    phost->Control.setup.b.wValue.w = (uint16_t)AUDIO_SAMPLING_FREQ_CONTROL << 8;
+    phost->Control.setup.b.wLength.w = length;
+  }
+
+  return USBH_CtlReq(phost, AUDIO_Handle->ReqBuff, length);
+}
+
+
+/**
+  * @brief  AUDIO_OpenStream
+  *         Allocate the packet buffers and the pipes of a stream, then hand
+  *         it to the SOF interrupt.
+  * @param  phost: Host handle
+  * @param  stream: Stream
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef AUDIO_OpenStream(USBH_HandleTypeDef *phost, AUDIO_StreamTypeDef *stream)
+{
+  uint8_t high_speed = (phost->device.speed == (uint8_t)USBH_SPEED_HIGH) ? 1U : 0U;
+  uint32_t ticks;
+  uint32_t size;
+  uint32_t slot;
+
+  /* The SOF counter of a high-speed root port runs at 8 kHz */
+  ticks = ((high_speed == 0U) && (phost->pRoot->device.speed == (uint8_t)USBH_SPEED_HIGH)) ? 8U : 1U;
+
+  stream->PacketFrames = 1UL << stream->Interval;
+  stream->Period = stream->PacketFrames * ticks;
+  stream->FbPeriod = MAX((1UL << stream->FbInterval) * ticks, 2UL);
+
+  /* A packet every (micro)frame needs two pipes: a transfer goes out in
+     the frame after its submission */
+  stream->Slots = (stream->Period < 2U) ? 2U : 1U;
+  stream->SlotSize = ((uint32_t)stream->EpSize + AUDIO_SLOT_ALIGN - 1U) & ~(AUDIO_SLOT_ALIGN - 1U);
+
+  stream->Nominal = (uint32_t)(((uint64_t)stream->Format.SampleRate << 16) /
+                               ((high_speed != 0U) ? 8000U : 1000U));
+  stream->Rate = stream->Nominal;
+  stream->Accum = 0U;
+  stream->Slot = 0U;
+  stream->Busy[0] = 0U;
+  stream->Busy[1] = 0U;
+  stream->FbBusy = 0U;
+
+  size = (stream->Slots * stream->SlotSize) + ((stream->FbEp != 0U) ? AUDIO_SLOT_ALIGN : 0U);
+  stream->pBuff = (uint8_t *)AUDIO_BUFF_ALLOC(size);
+
+  if (stream->pBuff == NULL)
+  {
+    USBH_ErrLog("AUDIO: cannot allocate %lu bytes of packet buffers", (unsigned long)size);
+    return USBH_FAIL;
+  }
+
+  for (slot = 0U; slot < stream->Slots; slot++)
+  {
+    stream->Pipe[slot] = USBH_AllocPipe(phost, stream->Ep);
+
+    /* Host channels are shared by every device behind a hub */
+    if (stream->Pipe[slot] >= USBH_MAX_PIPES_NBR)
+    {
+      stream->Pipe[slot] = 0U;
+      USBH_ErrLog("AUDIO: no free host channel");
+      return USBH_FAIL;
+    }
+
+    (void)USBH_OpenPipe(phost, stream->Pipe[slot], stream->Ep, phost->device.address,
+                        phost->device.speed, USB_EP_TYPE_ISOC, stream->EpSize);
+  }
+
+  if (stream->FbEp != 0U)
+  {
+    stream->FbPipe = USBH_AllocPipe(phost, stream->FbEp);
+
+    if (stream->FbPipe >= USBH_MAX_PIPES_NBR)
+    {
+      stream->FbPipe = 0U;
+      USBH_ErrLog("AUDIO: no free host channel");
+      return USBH_FAIL;
+    }
+
+    (void)USBH_OpenPipe(phost, stream->FbPipe, stream->FbEp, phost->device.address,
+                        phost->device.speed, USB_EP_TYPE_ISOC, stream->FbEpSize);
+  }
+
+  stream->NextTick = phost->Timer + 1U;
+  stream->FbTick = stream->NextTick;
+
+  /* Publish the stream to the SOF interrupt */
+  __atomic_store_n(&stream->state, AUDIO_STREAM_RUN, __ATOMIC_RELEASE);
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  AUDIO_CloseStream
+  *         Release the pipes and the packet buffers of a stream. The SOF
+  *         interrupt no longer services it.
+  * @param  phost: Host handle
+  * @param  stream: Stream
+  * @retval None
+  */
+static void AUDIO_CloseStream(USBH_HandleTypeDef *phost, AUDIO_StreamTypeDef *stream)
+{
+  uint32_t slot;
+
+  for (slot = 0U; slot < 2U; slot++)
+  {
+    if (stream->Pipe[slot] != 0U)
+    {
+      (void)USBH_ClosePipe(phost, stream->Pipe[slot]);
+      (void)USBH_FreePipe(phost, stream->Pipe[slot]);
+      stream->Pipe[slot] = 0U;     /* Reset the Channel as Free */
+    }
+  }
+
+  if (stream->FbPipe != 0U)
+  {
+    (void)USBH_ClosePipe(phost, stream->FbPipe);
+    (void)USBH_FreePipe(phost, stream->FbPipe);
+    stream->FbPipe = 0U;
+  }
+
+  if (stream->pBuff != NULL)
+  {
+    AUDIO_BUFF_FREE(stream->pBuff);
+    stream->pBuff = NULL;
+  }
+}
+
+
+/**
+  * @brief  AUDIO_ServiceStream
+  *         Move one packet of a running stream when its service interval
+  *         comes: harvest the transfer of the slot, then submit the next one
+  *         for the following (micro)frame. A slot whose transfer is still in
+  *         flight is skipped and counted late.
+  * @param  phost: Host handle
+  * @param  stream: Stream
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @retval None
+  */
+static void AUDIO_ServiceStream(USBH_HandleTypeDef *phost, AUDIO_StreamTypeDef *stream, uint8_t dir)
+{
+  USBH_URBStateTypeDef urb_state;
+  uint8_t *pbuff;
+  uint64_t step;
+  uint32_t length;
+  uint8_t slot;
+
+  if ((int32_t)(phost->Timer - stream->NextTick) < 0)
+  {
+    return;
+  }
+
+  /* Resynchronise after the SOF interrupt was held off for several packets */
+  if ((phost->Timer - stream->NextTick) >= (stream->Period * 4U))
+  {
+    stream->NextTick = phost->Timer;
+  }
+
+  stream->NextTick += stream->Period;
+  slot = stream->Slot;
+  stream->Slot = (uint8_t)((slot + 1U) % stream->Slots);
+  pbuff = &stream->pBuff[slot * stream->SlotSize];
+
+  if (stream->Busy[slot] != 0U)
+  {
+    urb_state = USBH_LL_GetURBState(phost, stream->Pipe[slot]);
+
+    if (urb_state == USBH_URB_IDLE)
+    {
+      stream->Stats.LateUrbs++;
+      return;
+    }
+
+    stream->Busy[slot] = 0U;
+
+    if (urb_state == USBH_URB_DONE)
+    {
+      stream->Stats.Packets++;
+
+      if (dir == AUDIO_CAPTURE)
+      {
+        length = USBH_LL_GetLastXferSize(phost, stream->Pipe[slot]);
+        length = MIN(length, (uint32_t)stream->EpSize);
+        (void)AUDIO_JitterPut(stream, pbuff, length - (length % stream->FrameSize));
+      }
+    }
+  }
+
+  if (dir == AUDIO_PLAYBACK)
+  {
+    /* Sample frames owed to the device: fractional rates carry over */
+    step = (uint64_t)stream->Accum + ((uint64_t)stream->Rate * stream->PacketFrames);
+    stream->Accum = (uint32_t)(step & 0xFFFFU);
+    length = MIN((uint32_t)(step >> 16), stream->EpSize / stream->FrameSize) * stream->FrameSize;
+
+    (void)AUDIO_JitterGet(stream, pbuff, length);
+    (void)USBH_IsocSendData(phost, pbuff, length, stream->Pipe[slot]);
+  }
+  else
+  {
+    (void)USBH_IsocReceiveData(phost, pbuff, stream->EpSize, stream->Pipe[slot]);
+  }
+
+  stream->Busy[slot] = 1U;
+}
+
+
+/**
+  * @brief  AUDIO_ServiceFeedback
+  *         Poll the feedback endpoint of an asynchronous sink at its period.
+  * @param  phost: Host handle
+  * @param  stream: Stream
+  * @retval None
+  */
+static void AUDIO_ServiceFeedback(USBH_HandleTypeDef *phost, AUDIO_StreamTypeDef *stream)
+{
+  USBH_URBStateTypeDef urb_state;
+  uint8_t *pbuff = &stream->pBuff[stream->Slots * stream->SlotSize];
+
+  if ((int32_t)(phost->Timer - stream->FbTick) < 0)
+  {
+    return;
+  }
+
+  stream->FbTick = phost->Timer + stream->FbPeriod;
+
+  if (stream->FbBusy != 0U)
+  {
+    urb_state = USBH_LL_GetURBState(phost, stream->FbPipe);
+
+    if (urb_state == USBH_URB_IDLE)
+    {
+      return;
+    }
+
+    stream->FbBusy = 0U;
+
+    if (urb_state == USBH_URB_DONE)
+    {
+      AUDIO_DecodeFeedback(stream, pbuff, USBH_LL_GetLastXferSize(phost, stream->FbPipe),
+                           (phost->device.speed == (uint8_t)USBH_SPEED_HIGH) ? 1U : 0U);
+    }
+  }
+
+  (void)USBH_IsocReceiveData(phost, pbuff, stream->FbEpSize, stream->FbPipe);
+  stream->FbBusy = 1U;
+}
+
+
+/**
+  * @brief  AUDIO_DecodeFeedback
+  *         Take the rate reported by the sink: 10.14 samples per frame in 3
+  *         bytes at full speed, 16.16 samples per microframe at high speed.
+  *         Devices sending the other format are recognised by the value;
+  *         values off the nominal rate by more than 1/8 are dropped.
+  * @param  stream: Stream
+  * @param  pbuff: Feedback packet
+  * @param  length: Packet length
+  * @param  high_speed: 1 for a high-speed device
+  * @retval None
+  */
+static void AUDIO_DecodeFeedback(AUDIO_StreamTypeDef *stream, const uint8_t *pbuff,
+                                 uint32_t length, uint8_t high_speed)
+{
+  uint32_t tolerance = stream->Nominal >> AUDIO_FEEDBACK_TOLERANCE_SHIFT;
+  uint32_t value;
+  uint32_t other;
+
+  if (length < 3U)
+  {
+    return;
+  }
+
+  value = (length >= 4U) ? LE32(pbuff) : LE24(pbuff);
+
+  if (high_speed != 0U)
+  {
+    other = value << 2;
+  }
+  else
+  {
+    other = value;
+    value = LE24(pbuff) << 2;
+  }
+
+  if (((value + tolerance) >= stream->Nominal) && (value <= (stream->Nominal + tolerance)))
+  {
+    stream->Rate = value;
+  }
+  else if (((other + tolerance) >= stream->Nominal) && (other <= (stream->Nominal + tolerance)))
+  {
+    stream->Rate = other;
+  }
+  else
+  {
+    return;
+  }
+
+  stream->Stats.Feedback = stream->Rate;
+}
+
+
+/**
+  * @brief  AUDIO_JitterLimits
+  *         Convert the latency bounds of a stream to ring levels.
+  * @param  stream: Stream
+  * @retval None
+  */
+static void AUDIO_JitterLimits(AUDIO_StreamTypeDef *stream)
+{
+  AUDIO_JitterTypeDef *pjit = &stream->Jitter;
+  uint32_t usable = pjit->Size - (pjit->Size % stream->FrameSize);
+
+  pjit->MaxLevel = MIN((uint32_t)stream->LatencyMax * pjit->MsBytes, usable);
+  pjit->MinTarget = MIN((uint32_t)stream->LatencyMin * pjit->MsBytes, pjit->MaxLevel);
+  pjit->Target = MIN(MAX(pjit->Target, pjit->MinTarget), pjit->MaxLevel);
+}
+
+
+/**
+  * @brief  AUDIO_JitterPut
+  *         Producer side of the jitter buffer: USBH_AUDIO_Write for the
+  *         playback stream, the SOF interrupt for the capture stream. Data
+  *         beyond the latency bound is dropped and counted as an overrun.
+  * @param  stream: Stream
+  * @param  pbuff: Whole sample frames
+  * @param  length: Bytes
+  * @retval Bytes queued
+  */
+static uint32_t AUDIO_JitterPut(AUDIO_StreamTypeDef *stream, const uint8_t *pbuff, uint32_t length)
+{
+  AUDIO_JitterTypeDef *pjit = &stream->Jitter;
+  uint32_t head = pjit->Head;
+  uint32_t level = head - __atomic_load_n(&pjit->Tail, __ATOMIC_ACQUIRE);
+  uint32_t count = 0U;
+  uint32_t offset;
+  uint32_t chunk;
+
+  if (level < pjit->MaxLevel)
+  {
+    count = MIN(pjit->MaxLevel - level, length);
+    count -= count % stream->FrameSize;
+  }
+
+  if (count < length)
+  {
+    stream->Stats.Overruns++;
+  }
+
+  __atomic_store_n(&pjit->Burst, length, __ATOMIC_RELAXED);
+
+  if (count != 0U)
+  {
+    offset = head & (pjit->Size - 1U);
+    chunk = MIN(pjit->Size - offset, count);
+
+    (void)USBH_memcpy(&pjit->pRing[offset], pbuff, chunk);
+    (void)USBH_memcpy(pjit->pRing, &pbuff[chunk], count - chunk);
+
+    /* Publish the data to the consumer */
+    __atomic_store_n(&pjit->Head, head + count, __ATOMIC_RELEASE);
+  }
+
+  return count;
+}
+
+
+/**
+  * @brief  AUDIO_JitterGet
+  *         Consumer side of the jitter buffer: the SOF interrupt for the
+  *         playback stream, USBH_AUDIO_Read for the capture stream. The
+  *         request is always filled, with silence for the missing part.
+  *         - Prefill: silence until the level covers the target on top of
+  *           this request and of the last write, the level being lowest
+  *           just before a write and just after a read. The oldest data
+  *           beyond that is dropped before anything is delivered, so that
+  *           an application moving large blocks starts at the target.
+  *         - Underrun: the rest is silence, the target grows by 1 ms up to
+  *           the latency bound and the buffer fills up again.
+  *         - Trim: a window whose lowest level stays over the target by more
+  *           than 1 ms, plus the smaller of a read and a write, makes the
+  *           following requests drop one sample frame each, until the excess
+  *           is gone. After quiet windows the target
+  *           steps back towards the configured minimum.
+  * @param  stream: Stream
+  * @param  pbuff: Destination
+  * @param  length: Bytes, whole sample frames
+  * @retval Bytes taken from the ring
+  */
+static uint32_t AUDIO_JitterGet(AUDIO_StreamTypeDef *stream, uint8_t *pbuff, uint32_t length)
+{
+  AUDIO_JitterTypeDef *pjit = &stream->Jitter;
+  uint32_t tail = pjit->Tail;
+  uint32_t level = __atomic_load_n(&pjit->Head, __ATOMIC_ACQUIRE) - tail;
+  uint32_t count = length;
+  uint32_t offset;
+  uint32_t chunk;
+  uint32_t need;
+
+  if (pjit->Prefill != 0U)
+  {
+    need = MIN(pjit->Target + length + __atomic_load_n(&pjit->Burst, __ATOMIC_RELAXED), pjit->MaxLevel);
+
+    if ((level < need) || (level == 0U))
+    {
+      (void)USBH_memset(pbuff, 0, length);
+      return 0U;
+    }
+
+    need = level - need;
+    need -= need % stream->FrameSize;
+    tail += need;
+    level -= need;
+
+    pjit->Prefill = 0U;
+    pjit->WindowMin = level;
+    pjit->WindowLeft = USBH_AUDIO_TRIM_WINDOW_MS * pjit->MsBytes;
+  }
+
+  if (level < length)
+  {
+    count = level;
+    (void)USBH_memset(&pbuff[count], 0, length - count);
+
+    stream->Stats.Underruns++;
+    pjit->Prefill = 1U;
+    pjit->Trim = 0U;
+    pjit->Quiet = 0U;
+    pjit->Target = MIN(pjit->Target + pjit->MsBytes, pjit->MaxLevel);
+  }
+
+  offset = tail & (pjit->Size - 1U);
+  chunk = MIN(pjit->Size - offset, count);
+
+  (void)USBH_memcpy(pbuff, &pjit->pRing[offset], chunk);
+  (void)USBH_memcpy(&pbuff[chunk], pjit->pRing, count - chunk);
+
+  tail += count;
+  level -= count;
+
+  if (pjit->Prefill == 0U)
+  {
+    if ((pjit->Trim >= stream->FrameSize) && (level >= stream->FrameSize))
+    {
+      tail += stream->FrameSize;
+      level -= stream->FrameSize;
+      pjit->Trim -= stream->FrameSize;
+      stream->Stats.Slips++;
+    }
+
+    if (level < pjit->WindowMin)
+    {
+      pjit->WindowMin = level;
+    }
+
+    if (pjit->WindowLeft > count)
+    {
+      pjit->WindowLeft -= count;
+    }
+    else
+    {
+      /* Seen after the reads only, the lowest level is up to the smaller
+         of a read and a write above the true one */
+      if (pjit->WindowMin > (pjit->Target + pjit->MsBytes +
+                             MIN(length, __atomic_load_n(&pjit->Burst, __ATOMIC_RELAXED))))
+      {
+        pjit->Trim = pjit->WindowMin - pjit->Target;
+      }
+
+      pjit->Quiet++;
+      if ((pjit->Quiet >= USBH_AUDIO_TRIM_QUIET_WINDOWS) && (pjit->Target > pjit->MinTarget))
+      {
+        pjit->Target = MAX(pjit->Target - pjit->MsBytes, pjit->MinTarget);
+        pjit->Quiet = 0U;
+      }
+
+      pjit->WindowMin = level;
+      pjit->WindowLeft = USBH_AUDIO_TRIM_WINDOW_MS * pjit->MsBytes;
+    }
+  }
+
+  /* Release the space to the producer */
+  __atomic_store_n(&pjit->Tail, tail, __ATOMIC_RELEASE);
+
+  stream->Stats.Target = pjit->Target;
+
+  return count;
+}
+
+
+/**
+  * @brief  Start a stream: select the alternate setting streaming the
+  *         format, set the sampling frequency, then move packets from the
+  *         next SOF on. USBH_AUDIO_StreamStarted is called once it runs.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @param  format: PCM format
+  * @param  pring: Jitter buffer storage, owned by the class until the stop
+  * @param  size: Storage size in bytes, a power of two
+  * @retval USBH_NOT_SUPPORTED if the device has no matching setting,
+  *         USBH_BUSY if the stream is not idle
+  */
+USBH_StatusTypeDef USBH_AUDIO_Start(USBH_HandleTypeDef *phost, uint8_t dir,
+                                    const AUDIO_FormatTypeDef *format,
+                                    uint8_t *pring, uint32_t size)
+{
+  AUDIO_HandleTypeDef *AUDIO_Handle;
+  AUDIO_StreamTypeDef *stream;
+  AUDIO_JitterTypeDef *pjit;
+
+  if ((phost->gState != HOST_CLASS) || (phost->pActiveClass == NULL) ||
+      (phost->pActiveClass->pData == NULL) || (phost->pActiveClass->ClassCode != USB_AUDIO_CLASS) ||
+      (dir >= AUDIO_NUM_STREAMS) || (format == NULL) || (format->Channels == 0U) ||
+      (format->SubframeSize == 0U) || (format->SubframeSize > 4U) || (format->SampleRate < 1000U) ||
+      (pring == NULL) || (size == 0U) || ((size & (size - 1U)) != 0U))
+  {
+    return USBH_FAIL;
+  }
+
+  AUDIO_Handle = (AUDIO_HandleTypeDef *) phost->pActiveClass->pData;
+  stream = &AUDIO_Handle->Stream[dir];
+
+  if (stream->state != AUDIO_STREAM_IDLE)
+  {
+    return USBH_BUSY;
+  }
+
+  if (AUDIO_FindSetting(phost, dir, format) != USBH_OK)
+  {
+    USBH_ErrLog("AUDIO: no alternate setting for %lu Hz, %d channels of %d bytes",
+                (unsigned long)format->SampleRate, (int)format->Channels, (int)format->SubframeSize);
+    return USBH_NOT_SUPPORTED;
+  }
+
+  stream->Format = *format;
+  stream->FrameSize = (uint32_t)format->Channels * format->SubframeSize;
+  (void)USBH_memset(&stream->Stats, 0, sizeof(AUDIO_StatsTypeDef));
+
+  pjit = &stream->Jitter;
+  (void)USBH_memset(pjit, 0, sizeof(AUDIO_JitterTypeDef));
+  pjit->pRing = pring;
+  pjit->Size = size;
+  pjit->MsBytes = ((format->SampleRate + 999U) / 1000U) * stream->FrameSize;
+  pjit->Prefill = 1U;
+  AUDIO_JitterLimits(stream);
+  stream->Stats.Target = pjit->Target;
+
+  stream->state = AUDIO_STREAM_SET_INTERFACE;
+
+  (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  Stop a running stream and select its zero bandwidth setting.
+  *         USBH_AUDIO_StreamStopped is called once done; the ring is then
+  *         released to the application.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @retval USBH_BUSY while the stream is being set up or torn down
+  */
+USBH_StatusTypeDef USBH_AUDIO_Stop(USBH_HandleTypeDef *phost, uint8_t dir)
+{
+  AUDIO_StreamTypeDef *stream;
+
+  if ((phost->gState != HOST_CLASS) || (phost->pActiveClass == NULL) ||
+      (phost->pActiveClass->pData == NULL) || (phost->pActiveClass->ClassCode != USB_AUDIO_CLASS) ||
+      (dir >= AUDIO_NUM_STREAMS))
+  {
+    return USBH_FAIL;
+  }
+
+  stream = &((AUDIO_HandleTypeDef *) phost->pActiveClass->pData)->Stream[dir];
+
+  if (stream->state == AUDIO_STREAM_IDLE)
+  {
+    return USBH_OK;
+  }
+
+  if (stream->state != AUDIO_STREAM_RUN)
+  {
+    return USBH_BUSY;
+  }
+
+  /* Withdraw the stream from the SOF interrupt */
+  __atomic_store_n(&stream->state, AUDIO_STREAM_CLOSE, __ATOMIC_RELEASE);
+
+  (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  Bound the latency of a stream. The jitter buffer starts at the
+  *         minimum, grows by 1 ms per underrun up to the maximum and never
+  *         holds more than the maximum; it takes effect at once.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @param  min_ms: Starting latency, at least 1 ms
+  * @param  max_ms: Latency bound, at least min_ms
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_AUDIO_SetLatency(USBH_HandleTypeDef *phost, uint8_t dir,
+                                         uint8_t min_ms, uint8_t max_ms)
+{
+  AUDIO_StreamTypeDef *stream;
+
+  if ((phost->pActiveClass == NULL) || (phost->pActiveClass->pData == NULL) ||
+      (phost->pActiveClass->ClassCode != USB_AUDIO_CLASS) || (dir >= AUDIO_NUM_STREAMS) ||
+      (min_ms == 0U) || (max_ms < min_ms))
+  {
+    return USBH_FAIL;
+  }
+
+  stream = &((AUDIO_HandleTypeDef *) phost->pActiveClass->pData)->Stream[dir];
+
+  stream->LatencyMin = min_ms;
+  stream->LatencyMax = max_ms;
+
+  if (stream->state != AUDIO_STREAM_IDLE)
+  {
+    stream->Jitter.Target = 0U;
+    AUDIO_JitterLimits(stream);
+  }
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  Queue playback samples. Lock-free for one producer, which may
+  *         run in thread or interrupt context.
+  * @param  phost: Host handle
+  * @param  pbuff: Whole sample frames
+  * @param  length: Bytes
+  * @retval Bytes queued; the rest is beyond the latency bound and dropped
+  */
+uint32_t USBH_AUDIO_Write(USBH_HandleTypeDef *phost, const uint8_t *pbuff, uint32_t length)
+{
+  AUDIO_StreamTypeDef *stream;
+
+  if ((phost->pActiveClass == NULL) || (phost->pActiveClass->pData == NULL) ||
+      (phost->pActiveClass->ClassCode != USB_AUDIO_CLASS))
+  {
+    return 0U;
+  }
+
+  stream = &((AUDIO_HandleTypeDef *) phost->pActiveClass->pData)->Stream[AUDIO_PLAYBACK];
+
+  if ((stream->state == AUDIO_STREAM_IDLE) || (stream->state == AUDIO_STREAM_CLOSE) ||
+      (stream->state == AUDIO_STREAM_RESET_INTERFACE))
+  {
+    return 0U;
+  }
+
+  return AUDIO_JitterPut(stream, pbuff, length);
+}
+
+
+/**
+  * @brief  Take capture samples. Lock-free for one consumer, which may run
+  *         in thread or interrupt context. Call it at the sample rate: the
+  *         buffer is filled with silence while the jitter buffer prefills.
+  * @param  phost: Host handle
+  * @param  pbuff: Destination
+  * @param  length: Bytes, trimmed to whole sample frames
+  * @retval Bytes of captured audio, the rest of the buffer is silence
+  */
+uint32_t USBH_AUDIO_Read(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length)
+{
+  AUDIO_StreamTypeDef *stream;
+
+  if ((phost->pActiveClass == NULL) || (phost->pActiveClass->pData == NULL) ||
+      (phost->pActiveClass->ClassCode != USB_AUDIO_CLASS))
+  {
+    return 0U;
+  }
+
+  stream = &((AUDIO_HandleTypeDef *) phost->pActiveClass->pData)->Stream[AUDIO_CAPTURE];
+
+  if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) != AUDIO_STREAM_RUN)
+  {
+    return 0U;
+  }
+
+  return AUDIO_JitterGet(stream, pbuff, length - (length % stream->FrameSize));
+}
+
+
+/**
+  * @brief  Return the counters and the jitter buffer state of a stream.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @param  pstats: Destination
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_AUDIO_GetStats(USBH_HandleTypeDef *phost, uint8_t dir,
+                                       AUDIO_StatsTypeDef *pstats)
+{
+  AUDIO_StreamTypeDef *stream;
+
+  if ((phost->pActiveClass == NULL) || (phost->pActiveClass->pData == NULL) ||
+      (phost->pActiveClass->ClassCode != USB_AUDIO_CLASS) || (dir >= AUDIO_NUM_STREAMS) ||
+      (pstats == NULL))
+  {
+    return USBH_FAIL;
+  }
+
+  stream = &((AUDIO_HandleTypeDef *) phost->pActiveClass->pData)->Stream[dir];
+
+  *pstats = stream->Stats;
+  pstats->Level = __atomic_load_n(&stream->Jitter.Head, __ATOMIC_ACQUIRE) -
+                  __atomic_load_n(&stream->Jitter.Tail, __ATOMIC_ACQUIRE);
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  The stream moves packets.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @retval None
+  */
+__weak void USBH_AUDIO_StreamStarted(USBH_HandleTypeDef *phost, uint8_t dir)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(phost);
+  UNUSED(dir);
+}
+
+/**
+  * @brief  The stream stopped, or failed to start; its ring is released.
+  * @param  phost: Host handle
+  * @param  dir: AUDIO_PLAYBACK or AUDIO_CAPTURE
+  * @retval None
+  */
+__weak void USBH_AUDIO_StreamStopped(USBH_HandleTypeDef *phost, uint8_t dir)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(phost);
+  UNUSED(dir);
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+
+/**
+  * @}
+  */
+
@@ -125,6 +125,61 @@ extern "C" {
 #define CDC_DEACTIVATE_SIGNAL_DTR                               0x0000U
 
 #define LINE_CODING_STRUCTURE_SIZE                              0x07U
+
+/* Notification codes (PSTN 6.5) */
+#define CDC_NOTIFICATION_NETWORK_CONNECTION                     0x00U
+#define CDC_NOTIFICATION_RESPONSE_AVAILABLE                     0x01U
+#define CDC_NOTIFICATION_SERIAL_STATE                           0x20U
+
+#define CDC_NOTIFICATION_HEADER_SIZE                            0x08U
+
+/* SERIAL_STATE bitmap (PSTN 6.5.4) */
+#define CDC_SERIAL_STATE_DCD                                    0x0001U  /* bRxCarrier */
+#define CDC_SERIAL_STATE_DSR                                    0x0002U  /* bTxCarrier */
+#define CDC_SERIAL_STATE_BREAK                                  0x0004U
+#define CDC_SERIAL_STATE_RING                                   0x0008U
+#define CDC_SERIAL_STATE_FRAMING                                0x0010U
+#define CDC_SERIAL_STATE_PARITY                                 0x0020U
+#define CDC_SERIAL_STATE_OVERRUN                                0x0040U
+
+/* Notification assembly buffer: header plus the largest payload decoded */
+#ifndef USBH_CDC_NOTIF_BUFFER_SIZE
+#define USBH_CDC_NOTIF_BUFFER_SIZE                              16U
+#endif /* USBH_CDC_NOTIF_BUFFER_SIZE */
+
+/* Longest notification polling period in (micro)frames, whatever the
+   endpoint bInterval asks for */
+#ifndef USBH_CDC_NOTIF_MAX_POLL
+#define USBH_CDC_NOTIF_MAX_POLL                                 64U
+#endif /* USBH_CDC_NOTIF_MAX_POLL */
+
+#if (USBH_CDC_NOTIF_BUFFER_SIZE < 12U) || ((USBH_CDC_NOTIF_BUFFER_SIZE & 3U) != 0U)
+#error "USBH_CDC_NOTIF_BUFFER_SIZE must be a multiple of 4, at least 12"
+#endif
+
+/* Streaming reception: number of class-owned buffers, a power of two >= 2 */
+#ifndef USBH_CDC_RX_STREAM_NUM_BUFFERS
+#define USBH_CDC_RX_STREAM_NUM_BUFFERS                          2U
+#endif /* USBH_CDC_RX_STREAM_NUM_BUFFERS */
+
+/* Streaming reception: size of each buffer, trimmed to whole IN packets */
+#ifndef USBH_CDC_RX_STREAM_BUFFER_SIZE
+#define USBH_CDC_RX_STREAM_BUFFER_SIZE                          512U
+#endif /* USBH_CDC_RX_STREAM_BUFFER_SIZE */
+
+#if (USBH_CDC_RX_STREAM_NUM_BUFFERS < 2U) || \
+    ((USBH_CDC_RX_STREAM_NUM_BUFFERS & (USBH_CDC_RX_STREAM_NUM_BUFFERS - 1U)) != 0U)
+#error "USBH_CDC_RX_STREAM_NUM_BUFFERS must be a power of two, at least 2"
+#endif
+
+/* Transmit ring behind USBH_CDC_Write, in bytes, a power of two */
+#ifndef USBH_CDC_TX_RING_SIZE
+#define USBH_CDC_TX_RING_SIZE                                   1024U
+#endif /* USBH_CDC_TX_RING_SIZE */
+
+#if (USBH_CDC_TX_RING_SIZE < 4U) || ((USBH_CDC_TX_RING_SIZE & (USBH_CDC_TX_RING_SIZE - 1U)) != 0U)
+#error "USBH_CDC_TX_RING_SIZE must be a power of two, at least 4"
+#endif
 /**
   * @}
   */
@@ -141,6 +196,8 @@ typedef enum
   CDC_SEND_DATA_WAIT,
   CDC_RECEIVE_DATA,
   CDC_RECEIVE_DATA_WAIT,
+  CDC_RECEIVE_STREAM,
+  CDC_RECEIVE_STREAM_WAIT,
 }
 CDC_DataStateTypeDef;
 
@@ -154,6 +211,16 @@ typedef enum
 }
 CDC_StateTypeDef;
 
+/* States for the notification endpoint polling */
+typedef enum
+{
+  CDC_NOTIF_IDLE = 0U,
+  CDC_NOTIF_POLL,
+  CDC_NOTIF_POLL_WAIT,
+  CDC_NOTIF_POLL_DELAY,
+}
+CDC_NotifStateTypeDef;
+
 
 /*Line coding structure*/
 typedef union _CDC_LineCodingStructure
@@ -326,6 +393,10 @@ typedef struct
   uint8_t              NotifEp;
   uint8_t              buff[8];
   uint16_t             NotifEpSize;
+  uint16_t             poll;
+  uint32_t             timer;
+  uint8_t              *pNotifBuff;     /* Assembly buffer, then one packet */
+  uint32_t             NotifLength;     /* Notification bytes received so far */
 }
 CDC_CommItfTypedef;
 
@@ -350,13 +421,31 @@ typedef struct _CDC_Process
   uint8_t                           *pRxData;
   uint32_t                           TxDataLength;
   uint32_t                           RxDataLength;
+  uint32_t                           TxXferLength;
+  uint8_t                            TxZlpPending;
   CDC_InterfaceDesc_Typedef         CDC_Desc;
   CDC_LineCodingTypeDef             LineCoding;
   CDC_LineCodingTypeDef             *pUserLineCoding;
   CDC_StateTypeDef                  state;
   CDC_DataStateTypeDef              data_tx_state;
   CDC_DataStateTypeDef              data_rx_state;
+  CDC_NotifStateTypeDef             notif_state;
+  uint16_t                          SerialState;
   uint8_t                           Rx_Poll;
+  uint8_t                           RxStreamActive;
+  uint8_t                           RxStreamBlocked;
+  uint8_t                           *RxStreamBuff[USBH_CDC_RX_STREAM_NUM_BUFFERS];
+  uint32_t                          RxStreamLength[USBH_CDC_RX_STREAM_NUM_BUFFERS];
+  volatile uint32_t                 RxStreamHead;     /* Buffers filled, written by the class */
+  volatile uint32_t                 RxStreamTail;     /* Buffers released, written by the application */
+  uint32_t                          RxOverrunCount;
+  uint8_t                           *TxRing;
+  uint32_t                          TxRingHead;       /* Bytes queued, written by the producer */
+  uint32_t                          TxRingTail;       /* Bytes sent, written by the class */
+  uint32_t                          TxRingSpan;       /* Ring bytes in the transfer in flight */
+  uint32_t                          TxRingBounce;     /* Word aligned copy of a misaligned span */
+  uint32_t                          TxRingHighWater;
+  uint32_t                          TxRingDropped;
 }
 CDC_HandleTypeDef;
 
@@ -410,6 +499,26 @@ USBH_StatusTypeDef  USBH_CDC_Receive(USBH_HandleTypeDef *phost,
 
 uint16_t            USBH_CDC_GetLastReceivedDataSize(USBH_HandleTypeDef *phost);
 
+USBH_StatusTypeDef  USBH_CDC_StartReceiveStream(USBH_HandleTypeDef *phost);
+
+USBH_StatusTypeDef  USBH_CDC_StopReceiveStream(USBH_HandleTypeDef *phost);
+
+USBH_StatusTypeDef  USBH_CDC_ReleaseStreamBuffer(USBH_HandleTypeDef *phost);
+
+uint32_t            USBH_CDC_GetRxOverrunCount(USBH_HandleTypeDef *phost);
+
+uint32_t            USBH_CDC_Write(USBH_HandleTypeDef *phost,
+                                   const uint8_t *pbuff,
+                                   uint32_t length);
+
+uint32_t            USBH_CDC_GetTxFree(USBH_HandleTypeDef *phost);
+
+uint32_t            USBH_CDC_GetTxHighWater(USBH_HandleTypeDef *phost);
+
+uint32_t            USBH_CDC_GetTxDropCount(USBH_HandleTypeDef *phost);
+
+uint16_t            USBH_CDC_GetSerialState(USBH_HandleTypeDef *phost);
+
 USBH_StatusTypeDef  USBH_CDC_Stop(USBH_HandleTypeDef *phost);
 
 void USBH_CDC_LineCodingChanged(USBH_HandleTypeDef *phost);
@@ -418,6 +527,12 @@ void USBH_CDC_TransmitCallback(USBH_HandleTypeDef *phost);
 
 void USBH_CDC_ReceiveCallback(USBH_HandleTypeDef *phost);
 
+void USBH_CDC_ReceiveStreamCallback(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length);
+
+void USBH_CDC_SerialStateCallback(USBH_HandleTypeDef *phost, uint16_t state);
+
+void USBH_CDC_ResponseAvailableCallback(USBH_HandleTypeDef *phost);
+
 /**
   * @}
   */
@@ -77,6 +77,9 @@ EndBSPDependencies */
   * @{
   */
 #define USBH_CDC_BUFFER_SIZE                 1024
+
+/* Largest packet count the OTG channel moves per OUT submission (HC_MAX_PKT_CNT) */
+#define USBH_CDC_MAX_TX_PACKETS              256U
 /**
   * @}
   */
@@ -85,6 +88,13 @@ EndBSPDependencies */
 /** @defgroup USBH_CDC_CORE_Private_Macros
   * @{
   */
+#if (USBH_USE_DMA == 1U)
+#define CDC_BUFF_ALLOC(size)                 USBH_dma_malloc(size)
+#define CDC_BUFF_FREE(ptr)                   USBH_dma_free(ptr)
+#else
+#define CDC_BUFF_ALLOC(size)                 USBH_malloc(size)
+#define CDC_BUFF_FREE(ptr)                   USBH_free(ptr)
+#endif /* (USBH_USE_DMA == 1U) */
 /**
   * @}
   */
@@ -122,6 +132,16 @@ static void CDC_ProcessTransmission(USBH_HandleTypeDef *phost);
 
 static void CDC_ProcessReception(USBH_HandleTypeDef *phost);
 
+static uint32_t CDC_GetTxXferSize(CDC_HandleTypeDef *CDC_Handle);
+
+static void CDC_ArmReceiveStream(USBH_HandleTypeDef *phost);
+
+static uint32_t CDC_GetTxRingSpan(CDC_HandleTypeDef *CDC_Handle);
+
+static void CDC_ProcessNotification(USBH_HandleTypeDef *phost);
+
+static void CDC_DecodeNotification(USBH_HandleTypeDef *phost);
+
 USBH_ClassTypeDef  CDC_Class =
 {
   "CDC",
@@ -183,6 +203,16 @@ static USBH_StatusTypeDef USBH_CDC_InterfaceInit(USBH_HandleTypeDef *phost)
   /* Initialize cdc handler */
   (void)USBH_memset(CDC_Handle, 0, sizeof(CDC_HandleTypeDef));
 
+  /* USBH_CDC_Write needs its ring: enumeration stops without it */
+  CDC_Handle->TxRing = (uint8_t *)CDC_BUFF_ALLOC(USBH_CDC_TX_RING_SIZE);
+
+  if (CDC_Handle->TxRing == NULL)
+  {
+    USBH_ErrLog("CDC: cannot allocate transmit ring");
+    (void)USBH_CDC_InterfaceDeInit(phost);
+    return USBH_FAIL;
+  }
+
   /*Collect the notification endpoint address and length*/
   if ((phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bEndpointAddress & 0x80U) != 0U)
   {
@@ -193,6 +223,13 @@ static USBH_StatusTypeDef USBH_CDC_InterfaceInit(USBH_HandleTypeDef *phost)
   /*Allocate the length for host channel number in*/
   CDC_Handle->CommItf.NotifPipe = USBH_AllocPipe(phost, CDC_Handle->CommItf.NotifEp);
 
+  /* Host channels are shared by every device behind a hub */
+  if (CDC_Handle->CommItf.NotifPipe >= USBH_MAX_PIPES_NBR)
+  {
+    USBH_ErrLog("CDC: no free host channel");
+    return USBH_FAIL;
+  }
+
   /* Open pipe for Notification endpoint */
   (void)USBH_OpenPipe(phost, CDC_Handle->CommItf.NotifPipe, CDC_Handle->CommItf.NotifEp,
                       phost->device.address, phost->device.speed, USB_EP_TYPE_INTR,
@@ -200,6 +237,38 @@ static USBH_StatusTypeDef USBH_CDC_InterfaceInit(USBH_HandleTypeDef *phost)
 
   (void)USBH_LL_SetToggle(phost, CDC_Handle->CommItf.NotifPipe, 0U);
 
+  /* bInterval counts (micro)frames as 2^(bInterval-1) at high speed */
+  CDC_Handle->CommItf.poll = phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bInterval;
+
+  if (phost->device.speed == (uint8_t)USBH_SPEED_HIGH)
+  {
+    CDC_Handle->CommItf.poll = (uint16_t)(1U << (MIN(MAX(CDC_Handle->CommItf.poll, 1U), 13U) - 1U));
+  }
+
+  CDC_Handle->CommItf.poll = (uint16_t)MIN(MAX(CDC_Handle->CommItf.poll, 1U), USBH_CDC_NOTIF_MAX_POLL);
+
+  /* Packets land behind the assembly area, so every DMA transfer starts aligned */
+  if ((CDC_Handle->CommItf.NotifEp != 0U) && (CDC_Handle->CommItf.NotifEpSize != 0U))
+  {
+    CDC_Handle->CommItf.pNotifBuff = (uint8_t *)CDC_BUFF_ALLOC(USBH_CDC_NOTIF_BUFFER_SIZE +
+                                                               (uint32_t)CDC_Handle->CommItf.NotifEpSize);
+  }
+
+  if (CDC_Handle->CommItf.pNotifBuff != NULL)
+  {
+    CDC_Handle->notif_state = CDC_NOTIF_POLL;
+  }
+  else if ((CDC_Handle->CommItf.NotifEp != 0U) && (CDC_Handle->CommItf.NotifEpSize != 0U))
+  {
+    USBH_ErrLog("CDC: cannot allocate notification buffer");
+    (void)USBH_CDC_InterfaceDeInit(phost);
+    return USBH_FAIL;
+  }
+  else
+  {
+    USBH_ErrLog("CDC: notifications unavailable");
+  }
+
   interface = USBH_FindInterface(phost, DATA_INTERFACE_CLASS_CODE,
                                    RESERVED, NO_CLASS_SPECIFIC_PROTOCOL_CODE);
 
@@ -238,6 +307,13 @@ static USBH_StatusTypeDef USBH_CDC_InterfaceInit(USBH_HandleTypeDef *phost)
   /*Allocate the length for host channel number in*/
   CDC_Handle->DataItf.InPipe = USBH_AllocPipe(phost, CDC_Handle->DataItf.InEp);
 
+  if ((CDC_Handle->DataItf.OutPipe >= USBH_MAX_PIPES_NBR) ||
+      (CDC_Handle->DataItf.InPipe >= USBH_MAX_PIPES_NBR))
+  {
+    USBH_ErrLog("CDC: no free host channel");
+    return USBH_FAIL;
+  }
+
   /* Open channel for OUT endpoint */
   (void)USBH_OpenPipe(phost, CDC_Handle->DataItf.OutPipe, CDC_Handle->DataItf.OutEp,
                       phost->device.address, phost->device.speed, USB_EP_TYPE_BULK,
@@ -267,6 +343,13 @@ static USBH_StatusTypeDef USBH_CDC_InterfaceInit(USBH_HandleTypeDef *phost)
 static USBH_StatusTypeDef USBH_CDC_InterfaceDeInit(USBH_HandleTypeDef *phost)
 {
   CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+  uint32_t idx;
+
+  /* Already released by a failed USBH_CDC_InterfaceInit */
+  if (CDC_Handle == NULL)
+  {
+    return USBH_OK;
+  }
 
   if ((CDC_Handle->CommItf.NotifPipe) != 0U)
   {
@@ -289,6 +372,27 @@ static USBH_StatusTypeDef USBH_CDC_InterfaceDeInit(USBH_HandleTypeDef *phost)
     CDC_Handle->DataItf.OutPipe = 0U;    /* Reset the Channel as Free */
   }
 
+  for (idx = 0U; idx < USBH_CDC_RX_STREAM_NUM_BUFFERS; idx++)
+  {
+    if (CDC_Handle->RxStreamBuff[idx] != NULL)
+    {
+      CDC_BUFF_FREE(CDC_Handle->RxStreamBuff[idx]);
+      CDC_Handle->RxStreamBuff[idx] = NULL;
+    }
+  }
+
+  if (CDC_Handle->TxRing != NULL)
+  {
+    CDC_BUFF_FREE(CDC_Handle->TxRing);
+    CDC_Handle->TxRing = NULL;
+  }
+
+  if (CDC_Handle->CommItf.pNotifBuff != NULL)
+  {
+    CDC_BUFF_FREE(CDC_Handle->CommItf.pNotifBuff);
+    CDC_Handle->CommItf.pNotifBuff = NULL;
+  }
+
   if ((phost->pActiveClass->pData) != NULL)
   {
     USBH_free(phost->pActiveClass->pData);
@@ -341,10 +445,20 @@ static USBH_StatusTypeDef USBH_CDC_Process(USBH_HandleTypeDef *phost)
   USBH_StatusTypeDef req_status = USBH_OK;
   CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
 
+  /* The notification endpoint is polled alongside every other state */
+  CDC_ProcessNotification(phost);
+
   switch (CDC_Handle->state)
   {
 
     case CDC_IDLE_STATE:
+      /* Data queued by USBH_CDC_Write restarts the transfers */
+      if (CDC_GetTxRingSpan(CDC_Handle) != 0U)
+      {
+        CDC_Handle->state = CDC_TRANSFER_DATA;
+
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
       status = USBH_OK;
       break;
 
@@ -371,7 +485,8 @@ static USBH_StatusTypeDef USBH_CDC_Process(USBH_HandleTypeDef *phost)
 
       if (req_status == USBH_OK)
       {
-        CDC_Handle->state = CDC_IDLE_STATE;
+        /* Resume a reception stream interrupted by the line coding request */
+        CDC_Handle->state = (CDC_Handle->RxStreamActive != 0U) ? CDC_TRANSFER_DATA : CDC_IDLE_STATE;
 
         if ((CDC_Handle->LineCoding.b.bCharFormat == CDC_Handle->pUserLineCoding->b.bCharFormat) &&
             (CDC_Handle->LineCoding.b.bDataBits == CDC_Handle->pUserLineCoding->b.bDataBits) &&
@@ -415,14 +530,27 @@ static USBH_StatusTypeDef USBH_CDC_Process(USBH_HandleTypeDef *phost)
 
 /**
   * @brief  USBH_CDC_SOFProcess
-  *         The function is for managing SOF callback
+  *         The function is for managing SOF callback: it schedules the
+  *         notification endpoint polling and the NAKed transmissions.
   * @param  phost: Host handle
   * @retval USBH Status
   */
 static USBH_StatusTypeDef USBH_CDC_SOFProcess(USBH_HandleTypeDef *phost)
 {
-  /* Prevent unused argument(s) compilation warning */
-  UNUSED(phost);
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if ((CDC_Handle->notif_state == CDC_NOTIF_POLL_DELAY) &&
+      ((phost->Timer - CDC_Handle->CommItf.timer) >= CDC_Handle->CommItf.poll))
+  {
+    return USBH_BUSY;
+  }
+
+  /* Resume a transmission held back by the NAK backoff */
+  if ((CDC_Handle->state == CDC_TRANSFER_DATA) && (CDC_Handle->data_tx_state == CDC_SEND_DATA) &&
+      (USBH_PipeRetryDue(phost, CDC_Handle->DataItf.OutPipe) != 0U))
+  {
+    return USBH_BUSY;
+  }
 
   return USBH_OK;
 }
@@ -441,6 +569,7 @@ USBH_StatusTypeDef USBH_CDC_Stop(USBH_HandleTypeDef *phost)
   if (phost->gState == HOST_CLASS)
   {
     CDC_Handle->state = CDC_IDLE_STATE;
+    CDC_Handle->notif_state = CDC_NOTIF_IDLE;
 
     (void)USBH_ClosePipe(phost, CDC_Handle->CommItf.NotifPipe);
     (void)USBH_ClosePipe(phost, CDC_Handle->DataItf.InPipe);
@@ -508,14 +637,7 @@ USBH_StatusTypeDef USBH_CDC_SetLineCoding(USBH_HandleTypeDef *phost,
     CDC_Handle->state = CDC_SET_LINE_CODING_STATE;
     CDC_Handle->pUserLineCoding = linecoding;
 
-#if (USBH_USE_OS == 1U)
-    phost->os_msg = (uint32_t)USBH_CLASS_EVENT;
-#if (osCMSIS < 0x20000U)
-    (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-    (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+    (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
   }
 
   return USBH_OK;
@@ -574,22 +696,17 @@ USBH_StatusTypeDef USBH_CDC_Transmit(USBH_HandleTypeDef *phost, uint8_t *pbuff,
   USBH_StatusTypeDef Status = USBH_BUSY;
   CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
 
-  if ((CDC_Handle->state == CDC_IDLE_STATE) || (CDC_Handle->state == CDC_TRANSFER_DATA))
+  if (((CDC_Handle->state == CDC_IDLE_STATE) || (CDC_Handle->state == CDC_TRANSFER_DATA)) &&
+      (CDC_Handle->TxRingSpan == 0U))
   {
     CDC_Handle->pTxData = pbuff;
     CDC_Handle->TxDataLength = length;
+    CDC_Handle->TxZlpPending = 0U;
     CDC_Handle->state = CDC_TRANSFER_DATA;
     CDC_Handle->data_tx_state = CDC_SEND_DATA;
     Status = USBH_OK;
 
-#if (USBH_USE_OS == 1U)
-    phost->os_msg = (uint32_t)USBH_CLASS_EVENT;
-#if (osCMSIS < 0x20000U)
-    (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-    (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+    (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
   }
   return Status;
 }
@@ -605,7 +722,9 @@ USBH_StatusTypeDef USBH_CDC_Receive(USBH_HandleTypeDef *phost, uint8_t *pbuff, u
   USBH_StatusTypeDef Status = USBH_BUSY;
   CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
 
-  if ((CDC_Handle->state == CDC_IDLE_STATE) || (CDC_Handle->state == CDC_TRANSFER_DATA))
+  if (((CDC_Handle->state == CDC_IDLE_STATE) || (CDC_Handle->state == CDC_TRANSFER_DATA)) &&
+      (CDC_Handle->data_rx_state != CDC_RECEIVE_STREAM) &&
+      (CDC_Handle->data_rx_state != CDC_RECEIVE_STREAM_WAIT))
   {
     CDC_Handle->pRxData = pbuff;
     CDC_Handle->RxDataLength = length;
@@ -613,18 +732,255 @@ USBH_StatusTypeDef USBH_CDC_Receive(USBH_HandleTypeDef *phost, uint8_t *pbuff, u
     CDC_Handle->data_rx_state = CDC_RECEIVE_DATA;
     Status = USBH_OK;
 
-#if (USBH_USE_OS == 1U)
-    phost->os_msg = (uint32_t)USBH_CLASS_EVENT;
-#if (osCMSIS < 0x20000U)
-    (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-    (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+    (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
   }
   return Status;
 }
 
+/**
+  * @brief  Start streaming reception into class-owned buffers.
+  *         The IN pipe is re-armed as soon as a buffer fills, and each filled
+  *         buffer is passed to USBH_CDC_ReceiveStreamCallback. It stays owned
+  *         by the application until USBH_CDC_ReleaseStreamBuffer is called.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_CDC_StartReceiveStream(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+  uint32_t idx;
+
+  if ((phost->gState != HOST_CLASS) ||
+      ((CDC_Handle->state != CDC_IDLE_STATE) && (CDC_Handle->state != CDC_TRANSFER_DATA)) ||
+      (CDC_Handle->data_rx_state == CDC_RECEIVE_DATA) ||
+      (CDC_Handle->data_rx_state == CDC_RECEIVE_DATA_WAIT))
+  {
+    return USBH_BUSY;
+  }
+
+  if ((CDC_Handle->DataItf.InEpSize == 0U) ||
+      (CDC_Handle->DataItf.InEpSize > USBH_CDC_RX_STREAM_BUFFER_SIZE))
+  {
+    return USBH_FAIL;
+  }
+
+  for (idx = 0U; idx < USBH_CDC_RX_STREAM_NUM_BUFFERS; idx++)
+  {
+    if (CDC_Handle->RxStreamBuff[idx] == NULL)
+    {
+      CDC_Handle->RxStreamBuff[idx] = (uint8_t *)CDC_BUFF_ALLOC(USBH_CDC_RX_STREAM_BUFFER_SIZE);
+
+      if (CDC_Handle->RxStreamBuff[idx] == NULL)
+      {
+        USBH_ErrLog("CDC: cannot allocate reception stream buffer");
+        return USBH_FAIL;
+      }
+    }
+  }
+
+  if (CDC_Handle->data_rx_state == CDC_IDLE)
+  {
+    CDC_Handle->RxStreamHead = 0U;
+    CDC_Handle->RxStreamTail = 0U;
+    CDC_Handle->RxStreamBlocked = 0U;
+    CDC_Handle->data_rx_state = CDC_RECEIVE_STREAM;
+  }
+
+  CDC_Handle->RxStreamActive = 1U;
+  CDC_Handle->state = CDC_TRANSFER_DATA;
+
+  (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Stop streaming reception. The URB in flight completes into its
+  *         buffer and is discarded; buffers not yet released are dropped.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_CDC_StopReceiveStream(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  CDC_Handle->RxStreamActive = 0U;
+
+  (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Give the oldest buffer passed to USBH_CDC_ReceiveStreamCallback
+  *         back to the class.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_CDC_ReleaseStreamBuffer(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if (CDC_Handle->RxStreamHead == CDC_Handle->RxStreamTail)
+  {
+    return USBH_FAIL;
+  }
+
+  CDC_Handle->RxStreamTail++;
+
+  if (CDC_Handle->RxStreamBlocked != 0U)
+  {
+    (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  Return how many times the reception stream found every buffer
+  *         held by the application and had to leave the IN pipe idle.
+  * @param  phost: Host handle
+  * @retval Overrun count
+  */
+uint32_t USBH_CDC_GetRxOverrunCount(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  return CDC_Handle->RxOverrunCount;
+}
+
+/**
+  * @brief  Queue data on the transmit ring without blocking.
+  *         Lock-free for one producer, which may run in thread or interrupt
+  *         context; the class sends the ring in place from its process.
+  * @param  phost: Host handle
+  * @param  pbuff: Data to send
+  * @param  length: Number of bytes to send
+  * @retval Number of bytes queued; the rest is counted as dropped
+  */
+uint32_t USBH_CDC_Write(USBH_HandleTypeDef *phost, const uint8_t *pbuff, uint32_t length)
+{
+  CDC_HandleTypeDef *CDC_Handle;
+  uint32_t head;
+  uint32_t used;
+  uint32_t count;
+  uint32_t offset;
+  uint32_t chunk;
+
+  if ((phost->gState != HOST_CLASS) || (phost->pActiveClass == NULL) ||
+      (phost->pActiveClass->pData == NULL))
+  {
+    return 0U;
+  }
+
+  CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if (CDC_Handle->TxRing == NULL)
+  {
+    return 0U;
+  }
+
+  head = CDC_Handle->TxRingHead;
+  used = head - __atomic_load_n(&CDC_Handle->TxRingTail, __ATOMIC_ACQUIRE);
+  count = USBH_CDC_TX_RING_SIZE - used;
+
+  if (length < count)
+  {
+    count = length;
+  }
+
+  offset = head & (USBH_CDC_TX_RING_SIZE - 1U);
+  chunk = USBH_CDC_TX_RING_SIZE - offset;
+
+  if (chunk > count)
+  {
+    chunk = count;
+  }
+
+  (void)USBH_memcpy(&CDC_Handle->TxRing[offset], pbuff, chunk);
+  (void)USBH_memcpy(CDC_Handle->TxRing, &pbuff[chunk], count - chunk);
+
+  CDC_Handle->TxRingDropped += length - count;
+
+  if ((used + count) > CDC_Handle->TxRingHighWater)
+  {
+    CDC_Handle->TxRingHighWater = used + count;
+  }
+
+  if (count != 0U)
+  {
+    /* Publish the data to the class */
+    __atomic_store_n(&CDC_Handle->TxRingHead, head + count, __ATOMIC_RELEASE);
+
+    (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+  }
+
+  return count;
+}
+
+/**
+  * @brief  Return the room left in the transmit ring, for writers that must
+  *         queue a record whole or not at all.
+  * @param  phost: Host handle
+  * @retval Free bytes, 0 when the class is not running
+  */
+uint32_t USBH_CDC_GetTxFree(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle;
+
+  if ((phost->gState != HOST_CLASS) || (phost->pActiveClass == NULL) ||
+      (phost->pActiveClass->pData == NULL))
+  {
+    return 0U;
+  }
+
+  CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if (CDC_Handle->TxRing == NULL)
+  {
+    return 0U;
+  }
+
+  return USBH_CDC_TX_RING_SIZE - (CDC_Handle->TxRingHead -
+                                  __atomic_load_n(&CDC_Handle->TxRingTail, __ATOMIC_ACQUIRE));
+}
+
+/**
+  * @brief  Return the highest fill level of the transmit ring, in bytes.
+  * @param  phost: Host handle
+  * @retval High-water mark
+  */
+uint32_t USBH_CDC_GetTxHighWater(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  return CDC_Handle->TxRingHighWater;
+}
+
+/**
+  * @brief  Return the number of bytes USBH_CDC_Write could not queue.
+  * @param  phost: Host handle
+  * @retval Dropped byte count
+  */
+uint32_t USBH_CDC_GetTxDropCount(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  return CDC_Handle->TxRingDropped;
+}
+
+/**
+  * @brief  Return the last serial state reported by the device
+  * @param  phost: Host handle
+  * @retval SERIAL_STATE bitmap, see CDC_SERIAL_STATE_xxx
+  */
+uint16_t USBH_CDC_GetSerialState(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  return CDC_Handle->SerialState;
+}
+
 /**
   * @brief  The function is responsible for sending data to the device
   *  @param  pdev: Selected device
@@ -634,27 +990,63 @@ static void CDC_ProcessTransmission(USBH_HandleTypeDef *phost)
 {
   CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
   USBH_URBStateTypeDef URB_Status = USBH_URB_IDLE;
+  uint32_t length;
+  uint32_t offset;
 
   switch (CDC_Handle->data_tx_state)
   {
+    case CDC_IDLE:
+      length = CDC_GetTxRingSpan(CDC_Handle);
+
+      if (length != 0U)
+      {
+        offset = CDC_Handle->TxRingTail & (USBH_CDC_TX_RING_SIZE - 1U);
+
+#if (USBH_USE_DMA == 1U)
+        if ((offset & 3U) != 0U)
+        {
+          /* The OTG DMA only reads from word aligned buffers */
+          (void)USBH_memcpy(&CDC_Handle->TxRingBounce, &CDC_Handle->TxRing[offset], length);
+          CDC_Handle->pTxData = (uint8_t *)&CDC_Handle->TxRingBounce;
+        }
+        else
+#endif /* (USBH_USE_DMA == 1U) */
+        {
+          CDC_Handle->pTxData = &CDC_Handle->TxRing[offset];
+        }
+
+        CDC_Handle->TxRingSpan = length;
+        CDC_Handle->TxDataLength = length;
+        CDC_Handle->TxZlpPending = 0U;
+        CDC_Handle->data_tx_state = CDC_SEND_DATA;
+
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      break;
+
     case CDC_SEND_DATA:
-      if (CDC_Handle->TxDataLength > CDC_Handle->DataItf.OutEpSize)
+      /* A NAKed transfer waits for its retry slot, see USBH_CDC_SOFProcess */
+      if (USBH_PipeRetryDue(phost, CDC_Handle->DataItf.OutPipe) == 0U)
       {
-        (void)USBH_BulkSendData(phost,
-                                CDC_Handle->pTxData,
-                                CDC_Handle->DataItf.OutEpSize,
-                                CDC_Handle->DataItf.OutPipe,
-                                1U);
+        break;
+      }
+
+      if (CDC_Handle->TxDataLength > 0U)
+      {
+        CDC_Handle->TxXferLength = CDC_GetTxXferSize(CDC_Handle);
       }
       else
       {
-        (void)USBH_BulkSendData(phost,
-                                CDC_Handle->pTxData,
-                                (uint16_t)CDC_Handle->TxDataLength,
-                                CDC_Handle->DataItf.OutPipe,
-                                1U);
+        /* Zero length packet closing a transfer ending on a full packet */
+        CDC_Handle->TxXferLength = 0U;
       }
 
+      (void)USBH_BulkSendData(phost,
+                              CDC_Handle->pTxData,
+                              (uint16_t)CDC_Handle->TxXferLength,
+                              CDC_Handle->DataItf.OutPipe,
+                              USBH_PipeRetryPing(phost, CDC_Handle->DataItf.OutPipe));
+
       CDC_Handle->data_tx_state = CDC_SEND_DATA_WAIT;
       break;
 
@@ -665,49 +1057,76 @@ static void CDC_ProcessTransmission(USBH_HandleTypeDef *phost)
       /* Check the status done for transmission */
       if (URB_Status == USBH_URB_DONE)
       {
-        if (CDC_Handle->TxDataLength > CDC_Handle->DataItf.OutEpSize)
+        USBH_PipeRetryReset(phost, CDC_Handle->DataItf.OutPipe);
+
+        if (CDC_Handle->TxDataLength > CDC_Handle->TxXferLength)
         {
-          CDC_Handle->TxDataLength -= CDC_Handle->DataItf.OutEpSize;
-          CDC_Handle->pTxData += CDC_Handle->DataItf.OutEpSize;
+          CDC_Handle->TxDataLength -= CDC_Handle->TxXferLength;
+          CDC_Handle->pTxData += CDC_Handle->TxXferLength;
         }
         else
         {
+          if ((CDC_Handle->TxXferLength == 0U) || (CDC_Handle->DataItf.OutEpSize == 0U))
+          {
+            CDC_Handle->TxZlpPending = 0U;
+          }
+          else
+          {
+            /* A transfer ending on a full packet is terminated by a ZLP */
+            CDC_Handle->TxZlpPending = ((CDC_Handle->TxXferLength % CDC_Handle->DataItf.OutEpSize) == 0U) ? 1U : 0U;
+          }
+
+          CDC_Handle->pTxData += CDC_Handle->TxDataLength;
           CDC_Handle->TxDataLength = 0U;
         }
 
-        if (CDC_Handle->TxDataLength > 0U)
+        if ((CDC_Handle->TxDataLength > 0U) || (CDC_Handle->TxZlpPending != 0U))
         {
           CDC_Handle->data_tx_state = CDC_SEND_DATA;
         }
+        else if (CDC_Handle->TxRingSpan != 0U)
+        {
+          /* Hand the span back to the producer */
+          __atomic_store_n(&CDC_Handle->TxRingTail, CDC_Handle->TxRingTail + CDC_Handle->TxRingSpan,
+                           __ATOMIC_RELEASE);
+          CDC_Handle->TxRingSpan = 0U;
+          CDC_Handle->data_tx_state = CDC_IDLE;
+        }
         else
         {
           CDC_Handle->data_tx_state = CDC_IDLE;
           USBH_CDC_TransmitCallback(phost);
         }
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CLASS_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
       }
       else
       {
-        if (URB_Status == USBH_URB_NOTREADY)
+        if ((URB_Status == USBH_URB_NOTREADY) || (URB_Status == USBH_URB_NYET))
         {
+          /* Skip the packets acknowledged before the NAK */
+          length = USBH_LL_GetOutXferCount(phost, CDC_Handle->DataItf.OutPipe);
+
+          if (length < CDC_Handle->TxXferLength)
+          {
+            CDC_Handle->TxDataLength -= length;
+            CDC_Handle->pTxData += length;
+          }
+
+          /* Packets went through: the device is draining, not stalling */
+          if (length != 0U)
+          {
+            USBH_PipeRetryReset(phost, CDC_Handle->DataItf.OutPipe);
+          }
+
+          /* A device that keeps NAKing is retried less and less often */
+          USBH_PipeRetrySchedule(phost, CDC_Handle->DataItf.OutPipe);
           CDC_Handle->data_tx_state = CDC_SEND_DATA;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_CLASS_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          if (USBH_PipeRetryDue(phost, CDC_Handle->DataItf.OutPipe) != 0U)
+          {
+            (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+          }
         }
       }
       break;
@@ -716,6 +1135,34 @@ static void CDC_ProcessTransmission(USBH_HandleTypeDef *phost)
       break;
   }
 }
+
+/**
+  * @brief  Return the size of the next OUT submission.
+  *         With the OTG DMA the channel sends up to USBH_CDC_MAX_TX_PACKETS
+  *         max-packets per URB; in slave mode the FIFO takes one packet.
+  * @param  CDC_Handle: CDC handle
+  * @retval Transfer size in bytes
+  */
+static uint32_t CDC_GetTxXferSize(CDC_HandleTypeDef *CDC_Handle)
+{
+  uint32_t max_xfer = CDC_Handle->DataItf.OutEpSize;
+
+#if (USBH_USE_DMA == 1U)
+  if (max_xfer != 0U)
+  {
+    max_xfer *= USBH_CDC_MAX_TX_PACKETS;
+
+    /* URB length is 16-bit; keep it a whole number of packets */
+    if (max_xfer > 0xFFFFU)
+    {
+      max_xfer = (0xFFFFU / CDC_Handle->DataItf.OutEpSize) * CDC_Handle->DataItf.OutEpSize;
+    }
+  }
+#endif /* (USBH_USE_DMA == 1U) */
+
+  return (CDC_Handle->TxDataLength > max_xfer) ? max_xfer : CDC_Handle->TxDataLength;
+}
+
 /**
   * @brief  This function responsible for reception of data from the device
   *  @param  pdev: Selected device
@@ -727,6 +1174,7 @@ static void CDC_ProcessReception(USBH_HandleTypeDef *phost)
   CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
   USBH_URBStateTypeDef URB_Status = USBH_URB_IDLE;
   uint32_t length;
+  uint32_t slot;
 
   switch (CDC_Handle->data_rx_state)
   {
@@ -763,18 +1211,280 @@ static void CDC_ProcessReception(USBH_HandleTypeDef *phost)
           USBH_CDC_ReceiveCallback(phost);
         }
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CLASS_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      break;
+
+    case CDC_RECEIVE_STREAM:
+      if (CDC_Handle->RxStreamActive != 0U)
+      {
+        CDC_ArmReceiveStream(phost);
+      }
+      else
+      {
+        CDC_Handle->data_rx_state = CDC_IDLE;
+      }
+      break;
+
+    case CDC_RECEIVE_STREAM_WAIT:
+
+      URB_Status = USBH_LL_GetURBState(phost, CDC_Handle->DataItf.InPipe);
+
+      if (URB_Status == USBH_URB_DONE)
+      {
+        slot = CDC_Handle->RxStreamHead & (USBH_CDC_RX_STREAM_NUM_BUFFERS - 1U);
+        length = USBH_LL_GetLastXferSize(phost, CDC_Handle->DataItf.InPipe);
+
+        if (CDC_Handle->RxStreamActive != 0U)
+        {
+          if (length > 0U)
+          {
+            CDC_Handle->RxStreamLength[slot] = length;
+            CDC_Handle->RxStreamHead++;
+          }
+
+          /* Re-arm the IN pipe before handing the buffer over */
+          CDC_ArmReceiveStream(phost);
+
+          if (length > 0U)
+          {
+            USBH_CDC_ReceiveStreamCallback(phost, CDC_Handle->RxStreamBuff[slot], length);
+          }
+        }
+        else
+        {
+          CDC_Handle->data_rx_state = CDC_IDLE;
+        }
+
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Return the length of the next contiguous span of the transmit
+  *         ring. With the OTG DMA, spans end on a word boundary when they
+  *         can, so the following span starts aligned.
+  * @param  CDC_Handle: CDC handle
+  * @retval Span length in bytes, 0 if the ring is empty
+  */
+static uint32_t CDC_GetTxRingSpan(CDC_HandleTypeDef *CDC_Handle)
+{
+  uint32_t used;
+  uint32_t offset;
+  uint32_t span;
+
+  if (CDC_Handle->TxRing == NULL)
+  {
+    return 0U;
+  }
+
+  used = __atomic_load_n(&CDC_Handle->TxRingHead, __ATOMIC_ACQUIRE) - CDC_Handle->TxRingTail;
+  offset = CDC_Handle->TxRingTail & (USBH_CDC_TX_RING_SIZE - 1U);
+  span = USBH_CDC_TX_RING_SIZE - offset;
+
+  if (used < span)
+  {
+    span = used;
+  }
+
+#if (USBH_USE_DMA == 1U)
+  if ((offset & 3U) != 0U)
+  {
+    /* Sent through the bounce word: realign the tail */
+    if (span > (4U - (offset & 3U)))
+    {
+      span = 4U - (offset & 3U);
+    }
+  }
+  else if (span > 3U)
+  {
+    span &= ~3U;
+  }
+  else
+  {
+    /* Less than a word left: send it as is */
+  }
+#endif /* (USBH_USE_DMA == 1U) */
+
+  return span;
+}
+
+/**
+  * @brief  Submit the next free stream buffer on the IN pipe, or record an
+  *         overrun when the application still holds all of them.
+  * @param  phost: Host handle
+  * @retval None
+  */
+static void CDC_ArmReceiveStream(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+  uint32_t slot;
+  uint32_t length;
+
+  if ((CDC_Handle->RxStreamHead - CDC_Handle->RxStreamTail) < USBH_CDC_RX_STREAM_NUM_BUFFERS)
+  {
+    slot = CDC_Handle->RxStreamHead & (USBH_CDC_RX_STREAM_NUM_BUFFERS - 1U);
+    length = (USBH_CDC_RX_STREAM_BUFFER_SIZE / CDC_Handle->DataItf.InEpSize) * CDC_Handle->DataItf.InEpSize;
+
+    (void)USBH_BulkReceiveData(phost,
+                               CDC_Handle->RxStreamBuff[slot],
+                               (uint16_t)length,
+                               CDC_Handle->DataItf.InPipe);
+
+    CDC_Handle->RxStreamBlocked = 0U;
+    CDC_Handle->data_rx_state = CDC_RECEIVE_STREAM_WAIT;
+  }
+  else
+  {
+    if (CDC_Handle->RxStreamBlocked == 0U)
+    {
+      CDC_Handle->RxStreamBlocked = 1U;
+      CDC_Handle->RxOverrunCount++;
+    }
+
+    CDC_Handle->data_rx_state = CDC_RECEIVE_STREAM;
+  }
+}
+
+/**
+  * @brief  This function polls the notification endpoint every bInterval
+  *         and reassembles notifications longer than one packet.
+  * @param  phost: Host handle
+  * @retval None
+  */
+static void CDC_ProcessNotification(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+  USBH_URBStateTypeDef URB_Status;
+  uint32_t length;
+  uint32_t expected;
+
+  switch (CDC_Handle->notif_state)
+  {
+    case CDC_NOTIF_POLL:
+      (void)USBH_InterruptReceiveData(phost, &CDC_Handle->CommItf.pNotifBuff[USBH_CDC_NOTIF_BUFFER_SIZE],
+                                      (uint8_t)MIN(CDC_Handle->CommItf.NotifEpSize, 0xFFU),
+                                      CDC_Handle->CommItf.NotifPipe);
+
+      CDC_Handle->CommItf.timer = phost->Timer;
+      CDC_Handle->notif_state = CDC_NOTIF_POLL_WAIT;
+      break;
+
+    case CDC_NOTIF_POLL_WAIT:
+      URB_Status = USBH_LL_GetURBState(phost, CDC_Handle->CommItf.NotifPipe);
+
+      if (URB_Status == USBH_URB_DONE)
+      {
+        length = USBH_LL_GetLastXferSize(phost, CDC_Handle->CommItf.NotifPipe);
+
+        if (CDC_Handle->CommItf.NotifLength < USBH_CDC_NOTIF_BUFFER_SIZE)
+        {
+          (void)USBH_memcpy(&CDC_Handle->CommItf.pNotifBuff[CDC_Handle->CommItf.NotifLength],
+                            &CDC_Handle->CommItf.pNotifBuff[USBH_CDC_NOTIF_BUFFER_SIZE],
+                            MIN(length, USBH_CDC_NOTIF_BUFFER_SIZE - CDC_Handle->CommItf.NotifLength));
+        }
+
+        CDC_Handle->CommItf.NotifLength += length;
+
+        if (CDC_Handle->CommItf.NotifLength >= CDC_NOTIFICATION_HEADER_SIZE)
+        {
+          expected = CDC_NOTIFICATION_HEADER_SIZE +
+                     LE16(&CDC_Handle->CommItf.pNotifBuff[6]);
+        }
+        else
+        {
+          expected = CDC_NOTIFICATION_HEADER_SIZE;
+        }
+
+        if ((CDC_Handle->CommItf.NotifLength < expected) && (length == CDC_Handle->CommItf.NotifEpSize))
+        {
+          /* The rest of the notification follows in the next packets */
+          CDC_Handle->notif_state = CDC_NOTIF_POLL;
+        }
+        else
+        {
+          if (CDC_Handle->CommItf.NotifLength >= expected)
+          {
+            CDC_DecodeNotification(phost);
+          }
+
+          CDC_Handle->CommItf.NotifLength = 0U;
+          CDC_Handle->notif_state = CDC_NOTIF_POLL_DELAY;
+        }
+
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      else if (URB_Status == USBH_URB_STALL)
+      {
+        /* The control pipe is free only between class requests */
+        if (((CDC_Handle->state == CDC_IDLE_STATE) || (CDC_Handle->state == CDC_TRANSFER_DATA)) &&
+            (USBH_ClrFeature(phost, CDC_Handle->CommItf.NotifEp) == USBH_OK))
+        {
+          CDC_Handle->CommItf.NotifLength = 0U;
+          CDC_Handle->notif_state = CDC_NOTIF_POLL_DELAY;
+        }
+      }
+      else if ((URB_Status == USBH_URB_NOTREADY) || (URB_Status == USBH_URB_ERROR))
+      {
+        /* Nothing to report, poll again at the next interval */
+        CDC_Handle->notif_state = CDC_NOTIF_POLL_DELAY;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case CDC_NOTIF_POLL_DELAY:
+      if ((phost->Timer - CDC_Handle->CommItf.timer) >= CDC_Handle->CommItf.poll)
+      {
+        CDC_Handle->notif_state = CDC_NOTIF_POLL;
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  This function decodes a complete notification and reports it
+  *         to the user.
+  * @param  phost: Host handle
+  * @retval None
+  */
+static void CDC_DecodeNotification(USBH_HandleTypeDef *phost)
+{
+  CDC_HandleTypeDef *CDC_Handle = (CDC_HandleTypeDef *) phost->pActiveClass->pData;
+  uint8_t *pnotif = CDC_Handle->CommItf.pNotifBuff;
+
+  if (pnotif[0] != (USB_D2H | USB_REQ_TYPE_CLASS | USB_REQ_RECIPIENT_INTERFACE))
+  {
+    return;
+  }
+
+  switch (pnotif[1])
+  {
+    case CDC_NOTIFICATION_SERIAL_STATE:
+      if (LE16(&pnotif[6]) >= 2U)
+      {
+        CDC_Handle->SerialState = LE16(&pnotif[CDC_NOTIFICATION_HEADER_SIZE]);
+        USBH_CDC_SerialStateCallback(phost, CDC_Handle->SerialState);
       }
       break;
 
+    case CDC_NOTIFICATION_RESPONSE_AVAILABLE:
+      USBH_CDC_ResponseAvailableCallback(phost);
+      break;
+
     default:
+      USBH_DbgLog("CDC: notification 0x%02x ignored", pnotif[1]);
       break;
   }
 }
@@ -801,6 +1511,49 @@ __weak void USBH_CDC_ReceiveCallback(USBH_HandleTypeDef *phost)
   UNUSED(phost);
 }
 
+/**
+  * @brief  The function hands a filled reception stream buffer to the user
+  * @param  phost: Host handle
+  * @param  pbuff: Buffer holding the received data
+  * @param  length: Number of bytes received
+  * @retval None
+  */
+__weak void USBH_CDC_ReceiveStreamCallback(USBH_HandleTypeDef *phost, uint8_t *pbuff, uint32_t length)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(pbuff);
+  UNUSED(length);
+
+  /* Nothing consumes the data: give the buffer straight back */
+  (void)USBH_CDC_ReleaseStreamBuffer(phost);
+}
+
+/**
+  * @brief  The function reports a SERIAL_STATE notification: carrier (DCD),
+  *         DSR, ring, break and line errors, see CDC_SERIAL_STATE_xxx
+  * @param  phost: Host handle
+  * @param  state: SERIAL_STATE bitmap
+  * @retval None
+  */
+__weak void USBH_CDC_SerialStateCallback(USBH_HandleTypeDef *phost, uint16_t state)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(phost);
+  UNUSED(state);
+}
+
+/**
+  * @brief  The function reports a RESPONSE_AVAILABLE notification: the device
+  *         has an encapsulated response ready to be read
+  * @param  phost: Host handle
+  * @retval None
+  */
+__weak void USBH_CDC_ResponseAvailableCallback(USBH_HandleTypeDef *phost)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(phost);
+}
+
 /**
   * @brief  The function informs user that Settings have been changed
   *  @param  pdev: Selected device
@@ -0,0 +1,197 @@
+/**
+  ******************************************************************************
+  * @file    usbh_hub.h
+  * @author  MCD Application Team
+  * @brief   This file contains all the prototypes for the usbh_hub.c
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2015 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive  ----------------------------------------------*/
+#ifndef __USBH_HUB_H
+#define __USBH_HUB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+
+
+/** @addtogroup USBH_LIB
+  * @{
+  */
+
+/** @addtogroup USBH_CLASS
+  * @{
+  */
+
+/** @addtogroup USBH_HUB_CLASS
+  * @{
+  */
+
+/** @defgroup USBH_HUB_CORE
+  * @brief This file is the Header file for usbh_hub.c
+  * @{
+  */
+
+
+/* Hub Class code */
+#define USB_HUB_CLASS                                           0x09U
+
+/* Hub descriptor type */
+#define USB_DESC_TYPE_HUB                                       0x29U
+
+/* Hub port feature selectors (USB 2.0 table 11-17) */
+#define HUB_FEAT_PORT_RESET                                     0x04U
+#define HUB_FEAT_PORT_POWER                                     0x08U
+#define HUB_FEAT_C_PORT_CONNECTION                              0x10U
+
+/* wPortStatus bits (USB 2.0 table 11-21) */
+#define HUB_PORT_STATUS_CONNECTION                              0x0001U
+#define HUB_PORT_STATUS_ENABLE                                  0x0002U
+#define HUB_PORT_STATUS_LOW_SPEED                               0x0200U
+#define HUB_PORT_STATUS_HIGH_SPEED                              0x0400U
+
+/* wPortChange bits (USB 2.0 table 11-22), bit n maps to feature 0x10 + n */
+#define HUB_PORT_CHANGE_CONNECTION                              0x0001U
+#define HUB_PORT_CHANGE_RESET                                   0x0010U
+#define HUB_PORT_CHANGE_MASK                                    0x001FU
+
+/* Number of hub ports served; higher ports are left unpowered. The port
+   devices share the host channels of the root port with the hub: size it so
+   that their pipes fit in USBH_MAX_PIPES_NBR (see usbh_conf.h) */
+#ifndef USBH_HUB_MAX_PORTS
+#define USBH_HUB_MAX_PORTS                                      2U
+#endif /* USBH_HUB_MAX_PORTS */
+
+/* Connection debounce before the port reset (USB 2.0 section 7.1.7.3) */
+#ifndef USBH_HUB_DEBOUNCE_MS
+#define USBH_HUB_DEBOUNCE_MS                                    100U
+#endif /* USBH_HUB_DEBOUNCE_MS */
+
+/* Hub descriptor, status change bitmap and port status, in one DMA capable block */
+#define USBH_HUB_BUFF_SIZE                                      64U
+
+#if (USBH_HUB_MAX_PORTS > 7U)
+#error "USBH_HUB_MAX_PORTS is limited by the one byte status change bitmap"
+#endif
+
+
+/** @defgroup USBH_HUB_CORE_Exported_Types
+  * @{
+  */
+
+/* States for HUB State Machine */
+typedef enum
+{
+  HUB_REQ_GET_DESC = 0U,
+  HUB_REQ_PORT_POWER,
+  HUB_REQ_DONE,
+}
+HUB_ReqStateTypeDef;
+
+typedef enum
+{
+  HUB_POWER_GOOD = 0U,
+  HUB_POLL,
+  HUB_POLL_WAIT,
+  HUB_POLL_DELAY,
+  HUB_GET_PORT_STATUS,
+  HUB_CLEAR_PORT_CHANGE,
+  HUB_PORT_RESET,
+  HUB_ERROR_STATE,
+}
+HUB_StateTypeDef;
+
+/* Device attached to a hub port */
+typedef struct
+{
+  USBH_HandleTypeDef                host;
+  USBH_ClassTypeDef                 Class[USBH_MAX_NUM_SUPPORTED_CLASS];
+  uint8_t                           attached;
+}
+HUB_ChildTypeDef;
+
+/* Structure for HUB process */
+typedef struct
+{
+  uint8_t                           InPipe;
+  uint8_t                           InEp;
+  uint16_t                          InEpSize;
+  uint16_t                          poll;
+  uint32_t                          timer;
+  uint8_t                          *pBuff;
+  uint8_t                           NbrPorts;
+  uint8_t                           PwrOn2PwrGood;
+  uint8_t                           port;           /* Port being serviced */
+  uint8_t                           ResetPort;      /* Port in reset or enumerating at address 0 */
+  uint8_t                           ChangeMap;      /* Bit n: port n reported a change */
+  uint8_t                           ConnectMap;     /* Bit n: port n connected, waiting for reset */
+  uint16_t                          PortStatus;
+  uint16_t                          PortChange;
+  uint32_t                          ConnectTick[USBH_HUB_MAX_PORTS];
+  uint32_t                          DelayStart;
+  HUB_ReqStateTypeDef               req_state;
+  HUB_StateTypeDef                  state;
+  HUB_ChildTypeDef                  Children[USBH_HUB_MAX_PORTS];
+}
+HUB_HandleTypeDef;
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_HUB_CORE_Exported_Variables
+  * @{
+  */
+extern USBH_ClassTypeDef  HUB_Class;
+#define USBH_HUB_CLASS    &HUB_Class
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_HUB_CORE_Exported_FunctionsPrototype
+  * @{
+  */
+
+USBH_HandleTypeDef *USBH_HUB_GetDevice(USBH_HandleTypeDef *phost, uint8_t port);
+uint8_t             USBH_HUB_GetNbrPorts(USBH_HandleTypeDef *phost);
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBH_HUB_H */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
@@ -0,0 +1,969 @@
+/**
+  ******************************************************************************
+  * @file    usbh_hub.c
+  * @author  MCD Application Team
+  * @brief   This file is the HUB Layer Handlers for USB Host HUB class.
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2015 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  *  @verbatim
+  *
+  *          ===================================================================
+  *                                HUB Class Driver Description
+  *          ===================================================================
+  *           This driver manages a single external hub on the root port, as
+  *           described in chapter 11 of the "Universal Serial Bus Specification
+  *           Revision 2.0". It implements the following aspects:
+  *             - Hub descriptor request and port power switching
+  *             - Status change endpoint polling (interrupt IN)
+  *             - Port connection debounce, reset and disconnection
+  *             - Enumeration of the devices attached to the hub ports, one
+  *               port at a time at the default address
+  *
+  *           Each device attached to a hub port gets its own host handle and
+  *           its own copy of the registered classes, kept in the hub class
+  *           data, so class data such as the CDC handle is kept per device.
+  *           The devices share the HCD and the host channels of the root
+  *           handle, and their state machines are run from the hub background
+  *           process. Channels are not time-shared: USBH_HUB_MAX_PORTS bounds
+  *           the devices to what the channels of the root port can serve.
+  *           Nested hubs are not supported.
+  *
+  *  @endverbatim
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_hub.h"
+
+/** @addtogroup USBH_LIB
+  * @{
+  */
+
+/** @addtogroup USBH_CLASS
+  * @{
+  */
+
+/** @addtogroup USBH_HUB_CLASS
+  * @{
+  */
+
+/** @defgroup USBH_HUB_CORE
+  * @brief    This file includes HUB Layer Handlers for USB Host HUB class.
+  * @{
+  */
+
+/** @defgroup USBH_HUB_CORE_Private_Defines
+  * @{
+  */
+/* Layout of the HUB buffer */
+#define HUB_BUFF_STATUS_CHANGE               0U
+#define HUB_BUFF_PORT_STATUS                 8U
+#define HUB_BUFF_HUB_DESC                    16U
+
+#define HUB_STATUS_CHANGE_SIZE               8U
+#define HUB_PORT_STATUS_SIZE                 4U
+#define HUB_DESC_SIZE                        (USBH_HUB_BUFF_SIZE - HUB_BUFF_HUB_DESC)
+
+/* Hub descriptor fields */
+#define HUB_DESC_NBR_PORTS                   2U
+#define HUB_DESC_PWRON2PWRGOOD               5U
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_HUB_CORE_Private_Macros
+  * @{
+  */
+#if (USBH_USE_DMA == 1U)
+#define HUB_BUFF_ALLOC(size)                 USBH_dma_malloc(size)
+#define HUB_BUFF_FREE(ptr)                   USBH_dma_free(ptr)
+#else
+#define HUB_BUFF_ALLOC(size)                 USBH_malloc(size)
+#define HUB_BUFF_FREE(ptr)                   USBH_free(ptr)
+#endif /* (USBH_USE_DMA == 1U) */
+
+/* bPwrOn2PwrGood is given in 2 ms units */
+#define HUB_POWER_GOOD_ELAPSED(hub)          ((USBH_GetTick() - (hub)->DelayStart) >= \
+                                              (2U * (uint32_t)(hub)->PwrOn2PwrGood))
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_HUB_CORE_Private_FunctionPrototypes
+  * @{
+  */
+
+static USBH_StatusTypeDef USBH_HUB_InterfaceInit(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_HUB_InterfaceDeInit(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_HUB_Process(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_HUB_SOFProcess(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_HUB_ClassRequest(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef HUB_GetHubDescriptor(USBH_HandleTypeDef *phost,
+                                               uint8_t *pbuff, uint16_t length);
+
+static USBH_StatusTypeDef HUB_GetPortStatus(USBH_HandleTypeDef *phost,
+                                            uint8_t port, uint8_t *pbuff);
+
+static USBH_StatusTypeDef HUB_SetPortFeature(USBH_HandleTypeDef *phost,
+                                             uint8_t port, uint16_t feature);
+
+static USBH_StatusTypeDef HUB_ClearPortFeature(USBH_HandleTypeDef *phost,
+                                               uint8_t port, uint16_t feature);
+
+static void HUB_SelectNextPort(HUB_HandleTypeDef *HUB_Handle);
+
+static void HUB_PortStatusChanged(USBH_HandleTypeDef *phost);
+
+static void HUB_AttachChild(USBH_HandleTypeDef *phost, uint8_t port, uint8_t speed);
+
+static void HUB_DetachChild(HUB_ChildTypeDef *child);
+
+static void HUB_ProcessChildren(USBH_HandleTypeDef *phost);
+
+USBH_ClassTypeDef  HUB_Class =
+{
+  "HUB",
+  USB_HUB_CLASS,
+  USBH_HUB_InterfaceInit,
+  USBH_HUB_InterfaceDeInit,
+  USBH_HUB_ClassRequest,
+  USBH_HUB_Process,
+  USBH_HUB_SOFProcess,
+  NULL,
+};
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_HUB_CORE_Private_Functions
+  * @{
+  */
+
+/**
+  * @brief  USBH_HUB_InterfaceInit
+  *         The function init the HUB class.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_InterfaceInit(USBH_HandleTypeDef *phost)
+{
+  USBH_StatusTypeDef status;
+  uint8_t interface;
+  HUB_HandleTypeDef *HUB_Handle;
+
+  /* Only the hub on the root port is served */
+  if (phost->pRoot != phost)
+  {
+    USBH_ErrLog("HUB: nested hubs are not supported");
+    return USBH_FAIL;
+  }
+
+  interface = USBH_FindInterface(phost, USB_HUB_CLASS, 0xFFU, 0xFFU);
+
+  if ((interface == 0xFFU) || (interface >= USBH_MAX_NUM_INTERFACES)) /* No Valid Interface */
+  {
+    USBH_DbgLog("Cannot Find the interface for %s class.", phost->pActiveClass->Name);
+    return USBH_FAIL;
+  }
+
+  status = USBH_SelectInterface(phost, interface);
+
+  if (status != USBH_OK)
+  {
+    return USBH_FAIL;
+  }
+
+  phost->pActiveClass->pData = (HUB_HandleTypeDef *)USBH_malloc(sizeof(HUB_HandleTypeDef));
+  HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if (HUB_Handle == NULL)
+  {
+    USBH_DbgLog("Cannot allocate memory for HUB Handle");
+    return USBH_FAIL;
+  }
+
+  /* Initialize hub handler */
+  (void)USBH_memset(HUB_Handle, 0, sizeof(HUB_HandleTypeDef));
+  HUB_Handle->InPipe = 0xFFU;
+
+  HUB_Handle->pBuff = (uint8_t *)HUB_BUFF_ALLOC(USBH_HUB_BUFF_SIZE);
+
+  if (HUB_Handle->pBuff == NULL)
+  {
+    USBH_ErrLog("HUB: cannot allocate buffer");
+    return USBH_FAIL;
+  }
+
+  /* Collect the status change endpoint address and length */
+  HUB_Handle->InEp = phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bEndpointAddress;
+  HUB_Handle->InEpSize = MIN(phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].wMaxPacketSize,
+                             HUB_STATUS_CHANGE_SIZE);
+
+  /* bInterval counts (micro)frames as 2^(bInterval-1) at high speed */
+  HUB_Handle->poll = phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bInterval;
+
+  if (phost->device.speed == (uint8_t)USBH_SPEED_HIGH)
+  {
+    HUB_Handle->poll = (uint16_t)(1U << (MIN(MAX(HUB_Handle->poll, 1U), 13U) - 1U));
+  }
+
+  if (HUB_Handle->poll == 0U)
+  {
+    HUB_Handle->poll = 1U;
+  }
+
+  HUB_Handle->InPipe = USBH_AllocPipe(phost, HUB_Handle->InEp);
+
+  if (HUB_Handle->InPipe >= USBH_MAX_PIPES_NBR)
+  {
+    USBH_ErrLog("HUB: no free host channel");
+    return USBH_FAIL;
+  }
+
+  (void)USBH_OpenPipe(phost, HUB_Handle->InPipe, HUB_Handle->InEp,
+                      phost->device.address, phost->device.speed, USB_EP_TYPE_INTR,
+                      HUB_Handle->InEpSize);
+
+  (void)USBH_LL_SetToggle(phost, HUB_Handle->InPipe, 0U);
+
+  HUB_Handle->req_state = HUB_REQ_GET_DESC;
+  HUB_Handle->state = HUB_POLL;
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_HUB_InterfaceDeInit
+  *         The function DeInit the Pipes used for the HUB class and
+  *         disconnects the devices attached to the hub.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_InterfaceDeInit(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  uint32_t idx;
+
+  if (HUB_Handle == NULL)
+  {
+    return USBH_OK;
+  }
+
+  for (idx = 0U; idx < USBH_HUB_MAX_PORTS; idx++)
+  {
+    if (HUB_Handle->Children[idx].attached != 0U)
+    {
+      HUB_DetachChild(&HUB_Handle->Children[idx]);
+    }
+  }
+
+  if (HUB_Handle->InPipe < USBH_MAX_PIPES_NBR)
+  {
+    (void)USBH_ClosePipe(phost, HUB_Handle->InPipe);
+    (void)USBH_FreePipe(phost, HUB_Handle->InPipe);
+    HUB_Handle->InPipe = 0xFFU;
+  }
+
+  if (HUB_Handle->pBuff != NULL)
+  {
+    HUB_BUFF_FREE(HUB_Handle->pBuff);
+    HUB_Handle->pBuff = NULL;
+  }
+
+  USBH_free(phost->pActiveClass->pData);
+  phost->pActiveClass->pData = 0U;
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_HUB_ClassRequest
+  *         The function is responsible for handling Standard requests
+  *         for HUB class: read the hub descriptor and power the ports.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_ClassRequest(USBH_HandleTypeDef *phost)
+{
+  USBH_StatusTypeDef status = USBH_BUSY;
+  USBH_StatusTypeDef req_status;
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  uint8_t *desc = &HUB_Handle->pBuff[HUB_BUFF_HUB_DESC];
+
+  switch (HUB_Handle->req_state)
+  {
+    case HUB_REQ_GET_DESC:
+      req_status = HUB_GetHubDescriptor(phost, desc, HUB_DESC_SIZE);
+
+      if (req_status == USBH_OK)
+      {
+        HUB_Handle->NbrPorts = desc[HUB_DESC_NBR_PORTS];
+        HUB_Handle->PwrOn2PwrGood = desc[HUB_DESC_PWRON2PWRGOOD];
+
+        if (HUB_Handle->NbrPorts > USBH_HUB_MAX_PORTS)
+        {
+          USBH_UsrLog("HUB: %d ports, serving %d", HUB_Handle->NbrPorts, USBH_HUB_MAX_PORTS);
+          HUB_Handle->NbrPorts = USBH_HUB_MAX_PORTS;
+        }
+
+        HUB_Handle->port = 1U;
+        HUB_Handle->req_state = HUB_REQ_PORT_POWER;
+      }
+      else if (req_status != USBH_BUSY)
+      {
+        USBH_ErrLog("Control error: HUB: Get Hub Descriptor request failed");
+        status = USBH_FAIL;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_REQ_PORT_POWER:
+      if (HUB_Handle->port > HUB_Handle->NbrPorts)
+      {
+        /* The ports are polled once bPwrOn2PwrGood is over, see HUB_POWER_GOOD */
+        HUB_Handle->DelayStart = USBH_GetTick();
+        HUB_Handle->req_state = HUB_REQ_DONE;
+        HUB_Handle->state = HUB_POWER_GOOD;
+        HUB_Handle->port = 0U;
+        HUB_Handle->timer = phost->Timer;
+
+        phost->pUser(phost, HOST_USER_CLASS_ACTIVE);
+        status = USBH_OK;
+        break;
+      }
+
+      req_status = HUB_SetPortFeature(phost, HUB_Handle->port, HUB_FEAT_PORT_POWER);
+
+      if (req_status == USBH_OK)
+      {
+        HUB_Handle->port++;
+      }
+      else if (req_status != USBH_BUSY)
+      {
+        USBH_ErrLog("Control error: HUB: Port Power request failed");
+        status = USBH_FAIL;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_REQ_DONE:
+    default:
+      status = USBH_OK;
+      break;
+  }
+
+  return status;
+}
+
+
+/**
+  * @brief  USBH_HUB_Process
+  *         The function is for managing state machine for the hub status
+  *         changes and runs the devices attached to the hub ports.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_Process(USBH_HandleTypeDef *phost)
+{
+  USBH_StatusTypeDef status = USBH_BUSY;
+  USBH_StatusTypeDef req_status;
+  USBH_URBStateTypeDef URB_Status;
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  uint8_t *port_status = &HUB_Handle->pBuff[HUB_BUFF_PORT_STATUS];
+
+  HUB_ProcessChildren(phost);
+
+  switch (HUB_Handle->state)
+  {
+    case HUB_POWER_GOOD:
+      /* Woken up by the SOF process once the port power is good */
+      if (HUB_POWER_GOOD_ELAPSED(HUB_Handle))
+      {
+        HUB_Handle->state = HUB_POLL;
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      status = USBH_OK;
+      break;
+
+    case HUB_POLL:
+      (void)USBH_InterruptReceiveData(phost, &HUB_Handle->pBuff[HUB_BUFF_STATUS_CHANGE],
+                                      (uint8_t)HUB_Handle->InEpSize, HUB_Handle->InPipe);
+
+      HUB_Handle->timer = phost->Timer;
+      HUB_Handle->state = HUB_POLL_WAIT;
+      break;
+
+    case HUB_POLL_WAIT:
+      URB_Status = USBH_LL_GetURBState(phost, HUB_Handle->InPipe);
+
+      if (URB_Status == USBH_URB_DONE)
+      {
+        /* Bit 0 reports a hub change, bit n a change on port n */
+        HUB_Handle->ChangeMap |= (uint8_t)(HUB_Handle->pBuff[HUB_BUFF_STATUS_CHANGE] &
+                                           (uint8_t)((2U << HUB_Handle->NbrPorts) - 2U));
+        HUB_SelectNextPort(HUB_Handle);
+
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      else if (URB_Status == USBH_URB_STALL)
+      {
+        if (USBH_ClrFeature(phost, HUB_Handle->InEp) == USBH_OK)
+        {
+          HUB_Handle->state = HUB_POLL_DELAY;
+        }
+      }
+      else if ((URB_Status == USBH_URB_NOTREADY) || (URB_Status == USBH_URB_ERROR))
+      {
+        /* No change pending, poll again at the next interval */
+        HUB_Handle->state = HUB_POLL_DELAY;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_POLL_DELAY:
+      HUB_SelectNextPort(HUB_Handle);
+
+      if (HUB_Handle->state != HUB_POLL_DELAY)
+      {
+        /* A debounced port is due for its reset */
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      else if ((phost->Timer - HUB_Handle->timer) >= HUB_Handle->poll)
+      {
+        HUB_Handle->state = HUB_POLL;
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      else
+      {
+        /* .. */
+      }
+      status = USBH_OK;
+      break;
+
+    case HUB_GET_PORT_STATUS:
+      req_status = HUB_GetPortStatus(phost, HUB_Handle->port, port_status);
+
+      if (req_status == USBH_OK)
+      {
+        HUB_Handle->PortStatus = LE16(&port_status[0]);
+        HUB_Handle->PortChange = LE16(&port_status[2]);
+
+        HUB_PortStatusChanged(phost);
+        HUB_Handle->state = HUB_CLEAR_PORT_CHANGE;
+
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      else if (req_status != USBH_BUSY)
+      {
+        USBH_ErrLog("Control error: HUB: Get Port Status request failed");
+        HUB_Handle->state = HUB_POLL_DELAY;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_CLEAR_PORT_CHANGE:
+      HUB_Handle->PortChange &= HUB_PORT_CHANGE_MASK;
+
+      if (HUB_Handle->PortChange == 0U)
+      {
+        HUB_SelectNextPort(HUB_Handle);
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+        break;
+      }
+
+      /* Acknowledge the lowest change bit, C_PORT_xxx = C_PORT_CONNECTION + bit */
+      req_status = HUB_ClearPortFeature(phost, HUB_Handle->port,
+                                        (uint16_t)(HUB_FEAT_C_PORT_CONNECTION +
+                                                   (uint16_t)__builtin_ctz(HUB_Handle->PortChange)));
+
+      if (req_status == USBH_OK)
+      {
+        HUB_Handle->PortChange &= (uint16_t)(HUB_Handle->PortChange - 1U);
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      else if (req_status != USBH_BUSY)
+      {
+        USBH_ErrLog("Control error: HUB: Clear Port Feature request failed");
+        HUB_Handle->state = HUB_POLL_DELAY;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_PORT_RESET:
+      req_status = HUB_SetPortFeature(phost, HUB_Handle->port, HUB_FEAT_PORT_RESET);
+
+      if (req_status == USBH_OK)
+      {
+        /* Completion is reported as C_PORT_RESET on the status change endpoint */
+        HUB_Handle->state = HUB_POLL;
+        (void)USBH_PostEvent(phost, USBH_CLASS_EVENT);
+      }
+      else if (req_status != USBH_BUSY)
+      {
+        USBH_ErrLog("Control error: HUB: Port Reset request failed");
+        HUB_Handle->ResetPort = 0U;
+        HUB_Handle->state = HUB_POLL_DELAY;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_ERROR_STATE:
+    default:
+      break;
+  }
+
+  return status;
+}
+
+
+/**
+  * @brief  USBH_HUB_SOFProcess
+  *         The function is for managing SOF callback: it clocks the devices
+  *         attached to the hub and schedules the status change polling.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_SOFProcess(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  uint32_t idx;
+
+  for (idx = 0U; idx < USBH_HUB_MAX_PORTS; idx++)
+  {
+    if (HUB_Handle->Children[idx].attached != 0U)
+    {
+      USBH_LL_IncTimer(&HUB_Handle->Children[idx].host);
+    }
+  }
+
+  if ((HUB_Handle->state == HUB_POWER_GOOD) && HUB_POWER_GOOD_ELAPSED(HUB_Handle))
+  {
+    return USBH_BUSY;
+  }
+
+  if (HUB_Handle->state == HUB_POLL_DELAY)
+  {
+    if (((phost->Timer - HUB_Handle->timer) >= HUB_Handle->poll) ||
+        ((HUB_Handle->ConnectMap != 0U) && (HUB_Handle->ResetPort == 0U)))
+    {
+      return USBH_BUSY;
+    }
+  }
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  HUB_GetHubDescriptor
+  *         This request returns the hub descriptor.
+  * @param  phost: Host handle
+  * @param  pbuff: Buffer for the descriptor
+  * @param  length: Length of the buffer
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef HUB_GetHubDescriptor(USBH_HandleTypeDef *phost,
+                                               uint8_t *pbuff, uint16_t length)
+{
+  phost->Control.setup.b.bmRequestType = USB_D2H | USB_REQ_TYPE_CLASS |
+                                         USB_REQ_RECIPIENT_DEVICE;
+
+  phost->Control.setup.b.bRequest = USB_REQ_GET_DESCRIPTOR;
+  phost->Control.setup.b.wValue.w = (uint16_t)USB_DESC_TYPE_HUB << 8;
+
+  phost->Control.setup.b.wIndex.w = 0U;
+
+  phost->Control.setup.b.wLength.w = length;
+
+  return USBH_CtlReq(phost, pbuff, length);
+}
+
+
+/**
+  * @brief  HUB_GetPortStatus
+  *         This request returns wPortStatus and wPortChange of a port.
+  * @param  phost: Host handle
+  * @param  port: Port number
+  * @param  pbuff: Buffer for the 4 status bytes
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef HUB_GetPortStatus(USBH_HandleTypeDef *phost,
+                                            uint8_t port, uint8_t *pbuff)
+{
+  phost->Control.setup.b.bmRequestType = USB_D2H | USB_REQ_TYPE_CLASS |
+                                         USB_REQ_RECIPIENT_OTHER;
+
+  phost->Control.setup.b.bRequest = USB_REQ_GET_STATUS;
+  phost->Control.setup.b.wValue.w = 0U;
+
+  phost->Control.setup.b.wIndex.w = port;
+
+  phost->Control.setup.b.wLength.w = HUB_PORT_STATUS_SIZE;
+
+  return USBH_CtlReq(phost, pbuff, HUB_PORT_STATUS_SIZE);
+}
+
+
+/**
+  * @brief  HUB_SetPortFeature
+  *         This request sets a port feature.
+  * @param  phost: Host handle
+  * @param  port: Port number
+  * @param  feature: Feature selector
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef HUB_SetPortFeature(USBH_HandleTypeDef *phost,
+                                             uint8_t port, uint16_t feature)
+{
+  phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_TYPE_CLASS |
+                                         USB_REQ_RECIPIENT_OTHER;
+
+  phost->Control.setup.b.bRequest = USB_REQ_SET_FEATURE;
+  phost->Control.setup.b.wValue.w = feature;
+
+  phost->Control.setup.b.wIndex.w = port;
+
+  phost->Control.setup.b.wLength.w = 0U;
+
+  return USBH_CtlReq(phost, NULL, 0U);
+}
+
+
+/**
+  * @brief  HUB_ClearPortFeature
+  *         This request clears a port feature.
+  * @param  phost: Host handle
+  * @param  port: Port number
+  * @param  feature: Feature selector
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef HUB_ClearPortFeature(USBH_HandleTypeDef *phost,
+                                               uint8_t port, uint16_t feature)
+{
+  phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_TYPE_CLASS |
+                                         USB_REQ_RECIPIENT_OTHER;
+
+  phost->Control.setup.b.bRequest = USB_REQ_CLEAR_FEATURE;
+  phost->Control.setup.b.wValue.w = feature;
+
+  phost->Control.setup.b.wIndex.w = port;
+
+  phost->Control.setup.b.wLength.w = 0U;
+
+  return USBH_CtlReq(phost, NULL, 0U);
+}
+
+
+/**
+  * @brief  HUB_SelectNextPort
+  *         Pick the next port to service: reported changes first, then a
+  *         debounced connection once no other device sits at address 0.
+  * @param  HUB_Handle: HUB handle
+  * @retval None
+  */
+static void HUB_SelectNextPort(HUB_HandleTypeDef *HUB_Handle)
+{
+  uint8_t port;
+
+  if (HUB_Handle->ChangeMap != 0U)
+  {
+    port = (uint8_t)__builtin_ctz(HUB_Handle->ChangeMap);
+    HUB_Handle->ChangeMap &= (uint8_t)~(1U << port);
+    HUB_Handle->port = port;
+    HUB_Handle->state = HUB_GET_PORT_STATUS;
+    return;
+  }
+
+  if ((HUB_Handle->ResetPort == 0U) && (HUB_Handle->ConnectMap != 0U))
+  {
+    for (port = 1U; port <= HUB_Handle->NbrPorts; port++)
+    {
+      if (((HUB_Handle->ConnectMap & (1U << port)) != 0U) &&
+          ((USBH_GetTick() - HUB_Handle->ConnectTick[port - 1U]) >= USBH_HUB_DEBOUNCE_MS))
+      {
+        HUB_Handle->ConnectMap &= (uint8_t)~(1U << port);
+        HUB_Handle->ResetPort = port;
+        HUB_Handle->port = port;
+        HUB_Handle->state = HUB_PORT_RESET;
+        return;
+      }
+    }
+  }
+
+  HUB_Handle->state = HUB_POLL_DELAY;
+}
+
+
+/**
+  * @brief  HUB_PortStatusChanged
+  *         Act on the status of the port being serviced.
+  * @param  phost: Host handle
+  * @retval None
+  */
+static void HUB_PortStatusChanged(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  uint8_t port = HUB_Handle->port;
+  HUB_ChildTypeDef *child;
+  uint8_t speed;
+
+  if ((port == 0U) || (port > HUB_Handle->NbrPorts))
+  {
+    return;
+  }
+
+  child = &HUB_Handle->Children[port - 1U];
+
+  if (((HUB_Handle->PortStatus & HUB_PORT_STATUS_CONNECTION) == 0U) ||
+      ((HUB_Handle->PortChange & HUB_PORT_CHANGE_CONNECTION) != 0U))
+  {
+    /* Disconnection, or a new connection that replaces the previous device */
+    if (child->attached != 0U)
+    {
+      HUB_DetachChild(child);
+    }
+
+    if (HUB_Handle->ResetPort == port)
+    {
+      HUB_Handle->ResetPort = 0U;
+    }
+
+    HUB_Handle->ConnectMap &= (uint8_t)~(1U << port);
+
+    if ((HUB_Handle->PortStatus & HUB_PORT_STATUS_CONNECTION) != 0U)
+    {
+      USBH_UsrLog("HUB: device connected on port %d", port);
+      HUB_Handle->ConnectMap |= (uint8_t)(1U << port);
+      HUB_Handle->ConnectTick[port - 1U] = USBH_GetTick();
+    }
+  }
+  else if (((HUB_Handle->PortChange & HUB_PORT_CHANGE_RESET) != 0U) &&
+           (HUB_Handle->ResetPort == port) && (child->attached == 0U))
+  {
+    if ((HUB_Handle->PortStatus & HUB_PORT_STATUS_ENABLE) != 0U)
+    {
+      if ((HUB_Handle->PortStatus & HUB_PORT_STATUS_LOW_SPEED) != 0U)
+      {
+        speed = (uint8_t)USBH_SPEED_LOW;
+      }
+      else if ((HUB_Handle->PortStatus & HUB_PORT_STATUS_HIGH_SPEED) != 0U)
+      {
+        speed = (uint8_t)USBH_SPEED_HIGH;
+      }
+      else
+      {
+        speed = (uint8_t)USBH_SPEED_FULL;
+      }
+
+      HUB_AttachChild(phost, port, speed);
+    }
+    else
+    {
+      USBH_ErrLog("HUB: port %d reset failed", port);
+      HUB_Handle->ResetPort = 0U;
+    }
+  }
+  else
+  {
+    /* .. */
+  }
+}
+
+
+/**
+  * @brief  HUB_AttachChild
+  *         Start the enumeration of the device on a freshly reset port.
+  * @param  phost: Host handle
+  * @param  port: Port number
+  * @param  speed: Device speed
+  * @retval None
+  */
+static void HUB_AttachChild(USBH_HandleTypeDef *phost, uint8_t port, uint8_t speed)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  HUB_ChildTypeDef *child = &HUB_Handle->Children[port - 1U];
+  uint32_t idx;
+  uint32_t num = 0U;
+
+  (void)USBH_memset(child, 0, sizeof(HUB_ChildTypeDef));
+
+  /* Private copies of the classes keep the class data per device */
+  for (idx = 0U; idx < phost->ClassNumber; idx++)
+  {
+    if (phost->pClass[idx]->ClassCode != USB_HUB_CLASS)
+    {
+      child->Class[num] = *phost->pClass[idx];
+      child->Class[num].pData = NULL;
+      child->host.pClass[num] = &child->Class[num];
+      num++;
+    }
+  }
+
+  child->host.ClassNumber = num;
+
+  if (USBH_InitChild(&child->host, phost, port, speed,
+                     (uint8_t)(USBH_DEVICE_ADDRESS + port)) == USBH_OK)
+  {
+    child->attached = 1U;
+  }
+}
+
+
+/**
+  * @brief  HUB_DetachChild
+  *         Run the disconnection of a device attached to a hub port.
+  * @param  child: Hub port device
+  * @retval None
+  */
+static void HUB_DetachChild(HUB_ChildTypeDef *child)
+{
+  child->host.device.is_disconnected = 1U;
+  (void)USBH_Process(&child->host);
+
+  child->attached = 0U;
+}
+
+
+/**
+  * @brief  HUB_ProcessChildren
+  *         Run the state machines of the devices attached to the hub.
+  * @param  phost: Host handle
+  * @retval None
+  */
+static void HUB_ProcessChildren(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  HUB_ChildTypeDef *child;
+  uint32_t idx;
+
+  for (idx = 0U; idx < HUB_Handle->NbrPorts; idx++)
+  {
+    child = &HUB_Handle->Children[idx];
+
+    if (child->attached == 0U)
+    {
+      continue;
+    }
+
+    (void)USBH_Process(&child->host);
+
+    /* The next port may be reset once this device left the default address */
+    if ((HUB_Handle->ResetPort == (idx + 1U)) &&
+        ((child->host.device.address != USBH_DEVICE_ADDRESS_DEFAULT) ||
+         (child->host.gState == HOST_ABORT_STATE)))
+    {
+      HUB_Handle->ResetPort = 0U;
+    }
+  }
+}
+
+
+/**
+  * @brief  USBH_HUB_GetDevice
+  *         Return the handle of the device attached to a hub port, to be
+  *         passed to the class APIs (e.g. USBH_CDC_Transmit).
+  * @param  phost: Host handle of the hub
+  * @param  port: Port number (1..n)
+  * @retval Device handle, NULL if no device is ready on this port
+  */
+USBH_HandleTypeDef *USBH_HUB_GetDevice(USBH_HandleTypeDef *phost, uint8_t port)
+{
+  HUB_ChildTypeDef *child;
+
+  if ((phost->gState != HOST_CLASS) || (phost->pActiveClass != &HUB_Class) ||
+      (port == 0U) || (port > USBH_HUB_MAX_PORTS))
+  {
+    return NULL;
+  }
+
+  child = &((HUB_HandleTypeDef *) phost->pActiveClass->pData)->Children[port - 1U];
+
+  if ((child->attached == 0U) || (child->host.gState != HOST_CLASS))
+  {
+    return NULL;
+  }
+
+  return &child->host;
+}
+
+
+/**
+  * @brief  USBH_HUB_GetNbrPorts
+  *         Return the number of hub ports served.
+  * @param  phost: Host handle of the hub
+  * @retval Number of ports, 0 if no hub is active
+  */
+uint8_t USBH_HUB_GetNbrPorts(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle;
+
+  if ((phost->gState != HOST_CLASS) || (phost->pActiveClass != &HUB_Class))
+  {
+    return 0U;
+  }
+
+  HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+
+  return HUB_Handle->NbrPorts;
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+
+/**
+  * @}
+  */
+
+
+/**
+  * @}
+  */
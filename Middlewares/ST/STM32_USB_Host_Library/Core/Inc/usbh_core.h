@@ -88,6 +88,8 @@ extern "C" {
 
 USBH_StatusTypeDef  USBH_Init(USBH_HandleTypeDef *phost, void (*pUsrFunc)(USBH_HandleTypeDef *phost, uint8_t id), uint8_t id);
 USBH_StatusTypeDef  USBH_DeInit(USBH_HandleTypeDef *phost);
+USBH_StatusTypeDef  USBH_InitChild(USBH_HandleTypeDef *phost, USBH_HandleTypeDef *phub,
+                                   uint8_t port, uint8_t speed, uint8_t address);
 USBH_StatusTypeDef  USBH_RegisterClass(USBH_HandleTypeDef *phost, USBH_ClassTypeDef *pclass);
 USBH_StatusTypeDef  USBH_SelectInterface(USBH_HandleTypeDef *phost, uint8_t interface);
 uint8_t             USBH_FindInterface(USBH_HandleTypeDef *phost,
@@ -106,6 +108,16 @@ USBH_StatusTypeDef  USBH_Start(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef  USBH_Stop(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef  USBH_ReEnumerate(USBH_HandleTypeDef *phost);
+USBH_StatusTypeDef  USBH_PostEvent(USBH_HandleTypeDef *phost, USBH_OSEventTypeDef event);
+
+#if (USBH_USE_ENUM_CACHE == 1U)
+void                USBH_EnumCacheClear(void);
+#endif
+
+#if (USBH_USE_EVENTS == 1U)
+USBH_StatusTypeDef  USBH_ProcessEvents(USBH_HandleTypeDef *phost);
+uint8_t             USBH_EventPending(USBH_HandleTypeDef *phost);
+#endif
 
 /* USBH Low Level Driver */
 USBH_StatusTypeDef   USBH_LL_Init(USBH_HandleTypeDef *phost);
@@ -117,9 +129,14 @@ USBH_StatusTypeDef   USBH_LL_Connect(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef   USBH_LL_Disconnect(USBH_HandleTypeDef *phost);
 USBH_SpeedTypeDef    USBH_LL_GetSpeed(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef   USBH_LL_ResetPort(USBH_HandleTypeDef *phost);
+USBH_StatusTypeDef   USBH_LL_ResetPort2(USBH_HandleTypeDef *phost,
+                                        uint8_t state);
 uint32_t             USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost,
                                              uint8_t pipe);
 
+uint32_t             USBH_LL_GetOutXferCount(USBH_HandleTypeDef *phost,
+                                             uint8_t pipe);
+
 USBH_StatusTypeDef   USBH_LL_DriverVBUS(USBH_HandleTypeDef *phost,
                                         uint8_t state);
 
@@ -146,10 +163,18 @@ USBH_StatusTypeDef   USBH_LL_SubmitURB(USBH_HandleTypeDef *phost,
 USBH_URBStateTypeDef USBH_LL_GetURBState(USBH_HandleTypeDef *phost,
                                          uint8_t pipe);
 
-#if (USBH_USE_OS == 1U)
+#if (USBH_USE_OS == 1U) || (USBH_USE_EVENTS == 1U)
 USBH_StatusTypeDef  USBH_LL_NotifyURBChange(USBH_HandleTypeDef *phost);
 #endif
 
+void USBH_LL_PipeCompleted(USBH_HandleTypeDef *phost, uint8_t pipe_num,
+                           USBH_URBStateTypeDef urb_state, uint32_t count);
+
+#if (USBH_USE_URB_TRACE == 1U)
+void USBH_LL_PipeObserved(USBH_HandleTypeDef *phost, uint8_t pipe_num);
+uint32_t USBH_LL_GetCycles(USBH_HandleTypeDef *phost);
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
 USBH_StatusTypeDef USBH_LL_SetToggle(USBH_HandleTypeDef *phost,
                                      uint8_t pipe, uint8_t toggle);
 
@@ -163,6 +188,7 @@ void USBH_LL_SetTimer(USBH_HandleTypeDef *phost, uint32_t time);
 void USBH_LL_IncTimer(USBH_HandleTypeDef *phost);
 
 void USBH_Delay(uint32_t Delay);
+uint32_t USBH_GetTick(void);
 
 /**
   * @}
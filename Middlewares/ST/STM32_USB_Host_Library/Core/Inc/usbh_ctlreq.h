@@ -113,6 +113,11 @@ USBH_StatusTypeDef USBH_SetFeature(USBH_HandleTypeDef *phost, uint8_t wValue);
 USBH_StatusTypeDef USBH_ClrFeature(USBH_HandleTypeDef *phost, uint8_t ep_num);
 
 USBH_DescHeader_t *USBH_GetNextDesc(uint8_t *pbuf, uint16_t *ptr);
+
+#if (USBH_USE_CTL_CHAIN == 1U)
+void USBH_CtlChainCompleted(USBH_HandleTypeDef *phost, uint8_t pipe_num,
+                            USBH_URBStateTypeDef urb_state);
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
 /**
   * @}
   */
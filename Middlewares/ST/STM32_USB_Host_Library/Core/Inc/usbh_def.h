@@ -185,6 +185,21 @@ extern "C" {
 #define USBH_MAX_PIPES_NBR                                 16U
 #endif /* USBH_MAX_PIPES_NBR */
 
+/* Pipes are allocated from a 32-bit map */
+#if (USBH_MAX_PIPES_NBR < 1U) || (USBH_MAX_PIPES_NBR > 32U)
+#error "USBH_MAX_PIPES_NBR must be between 1 and 32"
+#endif
+
+/* NAKs in a row retried at once before a bulk pipe starts backing off */
+#ifndef USBH_PIPE_NAK_BURST
+#define USBH_PIPE_NAK_BURST                                8U
+#endif /* USBH_PIPE_NAK_BURST */
+
+/* Longest NAK backoff of a pipe: 2^(USBH_PIPE_MAX_BACKOFF - 1) (micro)frames */
+#ifndef USBH_PIPE_MAX_BACKOFF
+#define USBH_PIPE_MAX_BACKOFF                              4U
+#endif /* USBH_PIPE_MAX_BACKOFF */
+
 #define USBH_DEVICE_ADDRESS_DEFAULT                        0x00U
 #define USBH_DEVICE_ADDRESS                                0x01U
 
@@ -194,6 +209,75 @@ extern "C" {
 #define MSGQUEUE_OBJECTS                                   0x10U
 #endif
 
+#ifndef USBH_USE_EVENTS
+#define USBH_USE_EVENTS                                    0U
+#endif /* USBH_USE_EVENTS */
+
+#if (USBH_USE_EVENTS == 1U)
+#if (USBH_USE_OS == 1U)
+#error "USBH_USE_EVENTS is the bare-metal alternative to USBH_USE_OS"
+#endif
+#ifndef USBH_EVENT_QUEUE_SIZE
+#define USBH_EVENT_QUEUE_SIZE                              0x10U
+#endif /* USBH_EVENT_QUEUE_SIZE */
+#endif /* (USBH_USE_EVENTS == 1U) */
+
+#ifndef USBH_USE_DMA
+#define USBH_USE_DMA                                       0U
+#endif /* USBH_USE_DMA */
+
+/* Chain the stages of a control transfer from the URB completion interrupt */
+#ifndef USBH_USE_CTL_CHAIN
+#define USBH_USE_CTL_CHAIN                                 0U
+#endif /* USBH_USE_CTL_CHAIN */
+
+/* NAKs a chained transfer takes from the interrupt before USBH_Process
+   paces the retries of a slow device */
+#ifndef USBH_CTL_CHAIN_MAX_NAKS
+#define USBH_CTL_CHAIN_MAX_NAKS                            0x10U
+#endif /* USBH_CTL_CHAIN_MAX_NAKS */
+
+/* Time given to a control transfer in ms, the 5 s a device has to complete
+   a request with a data stage */
+#ifndef USBH_CTL_TIMEOUT
+#define USBH_CTL_TIMEOUT                                   5000U
+#endif /* USBH_CTL_TIMEOUT */
+
+/* URB latency histograms stamped with a cycle counter, see USBH_GetUrbTrace */
+#ifndef USBH_USE_URB_TRACE
+#define USBH_USE_URB_TRACE                                 0U
+#endif /* USBH_USE_URB_TRACE */
+
+#if (USBH_USE_URB_TRACE == 1U)
+#ifndef USBH_URB_TRACE_BINS
+#define USBH_URB_TRACE_BINS                                16U
+#endif /* USBH_URB_TRACE_BINS */
+
+/* Bin 0 counts latencies below 2^USBH_URB_TRACE_SHIFT cycles, bin n those
+   from 2^(n + USBH_URB_TRACE_SHIFT - 1); the last bin is open-ended */
+#ifndef USBH_URB_TRACE_SHIFT
+#define USBH_URB_TRACE_SHIFT                               6U
+#endif /* USBH_URB_TRACE_SHIFT */
+
+#define USBH_URB_TRACE_MAGIC                               0x43525455U  /* "UTRC" */
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+#ifndef USBH_USE_ENUM_CACHE
+#define USBH_USE_ENUM_CACHE                                0U
+#endif /* USBH_USE_ENUM_CACHE */
+
+#if (USBH_USE_ENUM_CACHE == 1U) && (USBH_KEEP_CFG_DESCRIPTOR != 1U)
+#error "USBH_USE_ENUM_CACHE restores the configuration descriptor kept by USBH_KEEP_CFG_DESCRIPTOR"
+#endif
+
+#ifndef USBH_ENUM_CACHE_ENTRIES
+#define USBH_ENUM_CACHE_ENTRIES                            4U
+#endif /* USBH_ENUM_CACHE_ENTRIES */
+
+#ifndef USBH_ENUM_CACHE_BKPSRAM
+#define USBH_ENUM_CACHE_BKPSRAM                            0U
+#endif /* USBH_ENUM_CACHE_BKPSRAM */
+
 
 /**
   * @}
@@ -336,6 +420,8 @@ typedef enum
 typedef enum
 {
   HOST_IDLE = 0U,
+  HOST_DEV_CONNECT_DEBOUNCE,
+  HOST_DEV_PORT_RESET,
   HOST_DEV_WAIT_FOR_ATTACHMENT,
   HOST_DEV_ATTACHED,
   HOST_DEV_DISCONNECTED,
@@ -409,9 +495,84 @@ typedef enum
   USBH_CONTROL_EVENT,
   USBH_CLASS_EVENT,
   USBH_STATE_CHANGED_EVENT,
+  USBH_SOF_EVENT,
 }
 USBH_OSEventTypeDef;
 
+#if (USBH_USE_EVENTS == 1U)
+/* Bare-metal event queue: posted from IRQ and thread context, drained by
+   USBH_ProcessEvents. A zero slot is empty or not yet published. */
+typedef struct
+{
+  uint8_t               evt[USBH_EVENT_QUEUE_SIZE];
+  uint32_t              stamp[USBH_EVENT_QUEUE_SIZE];
+  uint32_t              head;
+  uint32_t              tail;
+  uint32_t              dropped;
+  uint32_t              latency_max;  /* Host timer ticks from post to process */
+  uint32_t              wake_tick;    /* USBH_GetTick deadline of a waiting state */
+  uint8_t               wake_armed;   /* 1 while wake_tick is pending */
+} USBH_EventQueueTypeDef;
+#endif
+
+/* Resubmission of a pipe after a NAK or a NYET */
+typedef enum
+{
+  USBH_RETRY_IMMEDIATE = 0U,  /* Next process pass */
+  USBH_RETRY_NEXT_FRAME,      /* Next (micro)frame */
+  USBH_RETRY_BACKOFF,         /* After a burst, delay doubled on each NAK, bounded */
+}
+USBH_RetryPolicyTypeDef;
+
+typedef struct
+{
+  USBH_RetryPolicyTypeDef   Policy;
+  uint8_t                   Burst;        /* NAKs retried at once before backing off */
+  uint8_t                   MaxBackoff;
+  uint8_t                   NakRun;       /* NAKs in a row, saturating */
+  uint8_t                   Ping;         /* High-speed OUT: probe with PING first */
+  uint32_t                  RetryStart;   /* Host timer value of the NAK */
+  uint32_t                  RetryDelay;   /* Host timer ticks before the retry */
+} USBH_PipeRetryTypeDef;
+
+/* Traffic of a pipe since its allocation, updated on URB completion */
+typedef struct
+{
+  uint32_t                  Urbs;         /* URBs submitted */
+  uint32_t                  Bytes;        /* Bytes transferred */
+  uint32_t                  Errors;
+  uint32_t                  Stalls;
+  uint32_t                  Naks;
+  uint32_t                  Nyets;
+  uint32_t                  LastDone;     /* Host timer value of the last completion */
+} USBH_PipeStatsTypeDef;
+
+#if (USBH_USE_URB_TRACE == 1U)
+/* URB latencies of a pipe, in cycles */
+typedef struct
+{
+  uint32_t              EpAddr;
+  uint32_t              Samples;      /* Completions read by the class, ObsHist total */
+  uint32_t              BusMax;       /* Submission to completion interrupt */
+  uint32_t              ObsMax;       /* Completion interrupt to class observation */
+  uint32_t              BusHist[USBH_URB_TRACE_BINS];
+  uint32_t              ObsHist[USBH_URB_TRACE_BINS];
+  uint32_t              SubmitStamp;
+  uint32_t              DoneStamp;
+  uint32_t              Pending;      /* URB submitted (1) or completed (2), not yet observed */
+} USBH_UrbTracePipeTypeDef;
+
+/* Fixed-size record, meant to be dumped as is over a serial link */
+typedef struct
+{
+  uint32_t                  Magic;
+  uint16_t                  Bins;
+  uint8_t                   Shift;
+  uint8_t                   Pipes;
+  USBH_UrbTracePipeTypeDef  Pipe[USBH_MAX_PIPES_NBR];
+} USBH_UrbTraceTypeDef;
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
 /* Control request structure */
 typedef struct
 {
@@ -424,6 +585,9 @@ typedef struct
   USB_Setup_TypeDef     setup;
   CTRL_StateTypeDef     state;
   uint8_t               errorcount;
+  uint8_t               chain;        /* Set while the URB completion interrupt runs the stages */
+  uint8_t               naks;         /* NAKs taken by the chained stages */
+  uint32_t              tick;         /* USBH_GetTick value when the transfer was started */
 
 } USBH_CtrlTypeDef;
 
@@ -441,6 +605,10 @@ typedef struct
   __IO uint8_t                      is_ReEnumerated;
   uint8_t                           PortEnabled;
   uint8_t                           current_interface;
+  uint8_t                           assigned_address;  /* Address given by SET_ADDRESS */
+  uint8_t                           hub_address;       /* Parent hub address, 0 on the root port */
+  uint8_t                           hub_port;          /* Parent hub port, 0 on the root port */
+  uint8_t                           EnumCacheIdx;      /* Enumeration cache entry, 0xFF if none */
   USBH_DevDescTypeDef               DevDesc;
   USBH_CfgDescTypeDef               CfgDesc;
 } USBH_DeviceTypeDef;
@@ -471,11 +639,23 @@ typedef struct _USBH_HandleTypeDef
   USBH_ClassTypeDef    *pClass[USBH_MAX_NUM_SUPPORTED_CLASS];
   USBH_ClassTypeDef    *pActiveClass;
   uint32_t              ClassNumber;
-  uint32_t              Pipes[16];
+  uint32_t              Pipes[USBH_MAX_PIPES_NBR];  /* Endpoint address of each allocated pipe */
+  uint32_t              PipeFree;     /* Bit (31 - n) set: pipe n is free */
+  USBH_PipeRetryTypeDef PipeRetry[USBH_MAX_PIPES_NBR];
+  USBH_PipeStatsTypeDef PipeStats[USBH_MAX_PIPES_NBR];
+#if (USBH_USE_URB_TRACE == 1U)
+  USBH_UrbTraceTypeDef  UrbTrace;
+#endif
+#if (USBH_USE_CTL_CHAIN == 1U)
+  struct _USBH_HandleTypeDef *CtlChain[USBH_MAX_PIPES_NBR];  /* Handle chaining a control transfer on each pipe */
+#endif
   __IO uint32_t         Timer;
   uint32_t              Timeout;
+  uint32_t              DelayStart;   /* USBH_GetTick value when the wait started */
+  uint32_t              DelayLength;  /* Wait length in ms */
   uint8_t               id;
   void                 *pData;
+  struct _USBH_HandleTypeDef *pRoot;  /* Handle owning the HCD and the host channels */
   void (* pUser)(struct _USBH_HandleTypeDef *pHandle, uint8_t id);
 
 #if (USBH_USE_OS == 1U)
@@ -489,6 +669,10 @@ typedef struct _USBH_HandleTypeDef
   uint32_t              os_msg;
 #endif
 
+#if (USBH_USE_EVENTS == 1U)
+  USBH_EventQueueTypeDef events;
+#endif
+
 } USBH_HandleTypeDef;
 
 
@@ -90,6 +90,43 @@ uint8_t USBH_AllocPipe(USBH_HandleTypeDef *phost,
 USBH_StatusTypeDef USBH_FreePipe(USBH_HandleTypeDef *phost,
                                  uint8_t idx);
 
+void USBH_ResetPipes(USBH_HandleTypeDef *phost);
+
+uint32_t USBH_GetPipeMap(USBH_HandleTypeDef *phost);
+
+const USBH_PipeStatsTypeDef *USBH_GetPipeStats(USBH_HandleTypeDef *phost,
+                                               uint8_t pipe_num);
+
+USBH_StatusTypeDef USBH_ClearPipeStats(USBH_HandleTypeDef *phost,
+                                       uint8_t pipe_num);
+
+void USBH_PipeSubmitted(USBH_HandleTypeDef *phost,
+                        uint8_t pipe_num);
+
+#if (USBH_USE_URB_TRACE == 1U)
+const USBH_UrbTraceTypeDef *USBH_GetUrbTrace(USBH_HandleTypeDef *phost);
+
+USBH_StatusTypeDef USBH_ClearUrbTrace(USBH_HandleTypeDef *phost);
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+USBH_StatusTypeDef USBH_SetPipeRetryPolicy(USBH_HandleTypeDef *phost,
+                                           uint8_t pipe_num,
+                                           USBH_RetryPolicyTypeDef policy,
+                                           uint8_t burst,
+                                           uint8_t max_backoff);
+
+void USBH_PipeRetrySchedule(USBH_HandleTypeDef *phost,
+                            uint8_t pipe_num);
+
+void USBH_PipeRetryReset(USBH_HandleTypeDef *phost,
+                         uint8_t pipe_num);
+
+uint8_t USBH_PipeRetryDue(USBH_HandleTypeDef *phost,
+                          uint8_t pipe_num);
+
+uint8_t USBH_PipeRetryPing(USBH_HandleTypeDef *phost,
+                           uint8_t pipe_num);
+
 
 
 
@@ -42,6 +42,32 @@
 #define USBH_ADDRESS_DEFAULT                     0x00U
 #define USBH_ADDRESS_ASSIGNED                    0x01U
 #define USBH_MPS_DEFAULT                         0x40U
+
+#define USBH_ENUM_CACHE_NONE                     0xFFU
+/**
+  * @}
+  */
+
+/** @defgroup USBH_CORE_Private_TypesDefinitions
+  * @{
+  */
+#if (USBH_USE_ENUM_CACHE == 1U)
+/* Descriptors of an already enumerated device, matched on its device descriptor.
+   A hit only saves control transfers (the full configuration descriptor and
+   the strings): the attach debounce, the bus reset, the reset recovery and
+   the SetAddress recovery are waited out for every attach, about 400 ms
+   against well under a millisecond of control traffic at high speed. */
+typedef struct
+{
+  uint8_t               DevDesc_Raw[USB_DEVICE_DESC_SIZE];
+  uint8_t               ClassIdx;     /* Class selected by HOST_CHECK_CLASS */
+  uint16_t              CfgLength;
+  uint32_t              stamp;        /* Last use, for replacement */
+  USBH_CfgDescTypeDef   CfgDesc;
+  uint8_t               CfgDesc_Raw[USBH_MAX_SIZE_CONFIGURATION];
+  uint32_t              check;        /* Validates the entry, e.g. after a power loss */
+} USBH_EnumCacheTypeDef;
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
 /**
   * @}
   */
@@ -63,6 +89,16 @@ osThreadAttr_t USBH_Thread_Atrr;
 #endif
 #endif
 
+#if (USBH_USE_ENUM_CACHE == 1U)
+/* Shared by every host handle; in BKPSRAM the entries survive resets */
+#if (USBH_ENUM_CACHE_BKPSRAM == 1U)
+static USBH_EnumCacheTypeDef USBH_EnumCache[USBH_ENUM_CACHE_ENTRIES] __attribute__((section(".bkpsram")));
+#else
+static USBH_EnumCacheTypeDef USBH_EnumCache[USBH_ENUM_CACHE_ENTRIES];
+#endif /* (USBH_ENUM_CACHE_BKPSRAM == 1U) */
+static uint32_t USBH_EnumCacheStamp;
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
+
 
 /**
   * @}
@@ -75,6 +111,18 @@ osThreadAttr_t USBH_Thread_Atrr;
 static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost);
 static void USBH_HandleSof(USBH_HandleTypeDef *phost);
 static USBH_StatusTypeDef DeInitStateMachine(USBH_HandleTypeDef *phost);
+static void USBH_StartDelay(USBH_HandleTypeDef *phost, uint32_t delay);
+static uint8_t USBH_DelayElapsed(USBH_HandleTypeDef *phost);
+static void USBH_ArmWakeup(USBH_HandleTypeDef *phost, uint32_t tick);
+static void USBH_FreeControlPipes(USBH_HandleTypeDef *phost);
+
+#if (USBH_USE_ENUM_CACHE == 1U)
+static uint32_t USBH_EnumCacheCheck(const USBH_EnumCacheTypeDef *entry);
+static uint8_t USBH_EnumCacheFind(USBH_HandleTypeDef *phost);
+static USBH_StatusTypeDef USBH_EnumCacheRestore(USBH_HandleTypeDef *phost);
+static void USBH_EnumCacheStore(USBH_HandleTypeDef *phost);
+static void USBH_EnumCacheSetClass(USBH_HandleTypeDef *phost, uint8_t idx);
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
 
 #if (USBH_USE_OS == 1U)
 #if (osCMSIS < 0x20000U)
@@ -106,6 +154,9 @@ USBH_StatusTypeDef USBH_Init(USBH_HandleTypeDef *phost,
   /* Set DRiver ID */
   phost->id = id;
 
+  /* The root port handle owns the HCD and the host channels */
+  phost->pRoot = phost;
+
   /* Unlink class*/
   phost->pActiveClass = NULL;
   phost->ClassNumber = 0U;
@@ -161,6 +212,11 @@ USBH_StatusTypeDef USBH_Init(USBH_HandleTypeDef *phost,
 #endif /* (osCMSIS < 0x20000U) */
 #endif /* (USBH_USE_OS == 1U) */
 
+#if (USBH_USE_EVENTS == 1U)
+  /* Reset the bare-metal event queue */
+  (void)USBH_memset(&phost->events, 0, sizeof(phost->events));
+#endif /* (USBH_USE_EVENTS == 1U) */
+
   /* Initialize low level driver */
   (void)USBH_LL_Init(phost);
 
@@ -211,6 +267,56 @@ USBH_StatusTypeDef USBH_DeInit(USBH_HandleTypeDef *phost)
 }
 
 
+/**
+  * @brief  USBH_InitChild
+  *         Initialize the handle of a device attached to a hub port. The
+  *         device shares the HCD, the host channels and the user callback of
+  *         the hub handle and starts right after the hub port reset.
+  * @param  phost: Handle of the hub port device
+  * @param  phub: Hub Handle
+  * @param  port: Hub port number (1..n)
+  * @param  speed: Device speed reported by the hub
+  * @param  address: USB address to assign to the device
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_InitChild(USBH_HandleTypeDef *phost, USBH_HandleTypeDef *phub,
+                                  uint8_t port, uint8_t speed, uint8_t address)
+{
+  if ((phost == NULL) || (phub == NULL) || (phub->pRoot == NULL))
+  {
+    USBH_ErrLog("Invalid Host handle");
+    return USBH_FAIL;
+  }
+
+  phost->id = phub->id;
+  phost->pData = phub->pData;
+  phost->pRoot = phub->pRoot;
+  phost->pUser = phub->pUser;
+  phost->pActiveClass = NULL;
+
+  (void)DeInitStateMachine(phost);
+
+  phost->Control.pipe_in = 0xFFU;
+  phost->Control.pipe_out = 0xFFU;
+
+  phost->device.assigned_address = address;
+  phost->device.hub_address = phub->device.address;
+  phost->device.hub_port = port;
+  phost->device.speed = speed;
+
+  /* The hub driver already debounced and reset the port */
+  phost->device.PortEnabled = 1U;
+  phost->device.is_connected = 1U;
+  phost->device.is_disconnected = 0U;
+  phost->device.is_ReEnumerated = 0U;
+  phost->gState = HOST_DEV_ATTACHED;
+
+  (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
+
+  return USBH_OK;
+}
+
+
 /**
   * @brief  DeInitStateMachine
   *         De-Initialize the Host state machine.
@@ -221,10 +327,12 @@ static USBH_StatusTypeDef DeInitStateMachine(USBH_HandleTypeDef *phost)
 {
   uint32_t i = 0U;
 
-  /* Clear Pipes flags*/
-  for (i = 0U; i < USBH_MAX_PIPES_NBR; i++)
+  /* Clear Pipes flags, the channels of a hub port device belong to the root */
+  if (phost->pRoot == phost)
   {
-    phost->Pipes[i] = 0U;
+    USBH_ResetPipes(phost);
+
+    phost->device.assigned_address = USBH_DEVICE_ADDRESS;
   }
 
   for (i = 0U; i < USBH_MAX_DATA_BUFFER; i++)
@@ -236,15 +344,19 @@ static USBH_StatusTypeDef DeInitStateMachine(USBH_HandleTypeDef *phost)
   phost->EnumState = ENUM_IDLE;
   phost->RequestState = CMD_SEND;
   phost->Timer = 0U;
+  phost->DelayStart = 0U;
+  phost->DelayLength = 0U;
 
   phost->Control.state = CTRL_SETUP;
   phost->Control.pipe_size = USBH_MPS_DEFAULT;
   phost->Control.errorcount = 0U;
+  phost->Control.chain = 0U;
 
   phost->device.address = USBH_ADDRESS_DEFAULT;
   phost->device.speed = (uint8_t)USBH_SPEED_FULL;
   phost->device.RstCnt = 0U;
   phost->device.EnumCnt = 0U;
+  phost->device.EnumCacheIdx = USBH_ENUM_CACHE_NONE;
 
   /* Reset the device struct */
   USBH_memset(&phost->device.CfgDesc_Raw, 0, sizeof(phost->device.CfgDesc_Raw));
@@ -456,14 +568,7 @@ USBH_StatusTypeDef USBH_ReEnumerate(USBH_HandleTypeDef *phost)
     phost->device.is_disconnected = 1U;
   }
 
-#if (USBH_USE_OS == 1U)
-  phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-  (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-  (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+  (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
 
   return USBH_OK;
 }
@@ -495,22 +600,47 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         USBH_UsrLog("USB Device Connected");
 
         /* Wait for 200 ms after connection */
-        phost->gState = HOST_DEV_WAIT_FOR_ATTACHMENT;
-        USBH_Delay(200U);
-        (void)USBH_LL_ResetPort(phost);
+        USBH_StartDelay(phost, 200U);
+        phost->gState = HOST_DEV_CONNECT_DEBOUNCE;
+
+        (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
+      }
+      break;
+
+    case HOST_DEV_CONNECT_DEBOUNCE:
+
+      /* Until the deadline the wakeup armed by USBH_StartDelay runs the next pass */
+      if (USBH_DelayElapsed(phost) != 0U)
+      {
+        if (phost->pRoot != phost)
+        {
+          /* Hub port device: the port stays enabled, retry at default address */
+          phost->device.address = USBH_ADDRESS_DEFAULT;
+          USBH_StartDelay(phost, USBH_DEV_RESET_TIMEOUT);
+          phost->gState = HOST_DEV_WAIT_FOR_ATTACHMENT;
+        }
+        else
+        {
+          /* Hold the bus reset for 100 ms */
+          (void)USBH_LL_ResetPort2(phost, 1U);
+          USBH_StartDelay(phost, 100U);
+          phost->gState = HOST_DEV_PORT_RESET;
+        }
+      }
+      break;
+
+    case HOST_DEV_PORT_RESET:
+
+      if (USBH_DelayElapsed(phost) != 0U)
+      {
+        (void)USBH_LL_ResetPort2(phost, 0U);
 
         /* Make sure to start with Default address */
         phost->device.address = USBH_ADDRESS_DEFAULT;
         phost->Timeout = 0U;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        USBH_StartDelay(phost, USBH_DEV_RESET_TIMEOUT);
+        phost->gState = HOST_DEV_WAIT_FOR_ATTACHMENT;
       }
       break;
 
@@ -521,10 +651,11 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         USBH_UsrLog("USB Device Reset Completed");
         phost->device.RstCnt = 0U;
         phost->gState = HOST_DEV_ATTACHED;
+        (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
       }
       else
       {
-        if (phost->Timeout > USBH_DEV_RESET_TIMEOUT)
+        if (USBH_DelayElapsed(phost) != 0U)
         {
           phost->device.RstCnt++;
           if (phost->device.RstCnt > 3U)
@@ -536,22 +667,10 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
           else
           {
             phost->gState = HOST_IDLE;
+            (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
           }
         }
-        else
-        {
-          phost->Timeout += 10U;
-          USBH_Delay(10U);
-        }
       }
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
       break;
 
     case HOST_DEV_ATTACHED :
@@ -562,15 +681,39 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
       }
 
       /* Wait for 100 ms after Reset */
-      USBH_Delay(100U);
+      USBH_StartDelay(phost, 100U);
+      phost->gState = HOST_DETECT_DEVICE_SPEED;
+
+      (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
+      break;
 
-      phost->device.speed = (uint8_t)USBH_LL_GetSpeed(phost);
+    case HOST_DETECT_DEVICE_SPEED:
 
-      phost->gState = HOST_ENUMERATION;
+      if (USBH_DelayElapsed(phost) == 0U)
+      {
+        break;
+      }
+
+      /* The speed of a hub port device comes from the hub port status */
+      if (phost->pRoot == phost)
+      {
+        phost->device.speed = (uint8_t)USBH_LL_GetSpeed(phost);
+      }
 
       phost->Control.pipe_out = USBH_AllocPipe(phost, 0x00U);
       phost->Control.pipe_in  = USBH_AllocPipe(phost, 0x80U);
 
+      if ((phost->Control.pipe_out >= USBH_MAX_PIPES_NBR) ||
+          (phost->Control.pipe_in >= USBH_MAX_PIPES_NBR))
+      {
+        USBH_ErrLog("No free host channel for the control pipes");
+        USBH_FreeControlPipes(phost);
+        phost->gState = HOST_ABORT_STATE;
+        break;
+      }
+
+      phost->gState = HOST_ENUMERATION;
+
       /* Open Control pipes */
       (void)USBH_OpenPipe(phost, phost->Control.pipe_in, 0x80U,
                           phost->device.address, phost->device.speed,
@@ -581,14 +724,7 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
                           phost->device.address, phost->device.speed,
                           USBH_EP_CONTROL, (uint16_t)phost->Control.pipe_size);
 
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+      (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
       break;
 
     case HOST_ENUMERATION:
@@ -610,14 +746,7 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         {
           phost->gState = HOST_INPUT;
         }
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
       }
       break;
 
@@ -629,14 +758,7 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         phost->pUser(phost, HOST_USER_SELECT_CONFIGURATION);
         phost->gState = HOST_SET_CONFIGURATION;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
       }
     }
     break;
@@ -649,14 +771,7 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         USBH_UsrLog("Default configuration set.");
       }
 
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+      (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
       break;
 
     case  HOST_SET_WAKEUP_FEATURE:
@@ -685,14 +800,7 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         phost->gState = HOST_CHECK_CLASS;
       }
 
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+      (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
       break;
 
     case HOST_CHECK_CLASS:
@@ -705,13 +813,30 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
       {
         phost->pActiveClass = NULL;
 
-        for (idx = 0U; idx < USBH_MAX_NUM_SUPPORTED_CLASS; idx++)
+#if (USBH_USE_ENUM_CACHE == 1U)
+        idx = (phost->device.EnumCacheIdx != USBH_ENUM_CACHE_NONE) ?
+              USBH_EnumCache[phost->device.EnumCacheIdx].ClassIdx : USBH_ENUM_CACHE_NONE;
+
+        if ((idx < phost->ClassNumber) &&
+            (phost->pClass[idx]->ClassCode == phost->device.CfgDesc.Itf_Desc[0].bInterfaceClass))
+        {
+          phost->pActiveClass = phost->pClass[idx];
+        }
+        else
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
         {
-          if (phost->pClass[idx]->ClassCode == phost->device.CfgDesc.Itf_Desc[0].bInterfaceClass)
+          for (idx = 0U; idx < phost->ClassNumber; idx++)
           {
-            phost->pActiveClass = phost->pClass[idx];
-            break;
+            if (phost->pClass[idx]->ClassCode == phost->device.CfgDesc.Itf_Desc[0].bInterfaceClass)
+            {
+              phost->pActiveClass = phost->pClass[idx];
+              break;
+            }
           }
+
+#if (USBH_USE_ENUM_CACHE == 1U)
+          USBH_EnumCacheSetClass(phost, idx);
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
         }
 
         if (phost->pActiveClass != NULL)
@@ -737,14 +862,7 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         }
       }
 
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+      (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
       break;
 
     case HOST_CLASS_REQUEST:
@@ -772,14 +890,7 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         phost->gState = HOST_ABORT_STATE;
         USBH_ErrLog("Invalid Class Driver.");
       }
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+      (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
       break;
 
     case HOST_CLASS:
@@ -808,7 +919,14 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
       }
       USBH_UsrLog("USB Device disconnected");
 
-      if (phost->device.is_ReEnumerated == 1U)
+      if (phost->pRoot != phost)
+      {
+        /* Hub port device: release its channels, the hub frees the slot */
+        USBH_FreeControlPipes(phost);
+        phost->device.is_connected = 0U;
+        phost->device.PortEnabled = 0U;
+      }
+      else if (phost->device.is_ReEnumerated == 1U)
       {
         phost->device.is_ReEnumerated = 0U;
 
@@ -821,14 +939,7 @@ USBH_StatusTypeDef USBH_Process(USBH_HandleTypeDef *phost)
         (void)USBH_LL_Start(phost);
       }
 
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+      (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
       break;
 
     case HOST_ABORT_STATE:
@@ -884,8 +995,7 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
         else
         {
           /* free control pipes */
-          (void)USBH_FreePipe(phost, phost->Control.pipe_out);
-          (void)USBH_FreePipe(phost, phost->Control.pipe_in);
+          USBH_FreeControlPipes(phost);
 
           /* Reset the USB Device */
           phost->gState = HOST_IDLE;
@@ -905,6 +1015,10 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
         USBH_UsrLog("PID: %xh", phost->device.DevDesc.idProduct);
         USBH_UsrLog("VID: %xh", phost->device.DevDesc.idVendor);
 
+#if (USBH_USE_ENUM_CACHE == 1U)
+        phost->device.EnumCacheIdx = USBH_EnumCacheFind(phost);
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
+
         phost->EnumState = ENUM_SET_ADDR;
       }
       else if (ReqStatus == USBH_NOT_SUPPORTED)
@@ -920,8 +1034,7 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
         else
         {
           /* Free control pipes */
-          (void)USBH_FreePipe(phost, phost->Control.pipe_out);
-          (void)USBH_FreePipe(phost, phost->Control.pipe_in);
+          USBH_FreeControlPipes(phost);
 
           /* Reset the USB Device */
           phost->EnumState = ENUM_IDLE;
@@ -936,11 +1049,12 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
 
     case ENUM_SET_ADDR:
       /* set address */
-      ReqStatus = USBH_SetAddress(phost, USBH_DEVICE_ADDRESS);
+      ReqStatus = USBH_SetAddress(phost, phost->device.assigned_address);
       if (ReqStatus == USBH_OK)
       {
-        USBH_Delay(2U);
-        phost->device.address = USBH_DEVICE_ADDRESS;
+        /* 2 ms SetAddress recovery, waited out in ENUM_GET_CFG_DESC */
+        USBH_StartDelay(phost, 2U);
+        phost->device.address = phost->device.assigned_address;
 
         /* user callback for device address assigned */
         USBH_UsrLog("Address (#%d) assigned.", phost->device.address);
@@ -972,10 +1086,26 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
       break;
 
     case ENUM_GET_CFG_DESC:
+      if (USBH_DelayElapsed(phost) == 0U)
+      {
+        break;
+      }
+
       /* get standard configuration descriptor */
       ReqStatus = USBH_Get_CfgDesc(phost, USB_CONFIGURATION_DESC_SIZE);
       if (ReqStatus == USBH_OK)
       {
+#if (USBH_USE_ENUM_CACHE == 1U)
+        /* Known device: the configuration header verifies the cached descriptors,
+           the full configuration descriptor and the strings are not read again */
+        if (USBH_EnumCacheRestore(phost) == USBH_OK)
+        {
+          USBH_UsrLog("Enumeration cache hit.");
+          Status = USBH_OK;
+          break;
+        }
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
+
         phost->EnumState = ENUM_GET_FULL_CFG_DESC;
       }
       else if (ReqStatus == USBH_NOT_SUPPORTED)
@@ -991,8 +1121,7 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
         else
         {
           /* Free control pipes */
-          (void)USBH_FreePipe(phost, phost->Control.pipe_out);
-          (void)USBH_FreePipe(phost, phost->Control.pipe_in);
+          USBH_FreeControlPipes(phost);
 
           /* Reset the USB Device */
           phost->EnumState = ENUM_IDLE;
@@ -1010,6 +1139,10 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
       ReqStatus = USBH_Get_CfgDesc(phost, phost->device.CfgDesc.wTotalLength);
       if (ReqStatus == USBH_OK)
       {
+#if (USBH_USE_ENUM_CACHE == 1U)
+        USBH_EnumCacheStore(phost);
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
+
         phost->EnumState = ENUM_GET_MFC_STRING_DESC;
       }
       else if (ReqStatus == USBH_NOT_SUPPORTED)
@@ -1025,8 +1158,7 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
         else
         {
           /* Free control pipes */
-          (void)USBH_FreePipe(phost, phost->Control.pipe_out);
-          (void)USBH_FreePipe(phost, phost->Control.pipe_in);
+          USBH_FreeControlPipes(phost);
 
           /* Reset the USB Device */
           phost->EnumState = ENUM_IDLE;
@@ -1051,28 +1183,14 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
           USBH_UsrLog("Manufacturer : %s", (char *)(void *)phost->device.Data);
           phost->EnumState = ENUM_GET_PRODUCT_STRING_DESC;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
         }
         else if (ReqStatus == USBH_NOT_SUPPORTED)
         {
           USBH_UsrLog("Manufacturer : N/A");
           phost->EnumState = ENUM_GET_PRODUCT_STRING_DESC;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
         }
         else
         {
@@ -1084,14 +1202,7 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
         USBH_UsrLog("Manufacturer : N/A");
         phost->EnumState = ENUM_GET_PRODUCT_STRING_DESC;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
       }
       break;
 
@@ -1112,14 +1223,7 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
           USBH_UsrLog("Product : N/A");
           phost->EnumState = ENUM_GET_SERIALNUM_STRING_DESC;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
         }
         else
         {
@@ -1131,14 +1235,7 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
         USBH_UsrLog("Product : N/A");
         phost->EnumState = ENUM_GET_SERIALNUM_STRING_DESC;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_STATE_CHANGED_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_STATE_CHANGED_EVENT);
       }
       break;
 
@@ -1178,6 +1275,72 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
 }
 
 
+/**
+  * @brief  USBH_StartDelay
+  *         Start a wait that the state machine polls with USBH_DelayElapsed
+  *         instead of blocking in USBH_Delay
+  * @param  phost: Host Handle
+  * @param  delay: Wait length in ms
+  * @retval None
+  */
+static void USBH_StartDelay(USBH_HandleTypeDef *phost, uint32_t delay)
+{
+  phost->DelayStart = USBH_GetTick();
+  phost->DelayLength = delay;
+
+  USBH_ArmWakeup(phost, phost->DelayStart + delay);
+}
+
+
+/**
+  * @brief  USBH_DelayElapsed
+  *         Check whether the wait started by USBH_StartDelay is over,
+  *         re-arming the wakeup otherwise: an earlier deadline of another
+  *         handle may have consumed it
+  * @param  phost: Host Handle
+  * @retval 1 once the delay has elapsed, 0 otherwise
+  */
+static uint8_t USBH_DelayElapsed(USBH_HandleTypeDef *phost)
+{
+  if ((USBH_GetTick() - phost->DelayStart) >= phost->DelayLength)
+  {
+    return 1U;
+  }
+
+  USBH_ArmWakeup(phost, phost->DelayStart + phost->DelayLength);
+
+  return 0U;
+}
+
+
+/**
+  * @brief  USBH_ArmWakeup
+  *         Get the host process run once the tick is reached. In event mode
+  *         the root handle keeps the earliest deadline, checked by
+  *         USBH_EventPending/USBH_ProcessEvents, so that the main loop can
+  *         sleep until then; an OS queue is polled as before.
+  * @param  phost: Host Handle
+  * @param  tick: USBH_GetTick value of the deadline
+  * @retval None
+  */
+static void USBH_ArmWakeup(USBH_HandleTypeDef *phost, uint32_t tick)
+{
+#if (USBH_USE_EVENTS == 1U)
+  USBH_EventQueueTypeDef *queue = ((phost->pRoot != NULL) ? &phost->pRoot->events : &phost->events);
+
+  if ((queue->wake_armed == 0U) || ((int32_t)(tick - queue->wake_tick) < 0))
+  {
+    queue->wake_tick = tick;
+    queue->wake_armed = 1U;
+  }
+#else
+  UNUSED(tick);
+
+  (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
+#endif /* (USBH_USE_EVENTS == 1U) */
+}
+
+
 /**
   * @brief  USBH_LL_SetTimer
   *         Set the initial Host Timer tick
@@ -1190,6 +1353,197 @@ void USBH_LL_SetTimer(USBH_HandleTypeDef *phost, uint32_t time)
 }
 
 
+/**
+  * @brief  USBH_FreeControlPipes
+  *         Close and free the control pipes of a device.
+  * @param  phost: Host Handle
+  * @retval None
+  */
+static void USBH_FreeControlPipes(USBH_HandleTypeDef *phost)
+{
+  if (phost->Control.pipe_out < USBH_MAX_PIPES_NBR)
+  {
+    (void)USBH_ClosePipe(phost, phost->Control.pipe_out);
+    (void)USBH_FreePipe(phost, phost->Control.pipe_out);
+  }
+
+  if (phost->Control.pipe_in < USBH_MAX_PIPES_NBR)
+  {
+    (void)USBH_ClosePipe(phost, phost->Control.pipe_in);
+    (void)USBH_FreePipe(phost, phost->Control.pipe_in);
+  }
+
+  phost->Control.pipe_out = 0xFFU;
+  phost->Control.pipe_in = 0xFFU;
+}
+
+
+#if (USBH_USE_ENUM_CACHE == 1U)
+/**
+  * @brief  USBH_EnumCacheCheck
+  *         FNV-1a hash of a cache entry, excluding the check field.
+  * @param  entry: Cache entry
+  * @retval Hash value
+  */
+static uint32_t USBH_EnumCacheCheck(const USBH_EnumCacheTypeDef *entry)
+{
+  const uint8_t *pbuff = (const uint8_t *)entry;
+  uint32_t hash = 0x811C9DC5U;
+  uint32_t idx;
+
+  for (idx = 0U; idx < (sizeof(USBH_EnumCacheTypeDef) - sizeof(entry->check)); idx++)
+  {
+    hash = (hash ^ pbuff[idx]) * 0x01000193U;
+  }
+
+  /* Never matches a zeroed entry */
+  return hash ^ 0xA5A5A5A5U;
+}
+
+
+/**
+  * @brief  USBH_EnumCacheFind
+  *         Look up the device descriptor just read in the enumeration cache.
+  * @param  phost: Host Handle
+  * @retval Cache entry index, USBH_ENUM_CACHE_NONE on a miss
+  */
+static uint8_t USBH_EnumCacheFind(USBH_HandleTypeDef *phost)
+{
+  USBH_EnumCacheTypeDef *entry;
+  uint8_t idx;
+
+  for (idx = 0U; idx < USBH_ENUM_CACHE_ENTRIES; idx++)
+  {
+    entry = &USBH_EnumCache[idx];
+
+    if ((USBH_memcmp(entry->DevDesc_Raw, phost->device.Data, USB_DEVICE_DESC_SIZE) == 0) &&
+        (entry->check == USBH_EnumCacheCheck(entry)))
+    {
+      return idx;
+    }
+  }
+
+  return USBH_ENUM_CACHE_NONE;
+}
+
+
+/**
+  * @brief  USBH_EnumCacheRestore
+  *         Restore the configuration descriptor of a known device once its
+  *         configuration header, just read into CfgDesc_Raw, matches the cache.
+  * @param  phost: Host Handle
+  * @retval USBH_OK on a hit, USBH_FAIL if the device must be enumerated
+  */
+static USBH_StatusTypeDef USBH_EnumCacheRestore(USBH_HandleTypeDef *phost)
+{
+  USBH_EnumCacheTypeDef *entry;
+
+  if (phost->device.EnumCacheIdx == USBH_ENUM_CACHE_NONE)
+  {
+    return USBH_FAIL;
+  }
+
+  entry = &USBH_EnumCache[phost->device.EnumCacheIdx];
+
+  if ((entry->check != USBH_EnumCacheCheck(entry)) ||
+      (USBH_memcmp(entry->CfgDesc_Raw, phost->device.CfgDesc_Raw, USB_CONFIGURATION_DESC_SIZE) != 0))
+  {
+    /* Same device descriptor, different configuration: drop the stale entry */
+    entry->check = 0U;
+    phost->device.EnumCacheIdx = USBH_ENUM_CACHE_NONE;
+    return USBH_FAIL;
+  }
+
+  (void)USBH_memcpy(phost->device.CfgDesc_Raw, entry->CfgDesc_Raw, entry->CfgLength);
+  (void)USBH_memcpy(&phost->device.CfgDesc, &entry->CfgDesc, sizeof(USBH_CfgDescTypeDef));
+
+  entry->stamp = ++USBH_EnumCacheStamp;
+  entry->check = USBH_EnumCacheCheck(entry);
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_EnumCacheStore
+  *         Record the descriptors of a fully enumerated device, replacing the
+  *         least recently used entry.
+  * @param  phost: Host Handle
+  * @retval None
+  */
+static void USBH_EnumCacheStore(USBH_HandleTypeDef *phost)
+{
+  USBH_EnumCacheTypeDef *entry;
+  uint16_t length = MIN(phost->device.CfgDesc.wTotalLength, USBH_MAX_SIZE_CONFIGURATION);
+  uint8_t victim = 0U;
+  uint8_t idx;
+
+  for (idx = 0U; idx < USBH_ENUM_CACHE_ENTRIES; idx++)
+  {
+    entry = &USBH_EnumCache[idx];
+
+    if (entry->check != USBH_EnumCacheCheck(entry))
+    {
+      victim = idx;
+      break;
+    }
+
+    if (entry->stamp < USBH_EnumCache[victim].stamp)
+    {
+      victim = idx;
+    }
+  }
+
+  entry = &USBH_EnumCache[victim];
+
+  (void)USBH_memset(entry, 0, sizeof(USBH_EnumCacheTypeDef));
+  (void)USBH_memcpy(entry->DevDesc_Raw, phost->device.Data, USB_DEVICE_DESC_SIZE);
+  (void)USBH_memcpy(entry->CfgDesc_Raw, phost->device.CfgDesc_Raw, length);
+  (void)USBH_memcpy(&entry->CfgDesc, &phost->device.CfgDesc, sizeof(USBH_CfgDescTypeDef));
+  entry->CfgLength = length;
+  entry->ClassIdx = USBH_ENUM_CACHE_NONE;
+  entry->stamp = ++USBH_EnumCacheStamp;
+  entry->check = USBH_EnumCacheCheck(entry);
+
+  phost->device.EnumCacheIdx = victim;
+}
+
+
+/**
+  * @brief  USBH_EnumCacheSetClass
+  *         Record the class selected for the device in its cache entry.
+  * @param  phost: Host Handle
+  * @param  idx: Index of the class in phost->pClass
+  * @retval None
+  */
+static void USBH_EnumCacheSetClass(USBH_HandleTypeDef *phost, uint8_t idx)
+{
+  USBH_EnumCacheTypeDef *entry;
+
+  if ((phost->device.EnumCacheIdx == USBH_ENUM_CACHE_NONE) || (idx >= phost->ClassNumber))
+  {
+    return;
+  }
+
+  entry = &USBH_EnumCache[phost->device.EnumCacheIdx];
+  entry->ClassIdx = idx;
+  entry->check = USBH_EnumCacheCheck(entry);
+}
+
+
+/**
+  * @brief  USBH_EnumCacheClear
+  *         Forget every device of the enumeration cache.
+  * @retval None
+  */
+void USBH_EnumCacheClear(void)
+{
+  (void)USBH_memset(USBH_EnumCache, 0, sizeof(USBH_EnumCache));
+  USBH_EnumCacheStamp = 0U;
+}
+#endif /* (USBH_USE_ENUM_CACHE == 1U) */
+
+
 /**
   * @brief  USBH_LL_IncTimer
   *         Increment Host Timer tick
@@ -1199,6 +1553,17 @@ void USBH_LL_SetTimer(USBH_HandleTypeDef *phost, uint32_t time)
 void USBH_LL_IncTimer(USBH_HandleTypeDef *phost)
 {
   phost->Timer++;
+
+#if (USBH_USE_CTL_CHAIN == 1U)
+  /* A chained control transfer posts no event until it ends: wake
+     USBH_CtlReq once it is late, so that it can take it back */
+  if ((__atomic_load_n(&phost->Control.chain, __ATOMIC_ACQUIRE) != 0U) &&
+      ((USBH_GetTick() - phost->Control.tick) >= USBH_CTL_TIMEOUT))
+  {
+    (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
+  }
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
+
   USBH_HandleSof(phost);
 }
 
@@ -1213,7 +1578,11 @@ static void USBH_HandleSof(USBH_HandleTypeDef *phost)
 {
   if ((phost->gState == HOST_CLASS) && (phost->pActiveClass != NULL))
   {
-    phost->pActiveClass->SOFProcess(phost);
+    /* A busy SOF process requests a background pass of the class */
+    if (phost->pActiveClass->SOFProcess(phost) == USBH_BUSY)
+    {
+      (void)USBH_PostEvent(phost, USBH_SOF_EVENT);
+    }
   }
 }
 
@@ -1228,14 +1597,7 @@ void USBH_LL_PortEnabled(USBH_HandleTypeDef *phost)
 {
   phost->device.PortEnabled = 1U;
 
-#if (USBH_USE_OS == 1U)
-  phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-  (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-  (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+  (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
 
   return;
 }
@@ -1280,14 +1642,7 @@ USBH_StatusTypeDef USBH_LL_Connect(USBH_HandleTypeDef *phost)
   phost->device.is_ReEnumerated = 0U;
 
 
-#if (USBH_USE_OS == 1U)
-  phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-  (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-  (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+  (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
 
   return USBH_OK;
 }
@@ -1312,14 +1667,7 @@ USBH_StatusTypeDef USBH_LL_Disconnect(USBH_HandleTypeDef *phost)
   /* FRee Control Pipes */
   (void)USBH_FreePipe(phost, phost->Control.pipe_in);
   (void)USBH_FreePipe(phost, phost->Control.pipe_out);
-#if (USBH_USE_OS == 1U)
-  phost->os_msg = (uint32_t)USBH_PORT_EVENT;
-#if (osCMSIS < 0x20000U)
-  (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-  (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+  (void)USBH_PostEvent(phost, USBH_PORT_EVENT);
 
   return USBH_OK;
 }
@@ -1362,8 +1710,10 @@ static void USBH_Process_OS(void *argument)
   }
 }
 #endif /* (osCMSIS < 0x20000U) */
+#endif /* (USBH_USE_OS == 1U) */
 
 
+#if (USBH_USE_OS == 1U) || (USBH_USE_EVENTS == 1U)
 /**
   * @brief  USBH_LL_NotifyURBChange
   *         Notify URB state Change
@@ -1372,8 +1722,34 @@ static void USBH_Process_OS(void *argument)
   */
 USBH_StatusTypeDef USBH_LL_NotifyURBChange(USBH_HandleTypeDef *phost)
 {
-  phost->os_msg = (uint32_t)USBH_PORT_EVENT;
+#if (USBH_USE_OS == 1U)
+  return USBH_PostEvent(phost, USBH_PORT_EVENT);
+#else
+  return USBH_PostEvent(phost, USBH_URB_EVENT);
+#endif
+}
+#endif
 
+
+/**
+  * @brief  USBH_PostEvent
+  *         Wake up the host process: post to the OS message queue, or to the
+  *         lock-free event queue in bare-metal event mode.
+  *         Can be called from thread and interrupt context.
+  * @param  phost: Host handle
+  * @param  event: Event type
+  * @retval USBH Status, USBH_BUSY if the event queue is full
+  */
+USBH_StatusTypeDef USBH_PostEvent(USBH_HandleTypeDef *phost, USBH_OSEventTypeDef event)
+{
+  /* Hub port devices are run from the root host process */
+  if ((phost->pRoot != NULL) && (phost->pRoot != phost))
+  {
+    phost = phost->pRoot;
+  }
+
+#if (USBH_USE_OS == 1U)
+  phost->os_msg = (uint32_t)event;
 #if (osCMSIS < 0x20000U)
   (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
 #else
@@ -1381,8 +1757,109 @@ USBH_StatusTypeDef USBH_LL_NotifyURBChange(USBH_HandleTypeDef *phost)
 #endif
 
   return USBH_OK;
-}
+#elif (USBH_USE_EVENTS == 1U)
+  USBH_EventQueueTypeDef *queue = &phost->events;
+  uint32_t head;
+  uint32_t slot;
+
+  /* Reserve a slot; producers may preempt each other */
+  head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+  do
+  {
+    if ((head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) >= USBH_EVENT_QUEUE_SIZE)
+    {
+      /* A full queue already guarantees that USBH_Process will run */
+      (void)__atomic_fetch_add(&queue->dropped, 1U, __ATOMIC_RELAXED);
+      return USBH_BUSY;
+    }
+  } while (__atomic_compare_exchange_n(&queue->head, &head, head + 1U, 1,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) == 0);
+
+  slot = head % USBH_EVENT_QUEUE_SIZE;
+  queue->stamp[slot] = phost->Timer;
+
+  /* Publish the slot to the consumer */
+  __atomic_store_n(&queue->evt[slot], (uint8_t)event, __ATOMIC_RELEASE);
+
+  return USBH_OK;
+#else
+  UNUSED(phost);
+  UNUSED(event);
+
+  return USBH_OK;
 #endif
+}
+
+
+#if (USBH_USE_EVENTS == 1U)
+/**
+  * @brief  USBH_ProcessEvents
+  *         Bare-metal replacement for USBH_Process polling: run the host
+  *         process once per pending event, bounded by the queue size.
+  * @param  phost: Host handle
+  * @retval USBH_OK if at least one event was processed, USBH_BUSY otherwise
+  */
+USBH_StatusTypeDef USBH_ProcessEvents(USBH_HandleTypeDef *phost)
+{
+  USBH_EventQueueTypeDef *queue = &phost->events;
+  uint32_t count = 0U;
+  uint32_t slot;
+  uint32_t latency;
+
+  /* A waiting state reached its deadline: one pass, which re-arms if needed */
+  if ((queue->wake_armed != 0U) && ((int32_t)(USBH_GetTick() - queue->wake_tick) >= 0))
+  {
+    queue->wake_armed = 0U;
+    (void)USBH_Process(phost);
+    count++;
+  }
+
+  while (count < USBH_EVENT_QUEUE_SIZE)
+  {
+    slot = queue->tail % USBH_EVENT_QUEUE_SIZE;
+
+    if (__atomic_load_n(&queue->evt[slot], __ATOMIC_ACQUIRE) == 0U)
+    {
+      break;
+    }
+
+    latency = phost->Timer - queue->stamp[slot];
+    if (latency > queue->latency_max)
+    {
+      queue->latency_max = latency;
+    }
+
+    /* Release the slot before handing it back to the producers */
+    queue->evt[slot] = 0U;
+    __atomic_store_n(&queue->tail, queue->tail + 1U, __ATOMIC_RELEASE);
+
+    (void)USBH_Process(phost);
+    count++;
+  }
+
+  return (count != 0U) ? USBH_OK : USBH_BUSY;
+}
+
+
+/**
+  * @brief  USBH_EventPending
+  *         Check whether the host process has work to do: an event posted,
+  *         or the deadline of a waiting state reached. The tick interrupt
+  *         wakes the caller to check the deadline again.
+  * @param  phost: Host handle
+  * @retval 1 if an event is pending, 0 otherwise
+  */
+uint8_t USBH_EventPending(USBH_HandleTypeDef *phost)
+{
+  if ((phost->events.wake_armed != 0U) && ((int32_t)(USBH_GetTick() - phost->events.wake_tick) >= 0))
+  {
+    return 1U;
+  }
+
+  return (__atomic_load_n(&phost->events.head, __ATOMIC_ACQUIRE) !=
+          __atomic_load_n(&phost->events.tail, __ATOMIC_RELAXED)) ? 1U : 0U;
+}
+#endif /* (USBH_USE_EVENTS == 1U) */
 /**
   * @}
   */
@@ -69,6 +69,11 @@
   * @{
   */
 static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost);
+static void USBH_CtlTimeout(USBH_HandleTypeDef *phost);
+#if (USBH_USE_CTL_CHAIN == 1U)
+static uint8_t USBH_CtlChainStart(USBH_HandleTypeDef *phost);
+static void USBH_CtlChainSubmit(USBH_HandleTypeDef *phost, CTRL_StateTypeDef state);
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
 static USBH_StatusTypeDef USBH_ParseDevDesc(USBH_HandleTypeDef *phost, uint8_t *buf, uint16_t length);
 static USBH_StatusTypeDef USBH_ParseCfgDesc(USBH_HandleTypeDef *phost, uint8_t *buf, uint16_t length);
 static USBH_StatusTypeDef USBH_ParseEPDesc(USBH_HandleTypeDef *phost, USBH_EpDescTypeDef *ep_descriptor, uint8_t *buf);
@@ -758,21 +763,35 @@ USBH_StatusTypeDef USBH_CtlReq(USBH_HandleTypeDef *phost, uint8_t *buff,
       /* Start a SETUP transfer */
       phost->Control.buff = buff;
       phost->Control.length = length;
-      phost->Control.state = CTRL_SETUP;
+      phost->Control.tick = USBH_GetTick();
       phost->RequestState = CMD_WAIT;
       status = USBH_BUSY;
 
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+#if (USBH_USE_CTL_CHAIN == 1U)
+      if (USBH_CtlChainStart(phost) != 0U)
+      {
+        break;
+      }
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
+
+      phost->Control.state = CTRL_SETUP;
+      (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       break;
 
     case CMD_WAIT:
+      if ((USBH_GetTick() - phost->Control.tick) >= USBH_CTL_TIMEOUT)
+      {
+        USBH_CtlTimeout(phost);
+      }
+
+#if (USBH_USE_CTL_CHAIN == 1U)
+      /* The interrupt posts the event once the transfer ends */
+      if (__atomic_load_n(&phost->Control.chain, __ATOMIC_ACQUIRE) != 0U)
+      {
+        break;
+      }
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
+
       status = USBH_HandleControl(phost);
       if ((status == USBH_OK) || (status == USBH_NOT_SUPPORTED))
       {
@@ -789,14 +808,7 @@ USBH_StatusTypeDef USBH_CtlReq(USBH_HandleTypeDef *phost, uint8_t *buff,
       {
         /* .. */
       }
-#if (USBH_USE_OS == 1U)
-      phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-      (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-      (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+      (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       break;
 
     default:
@@ -806,6 +818,201 @@ USBH_StatusTypeDef USBH_CtlReq(USBH_HandleTypeDef *phost, uint8_t *buff,
 }
 
 
+/**
+  * @brief  USBH_CtlTimeout
+  *         Give up the current stage of a control transfer that ran out of
+  *         time, taking it back from the interrupt if it is chained. The
+  *         error state retries it from the SETUP stage.
+  * @param  phost: Host Handle
+  * @retval None
+  */
+static void USBH_CtlTimeout(USBH_HandleTypeDef *phost)
+{
+#if (USBH_USE_CTL_CHAIN == 1U)
+  if (__atomic_exchange_n(&phost->Control.chain, 0U, __ATOMIC_ACQ_REL) != 0U)
+  {
+    phost->pRoot->CtlChain[phost->Control.pipe_in] = NULL;
+    phost->pRoot->CtlChain[phost->Control.pipe_out] = NULL;
+  }
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
+
+  USBH_ErrLog("Control error: Timeout in state %d", (int)phost->Control.state);
+  phost->Control.state = CTRL_ERROR;
+}
+
+
+#if (USBH_USE_CTL_CHAIN == 1U)
+/**
+  * @brief  USBH_CtlChainStart
+  *         Send the SETUP stage and leave the next stages to the URB
+  *         completion interrupt
+  * @param  phost: Host Handle
+  * @retval 1 if the transfer is chained, 0 to run it from USBH_Process
+  */
+static uint8_t USBH_CtlChainStart(USBH_HandleTypeDef *phost)
+{
+  USBH_HandleTypeDef *proot = phost->pRoot;
+
+  if ((phost->Control.pipe_in >= USBH_MAX_PIPES_NBR) ||
+      (phost->Control.pipe_out >= USBH_MAX_PIPES_NBR))
+  {
+    return 0U;
+  }
+
+  proot->CtlChain[phost->Control.pipe_in] = phost;
+  proot->CtlChain[phost->Control.pipe_out] = phost;
+  phost->Control.naks = 0U;
+  __atomic_store_n(&phost->Control.chain, 1U, __ATOMIC_RELEASE);
+
+  USBH_CtlChainSubmit(phost, CTRL_SETUP_WAIT);
+
+  return 1U;
+}
+
+
+/**
+  * @brief  USBH_CtlChainSubmit
+  *         Enter the wait state of a control stage and submit its URB
+  * @param  phost: Host Handle
+  * @param  state: Wait state of the stage
+  * @retval None
+  */
+static void USBH_CtlChainSubmit(USBH_HandleTypeDef *phost, CTRL_StateTypeDef state)
+{
+  phost->Control.state = state;
+  phost->Control.timer = (uint16_t)phost->Timer;
+
+  switch (state)
+  {
+    case CTRL_SETUP_WAIT:
+      (void)USBH_CtlSendSetup(phost, (uint8_t *)(void *)phost->Control.setup.d8,
+                              phost->Control.pipe_out);
+      break;
+
+    case CTRL_DATA_IN_WAIT:
+      (void)USBH_CtlReceiveData(phost, phost->Control.buff,
+                                phost->Control.length, phost->Control.pipe_in);
+      break;
+
+    case CTRL_DATA_OUT_WAIT:
+      (void)USBH_CtlSendData(phost, phost->Control.buff, phost->Control.length,
+                             phost->Control.pipe_out, 1U);
+      break;
+
+    case CTRL_STATUS_IN_WAIT:
+      (void)USBH_CtlReceiveData(phost, NULL, 0U, phost->Control.pipe_in);
+      break;
+
+    case CTRL_STATUS_OUT_WAIT:
+      (void)USBH_CtlSendData(phost, NULL, 0U, phost->Control.pipe_out, 1U);
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+/**
+  * @brief  USBH_CtlChainCompleted
+  *         Advance a chained control transfer from the URB completion
+  *         interrupt. The next stage is submitted at once; the end of the
+  *         transfer, a STALL, an error or the USBH_CTL_CHAIN_MAX_NAKS-th NAK
+  *         hands the state machine back to USBH_HandleControl through a
+  *         single control event.
+  * @param  phost: Root Host Handle
+  * @param  pipe_num: Pipe Number
+  * @param  urb_state: URB state of the completed transfer
+  * @retval None
+  */
+void USBH_CtlChainCompleted(USBH_HandleTypeDef *phost, uint8_t pipe_num,
+                            USBH_URBStateTypeDef urb_state)
+{
+  USBH_HandleTypeDef *pdev = phost->CtlChain[pipe_num];
+  CTRL_StateTypeDef state;
+  uint8_t direction;
+  uint8_t stage_pipe;
+
+  if ((pdev == NULL) || (__atomic_load_n(&pdev->Control.chain, __ATOMIC_ACQUIRE) == 0U))
+  {
+    return;
+  }
+
+  state = pdev->Control.state;
+  stage_pipe = ((state == CTRL_DATA_IN_WAIT) || (state == CTRL_STATUS_IN_WAIT)) ?
+               pdev->Control.pipe_in : pdev->Control.pipe_out;
+
+  if (stage_pipe != pipe_num)
+  {
+    return;
+  }
+
+  if (urb_state == USBH_URB_DONE)
+  {
+    direction = (pdev->Control.setup.b.bmRequestType & USB_REQ_DIR_MASK);
+
+    switch (state)
+    {
+      case CTRL_SETUP_WAIT:
+        if (pdev->Control.setup.b.wLength.w != 0U)
+        {
+          USBH_CtlChainSubmit(pdev, (direction == USB_D2H) ? CTRL_DATA_IN_WAIT : CTRL_DATA_OUT_WAIT);
+        }
+        else
+        {
+          USBH_CtlChainSubmit(pdev, (direction == USB_D2H) ? CTRL_STATUS_OUT_WAIT : CTRL_STATUS_IN_WAIT);
+        }
+        return;
+
+      case CTRL_DATA_IN_WAIT:
+        USBH_CtlChainSubmit(pdev, CTRL_STATUS_OUT_WAIT);
+        return;
+
+      case CTRL_DATA_OUT_WAIT:
+        USBH_CtlChainSubmit(pdev, CTRL_STATUS_IN_WAIT);
+        return;
+
+      default:
+        /* Status stage done */
+        break;
+    }
+  }
+  else if (urb_state == USBH_URB_NOTREADY)
+  {
+    /* A NAKed SETUP is a device error. A device NAKing on is left to
+       USBH_HandleControl, which retries at the pace of USBH_Process */
+    if ((state != CTRL_SETUP_WAIT) && (++pdev->Control.naks < USBH_CTL_CHAIN_MAX_NAKS))
+    {
+      if ((state == CTRL_DATA_OUT_WAIT) || (state == CTRL_STATUS_OUT_WAIT))
+      {
+        /* Nack received from device, send the stage again */
+        USBH_CtlChainSubmit(pdev, state);
+      }
+
+      /* The channel is rearmed on an IN NAK */
+      return;
+    }
+  }
+  else if (urb_state == USBH_URB_IDLE)
+  {
+    /* Channel halted without a result */
+    return;
+  }
+  else
+  {
+    /* .. */
+  }
+
+  /* The URB state is left for USBH_HandleControl to conclude the transfer */
+  phost->CtlChain[pdev->Control.pipe_in] = NULL;
+  phost->CtlChain[pdev->Control.pipe_out] = NULL;
+  __atomic_store_n(&pdev->Control.chain, 0U, __ATOMIC_RELEASE);
+
+  (void)USBH_PostEvent(pdev, USBH_CONTROL_EVENT);
+}
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
+
+
 /**
   * @brief  USBH_HandleControl
   *         Handles the USB control transfer state machine
@@ -866,14 +1073,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
           }
         }
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
       else
       {
@@ -881,14 +1081,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
         {
           phost->Control.state = CTRL_ERROR;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
         }
       }
       break;
@@ -911,14 +1104,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
       {
         phost->Control.state = CTRL_STATUS_OUT;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
 
       /* manage error cases*/
@@ -927,14 +1113,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
         /* In stall case, return to previous machine state*/
         status = USBH_NOT_SUPPORTED;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
       else
       {
@@ -943,14 +1122,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
           /* Device error */
           phost->Control.state = CTRL_ERROR;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
         }
       }
       break;
@@ -973,14 +1145,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
         /* If the Setup Pkt is sent successful, then change the state */
         phost->Control.state = CTRL_STATUS_IN;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
 
       /* handle error cases */
@@ -990,28 +1155,14 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
         phost->Control.state = CTRL_STALLED;
         status = USBH_NOT_SUPPORTED;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
       else if (URB_Status == USBH_URB_NOTREADY)
       {
         /* Nack received from device */
         phost->Control.state = CTRL_DATA_OUT;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
       else
       {
@@ -1021,14 +1172,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
           phost->Control.state = CTRL_ERROR;
           status = USBH_FAIL;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
         }
       }
       break;
@@ -1052,27 +1196,13 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
         phost->Control.state = CTRL_COMPLETE;
         status = USBH_OK;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
       else if (URB_Status == USBH_URB_ERROR)
       {
         phost->Control.state = CTRL_ERROR;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
       else
       {
@@ -1081,14 +1211,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
           /* Control transfers completed, Exit the State Machine */
           status = USBH_NOT_SUPPORTED;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
         }
       }
       break;
@@ -1107,27 +1230,13 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
         status = USBH_OK;
         phost->Control.state = CTRL_COMPLETE;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
       else if (URB_Status == USBH_URB_NOTREADY)
       {
         phost->Control.state = CTRL_STATUS_OUT;
 
-#if (USBH_USE_OS == 1U)
-        phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-        (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-        (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+        (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
       }
       else
       {
@@ -1135,14 +1244,7 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
         {
           phost->Control.state = CTRL_ERROR;
 
-#if (USBH_USE_OS == 1U)
-          phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
-#if (osCMSIS < 0x20000U)
-          (void)osMessagePut(phost->os_event, phost->os_msg, 0U);
-#else
-          (void)osMessageQueuePut(phost->os_event, &phost->os_msg, 0U, 0U);
-#endif
-#endif
+          (void)USBH_PostEvent(phost, USBH_CONTROL_EVENT);
         }
       }
       break;
@@ -1171,6 +1273,8 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
         /* Free control pipes */
         (void)USBH_FreePipe(phost, phost->Control.pipe_out);
         (void)USBH_FreePipe(phost, phost->Control.pipe_in);
+        phost->Control.pipe_out = 0xFFU;
+        phost->Control.pipe_in = 0xFFU;
 
         phost->gState = HOST_IDLE;
         status = USBH_FAIL;
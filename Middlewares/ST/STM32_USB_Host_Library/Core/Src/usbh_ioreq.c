@@ -93,6 +93,8 @@ USBH_StatusTypeDef USBH_CtlSendSetup(USBH_HandleTypeDef *phost,
                                      uint8_t pipe_num)
 {
 
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           0U,                   /* Direction : OUT  */
@@ -125,6 +127,8 @@ USBH_StatusTypeDef USBH_CtlSendData(USBH_HandleTypeDef *phost,
     do_ping = 0U;
   }
 
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           0U,                   /* Direction : OUT  */
@@ -152,6 +156,8 @@ USBH_StatusTypeDef USBH_CtlReceiveData(USBH_HandleTypeDef *phost,
                                        uint16_t length,
                                        uint8_t pipe_num)
 {
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           1U,                   /* Direction : IN   */
@@ -185,6 +191,8 @@ USBH_StatusTypeDef USBH_BulkSendData(USBH_HandleTypeDef *phost,
     do_ping = 0U;
   }
 
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           0U,                   /* Direction : IN   */
@@ -211,6 +219,8 @@ USBH_StatusTypeDef USBH_BulkReceiveData(USBH_HandleTypeDef *phost,
                                         uint16_t length,
                                         uint8_t pipe_num)
 {
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           1U,                   /* Direction : IN   */
@@ -237,6 +247,8 @@ USBH_StatusTypeDef USBH_InterruptReceiveData(USBH_HandleTypeDef *phost,
                                              uint8_t length,
                                              uint8_t pipe_num)
 {
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           1U,                   /* Direction : IN   */
@@ -263,6 +275,8 @@ USBH_StatusTypeDef USBH_InterruptSendData(USBH_HandleTypeDef *phost,
                                           uint8_t length,
                                           uint8_t pipe_num)
 {
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           0U,                   /* Direction : OUT  */
@@ -289,6 +303,8 @@ USBH_StatusTypeDef USBH_IsocReceiveData(USBH_HandleTypeDef *phost,
                                         uint32_t length,
                                         uint8_t pipe_num)
 {
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           1U,                   /* Direction : IN   */
@@ -316,6 +332,8 @@ USBH_StatusTypeDef USBH_IsocSendData(USBH_HandleTypeDef *phost,
                                      uint32_t length,
                                      uint8_t pipe_num)
 {
+  USBH_PipeSubmitted(phost, pipe_num);
+
   (void)USBH_LL_SubmitURB(phost,                /* Driver handle    */
                           pipe_num,             /* Pipe index       */
                           0U,                   /* Direction : OUT  */
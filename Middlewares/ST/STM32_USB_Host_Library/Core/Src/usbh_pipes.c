@@ -35,6 +35,8 @@
 /** @defgroup USBH_PIPES_Private_Defines
   * @{
   */
+#define USBH_PIPE_BIT(n)                     (0x80000000U >> (n))
+#define USBH_PIPE_FREE_ALL                   (0xFFFFFFFFU << (32U - USBH_MAX_PIPES_NBR))
 /**
   * @}
   */
@@ -50,6 +52,15 @@
 /** @defgroup USBH_PIPES_Private_Macros
   * @{
   */
+/* Count leading zeros: a single instruction on Cortex-M3 and up */
+#if defined ( __GNUC__ ) || defined ( __ARMCC_VERSION )
+#define USBH_PIPE_CLZ(x)                     ((uint32_t)__builtin_clz(x))
+#elif defined ( __ICCARM__ )
+#include <intrinsics.h>
+#define USBH_PIPE_CLZ(x)                     ((uint32_t)__CLZ(x))
+#else
+#define USBH_PIPE_CLZ(x)                     USBH_PipeClz(x)
+#endif
 /**
   * @}
   */
@@ -67,7 +78,12 @@
 /** @defgroup USBH_PIPES_Private_Functions
   * @{
   */
-static uint16_t USBH_GetFreePipe(USBH_HandleTypeDef *phost);
+#if !defined ( __GNUC__ ) && !defined ( __ARMCC_VERSION ) && !defined ( __ICCARM__ )
+static uint32_t USBH_PipeClz(uint32_t value);
+#endif
+#if (USBH_USE_URB_TRACE == 1U)
+static void USBH_UrbTraceAdd(uint32_t *phist, uint32_t *pmax, uint32_t cycles);
+#endif /* (USBH_USE_URB_TRACE == 1U) */
 
 
 /**
@@ -85,8 +101,20 @@ USBH_StatusTypeDef USBH_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num,
                                  uint8_t epnum, uint8_t dev_address,
                                  uint8_t speed, uint8_t ep_type, uint16_t mps)
 {
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return USBH_FAIL;
+  }
+
   (void)USBH_LL_OpenPipe(phost, pipe_num, epnum, dev_address, speed, ep_type, mps);
 
+  /* Bulk pipes back off under device flow control, the others retry at once */
+  (void)USBH_memset(&phost->pRoot->PipeRetry[pipe_num], 0, sizeof(USBH_PipeRetryTypeDef));
+  phost->pRoot->PipeRetry[pipe_num].Policy = (ep_type == USB_EP_TYPE_BULK) ? USBH_RETRY_BACKOFF :
+                                             USBH_RETRY_IMMEDIATE;
+  phost->pRoot->PipeRetry[pipe_num].Burst = USBH_PIPE_NAK_BURST;
+  phost->pRoot->PipeRetry[pipe_num].MaxBackoff = USBH_PIPE_MAX_BACKOFF;
+
   return USBH_OK;
 }
 
@@ -100,6 +128,11 @@ USBH_StatusTypeDef USBH_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num,
   */
 USBH_StatusTypeDef USBH_ClosePipe(USBH_HandleTypeDef *phost, uint8_t pipe_num)
 {
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return USBH_FAIL;
+  }
+
   (void)USBH_LL_ClosePipe(phost, pipe_num);
 
   return USBH_OK;
@@ -108,22 +141,33 @@ USBH_StatusTypeDef USBH_ClosePipe(USBH_HandleTypeDef *phost, uint8_t pipe_num)
 
 /**
   * @brief  USBH_Alloc_Pipe
-  *         Allocate a new Pipe
+  *         Allocate a new Pipe, devices behind a hub share the host channels
+  *         of the root handle. The lowest free pipe is found in constant
+  *         time from the free map.
   * @param  phost: Host Handle
   * @param  ep_addr: End point for which the Pipe to be allocated
-  * @retval Pipe number
+  * @retval Pipe number, 0xFF if none is free
   */
 uint8_t USBH_AllocPipe(USBH_HandleTypeDef *phost, uint8_t ep_addr)
 {
-  uint16_t pipe;
+  USBH_HandleTypeDef *proot = phost->pRoot;
+  uint32_t pipe;
 
-  pipe =  USBH_GetFreePipe(phost);
-
-  if (pipe != 0xFFFFU)
+  if (proot->PipeFree == 0U)
   {
-    phost->Pipes[pipe & 0xFU] = (uint32_t)(0x8000U | ep_addr);
+    return 0xFFU;
   }
 
+  pipe = USBH_PIPE_CLZ(proot->PipeFree);
+
+  proot->PipeFree &= ~USBH_PIPE_BIT(pipe);
+  proot->Pipes[pipe] = ep_addr;
+  (void)USBH_memset(&proot->PipeStats[pipe], 0, sizeof(USBH_PipeStatsTypeDef));
+#if (USBH_USE_URB_TRACE == 1U)
+  (void)USBH_memset(&proot->UrbTrace.Pipe[pipe], 0, sizeof(USBH_UrbTracePipeTypeDef));
+  proot->UrbTrace.Pipe[pipe].EpAddr = ep_addr;
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
   return (uint8_t)pipe;
 }
 
@@ -139,7 +183,10 @@ USBH_StatusTypeDef USBH_FreePipe(USBH_HandleTypeDef *phost, uint8_t idx)
 {
   if (idx < USBH_MAX_PIPES_NBR)
   {
-    phost->Pipes[idx] &= 0x7FFFU;
+    phost->pRoot->PipeFree |= USBH_PIPE_BIT(idx);
+#if (USBH_USE_CTL_CHAIN == 1U)
+    phost->pRoot->CtlChain[idx] = NULL;
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
   }
 
   return USBH_OK;
@@ -147,25 +194,463 @@ USBH_StatusTypeDef USBH_FreePipe(USBH_HandleTypeDef *phost, uint8_t idx)
 
 
 /**
-  * @brief  USBH_GetFreePipe
+  * @brief  USBH_ResetPipes
+  *         Mark every pipe of a root handle free
   * @param  phost: Host Handle
-  *         Get a free Pipe number for allocation to a device endpoint
-  * @retval idx: Free Pipe number
+  * @retval None
   */
-static uint16_t USBH_GetFreePipe(USBH_HandleTypeDef *phost)
+void USBH_ResetPipes(USBH_HandleTypeDef *phost)
 {
-  uint8_t idx = 0U;
+  uint32_t idx;
 
   for (idx = 0U; idx < USBH_MAX_PIPES_NBR; idx++)
   {
-    if ((phost->Pipes[idx] & 0x8000U) == 0U)
+    phost->Pipes[idx] = 0U;
+#if (USBH_USE_CTL_CHAIN == 1U)
+    phost->CtlChain[idx] = NULL;
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
+  }
+
+#if (USBH_USE_URB_TRACE == 1U)
+  (void)USBH_ClearUrbTrace(phost);
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+  phost->PipeFree = USBH_PIPE_FREE_ALL;
+}
+
+
+/**
+  * @brief  USBH_SetPipeRetryPolicy
+  *         Select how a pipe is resubmitted after a NAK
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @param  policy: Retry policy
+  * @param  burst: NAKs in a row retried at once before backing off
+  * @param  max_backoff: Longest backoff, 2^(max_backoff - 1) (micro)frames
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_SetPipeRetryPolicy(USBH_HandleTypeDef *phost, uint8_t pipe_num,
+                                           USBH_RetryPolicyTypeDef policy, uint8_t burst,
+                                           uint8_t max_backoff)
+{
+  if ((pipe_num >= USBH_MAX_PIPES_NBR) || (max_backoff > 16U))
+  {
+    return USBH_FAIL;
+  }
+
+  phost->pRoot->PipeRetry[pipe_num].Policy = policy;
+  phost->pRoot->PipeRetry[pipe_num].Burst = burst;
+  phost->pRoot->PipeRetry[pipe_num].MaxBackoff = max_backoff;
+  phost->pRoot->PipeRetry[pipe_num].NakRun = 0U;
+  phost->pRoot->PipeRetry[pipe_num].RetryDelay = 0U;
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_PipeRetrySchedule
+  *         Schedule the resubmission of a pipe ended by a NAK or a NYET.
+  *         Under the backoff policy, a short burst of NAKs is retried at
+  *         once; past it the delay doubles on each NAK, counted in host
+  *         timer ticks (one per (micro)frame), up to the pipe bound.
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @retval None
+  */
+void USBH_PipeRetrySchedule(USBH_HandleTypeDef *phost, uint8_t pipe_num)
+{
+  USBH_PipeRetryTypeDef *pretry;
+
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return;
+  }
+
+  pretry = &phost->pRoot->PipeRetry[pipe_num];
+
+  /* The OTG core probes a high-speed OUT endpoint with PING, data stays
+     in host memory until the device has room for it */
+  pretry->Ping = ((phost->device.speed == (uint8_t)USBH_SPEED_HIGH) &&
+                  ((phost->pRoot->Pipes[pipe_num] & USB_EP_DIR_MSK) == USB_EP_DIR_OUT)) ? 1U : 0U;
+  pretry->RetryStart = phost->Timer;
+
+  if (pretry->NakRun < 0xFFU)
+  {
+    pretry->NakRun++;
+  }
+
+  switch (pretry->Policy)
+  {
+    case USBH_RETRY_NEXT_FRAME:
+      pretry->RetryDelay = 1U;
+      break;
+
+    case USBH_RETRY_BACKOFF:
+      if ((pretry->NakRun <= pretry->Burst) || (pretry->MaxBackoff == 0U))
+      {
+        pretry->RetryDelay = 0U;
+      }
+      else
+      {
+        pretry->RetryDelay = 1U << MIN((uint32_t)pretry->NakRun - pretry->Burst - 1U,
+                                        (uint32_t)pretry->MaxBackoff - 1U);
+      }
+      break;
+
+    default:
+      pretry->RetryDelay = 0U;
+      break;
+  }
+}
+
+
+/**
+  * @brief  USBH_PipeRetryReset
+  *         Clear the backoff of a pipe once a transfer went through
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @retval None
+  */
+void USBH_PipeRetryReset(USBH_HandleTypeDef *phost, uint8_t pipe_num)
+{
+  if (pipe_num < USBH_MAX_PIPES_NBR)
+  {
+    phost->pRoot->PipeRetry[pipe_num].NakRun = 0U;
+    phost->pRoot->PipeRetry[pipe_num].RetryDelay = 0U;
+    phost->pRoot->PipeRetry[pipe_num].Ping = 0U;
+  }
+}
+
+
+/**
+  * @brief  USBH_PipeRetryDue
+  *         Tell whether a NAKed pipe may be resubmitted
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @retval 1 when the retry is due, 0 otherwise
+  */
+uint8_t USBH_PipeRetryDue(USBH_HandleTypeDef *phost, uint8_t pipe_num)
+{
+  USBH_PipeRetryTypeDef *pretry;
+
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return 1U;
+  }
+
+  pretry = &phost->pRoot->PipeRetry[pipe_num];
+
+  return ((phost->Timer - pretry->RetryStart) >= pretry->RetryDelay) ? 1U : 0U;
+}
+
+
+/**
+  * @brief  USBH_PipeRetryPing
+  *         Return the do_ping argument of the next OUT submission
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @retval 1 when the endpoint is to be probed with PING first
+  */
+uint8_t USBH_PipeRetryPing(USBH_HandleTypeDef *phost, uint8_t pipe_num)
+{
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return 0U;
+  }
+
+  return phost->pRoot->PipeRetry[pipe_num].Ping;
+}
+
+
+/**
+  * @brief  USBH_GetPipeMap
+  *         Return the allocated pipes
+  * @param  phost: Host Handle
+  * @retval Bit n set: pipe n is allocated
+  */
+uint32_t USBH_GetPipeMap(USBH_HandleTypeDef *phost)
+{
+  uint32_t free_map = phost->pRoot->PipeFree;
+  uint32_t map = 0U;
+  uint32_t pipe;
+
+  /* Walk the allocated pipes only */
+  free_map = ~free_map & USBH_PIPE_FREE_ALL;
+
+  while (free_map != 0U)
+  {
+    pipe = USBH_PIPE_CLZ(free_map);
+    free_map &= ~USBH_PIPE_BIT(pipe);
+    map |= 1U << pipe;
+  }
+
+  return map;
+}
+
+
+/**
+  * @brief  USBH_GetPipeStats
+  *         Return the traffic counters of a pipe
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @retval Pipe counters, NULL for an invalid pipe
+  */
+const USBH_PipeStatsTypeDef *USBH_GetPipeStats(USBH_HandleTypeDef *phost, uint8_t pipe_num)
+{
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return NULL;
+  }
+
+  return &phost->pRoot->PipeStats[pipe_num];
+}
+
+
+/**
+  * @brief  USBH_ClearPipeStats
+  *         Restart the traffic counters of a pipe
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_ClearPipeStats(USBH_HandleTypeDef *phost, uint8_t pipe_num)
+{
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return USBH_FAIL;
+  }
+
+  (void)USBH_memset(&phost->pRoot->PipeStats[pipe_num], 0, sizeof(USBH_PipeStatsTypeDef));
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_PipeSubmitted
+  *         Count an URB submitted on a pipe
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @retval None
+  */
+void USBH_PipeSubmitted(USBH_HandleTypeDef *phost, uint8_t pipe_num)
+{
+  if (pipe_num < USBH_MAX_PIPES_NBR)
+  {
+    phost->pRoot->PipeStats[pipe_num].Urbs++;
+#if (USBH_USE_URB_TRACE == 1U)
+    phost->pRoot->UrbTrace.Pipe[pipe_num].SubmitStamp = USBH_LL_GetCycles(phost);
+    phost->pRoot->UrbTrace.Pipe[pipe_num].Pending = 1U;
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+  }
+}
+
+
+/**
+  * @brief  USBH_LL_PipeCompleted
+  *         Account an URB state change reported by the low level driver.
+  *         Can be called from interrupt context.
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @param  urb_state: New URB state
+  * @param  count: Bytes transferred by the URB so far
+  * @retval None
+  */
+void USBH_LL_PipeCompleted(USBH_HandleTypeDef *phost, uint8_t pipe_num,
+                           USBH_URBStateTypeDef urb_state, uint32_t count)
+{
+  USBH_PipeStatsTypeDef *pstats;
+#if (USBH_USE_URB_TRACE == 1U)
+  USBH_UrbTracePipeTypeDef *ptrace;
+  uint32_t stamp = USBH_LL_GetCycles(phost);
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return;
+  }
+
+  pstats = &phost->pRoot->PipeStats[pipe_num];
+
+#if (USBH_USE_URB_TRACE == 1U)
+  ptrace = &phost->pRoot->UrbTrace.Pipe[pipe_num];
+
+  if (ptrace->Pending == 1U)
+  {
+    if (urb_state == USBH_URB_DONE)
+    {
+      USBH_UrbTraceAdd(ptrace->BusHist, &ptrace->BusMax, stamp - ptrace->SubmitStamp);
+      ptrace->DoneStamp = stamp;
+      ptrace->Pending = 2U;
+    }
+    else if ((urb_state == USBH_URB_STALL) || (urb_state == USBH_URB_ERROR) ||
+             ((urb_state == USBH_URB_NOTREADY) &&
+              ((phost->pRoot->Pipes[pipe_num] & USB_EP_DIR_MSK) == USB_EP_DIR_OUT)))
     {
-      return (uint16_t)idx;
+      /* Only completed URBs are sampled */
+      ptrace->Pending = 0U;
     }
+    else
+    {
+      /* .. */
+    }
+  }
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+  switch (urb_state)
+  {
+    case USBH_URB_DONE:
+      pstats->Bytes += count;
+      pstats->LastDone = phost->pRoot->Timer;
+      break;
+
+    case USBH_URB_NOTREADY:
+      /* A NAKed OUT ends with the packets already acknowledged, IN resumes */
+      if ((phost->pRoot->Pipes[pipe_num] & USB_EP_DIR_MSK) == USB_EP_DIR_OUT)
+      {
+        pstats->Bytes += count;
+      }
+      pstats->Naks++;
+      break;
+
+    case USBH_URB_NYET:
+      pstats->Nyets++;
+      break;
+
+    case USBH_URB_ERROR:
+      pstats->Errors++;
+      break;
+
+    case USBH_URB_STALL:
+      pstats->Stalls++;
+      break;
+
+    default:
+      break;
+  }
+
+#if (USBH_USE_CTL_CHAIN == 1U)
+  USBH_CtlChainCompleted(phost->pRoot, pipe_num, urb_state);
+#endif /* (USBH_USE_CTL_CHAIN == 1U) */
+}
+
+
+#if (USBH_USE_URB_TRACE == 1U)
+/**
+  * @brief  USBH_LL_PipeObserved
+  *         Close the latency sample of a completed URB once the class has
+  *         read its USBH_URB_DONE state
+  * @param  phost: Host Handle
+  * @param  pipe_num: Pipe Number
+  * @retval None
+  */
+void USBH_LL_PipeObserved(USBH_HandleTypeDef *phost, uint8_t pipe_num)
+{
+  USBH_UrbTracePipeTypeDef *ptrace;
+
+  if (pipe_num >= USBH_MAX_PIPES_NBR)
+  {
+    return;
+  }
+
+  ptrace = &phost->pRoot->UrbTrace.Pipe[pipe_num];
+
+  if (ptrace->Pending == 2U)
+  {
+    USBH_UrbTraceAdd(ptrace->ObsHist, &ptrace->ObsMax, USBH_LL_GetCycles(phost) - ptrace->DoneStamp);
+    ptrace->Samples++;
+    ptrace->Pending = 0U;
+  }
+}
+
+
+/**
+  * @brief  USBH_GetUrbTrace
+  *         Return the URB latency record of the host channels
+  * @param  phost: Host Handle
+  * @retval Latency record, sizeof(USBH_UrbTraceTypeDef) bytes
+  */
+const USBH_UrbTraceTypeDef *USBH_GetUrbTrace(USBH_HandleTypeDef *phost)
+{
+  return &phost->pRoot->UrbTrace;
+}
+
+
+/**
+  * @brief  USBH_ClearUrbTrace
+  *         Restart the URB latency histograms, the endpoint of each pipe is kept
+  * @param  phost: Host Handle
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_ClearUrbTrace(USBH_HandleTypeDef *phost)
+{
+  USBH_UrbTraceTypeDef *ptrace = &phost->pRoot->UrbTrace;
+  uint32_t idx;
+
+  for (idx = 0U; idx < USBH_MAX_PIPES_NBR; idx++)
+  {
+    (void)USBH_memset(&ptrace->Pipe[idx], 0, sizeof(USBH_UrbTracePipeTypeDef));
+    ptrace->Pipe[idx].EpAddr = phost->pRoot->Pipes[idx];
+  }
+
+  ptrace->Magic = USBH_URB_TRACE_MAGIC;
+  ptrace->Bins = (uint16_t)USBH_URB_TRACE_BINS;
+  ptrace->Shift = (uint8_t)USBH_URB_TRACE_SHIFT;
+  ptrace->Pipes = (uint8_t)USBH_MAX_PIPES_NBR;
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_UrbTraceAdd
+  *         Count a latency in its logarithmic bin
+  * @param  phist: Histogram
+  * @param  pmax: Largest latency seen
+  * @param  cycles: Latency
+  * @retval None
+  */
+static void USBH_UrbTraceAdd(uint32_t *phist, uint32_t *pmax, uint32_t cycles)
+{
+  uint32_t bin = 0U;
+
+  if ((cycles >> USBH_URB_TRACE_SHIFT) != 0U)
+  {
+    bin = 32U - USBH_PIPE_CLZ(cycles >> USBH_URB_TRACE_SHIFT);
+    bin = MIN(bin, USBH_URB_TRACE_BINS - 1U);
+  }
+
+  phist[bin]++;
+
+  if (cycles > *pmax)
+  {
+    *pmax = cycles;
+  }
+}
+#endif /* (USBH_USE_URB_TRACE == 1U) */
+
+
+#if !defined ( __GNUC__ ) && !defined ( __ARMCC_VERSION ) && !defined ( __ICCARM__ )
+/**
+  * @brief  USBH_PipeClz
+  *         Count the leading zeros of a non-zero word
+  * @param  value: Word
+  * @retval Leading zeros
+  */
+static uint32_t USBH_PipeClz(uint32_t value)
+{
+  uint32_t count = 0U;
+
+  while ((value & 0x80000000U) == 0U)
+  {
+    value <<= 1;
+    count++;
   }
 
-  return 0xFFFFU;
+  return count;
 }
+#endif
 /**
   * @}
   */